@@ -0,0 +1,213 @@
+// Times GameLoad on a game exe, phase by phase, and prints the results as JSON.
+// Every run is a fresh process, so later runs don't get to reuse anything the first one allocated or loaded.
+// Usage: LoadBench game.exe [--runs N] [--cache] [--lazy-compile] [--progressive] [--no-mmap] [--inflate-threads N] [--compile-threads N]
+//
+// By default the caches are ignored and all the code is compiled before GameLoad returns, so every phase actually runs.
+// --cache uses (and builds, on the first run) the .gm8cache and .gmlcache, and --lazy-compile only times getting the background compiler going.
+
+#include "FileMapping.hpp"
+#include "Game.hpp"
+#include <algorithm>
+#include <functional>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+struct LoadRun {
+    GameLoadStats stats;
+    unsigned long long peakMemory = 0;
+};
+
+// Every number in a run, in a fixed order. A run prints them on one line and the parent reads them back in the same order.
+template <typename F>
+void _VisitRun(LoadRun& run, F fn) {
+    fn(run.stats.totalSeconds);
+    fn(run.peakMemory);
+    for (GameLoadPhaseStats& phase : run.stats.phases) {
+        fn(phase.seconds);
+        fn(phase.bytes);
+    }
+    for (GameLoadSectionStats& section : run.stats.sections) {
+        fn(section.blocks);
+        fn(section.compressedBytes);
+        fn(section.inflatedBytes);
+        fn(section.inflateSeconds);
+        fn(section.waitSeconds);
+        fn(section.decodeSeconds);
+    }
+}
+
+// Loads the game once and prints the run's numbers on stdout
+int _RunOnce(const char* filename, const GameLoadOptions& options) {
+    LoadRun run;
+    GameLoadOptions runOptions = options;
+    runOptions.stats = &run.stats;
+
+    GameInit();
+    bool success = GameLoad(filename, runOptions);
+    GameTerminate();
+    if (!success) {
+        fprintf(stderr, "Failed to load %s\n", filename);
+        return 2;
+    }
+
+    run.peakMemory = GetPeakMemoryUsage();
+    _VisitRun(run, [](auto& value) { printf("%.17g ", ( double )value); });
+    printf("%d\n", run.stats.fromCache ? 1 : 0);
+    return 0;
+}
+
+// Runs this program again with --run-once and reads back what it printed
+bool _RunChild(const std::string& command, LoadRun* run) {
+    FILE* pipe = popen(command.c_str(), "r");
+    if (!pipe) return false;
+    std::string output;
+    char chunk[4096];
+    size_t got;
+    while ((got = fread(chunk, 1, sizeof(chunk), pipe)) > 0) {
+        output.append(chunk, got);
+    }
+    if (pclose(pipe) != 0) return false;
+
+    // The game may have printed things of its own, the numbers are on the last line
+    size_t end = output.find_last_not_of("\r\n");
+    if (end == std::string::npos) return false;
+    size_t lineStart = output.find_last_of('\n', end);
+    const char* p = output.c_str() + (lineStart == std::string::npos ? 0 : lineStart + 1);
+
+    bool ok = true;
+    _VisitRun(*run, [&p, &ok](auto& value) {
+        char* next;
+        double d = strtod(p, &next);
+        if (next == p) ok = false;
+        value = static_cast<std::remove_reference_t<decltype(value)>>(d);
+        p = next;
+    });
+    run->stats.fromCache = strtol(p, NULL, 10) != 0;
+    return ok;
+}
+
+// Prints min, median and p95 (nearest rank) of a number over all runs
+void _PrintSummary(const std::vector<LoadRun>& runs, const std::function<double(const LoadRun&)>& get) {
+    std::vector<double> values;
+    for (const LoadRun& run : runs) values.push_back(get(run));
+    std::sort(values.begin(), values.end());
+    size_t n = values.size();
+    double median = (n % 2) ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+    size_t p95 = (n * 95 + 99) / 100;
+    printf("{\"min\": %.9g, \"median\": %.9g, \"p95\": %.9g}", values[0], median, values[p95 - 1]);
+}
+
+// Paths go into the JSON as they are apart from these
+void _PrintString(const char* str) {
+    putchar('"');
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\') putchar('\\');
+        putchar(*str);
+    }
+    putchar('"');
+}
+
+int main(int argc, char** argv) {
+    const char* filename = NULL;
+    unsigned int runs = 5;
+    bool runOnce = false;
+    GameLoadOptions options;
+    options.useCache = false;
+    options.lazyCompile = false;
+
+    // Everything except --runs and --run-once gets passed on to the runs
+    std::string passOn;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--run-once") == 0) {
+            runOnce = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            runs = ( unsigned int )atoi(argv[++i]);
+            continue;
+        }
+
+        if (strcmp(argv[i], "--cache") == 0) options.useCache = true;
+        else if (strcmp(argv[i], "--lazy-compile") == 0) options.lazyCompile = true;
+        else if (strcmp(argv[i], "--progressive") == 0) options.progressive = true;
+        else if (strcmp(argv[i], "--no-mmap") == 0) options.mapFile = false;
+        else if (strcmp(argv[i], "--inflate-threads") == 0 && i + 1 < argc) options.inflateThreads = ( unsigned int )atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--compile-threads") == 0 && i + 1 < argc) options.compileThreads = ( unsigned int )atoi(argv[i + 1]);
+        else if (argv[i][0] != '-') filename = argv[i];
+        else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+        passOn += std::string(" \"") + argv[i] + "\"";
+        if (strcmp(argv[i], "--inflate-threads") == 0 || strcmp(argv[i], "--compile-threads") == 0) {
+            passOn += std::string(" ") + argv[++i];
+        }
+    }
+    if (!filename || runs == 0) {
+        fprintf(stderr, "Usage: %s game.exe [--runs N] [--cache] [--lazy-compile] [--progressive] [--no-mmap] [--inflate-threads N] [--compile-threads N]\n", argv[0]);
+        return 1;
+    }
+
+    if (runOnce) return _RunOnce(filename, options);
+
+    std::string command = std::string("\"") + argv[0] + "\" --run-once" + passOn;
+#ifdef _WIN32
+    // cmd strips the outer quotes off the whole command line
+    command = "\"" + command + "\"";
+#endif
+
+    std::vector<LoadRun> results(runs);
+    for (unsigned int i = 0; i < runs; i++) {
+        if (!_RunChild(command, &results[i])) {
+            fprintf(stderr, "Run %u failed\n", i + 1);
+            return 2;
+        }
+    }
+
+    printf("{\n  \"game\": ");
+    _PrintString(filename);
+    printf(",\n  \"runs\": %u,\n  \"options\": {\"cache\": %s, \"lazy_compile\": %s, \"progressive\": %s, \"mmap\": %s, \"inflate_threads\": %u, \"compile_threads\": %u},\n", runs,
+           options.useCache ? "true" : "false", options.lazyCompile ? "true" : "false", options.progressive ? "true" : "false", options.mapFile ? "true" : "false", options.inflateThreads,
+           options.compileThreads);
+    printf("  \"cache_hits\": %u,\n", ( unsigned int )std::count_if(results.begin(), results.end(), [](const LoadRun& run) { return run.stats.fromCache; }));
+    printf("  \"total_seconds\": ");
+    _PrintSummary(results, [](const LoadRun& run) { return run.stats.totalSeconds; });
+    printf(",\n  \"peak_memory_bytes\": ");
+    _PrintSummary(results, [](const LoadRun& run) { return ( double )run.peakMemory; });
+
+    // Bytes can change between runs when the first one builds a cache, so they get summarised too
+    printf(",\n  \"phases\": {");
+    for (int p = 0; p < LOAD_PHASE_COUNT; p++) {
+        printf("%s\n    \"%s\": {\"seconds\": ", p ? "," : "", GameLoadPhaseName(( GameLoadPhase )p));
+        _PrintSummary(results, [p](const LoadRun& run) { return run.stats.phases[p].seconds; });
+        printf(", \"bytes\": ");
+        _PrintSummary(results, [p](const LoadRun& run) { return ( double )run.stats.phases[p].bytes; });
+        printf("}");
+    }
+
+    printf("\n  },\n  \"sections\": {");
+    for (int s = 0; s < SECTION_COUNT; s++) {
+        // Sizes are the same every run unless a cache gets involved, and then the first run is the one that did the work
+        const GameLoadSectionStats& first = results[0].stats.sections[s];
+        printf("%s\n    \"%s\": {\"blocks\": %u, \"compressed_bytes\": %llu, \"inflated_bytes\": %llu,\n", s ? "," : "", GameDataSectionName(( GameDataSection )s), first.blocks,
+               first.compressedBytes, first.inflatedBytes);
+        printf("      \"inflate_seconds\": ");
+        _PrintSummary(results, [s](const LoadRun& run) { return run.stats.sections[s].inflateSeconds; });
+        printf(",\n      \"wait_seconds\": ");
+        _PrintSummary(results, [s](const LoadRun& run) { return run.stats.sections[s].waitSeconds; });
+        printf(",\n      \"decode_seconds\": ");
+        _PrintSummary(results, [s](const LoadRun& run) { return run.stats.sections[s].decodeSeconds; });
+        printf("}");
+    }
+    printf("\n  }\n}\n");
+    return 0;
+}
@@ -0,0 +1,130 @@
+// Times the loader's per-pixel conversions: the loops GameLoad used to run, against the kernels in PixelUtil. Also times the software renderer's blend.
+// Usage: PixelBench [width] [height] [iterations]
+
+#include "PixelUtil.hpp"
+#include "StreamUtil.hpp"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+// The loops as they were in GameLoad
+void _OldSwapRedBlue(unsigned char* data, unsigned int length) {
+    unsigned char tmp;
+    for (unsigned int dataPos = 0; dataPos < length; dataPos += 4) {
+        tmp = data[dataPos];
+        data[dataPos] = data[dataPos + 2];
+        data[dataPos + 2] = tmp;
+    }
+}
+
+void _OldUnpackMask(const unsigned char* data, bool* mask, unsigned int maskSize) {
+    unsigned int dataPos = 0;
+    for (unsigned int ii = 0; ii < maskSize; ii++) {
+        mask[ii] = ReadDword(data, &dataPos);
+    }
+}
+
+void _OldExpandAlpha(const unsigned char* data, unsigned char* d, unsigned int dlen) {
+    unsigned int dp = 3;
+    unsigned int dataPos = 0;
+    memset(d, 0xFF, dlen * 4);
+    for (; dlen; dlen--) {
+        d[dp] = *(data + dataPos);
+        dataPos++;
+        dp += 4;
+    }
+}
+
+// What the OpenGL renderer's shader and blend function do, in floats, for comparing the software renderer's blend against
+void _FloatBlend(unsigned char* dst, const unsigned char* src, size_t count, unsigned int blend, unsigned char alpha) {
+    float mul[4] = {(blend & 0xFF) / 255.0f, ((blend >> 8) & 0xFF) / 255.0f, ((blend >> 16) & 0xFF) / 255.0f, alpha / 255.0f};
+    for (; count; count--, src += 4, dst += 4) {
+        float a = src[3] / 255.0f * mul[3];
+        for (int c = 0; c < 4; c++) {
+            float s = c == 3 ? a : src[c] / 255.0f * mul[c];
+            dst[c] = ( unsigned char )((s * a + dst[c] / 255.0f * (1.0f - a)) * 255.0f + 0.5f);
+        }
+    }
+}
+
+// Runs fn iterations times and returns the average in milliseconds
+template <typename F>
+double _Time(unsigned int iterations, const F& fn) {
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < iterations; i++) {
+        fn();
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+void _Report(const char* name, double oldMs, double scalarMs, double newMs, bool match) {
+    printf("%-12s  old %8.3f ms  scalar %8.3f ms  %s %8.3f ms  %5.2fx  %s\n", name, oldMs, scalarMs, PixelKernelName(), newMs, oldMs / newMs, match ? "ok" : "MISMATCH");
+}
+
+int main(int argc, char** argv) {
+    unsigned int width = argc > 1 ? ( unsigned int )atoi(argv[1]) : 2048;
+    unsigned int height = argc > 2 ? ( unsigned int )atoi(argv[2]) : 2048;
+    unsigned int iterations = argc > 3 ? ( unsigned int )atoi(argv[3]) : 20;
+    size_t count = ( size_t )width * height;
+    printf("%ux%u, %u iterations, kernels: %s\n", width, height, iterations, PixelKernelName());
+
+    // Odd sizes leave a tail for the scalar loop to finish, which is worth exercising too
+    std::vector<unsigned char> source(count * 4);
+    srand(1);
+    for (size_t i = 0; i < source.size(); i++) {
+        source[i] = ( unsigned char )(rand() & 0xFF);
+    }
+    // Masks are mostly runs of 0 and 1
+    std::vector<unsigned char> maskData(count * 4, 0);
+    for (size_t i = 0; i < count; i++) {
+        if ((i / 7) % 3 == 0) maskData[i * 4 + (i % 4)] = ( unsigned char )(1 + (i % 200));
+    }
+
+    bool ok = true;
+
+    // Swapping twice gets back to the start, so every iteration works on the same kind of data
+    std::vector<unsigned char> a = source, b = source, c = source;
+    double oldMs = _Time(iterations, [&]() { _OldSwapRedBlue(a.data(), ( unsigned int )a.size()); });
+    double scalarMs = _Time(iterations, [&]() { PixelScalar::SwapRedBlue(b.data(), count); });
+    double newMs = _Time(iterations, [&]() { SwapRedBlue(c.data(), count); });
+    bool match = a == b && b == c;
+    ok &= match;
+    _Report("swizzle", oldMs, scalarMs, newMs, match);
+
+    bool* oldMask = new bool[count];
+    bool* scalarMask = new bool[count];
+    bool* newMask = new bool[count];
+    oldMs = _Time(iterations, [&]() { _OldUnpackMask(maskData.data(), oldMask, ( unsigned int )count); });
+    scalarMs = _Time(iterations, [&]() { PixelScalar::UnpackMask(maskData.data(), scalarMask, count); });
+    newMs = _Time(iterations, [&]() { UnpackMask(maskData.data(), newMask, count); });
+    match = memcmp(oldMask, scalarMask, count) == 0 && memcmp(oldMask, newMask, count) == 0;
+    ok &= match;
+    _Report("mask", oldMs, scalarMs, newMs, match);
+    delete[] oldMask;
+    delete[] scalarMask;
+    delete[] newMask;
+
+    // Fonts are one byte per pixel going in
+    std::vector<unsigned char> oldRgba(count * 4), scalarRgba(count * 4), newRgba(count * 4);
+    oldMs = _Time(iterations, [&]() { _OldExpandAlpha(source.data(), oldRgba.data(), ( unsigned int )count); });
+    scalarMs = _Time(iterations, [&]() { PixelScalar::ExpandAlpha(source.data(), scalarRgba.data(), count); });
+    newMs = _Time(iterations, [&]() { ExpandAlpha(source.data(), newRgba.data(), count); });
+    match = oldRgba == scalarRgba && oldRgba == newRgba;
+    ok &= match;
+    _Report("font alpha", oldMs, scalarMs, newMs, match);
+
+    // Drawing over the same buffer every iteration, so the kernels have to agree after all of them, not just one.
+    // The float version can round differently, it's only there for the timing.
+    std::vector<unsigned char> floatDst(count * 4, 0x40), scalarDst(count * 4, 0x40), newDst(count * 4, 0x40);
+    oldMs = _Time(iterations, [&]() { _FloatBlend(floatDst.data(), source.data(), count, 0xC0FFE0, 0xB0); });
+    scalarMs = _Time(iterations, [&]() { PixelScalar::BlendPixels(scalarDst.data(), source.data(), count, 0xC0FFE0, 0xB0); });
+    newMs = _Time(iterations, [&]() { BlendPixels(newDst.data(), source.data(), count, 0xC0FFE0, 0xB0); });
+    match = scalarDst == newDst;
+    ok &= match;
+    _Report("blend", oldMs, scalarMs, newMs, match);
+
+    return ok ? 0 : 1;
+}
@@ -29,6 +29,7 @@ void AssetManager::Clear() {
     _timelines.clear();
     _objects.clear();
     _rooms.clear();
+    _includeFiles.clear();
 }
 
 void AssetManager::ReserveExtensions(unsigned int count) { _extensions.reserve(count); }
@@ -0,0 +1,86 @@
+#include "AssetStreamer.hpp"
+
+AssetStreamer::AssetStreamer(size_t jobCount, const std::function<void(size_t)>& run, const std::function<void()>& finished, const std::vector<size_t>& order,
+                             unsigned int threadCount) {
+    _run = run;
+    _finished = finished;
+    _states.assign(jobCount, JOB_PENDING);
+    _done.reset(new std::atomic<bool>[jobCount]);
+    for (size_t i = 0; i < jobCount; i++) {
+        _done[i].store(false, std::memory_order_relaxed);
+    }
+    _next = 0;
+    _remaining = jobCount;
+    _stop = false;
+
+    // Everything left out of the order goes on the end, in job order
+    std::vector<bool> listed(jobCount, false);
+    for (size_t job : order) {
+        if (job < jobCount && !listed[job]) {
+            listed[job] = true;
+            _order.push_back(job);
+        }
+    }
+    for (size_t job = 0; job < jobCount; job++) {
+        if (!listed[job]) _order.push_back(job);
+    }
+
+    if (threadCount == 0) {
+        unsigned int hardware = std::thread::hardware_concurrency();
+        threadCount = hardware > 2 ? hardware - 1 : 1;
+    }
+    if (threadCount > jobCount) threadCount = static_cast<unsigned int>(jobCount);
+    for (unsigned int i = 0; i < threadCount; i++) {
+        _workers.emplace_back(&AssetStreamer::_Work, this);
+    }
+}
+
+void AssetStreamer::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    for (std::thread& worker : _workers) {
+        worker.join();
+    }
+    _workers.clear();
+}
+
+AssetStreamer::~AssetStreamer() { Stop(); }
+
+void AssetStreamer::_Run(size_t job, std::unique_lock<std::mutex>& lock) {
+    _states[job] = JOB_RUNNING;
+    lock.unlock();
+    _run(job);
+    lock.lock();
+    _states[job] = JOB_DONE;
+    _done[job].store(true, std::memory_order_release);
+    _jobDone.notify_all();
+
+    _remaining--;
+    if (_remaining == 0 && _finished) {
+        lock.unlock();
+        _finished();
+        lock.lock();
+    }
+}
+
+void AssetStreamer::_Work() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_stop) {
+        // Skip over anything somebody waiting for it has already done
+        while (_next < _order.size() && _states[_order[_next]] != JOB_PENDING) _next++;
+        if (_next >= _order.size()) return;
+        _Run(_order[_next], lock);
+    }
+}
+
+void AssetStreamer::Wait(size_t job) {
+    if (Done(job)) return;
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (_states[job] == JOB_PENDING) {
+        _Run(job, lock);
+        return;
+    }
+    _jobDone.wait(lock, [this, job]() { return _states[job] == JOB_DONE; });
+}
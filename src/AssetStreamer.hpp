@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs a fixed set of jobs on a pool of worker threads, in a given order, while the game carries on. It's how assets that aren't needed straight away
+// get decoded after the game has started. Anything that needs a job's result can wait for it, and if no worker has picked it up yet
+// the waiting thread runs it itself rather than waiting for the queue to get to it.
+class AssetStreamer {
+  private:
+    enum JobState : unsigned char { JOB_PENDING, JOB_RUNNING, JOB_DONE };
+
+    std::function<void(size_t)> _run;
+    std::function<void()> _finished;
+    std::vector<size_t> _order;  // Job numbers in the order workers take them
+    std::vector<JobState> _states;
+    std::unique_ptr<std::atomic<bool>[]> _done;  // Same as _states[job] == JOB_DONE, but can be checked without the lock
+    std::vector<std::thread> _workers;
+    std::mutex _mutex;
+    std::condition_variable _jobDone;
+    size_t _next;  // Next position in _order for a worker to look at
+    size_t _remaining;  // Jobs that haven't finished yet
+    bool _stop;
+
+    void _Work();
+
+    // Runs a pending job, dropping the lock while it does. The lock must be held.
+    void _Run(size_t job, std::unique_lock<std::mutex>& lock);
+
+  public:
+    // run is called once for each job number below jobCount, from whichever thread gets to it first. finished (if it isn't empty) is called once
+    // after the last job is done, on the thread that did it, so whatever the jobs were working from can be let go without waiting for Stop.
+    // order lists the job numbers in the order workers should take them, anything left out of it is done after everything in it.
+    // threadCount of 0 means one worker per hardware thread, minus one for the game.
+    AssetStreamer(size_t jobCount, const std::function<void(size_t)>& run, const std::function<void()>& finished, const std::vector<size_t>& order,
+                  unsigned int threadCount = 0);
+
+    // Stops the workers once they've finished what they're doing. Jobs that never got run stay pending.
+    void Stop();
+    ~AssetStreamer();
+
+    // Returns once the job is done, running it on this thread if nobody has started it yet
+    void Wait(size_t job);
+
+    bool Done(size_t job) const { return _done[job].load(std::memory_order_acquire); }
+};
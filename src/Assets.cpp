@@ -64,13 +64,15 @@ Sound::Sound() {
     fileType = nullptr;
     fileName = nullptr;
     data = nullptr;
+    dataLength = 0;
+    storage = nullptr;
 }
 
 Sound::~Sound() {
     free(name);
     free(fileType);
     free(fileName);
-    free(data);
+    free(storage);
 }
 
 Sprite::Sprite() {
@@ -84,7 +86,8 @@ Sprite::Sprite() {
 Sprite::~Sprite() {
     free(name);
 
-    while (frameCount) {
+    // A sprite that progressive loading never got round to decoding has no collision maps
+    while (frameCount && collisionMaps) {
         frameCount--;
         if (separateCollision || !frameCount) delete[] collisionMaps[frameCount].collision;
     }
@@ -97,6 +100,15 @@ Background::Background() {
     exists = true;
 }
 
+Background::Background(Background&& other) noexcept {
+    name = other.name;
+    exists = other.exists;
+    width = other.width;
+    height = other.height;
+    image = other.image;
+    other.name = nullptr;
+}
+
 Background::~Background() { free(name); }
 
 Path::Path() {
@@ -159,6 +159,7 @@ class Sound {
 
     unsigned char* data;
     unsigned int dataLength;
+    unsigned char* storage;  // What gets freed along with the sound. data points somewhere inside it, usually the whole inflated block.
 
     double volume;  // Between 1 and 0 (although the lowest it's actually allowed in the editor is 0.3)
     double pan;     // Between -1 and 1
@@ -189,6 +190,7 @@ class Sprite {
 class Background {
   public:
     Background();
+    Background(Background&& other) noexcept;  // background_create_color can add backgrounds while the game runs, moving the rest
     ~Background();
     char* name;
     bool exists;
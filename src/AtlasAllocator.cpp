@@ -0,0 +1,283 @@
+#include "AtlasAllocator.hpp"
+
+#include <algorithm>
+#include <climits>
+
+// Finds the lowest place on a page's skyline an image fits, returning false if it doesn't fit anywhere
+bool _SkylineFind(const RAtlasSpace* space, const RAtlasPage& page, unsigned int w, unsigned int h, size_t* pIndex, unsigned int* pX, unsigned int* pY);
+
+// Raises the skyline over an image placed by _SkylineFind
+void _SkylineAdd(RAtlasPage& page, size_t index, unsigned int x, unsigned int y, unsigned int w, unsigned int h);
+
+// Gives a freed image's space back to its page, joining it up with whatever free space it lines up with
+void _ReleaseRect(RAtlasPage& page, RAtlasRect rect);
+
+void RAtlasInit(RAtlasSpace* space, unsigned int pageW, unsigned int pageH, unsigned int layers, unsigned int maxLayers, unsigned int maxSide,
+                const std::vector<RAtlasSlot>& used) {
+    space->pageW = pageW;
+    space->pageH = pageH;
+    space->maxLayers = maxLayers;
+    space->maxSide = maxSide;
+    space->pages.assign(layers, RAtlasPage());
+    space->retired.clear();
+
+    // The skyline over each page is the bottom edge of the lowest image in each column, with runs of columns at the same height joined into one node
+    std::vector<std::vector<unsigned int>> heights(layers, std::vector<unsigned int>(pageW, 0));
+    for (const RAtlasSlot& slot : used) {
+        if (slot.rect.w == 0 || slot.rect.h == 0) continue;
+        std::vector<unsigned int>& columns = heights[slot.layer];
+        for (unsigned int x = slot.rect.x; x < slot.rect.x + slot.rect.w; x++) {
+            columns[x] = std::max(columns[x], slot.rect.y + slot.rect.h);
+        }
+        space->pages[slot.layer].images++;
+    }
+    for (size_t layer = 0; layer < layers; layer++) {
+        std::vector<RSkylineNode>& skyline = space->pages[layer].skyline;
+        for (unsigned int x = 0; x < pageW; x++) {
+            if (!skyline.empty() && skyline.back().y == heights[layer][x]) skyline.back().w++;
+            else skyline.push_back(RSkylineNode{x, heights[layer][x], 1});
+        }
+    }
+}
+
+bool RAtlasPlace(RAtlasSpace* space, unsigned int w, unsigned int h, RAtlasSlot* out) {
+    out->layer = 0;
+    out->rect = RAtlasRect{0, 0, w, h};
+    if (w == 0 || h == 0) return true;
+
+    std::vector<RAtlasPage>& pages = space->pages;
+    while (true) {
+        // Space from freed images first, whichever piece leaves the least over
+        RAtlasPage* bestPage = NULL;
+        size_t bestIndex = 0;
+        unsigned long long bestWaste = ULLONG_MAX;
+        for (size_t layer = 0; layer < pages.size(); layer++) {
+            std::vector<RAtlasRect>& freed = pages[layer].freed;
+            for (size_t i = 0; i < freed.size(); i++) {
+                if (freed[i].w < w || freed[i].h < h) continue;
+                unsigned long long waste = ( unsigned long long )freed[i].w * freed[i].h - ( unsigned long long )w * h;
+                if (waste < bestWaste) {
+                    bestPage = &pages[layer];
+                    bestIndex = i;
+                    bestWaste = waste;
+                    out->layer = static_cast<unsigned int>(layer);
+                }
+            }
+        }
+        if (bestPage) {
+            // Split what's left over into the strip to the right and the strip underneath, cutting along the longer side of the leftover
+            RAtlasRect rect = bestPage->freed[bestIndex];
+            bestPage->freed.erase(bestPage->freed.begin() + bestIndex);
+            out->rect.x = rect.x;
+            out->rect.y = rect.y;
+            bool cutAcross = (rect.w - w) < (rect.h - h);
+            RAtlasRect right = {rect.x + w, rect.y, rect.w - w, cutAcross ? h : rect.h};
+            RAtlasRect below = {rect.x, rect.y + h, cutAcross ? rect.w : w, rect.h - h};
+            if (right.w && right.h) bestPage->freed.push_back(right);
+            if (below.w && below.h) bestPage->freed.push_back(below);
+            bestPage->images++;
+            return true;
+        }
+
+        // Then the lowest place on top of any page's skyline
+        size_t bestNode = 0;
+        unsigned int bestX = 0, bestY = UINT_MAX;
+        for (size_t layer = 0; layer < pages.size(); layer++) {
+            size_t index;
+            unsigned int x, y;
+            if (_SkylineFind(space, pages[layer], w, h, &index, &x, &y) && y < bestY) {
+                bestPage = &pages[layer];
+                bestNode = index;
+                bestX = x;
+                bestY = y;
+                out->layer = static_cast<unsigned int>(layer);
+            }
+        }
+        if (bestPage) {
+            _SkylineAdd(*bestPage, bestNode, bestX, bestY, w, h);
+            out->rect.x = bestX;
+            out->rect.y = bestY;
+            bestPage->images++;
+            return true;
+        }
+
+        // Then a new page, if it would fit on one
+        if (w <= space->pageW && h <= space->pageH && pages.size() < space->maxLayers) {
+            pages.emplace_back();
+            pages.back().skyline.assign(1, RSkylineNode{0, 0, space->pageW});
+            continue;
+        }
+
+        // Otherwise every page gets bigger, which means copying the whole array on the GPU, so it at least doubles to make it rare
+        unsigned int pageW = space->pageW, pageH = space->pageH, maxSide = space->maxSide;
+        if (pageW >= maxSide && pageH >= maxSide) return false;
+        if (w > maxSide || h > maxSide) return false;
+        unsigned int newW = std::min(std::max(std::max(pageW * 2, w), RUNTIME_PAGE_SIDE), maxSide);
+        unsigned int newH = std::min(std::max(std::max(pageH * 2, h), RUNTIME_PAGE_SIDE), maxSide);
+        for (RAtlasPage& page : pages) {
+            if (page.images == 0) page.skyline.assign(1, RSkylineNode{0, 0, pageW});
+            if (page.skyline.back().y == 0) page.skyline.back().w += newW - pageW;
+            else page.skyline.push_back(RSkylineNode{pageW, 0, newW - pageW});
+        }
+        space->pageW = newW;
+        space->pageH = newH;
+    }
+}
+
+void RAtlasRetire(RAtlasSpace* space, const RAtlasSlot& slot, unsigned long long frame) {
+    if (slot.rect.w == 0 || slot.rect.h == 0 || slot.layer >= space->pages.size()) return;
+    space->retired.push_back(RRetiredSlot{slot, frame});
+}
+
+void RAtlasReturnRetired(RAtlasSpace* space, unsigned long long drawn) {
+    size_t kept = 0;
+    for (const RRetiredSlot& retired : space->retired) {
+        if (retired.frame > drawn) {
+            space->retired[kept++] = retired;
+            continue;
+        }
+
+        // A page with nothing left on it starts again from empty. Images never get moved to tidy a page up, since caches hold the atlas rects
+        // they were recorded with, so a page only gets back the space from its own images.
+        RAtlasPage& page = space->pages[retired.slot.layer];
+        page.images--;
+        if (page.images == 0) {
+            page.skyline.assign(1, RSkylineNode{0, 0, space->pageW});
+            page.freed.clear();
+        }
+        else {
+            _ReleaseRect(page, retired.slot.rect);
+        }
+    }
+    space->retired.resize(kept);
+}
+
+// Joins b onto a if they share a whole edge, returning false if they don't
+bool _JoinRects(RAtlasRect* a, const RAtlasRect& b) {
+    if (a->x == b.x && a->w == b.w && (a->y + a->h == b.y || b.y + b.h == a->y)) {
+        a->y = std::min(a->y, b.y);
+        a->h += b.h;
+        return true;
+    }
+    if (a->y == b.y && a->h == b.h && (a->x + a->w == b.x || b.x + b.w == a->x)) {
+        a->x = std::min(a->x, b.x);
+        a->w += b.w;
+        return true;
+    }
+    return false;
+}
+
+// Whether the skyline sits right on top of a free rect all the way across, meaning there's nothing above it
+bool _UnderSkyline(const RAtlasPage& page, const RAtlasRect& rect) {
+    for (const RSkylineNode& node : page.skyline) {
+        if (node.x + node.w <= rect.x) continue;
+        if (node.x >= rect.x + rect.w) break;
+        if (node.y != rect.y + rect.h) return false;
+    }
+    return true;
+}
+
+// Brings the skyline down to the bottom of a free rect that _UnderSkyline said was under it
+void _LowerSkyline(RAtlasPage& page, const RAtlasRect& rect) {
+    std::vector<RSkylineNode> skyline;
+    unsigned int end = rect.x + rect.w;
+    bool added = false;
+    for (const RSkylineNode& node : page.skyline) {
+        unsigned int nodeEnd = node.x + node.w;
+        if (node.x < rect.x) skyline.push_back(RSkylineNode{node.x, node.y, std::min(nodeEnd, rect.x) - node.x});
+        if (!added && nodeEnd > rect.x && node.x < end) {
+            skyline.push_back(RSkylineNode{rect.x, rect.y, rect.w});
+            added = true;
+        }
+        if (nodeEnd > end) {
+            unsigned int start = std::max(node.x, end);
+            skyline.push_back(RSkylineNode{start, node.y, nodeEnd - start});
+        }
+    }
+
+    // Join neighbours that have ended up at the same height
+    page.skyline.clear();
+    for (const RSkylineNode& node : skyline) {
+        if (!page.skyline.empty() && page.skyline.back().y == node.y) page.skyline.back().w += node.w;
+        else page.skyline.push_back(node);
+    }
+}
+
+void _ReleaseRect(RAtlasPage& page, RAtlasRect rect) {
+    while (true) {
+        // Keep joining it onto free neighbours until none of them line up with it any more
+        for (size_t i = 0; i < page.freed.size();) {
+            if (_JoinRects(&rect, page.freed[i])) {
+                page.freed.erase(page.freed.begin() + i);
+                i = 0;
+            }
+            else {
+                i++;
+            }
+        }
+
+        if (!_UnderSkyline(page, rect)) {
+            page.freed.push_back(rect);
+            return;
+        }
+
+        // Nothing's on top of it, so the skyline comes down over it instead. That can uncover free space further down, which goes the same way.
+        _LowerSkyline(page, rect);
+        size_t i = 0;
+        while (i < page.freed.size() && !_UnderSkyline(page, page.freed[i])) i++;
+        if (i == page.freed.size()) return;
+        rect = page.freed[i];
+        page.freed.erase(page.freed.begin() + i);
+    }
+}
+
+bool _SkylineFind(const RAtlasSpace* space, const RAtlasPage& page, unsigned int w, unsigned int h, size_t* pIndex, unsigned int* pX, unsigned int* pY) {
+    bool found = false;
+    for (size_t i = 0; i < page.skyline.size(); i++) {
+        // The image's left edge goes at the start of this node, and it has to sit on the highest node it spans
+        unsigned int x = page.skyline[i].x;
+        if (x + w > space->pageW) break;
+        unsigned int y = 0;
+        for (size_t j = i; j < page.skyline.size() && page.skyline[j].x < x + w; j++) {
+            y = std::max(y, page.skyline[j].y);
+        }
+        if (y + h > space->pageH) continue;
+        if (!found || y < (*pY)) {
+            (*pIndex) = i;
+            (*pX) = x;
+            (*pY) = y;
+            found = true;
+        }
+    }
+    return found;
+}
+
+void _SkylineAdd(RAtlasPage& page, size_t index, unsigned int x, unsigned int y, unsigned int w, unsigned int h) {
+    std::vector<RSkylineNode>& skyline = page.skyline;
+    skyline.insert(skyline.begin() + index, RSkylineNode{x, y + h, w});
+
+    // Cut the nodes it covers back to whatever sticks out past its right edge
+    size_t i = index + 1;
+    while (i < skyline.size() && skyline[i].x < x + w) {
+        unsigned int end = skyline[i].x + skyline[i].w;
+        if (end <= x + w) {
+            skyline.erase(skyline.begin() + i);
+        }
+        else {
+            skyline[i].w = end - (x + w);
+            skyline[i].x = x + w;
+            break;
+        }
+    }
+
+    // Join neighbours that have ended up at the same height
+    for (i = 1; i < skyline.size();) {
+        if (skyline[i - 1].y == skyline[i].y) {
+            skyline[i - 1].w += skyline[i].w;
+            skyline.erase(skyline.begin() + i);
+        }
+        else {
+            i++;
+        }
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <ostream>
+#include <vector>
+
+// Free space on each atlas page, for images made after the atlas was built. Each page has a skyline: the top edge of everything on it,
+// stored as flat segments from left to right, and new images go in on top of it as low down as they'll fit. Space from freed images goes in
+// a list that's tried first. Freed space gets joined up with its neighbours, and handed back to the skyline once nothing's on top of it,
+// so a page doesn't end up in splinters. A page that runs out of images starts again from empty.
+// None of this touches the GPU. Renderer.cpp keeps the array texture the size of the pages.
+struct RSkylineNode {
+    unsigned int x;
+    unsigned int y;
+    unsigned int w;
+};
+struct RAtlasRect {
+    unsigned int x;
+    unsigned int y;
+    unsigned int w;
+    unsigned int h;
+};
+struct RAtlasSlot {
+    unsigned int layer;  // Which page it's on
+    RAtlasRect rect;
+};
+struct RAtlasPage {
+    std::vector<RSkylineNode> skyline;
+    std::vector<RAtlasRect> freed;
+    unsigned int images = 0;  // Images on the page that haven't been freed
+};
+
+// Space from freed images doesn't go back to its page straight away: the frame being built, and with the render thread the one being drawn,
+// can still have commands for the image, and whatever got placed there would have its pixels uploaded over it before they're drawn.
+struct RRetiredSlot {
+    RAtlasSlot slot;
+    unsigned long long frame;  // The frame that was being built when it was freed
+};
+
+struct RAtlasSpace {
+    std::vector<RAtlasPage> pages;
+    unsigned int pageW = 0;  // Every page is the same size
+    unsigned int pageH = 0;
+    unsigned int maxLayers = 0;  // What the GPU can have, pages never go past these
+    unsigned int maxSide = 0;
+    std::vector<RRetiredSlot> retired;
+};
+
+// Smallest page made for images created after the atlas was built, if there wasn't one already
+constexpr unsigned int RUNTIME_PAGE_SIDE = 1024;
+
+// Sets up layers pages of pageW x pageH, with the images in used already on them. Gaps under the skyline that used leaves are lost,
+// but the packer doesn't leave many.
+void RAtlasInit(RAtlasSpace* space, unsigned int pageW, unsigned int pageH, unsigned int layers, unsigned int maxLayers, unsigned int maxSide,
+                const std::vector<RAtlasSlot>& used);
+
+// Finds room for a w x h image, adding or enlarging pages if it has to. Returns false if it's too big for the GPU.
+bool RAtlasPlace(RAtlasSpace* space, unsigned int w, unsigned int h, RAtlasSlot* out);
+
+// Frees a placed image's space once the given frame (the one being built now) has been drawn
+void RAtlasRetire(RAtlasSpace* space, const RAtlasSlot& slot, unsigned long long frame);
+
+// Gives the space back from images retired during the given frame or earlier, now that it's been drawn
+void RAtlasReturnRetired(RAtlasSpace* space, unsigned long long drawn);
+
+// Places, frees and reuses images the way a game making and deleting them at runtime would, checking that nothing ever overlaps or gets
+// handed out before its frame is done. Writes what it's checking to out, and returns false if anything was wrong.
+bool AtlasAllocatorUnitTest(std::ostream& out);
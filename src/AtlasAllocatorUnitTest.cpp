@@ -0,0 +1,251 @@
+#include "AtlasAllocator.hpp"
+
+#include <climits>
+#include <random>
+
+// Writes what went wrong if a check failed, so every test can carry on to the end and report everything
+bool _AtlasCheck(std::ostream& out, bool ok, const char* what) {
+    if (!ok) out << " -> FAILED! " << what << "\n";
+    return ok;
+}
+
+bool _RectsOverlap(const RAtlasRect& a, const RAtlasRect& b) {
+    return a.x < b.x + b.w && b.x < a.x + a.w && a.y < b.y + b.h && b.y < a.y + a.h;
+}
+
+// Height of a page's skyline over one column
+unsigned int _SkylineAt(const RAtlasPage& page, unsigned int x) {
+    for (const RSkylineNode& node : page.skyline) {
+        if (x >= node.x && x < node.x + node.w) return node.y;
+    }
+    return UINT_MAX;
+}
+
+// Whether a rect is somewhere the skyline has already passed over, so nothing can be placed on it from the skyline
+bool _BelowSkyline(const RAtlasPage& page, const RAtlasRect& rect) {
+    for (unsigned int x = rect.x; x < rect.x + rect.w; x++) {
+        if (rect.y + rect.h > _SkylineAt(page, x)) return false;
+    }
+    return true;
+}
+
+// Checks everything that has to hold between any two calls. Taken is every image that's been placed and not yet given back, including
+// retired ones: none of them can overlap each other or any free space, and each page has to be counting them.
+bool _AtlasConsistent(std::ostream& out, const RAtlasSpace& space, const std::vector<RAtlasSlot>& taken) {
+    bool ok = true;
+    std::vector<unsigned int> counts(space.pages.size(), 0);
+    for (size_t i = 0; i < taken.size(); i++) {
+        const RAtlasSlot& a = taken[i];
+        if (!_AtlasCheck(out, a.layer < space.pages.size(), "image on a page that doesn't exist")) return false;
+        counts[a.layer]++;
+        const RAtlasPage& page = space.pages[a.layer];
+        ok &= _AtlasCheck(out, a.rect.x + a.rect.w <= space.pageW && a.rect.y + a.rect.h <= space.pageH, "image off the edge of its page");
+        ok &= _AtlasCheck(out, _BelowSkyline(page, a.rect), "image above the skyline");
+        for (size_t j = i + 1; j < taken.size(); j++) {
+            if (taken[j].layer == a.layer) ok &= _AtlasCheck(out, !_RectsOverlap(a.rect, taken[j].rect), "two images overlap");
+        }
+        for (const RAtlasRect& free : page.freed) {
+            ok &= _AtlasCheck(out, !_RectsOverlap(a.rect, free), "free space overlaps an image");
+        }
+    }
+
+    for (size_t layer = 0; layer < space.pages.size(); layer++) {
+        const RAtlasPage& page = space.pages[layer];
+        ok &= _AtlasCheck(out, page.images == counts[layer], "page's image count is wrong");
+        unsigned int width = 0;
+        for (const RSkylineNode& node : page.skyline) {
+            ok &= _AtlasCheck(out, node.x == width && node.w > 0 && node.y <= space.pageH, "skyline has a gap or goes off the page");
+            width += node.w;
+        }
+        ok &= _AtlasCheck(out, width == space.pageW, "skyline isn't as wide as the page");
+        for (size_t i = 0; i < page.freed.size(); i++) {
+            const RAtlasRect& free = page.freed[i];
+            ok &= _AtlasCheck(out, free.w > 0 && free.h > 0, "empty free rect");
+            ok &= _AtlasCheck(out, _BelowSkyline(page, free), "free rect above the skyline");
+            for (size_t j = i + 1; j < page.freed.size(); j++) {
+                ok &= _AtlasCheck(out, !_RectsOverlap(free, page.freed[j]), "two free rects overlap");
+            }
+        }
+    }
+    return ok;
+}
+
+bool _AtlasSame(const RAtlasSlot& a, unsigned int layer, unsigned int x, unsigned int y) {
+    return a.layer == layer && a.rect.x == x && a.rect.y == y;
+}
+
+// Gives back everything retired by the end of a frame and drops it from taken
+void _AtlasReturn(RAtlasSpace* space, std::vector<RAtlasSlot>* taken, std::vector<RRetiredSlot>* pending, unsigned long long drawn) {
+    RAtlasReturnRetired(space, drawn);
+    size_t kept = 0;
+    for (const RRetiredSlot& retired : *pending) {
+        if (retired.frame > drawn) {
+            (*pending)[kept++] = retired;
+            continue;
+        }
+        for (size_t i = 0; i < taken->size(); i++) {
+            const RAtlasSlot& t = (*taken)[i];
+            if (t.layer == retired.slot.layer && t.rect.x == retired.slot.rect.x && t.rect.y == retired.slot.rect.y) {
+                taken->erase(taken->begin() + i);
+                break;
+            }
+        }
+    }
+    pending->resize(kept);
+}
+
+bool _AtlasInitTest(std::ostream& out) {
+    out << "Asserting pages start out with the packed images on them ..\n";
+    RAtlasSpace space;
+    std::vector<RAtlasSlot> used = {{0, {0, 0, 40, 30}}, {0, {40, 0, 20, 50}}, {1, {0, 0, 64, 10}}};
+    RAtlasInit(&space, 64, 64, 2, 4, 256, used);
+    bool ok = _AtlasConsistent(out, space, used);
+    ok &= _AtlasCheck(out, space.pages[0].skyline.size() == 3, "skyline over page 0 should be 30, 50 and 0 high");
+    ok &= _AtlasCheck(out, space.pages[1].skyline.size() == 1 && space.pages[1].skyline[0].y == 10, "skyline over page 1 should be 10 high");
+
+    // The lowest spot anywhere is the strip to the right of page 0's images
+    RAtlasSlot slot;
+    ok &= _AtlasCheck(out, RAtlasPlace(&space, 4, 4, &slot) && _AtlasSame(slot, 0, 60, 0), "4x4 should go in the gap at the right of page 0");
+    used.push_back(slot);
+    ok &= _AtlasConsistent(out, space, used);
+    return ok;
+}
+
+bool _AtlasRetireTest(std::ostream& out) {
+    out << "Asserting freed space isn't reused until its frame is drawn ..\n";
+    RAtlasSpace space;
+    RAtlasInit(&space, 64, 64, 1, 1, 64, {});
+    RAtlasSlot a, b, c, d;
+    bool ok = RAtlasPlace(&space, 16, 16, &a) && RAtlasPlace(&space, 16, 16, &b);
+    ok &= _AtlasCheck(out, _AtlasSame(a, 0, 0, 0) && _AtlasSame(b, 0, 16, 0), "first two 16x16 should sit side by side at the top");
+
+    RAtlasRetire(&space, a, 5);
+    ok &= _AtlasCheck(out, RAtlasPlace(&space, 16, 16, &c) && !_AtlasSame(c, 0, 0, 0), "retired space was handed out in the same frame");
+    RAtlasReturnRetired(&space, 4);
+    ok &= _AtlasCheck(out, space.retired.size() == 1 && space.pages[0].images == 3, "space came back before its frame was drawn");
+    ok &= _AtlasConsistent(out, space, {a, b, c});
+
+    RAtlasReturnRetired(&space, 5);
+    ok &= _AtlasCheck(out, space.retired.empty() && space.pages[0].images == 2, "space didn't come back once its frame was drawn");
+    ok &= _AtlasConsistent(out, space, {b, c});
+    ok &= _AtlasCheck(out, RAtlasPlace(&space, 16, 16, &d) && _AtlasSame(d, 0, 0, 0), "returned space wasn't reused");
+    ok &= _AtlasConsistent(out, space, {b, c, d});
+    return ok;
+}
+
+bool _AtlasMergeTest(std::ostream& out) {
+    out << "Asserting freed neighbours join up and go back to the skyline ..\n";
+    RAtlasSpace space;
+    RAtlasInit(&space, 64, 64, 1, 1, 64, {});
+
+    // Two full rows of four, and one more on the third row so the page never empties
+    std::vector<RAtlasSlot> rows(9);
+    bool ok = true;
+    for (RAtlasSlot& slot : rows) ok &= RAtlasPlace(&space, 16, 16, &slot);
+    for (size_t i = 0; i < rows.size(); i++) {
+        unsigned int x = static_cast<unsigned int>(i % 4) * 16, y = static_cast<unsigned int>(i / 4) * 16;
+        ok &= _AtlasCheck(out, _AtlasSame(rows[i], 0, x, y), "16x16 images should fill the page row by row");
+    }
+
+    // The middle two of the top row have the second row on top of them, so they stay as free space, joined into one
+    RAtlasRetire(&space, rows[1], 0);
+    RAtlasRetire(&space, rows[2], 0);
+    RAtlasReturnRetired(&space, 0);
+    const std::vector<RAtlasRect>& freed = space.pages[0].freed;
+    ok &= _AtlasCheck(out, freed.size() == 1, "two freed neighbours should have joined");
+    if (freed.size() == 1) {
+        ok &= _AtlasCheck(out, freed[0].x == 16 && freed[0].y == 0 && freed[0].w == 32 && freed[0].h == 16, "joined rect is the wrong shape");
+    }
+    ok &= _AtlasConsistent(out, space, {rows[0], rows[3], rows[4], rows[5], rows[6], rows[7], rows[8]});
+
+    // Freeing the ones above leaves nothing on top, so the skyline comes down over both rows
+    RAtlasRetire(&space, rows[5], 1);
+    RAtlasRetire(&space, rows[6], 1);
+    RAtlasReturnRetired(&space, 1);
+    ok &= _AtlasCheck(out, freed.empty(), "free space with nothing on top should be back in the skyline");
+    ok &= _AtlasCheck(out, _SkylineAt(space.pages[0], 16) == 0 && _SkylineAt(space.pages[0], 47) == 0, "skyline should be down to the top");
+    std::vector<RAtlasSlot> taken = {rows[0], rows[3], rows[4], rows[7], rows[8]};
+    ok &= _AtlasConsistent(out, space, taken);
+
+    RAtlasSlot big;
+    ok &= _AtlasCheck(out, RAtlasPlace(&space, 32, 32, &big) && _AtlasSame(big, 0, 16, 0), "32x32 should fit where the four were");
+    taken.push_back(big);
+    ok &= _AtlasConsistent(out, space, taken);
+
+    // A page with nothing left on it starts again
+    for (size_t i = 0; i < taken.size(); i++) RAtlasRetire(&space, taken[i], 2);
+    RAtlasReturnRetired(&space, 2);
+    ok &= _AtlasCheck(out, space.pages[0].images == 0 && freed.empty() && space.pages[0].skyline.size() == 1 && space.pages[0].skyline[0].y == 0,
+                      "empty page should be reset");
+    return ok;
+}
+
+bool _AtlasGrowTest(std::ostream& out) {
+    out << "Asserting pages get added, then doubled, then give up ..\n";
+    RAtlasSpace space;
+    RAtlasInit(&space, 0, 0, 0, 2, 2048, {});
+    std::vector<RAtlasSlot> taken(3);
+    bool ok = _AtlasCheck(out, RAtlasPlace(&space, 100, 100, &taken[0]), "first image didn't fit");
+    ok &= _AtlasCheck(out, space.pageW == RUNTIME_PAGE_SIDE && space.pageH == RUNTIME_PAGE_SIDE && space.pages.size() == 1, "should start at the smallest page");
+    ok &= _AtlasCheck(out, RAtlasPlace(&space, 1024, 1024, &taken[1]) && taken[1].layer == 1, "full-page image should go on a new page");
+    ok &= _AtlasCheck(out, RAtlasPlace(&space, 1024, 1024, &taken[2]) && space.pageW == 2048 && space.pageH == 2048 && space.pages.size() == 2,
+                      "out of layers, pages should have doubled");
+    ok &= _AtlasConsistent(out, space, taken);
+
+    RAtlasSlot tooBig;
+    ok &= _AtlasCheck(out, !RAtlasPlace(&space, 4096, 16, &tooBig), "image bigger than the GPU allows should fail");
+    ok &= _AtlasCheck(out, space.pageW == 2048 && space.pages.size() == 2, "failing shouldn't change the pages");
+    return ok;
+}
+
+bool _AtlasChurnTest(std::ostream& out) {
+    out << "Asserting random creating and freeing never overlaps ..\n";
+    RAtlasSpace space;
+    RAtlasInit(&space, 256, 256, 1, 4, 1024, {});
+    std::mt19937 rng(8);
+    std::uniform_int_distribution<unsigned int> side(1, 64);
+    std::uniform_int_distribution<unsigned int> count(0, 6);
+    std::uniform_int_distribution<unsigned int> fewer(0, 4);
+    std::uniform_int_distribution<unsigned int> more(0, 8);
+    std::vector<RAtlasSlot> taken;  // Placed and not returned yet, in the order they were placed
+    std::vector<RAtlasSlot> live;   // Placed and not retired
+    std::vector<RRetiredSlot> pending;
+    bool ok = true;
+
+    // Same lag as the render thread: what's freed while building a frame comes back once the frame after it is being built
+    for (unsigned long long frame = 0; frame < 600 && ok; frame++) {
+        for (unsigned int n = count(rng); n > 0; n--) {
+            RAtlasSlot slot;
+            if (!_AtlasCheck(out, RAtlasPlace(&space, side(rng), side(rng), &slot), "image that fits a page wasn't placed")) return false;
+            taken.push_back(slot);
+            live.push_back(slot);
+        }
+
+        // Free a bit less than gets made early on, so it grows, then more, so it shrinks back and pages empty out
+        unsigned int frees = (frame < 300) ? fewer(rng) : more(rng);
+        for (; frees > 0 && !live.empty(); frees--) {
+            size_t i = std::uniform_int_distribution<size_t>(0, live.size() - 1)(rng);
+            RAtlasRetire(&space, live[i], frame);
+            pending.push_back(RRetiredSlot{live[i], frame});
+            live.erase(live.begin() + i);
+        }
+        if (frame > 0) _AtlasReturn(&space, &taken, &pending, frame - 1);
+        ok &= _AtlasConsistent(out, space, taken);
+    }
+
+    _AtlasReturn(&space, &taken, &pending, ULLONG_MAX);
+    ok &= _AtlasConsistent(out, space, taken);
+    out << "    " << space.pages.size() << " pages of " << space.pageW << "x" << space.pageH << ", " << live.size() << " images left\n";
+    return ok;
+}
+
+bool AtlasAllocatorUnitTest(std::ostream& out) {
+    bool ok = true;
+    ok &= _AtlasInitTest(out);
+    ok &= _AtlasRetireTest(out);
+    ok &= _AtlasMergeTest(out);
+    ok &= _AtlasGrowTest(out);
+    ok &= _AtlasChurnTest(out);
+    out << (ok ? "Atlas allocator OK\n" : "Atlas allocator FAILED\n");
+    return ok;
+}
@@ -0,0 +1,123 @@
+#include "BlockInflater.hpp"
+#include "StreamUtil.hpp"
+#include <stdlib.h>
+
+BlockInflater::BlockInflater(unsigned char* stream, std::vector<DataBlock>* blocks, unsigned int threadCount, unsigned int window) {
+    _stream = stream;
+    _blocks = blocks;
+    _states.assign(blocks->size(), BLOCK_PENDING);
+    _next = 0;
+    _current = 0;
+    _released = 0;
+    _stop = false;
+    _deferredBefore.assign(blocks->size() + 1, 0);
+    for (size_t i = 0; i < blocks->size(); i++) {
+        _deferredBefore[i + 1] = _deferredBefore[i] + ((*blocks)[i].deferred ? 1 : 0);
+    }
+
+    if (threadCount == 0) threadCount = std::thread::hardware_concurrency();
+    if (threadCount == 0) threadCount = 1;
+    if (threadCount > blocks->size()) threadCount = static_cast<unsigned int>(blocks->size());
+
+    // Enough blocks in flight that no worker sits idle behind one big sprite, but not so many that we hold half the game in memory
+    _window = window ? window : threadCount * 4;
+
+    _workers.reserve(threadCount);
+    for (unsigned int i = 0; i < threadCount; i++) {
+        _workers.emplace_back(&BlockInflater::_Work, this);
+    }
+}
+
+BlockInflater::~BlockInflater() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _windowMoved.notify_all();
+    for (std::thread& worker : _workers) {
+        worker.join();
+    }
+
+    for (size_t i = _released; i < _blocks->size(); i++) {
+        free((*_blocks)[i].data);
+        (*_blocks)[i].data = nullptr;
+    }
+}
+
+void BlockInflater::_Work() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+        _windowMoved.wait(lock, [this]() { return _stop || _next >= _blocks->size() || _InWindow(_next); });
+        if (_stop || _next >= _blocks->size()) return;
+
+        size_t index = _next++;
+        DataBlock* block = &(*_blocks)[index];
+        if (block->deferred) {
+            _states[index] = BLOCK_FAILED;
+            _blockReady.notify_all();
+            continue;
+        }
+        lock.unlock();
+
+        // Blocks often end up as long-lived asset storage, so the buffer starts at a guess based on the compressed size and gets trimmed to fit afterwards
+        unsigned int pos = block->pos;
+        unsigned int compressedLength = ReadDword(_stream, &pos);
+        pos = block->pos;
+        unsigned int bufferSize = compressedLength > ZLIB_BUF_START / 2 ? compressedLength * 2 : ZLIB_BUF_START;
+        unsigned int outputSize = 0;
+        auto start = std::chrono::steady_clock::now();
+        unsigned char* buffer = ( unsigned char* )malloc(bufferSize);
+        bool success = buffer && InflateBlock(_stream, &pos, &buffer, &bufferSize, &outputSize);
+        if (!success) {
+            free(buffer);
+            buffer = nullptr;
+            outputSize = 0;
+        }
+        else if (outputSize < bufferSize && outputSize > 0) {
+            unsigned char* trimmed = ( unsigned char* )realloc(buffer, outputSize);
+            if (trimmed) buffer = trimmed;
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        lock.lock();
+        if (index < _released) {
+            // The caller skipped past this block while we were inflating it
+            free(buffer);
+            buffer = nullptr;
+        }
+        block->data = buffer;
+        block->length = outputSize;
+        block->inflateSeconds = elapsed.count();
+        _states[index] = success ? BLOCK_DONE : BLOCK_FAILED;
+        _blockReady.notify_all();
+    }
+}
+
+unsigned char* BlockInflater::Take(size_t index) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    unsigned char* data = (*_blocks)[index].data;
+    (*_blocks)[index].data = nullptr;
+    return data;
+}
+
+unsigned char* BlockInflater::Wait(size_t index, unsigned int* pLength) {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    // Everything before this block is finished with now
+    for (; _released < index; _released++) {
+        free((*_blocks)[_released].data);
+        (*_blocks)[_released].data = nullptr;
+    }
+    if (index > _current) {
+        _current = index;
+        _windowMoved.notify_all();
+    }
+
+    _blockReady.wait(lock, [this, index]() { return _states[index] != BLOCK_PENDING; });
+
+    DataBlock* block = &(*_blocks)[index];
+    if (pLength != nullptr) {
+        (*pLength) = block->length;
+    }
+    return block->data;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A zlib block somewhere in a byte stream, and its inflated data once a BlockInflater has got to it.
+struct DataBlock {
+    unsigned int pos = 0;  // Position of the block's length dword in the stream
+    unsigned char* data = nullptr;
+    unsigned int length = 0;
+    double inflateSeconds = 0;  // How long a worker spent inflating it
+    bool deferred = false;  // Left for the caller to inflate itself some other time, so workers skip it and waiting for it gives NULL
+};
+
+// Inflates a list of blocks on a pool of worker threads while the caller parses them in order.
+// Workers never get more than a fixed number of blocks ahead of the block being parsed, so memory use stays bounded no matter how big the game is.
+class BlockInflater {
+  private:
+    enum BlockState : unsigned char { BLOCK_PENDING, BLOCK_DONE, BLOCK_FAILED };
+
+    unsigned char* _stream;
+    std::vector<DataBlock>* _blocks;
+    std::vector<BlockState> _states;
+    std::vector<std::thread> _workers;
+    std::mutex _mutex;
+    std::condition_variable _blockReady;  // A worker finished a block
+    std::condition_variable _windowMoved;  // The caller moved on to a new block, or we're stopping
+    size_t _next;  // Next block for a worker to pick up
+    size_t _current;  // Block the caller is currently parsing
+    size_t _released;  // Every block before this one has had its data freed
+    size_t _window;
+    std::vector<size_t> _deferredBefore;  // How many deferred blocks come before each block. They take no time or memory, so they don't count towards the window.
+    bool _stop;
+
+    void _Work();
+    bool _InWindow(size_t index) const { return index < _current || (index - _current) - (_deferredBefore[index] - _deferredBefore[_current]) < _window; }
+
+  public:
+    // Starts inflating straight away. The stream and the block list must stay valid until the BlockInflater is destroyed.
+    // threadCount of 0 means one worker per hardware thread. window is how many blocks workers may run ahead, 0 picks one based on the thread count.
+    BlockInflater(unsigned char* stream, std::vector<DataBlock>* blocks, unsigned int threadCount = 0, unsigned int window = 0);
+
+    // Stops the workers and frees any block data that hasn't been freed yet.
+    ~BlockInflater();
+
+    // Waits until the block at the given index has been inflated and returns its data, or NULL if it couldn't be inflated.
+    // Blocks must be waited for in increasing order. A block's data is freed as soon as a later block is waited for, so copy anything you want to keep.
+    unsigned char* Wait(size_t index, unsigned int* pLength = nullptr);
+
+    // Hands a block that's already been waited for over to the caller, who then has to free() it. Its data stays where it is, so anything
+    // pointing into it is still good. The block isn't freed when the caller moves on.
+    unsigned char* Take(size_t index);
+};
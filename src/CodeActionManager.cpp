@@ -58,6 +58,8 @@ namespace CodeActionManager {
         unsigned int actionID;
         Parameter* params[8];
         unsigned int paramCount;
+        CodeObject paramCode[8];  // The code of its expression and GML params, which gets run before the action's own code
+        unsigned int paramCodeCount;
         CodeObject codeObj;
         bool question;
         bool appliesToSomething;
@@ -77,8 +79,14 @@ void CodeActionManager::Finalize() {
     }
 }
 
+void CodeActionManager::Clear() {
+    Finalize();
+    _actions.clear();
+}
+
 bool CodeActionManager::Read(const unsigned char* stream, unsigned int* pos, CodeAction* out) {
     CACodeAction action;
+    action.paramCodeCount = 0;
 
     (*pos) += 8;  // Skips version id and useless lib id
     action.actionID = ReadDword(stream, pos);
@@ -116,10 +124,12 @@ bool CodeActionManager::Read(const unsigned char* stream, unsigned int* pos, Cod
     for (i = 0; i < action.paramCount; i++) {
         switch (types[i]) {
             case 0:  // expression
-                action.params[i] = new ParamExpression(CodeManager::RegisterQuestion(args[i], lengths[i]));
+                action.paramCode[action.paramCodeCount] = CodeManager::RegisterQuestion(args[i], lengths[i]);
+                action.params[i] = new ParamExpression(action.paramCode[action.paramCodeCount++]);
                 break;
             case 1:  // gml
-                action.params[i] = new ParamGML(CodeManager::Register(args[i], lengths[i]));
+                action.paramCode[action.paramCodeCount] = CodeManager::Register(args[i], lengths[i]);
+                action.params[i] = new ParamGML(action.paramCode[action.paramCodeCount++]);
                 break;
             case 2:
                 action.params[i] = new ParamLiteral(args[i]);
@@ -580,6 +590,22 @@ bool CodeActionManager::Compile(CodeAction action) {
     return CodeManager::Compile(_actions[action].codeObj);
 }
 
+void CodeActionManager::GetCodeObjects(CodeAction action, std::vector<CodeObject>* out) {
+    const CACodeAction& a = _actions[action];
+    out->insert(out->end(), a.paramCode, a.paramCode + a.paramCodeCount);
+    out->push_back(a.codeObj);
+}
+
+void CodeActionManager::GetCodeObjects(const Object* obj, std::vector<CodeObject>* out) {
+    for (unsigned int i = 0; i < 12; i++) {
+        for (const auto& ev : obj->events[i]) {
+            for (unsigned int j = 0; j < ev.second.actionCount; j++) {
+                GetCodeObjects(ev.second.actions[j], out);
+            }
+        }
+    }
+}
+
 bool CodeActionManager::Run(CodeAction* actions, unsigned int count, InstanceHandle self, InstanceHandle other, int ev, int sub, unsigned int asObjId) {
     unsigned int pos = 0;
     while (pos < count) {
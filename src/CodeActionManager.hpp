@@ -12,6 +12,9 @@ namespace CodeActionManager {
     bool Init();
     void Finalize();
 
+    // Forgets every action read so far, for starting a load over after it failed part way
+    void Clear();
+
     // Read code action from EXE data stream, prepares and registers a GML block with the code runner.
     // Returns true on success, false on error (ie. game should close.) Outputs CodeAction reference in the "out" param.
     bool Read(const unsigned char* stream, unsigned int* pos, CodeAction* out);
@@ -20,6 +23,12 @@ namespace CodeActionManager {
     // Only do this after the asset list is fully loaded.
     bool Compile(CodeAction action);
 
+    // Lists the code objects this action can run: its params' code, then its own
+    void GetCodeObjects(CodeAction action, std::vector<CodeObject>* out);
+
+    // Lists the code objects in every action of every one of an object's own events, not counting the ones it inherits
+    void GetCodeObjects(const Object* obj, std::vector<CodeObject>* out);
+
     // Run a list of actions. Returns true on success, false on error (ie. game should close.)
     bool Run(CodeAction* actions, unsigned int count, InstanceHandle self, InstanceHandle other, int ev, int sub, unsigned int asObjId);
 
@@ -7,25 +7,76 @@
 #include "Compiler/Compiled.hpp"
 #include "Compiler/Interpreter.hpp"
 #include "Compiler/Tokenizer.hxx"
+#include "GameCache.hpp"
 #include "InstanceList.hpp"
 #include "RNG.hpp"
+#include <atomic>
+#include <condition_variable>
 #include <cstring>
+#include <deque>
+#include <mutex>
+#include <set>
 #include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Bump this whenever the compiled format in CRSerialize.cpp changes
+constexpr unsigned int CODE_CACHE_FORMAT_VERSION = 2;
+
+// Where a code object is at. Deferred code gets compiled when it's first run, or by the background compiler, whichever comes first.
+enum CRCompileState : unsigned char { CODE_NOT_COMPILED, CODE_DEFERRED, CODE_COMPILED, CODE_FAILED };
 
 // Internal code object
 struct CRCodeObject {
     char* _code;
-    GM8Emulator::Compiler::TokenList _tokenized;
+    unsigned int _length;
     bool question;
+    std::atomic<unsigned char> state;
     CRActionList _actions;
     CRExpression _expression;
-    CRCodeObject(const char* c, unsigned int l, bool q) : question(q) {
+    GM8Emulator::Compiler::TokenList _tokens;  // Kept from _TokenizeForFields until it's compiled, so nothing gets tokenized twice
+    bool _fieldsRegistered;  // Every field it uses has a number. Guarded by _compileMutex.
+    CRCodeObject(const char* c, unsigned int l, bool q) : _length(l), question(q), state(CODE_NOT_COMPILED), _fieldsRegistered(false) {
         _code = ( char* )malloc(l);
         memcpy(_code, c, l);
-        _tokenized = GM8Emulator::Compiler::TokenList(_code, l);
     }
 };
-std::vector<CRCodeObject> _codeObjects;
+std::deque<CRCodeObject> _codeObjects;  // A deque, since the atomic makes these immovable
+
+// Lazy compiling state, see StartBackgroundCompile
+// Guards the compile state of deferred code, so the game and the background compiler never compile the same object at once,
+// and the order field numbers get handed out in. CompileAll holds it while its threads compile different objects.
+std::mutex _compileMutex;
+bool _allFieldsRegistered = false;  // Code can't compile until its fields have numbers, and after this all of them do. Guarded by _compileMutex.
+std::condition_variable _fieldsReady;
+std::thread _compileThread;
+std::atomic<bool> _stopCompiling(false);
+
+// A compiled code object in the cache, found by the hash of its source
+struct CRCacheEntry {
+    unsigned int sourceLength;
+    bool question;
+    const unsigned char* data;
+    unsigned int length;
+};
+
+// Compiled code cache state, see LoadCache
+std::string _cachePath;
+GameCacheKey _cacheKey;
+FileMapping _cacheFile;
+std::vector<unsigned int> _cacheFieldMap;
+std::unordered_map<unsigned long long, CRCacheEntry> _cacheEntries;
+std::atomic<bool> _cacheMissed(false);
 
 // Global game value settings
 GlobalValues* _crGlobalValues;
@@ -37,6 +88,12 @@ bool CodeManager::Init(GlobalValues* globals) {
 }
 
 void CodeManager::Finalize() {
+    if (_compileThread.joinable()) {
+        _stopCompiling = true;
+        _compileThread.join();
+    }
+    FileUnmap(&_cacheFile);
+
     for (CRCodeObject& obj : _codeObjects) {
         if (obj.question) {
             obj._expression.Finalize();
@@ -49,41 +106,383 @@ void CodeManager::Finalize() {
     Runtime::Finalize();
 }
 
+void CodeManager::ClearRegistered() {
+    for (CRCodeObject& obj : _codeObjects) {
+        if (obj.question) {
+            obj._expression.Finalize();
+        }
+        else {
+            obj._actions.Finalize();
+        }
+        free(obj._code);
+    }
+    _codeObjects.clear();
+}
+
 CodeObject CodeManager::Register(const char* code, unsigned int len) {
     unsigned int ix = ( unsigned int )_codeObjects.size();
-    _codeObjects.push_back(CRCodeObject(code, len, false));
+    _codeObjects.emplace_back(code, len, false);
 
     return ix;
 }
 
 CodeObject CodeManager::RegisterQuestion(const char* code, unsigned int len) {
     unsigned int ix = ( unsigned int )_codeObjects.size();
-    _codeObjects.push_back(CRCodeObject(code, len, true));
+    _codeObjects.emplace_back(code, len, true);
 
     return ix;
 }
 
-bool CodeManager::Compile(CodeObject object) {
+void CodeManager::LoadCache(const char* path, unsigned int exeLength, unsigned long long exeHash) {
+    _cachePath = path;
+    // Compiled code refers to internal functions and variables by their enum values, so a cache from a build where those enums were different is no use
+    _cacheKey = {CODE_CACHE_MAGIC, CODE_CACHE_FORMAT_VERSION, exeLength, exeHash, GM8Emulator::Compiler::GetNameTableHash()};
+    _cacheMissed = false;
+
+    int unused;
+    if (!GameCacheOpen(path, _cacheKey, &_cacheFile, &unused)) {
+        // Nothing usable, so everything compiled from here on has to go in a new one
+        _cacheMissed = true;
+        return;
+    }
+
+    // The body's hash has already been checked, but the reader still won't go past the end of it
+    const unsigned char* body = _cacheFile.data + sizeof(GameCacheHeader);
+    CRReader reader(body, static_cast<unsigned int>(_cacheFile.length - sizeof(GameCacheHeader)), nullptr);
+
+    // Field numbers are handed out in the order the interpreter first sees each name, so they're only meaningful alongside the table they came from
+    unsigned int fieldCount = reader.ReadDword();
+    for (unsigned int i = 0; i < fieldCount && !reader.Failed(); i++) {
+        _cacheFieldMap.push_back(GM8Emulator::Compiler::RegisterField(reader.ReadString()));
+    }
+
+    unsigned int entryCount = reader.ReadDword();
+    for (unsigned int i = 0; i < entryCount && !reader.Failed(); i++) {
+        unsigned long long hash = reader.ReadDword();
+        hash |= static_cast<unsigned long long>(reader.ReadDword()) << 32;
+        CRCacheEntry entry;
+        entry.sourceLength = reader.ReadDword();
+        entry.question = reader.ReadByte() != 0;
+        entry.length = reader.ReadDword();
+        entry.data = body + reader.Position();
+        reader.Skip(entry.length);
+        if (!reader.Failed()) _cacheEntries[hash] = entry;
+    }
+
+    if (reader.Failed()) {
+        _cacheEntries.clear();
+        _cacheMissed = true;
+    }
+}
+
+bool CodeManager::SaveCache() {
+    // The entries point into the mapping, and Windows won't replace a file that's still mapped
+    _cacheEntries.clear();
+    FileUnmap(&_cacheFile);
+    if (_cachePath.empty() || !_cacheMissed) return true;
+    _cacheMissed = false;
+
+    GameCacheWriter writer;
+    if (!writer.Open(_cachePath.c_str())) return false;
+
+    // Written with this run's field table, which has everything the old cache had in it plus anything new
+    const std::vector<std::string>& fields = GM8Emulator::Compiler::GetFieldNames();
+    writer.WriteDword(static_cast<unsigned int>(fields.size()));
+    for (const std::string& field : fields) {
+        writer.WriteString(field.c_str());
+    }
+
+    // Lots of objects share the same few lines of code, those only need to be in here once
+    std::set<unsigned long long> written;
+    std::vector<unsigned long long> hashes;
+    for (const CRCodeObject& obj : _codeObjects) {
+        bool compiled = obj.state == CODE_COMPILED;
+        unsigned long long hash = compiled ? Hash64(obj._code, obj._length) : 0;
+        if (compiled && written.insert(hash).second) hashes.push_back(hash);
+        else hashes.push_back(0);
+    }
+    writer.WriteDword(static_cast<unsigned int>(written.size()));
+
+    CRWriter code;
+    for (size_t i = 0; i < _codeObjects.size(); i++) {
+        if (!hashes[i]) continue;
+        const CRCodeObject& obj = _codeObjects[i];
+        code.Clear();
+        if (obj.question) {
+            obj._expression.Write(&code);
+        }
+        else {
+            obj._actions.Write(&code);
+        }
+        writer.WriteDword(static_cast<unsigned int>(hashes[i] & 0xFFFFFFFF));
+        writer.WriteDword(static_cast<unsigned int>(hashes[i] >> 32));
+        writer.WriteDword(obj._length);
+        unsigned char question = obj.question ? 1 : 0;
+        writer.WriteBytes(&question, 1);
+        writer.WriteRecord(code.Data(), code.Length());
+    }
+
+    return writer.Finish(_cacheKey, 0);
+}
+
+// Finds the cache entry for a code object's source, or NULL if it isn't in the cache
+const CRCacheEntry* _FindCacheEntry(const CRCodeObject* obj) {
+    if (_cacheEntries.empty()) return NULL;
+    auto it = _cacheEntries.find(Hash64(obj->_code, obj->_length));
+    if (it == _cacheEntries.end()) return NULL;
+    const CRCacheEntry& entry = it->second;
+    if (entry.sourceLength != obj->_length || entry.question != obj->question) return NULL;
+    return &entry;
+}
+
+// Tries to fill in a code object from the cache instead of interpreting its source
+bool _CompileFromCache(CRCodeObject* obj) {
+    const CRCacheEntry* entry = _FindCacheEntry(obj);
+    if (!entry) return false;
+
+    CRReader reader(entry->data, entry->length, &_cacheFieldMap);
+    if (obj->question) {
+        if (reader.ReadExpression(&obj->_expression) && reader.AtEnd()) return true;
+        obj->_expression.Finalize();
+        obj->_expression = CRExpression();
+    }
+    else {
+        if (reader.ReadActionList(&obj->_actions) && reader.AtEnd()) return true;
+        obj->_actions.Finalize();
+        obj->_actions = CRActionList();
+    }
+    return false;
+}
+
+// Interprets a code object's tokens. Safe to call from several threads at once, as long as they're on different objects.
+bool _Interpret(CRCodeObject* obj, const GM8Emulator::Compiler::TokenList& tokens) {
+    _cacheMissed = true;
+
+    bool success;
     try {
-        if (_codeObjects[object].question) {
-            if (!GM8Emulator::Compiler::InterpretExpression(_codeObjects[object]._tokenized, &_codeObjects[object]._expression)) return false;
+        if (obj->question) {
+            success = GM8Emulator::Compiler::InterpretExpression(tokens, &obj->_expression);
         }
         else {
-            if (!GM8Emulator::Compiler::Interpret(_codeObjects[object]._tokenized, &_codeObjects[object]._actions)) return false;
+            success = GM8Emulator::Compiler::Interpret(tokens, &obj->_actions);
         }
-        GM8Emulator::Compiler::FlushLocals();
-        return true;
     }
     catch (const std::runtime_error&) {
+        success = false;
+    }
+    GM8Emulator::Compiler::FlushLocals();
+    obj->state.store(success ? CODE_COMPILED : CODE_FAILED, std::memory_order_release);
+    return success;
+}
+
+// Compiles a code object right now, from the cache if it's in there. The caller has to hold _compileMutex.
+bool _Compile(CRCodeObject* obj) {
+    if (_CompileFromCache(obj)) {
+        obj->state.store(CODE_COMPILED, std::memory_order_release);
+        return true;
+    }
+
+    // Code the cache was meant to have but couldn't read back wasn't tokenized yet
+    if (obj->_tokens.tokens.empty()) obj->_tokens = GM8Emulator::Compiler::TokenList(obj->_code, obj->_length);
+    bool success = _Interpret(obj, obj->_tokens);
+    obj->_tokens = GM8Emulator::Compiler::TokenList();
+    return success;
+}
+
+// Makes sure deferred code is compiled before it runs. Sets a runtime error if it doesn't compile.
+bool _EnsureCompiled(CRCodeObject* obj) {
+    unsigned char state = obj->state.load(std::memory_order_acquire);
+    if (state == CODE_DEFERRED) {
+        // The background compiler might still be handing out field numbers, or be half way through this one, in which case this waits for it
+        std::unique_lock<std::mutex> lock(_compileMutex);
+        _fieldsReady.wait(lock, [obj] { return obj->_fieldsRegistered || _allFieldsRegistered; });
+        if (obj->state.load(std::memory_order_acquire) == CODE_DEFERRED) _Compile(obj);
+        state = obj->state.load(std::memory_order_acquire);
+    }
+    if (state == CODE_FAILED) {
+        Runtime::SetReturnCause(Runtime::ReturnCause::ExitError);
+        Runtime::PushErrorMessage("Failed to compile code");
         return false;
     }
+    return true;
+}
+
+bool CodeManager::Compile(CodeObject object) {
+    CRCodeObject* obj = &_codeObjects[object];
+    if (obj->state == CODE_NOT_COMPILED) obj->state = CODE_DEFERRED;
+    return true;
+}
+
+// Runs fn(i) for every i below count, spread over threadCount threads including this one. 0 means one per hardware thread.
+template <typename F>
+void _ParallelFor(size_t count, unsigned int threadCount, const F& fn) {
+    if (threadCount == 0) threadCount = std::thread::hardware_concurrency();
+    if (threadCount == 0) threadCount = 1;
+    if (threadCount > count) threadCount = static_cast<unsigned int>(count);
+
+    std::atomic<size_t> next(0);
+    auto work = [&]() {
+        for (size_t i = next++; i < count; i = next++) {
+            fn(i);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < threadCount; i++) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
 }
 
+// Lists the code objects that are waiting to be compiled, in the order they were registered
+std::vector<CRCodeObject*> _DeferredObjects() {
+    std::vector<CRCodeObject*> objects;
+    for (CRCodeObject& obj : _codeObjects) {
+        if (obj.state == CODE_DEFERRED) objects.push_back(&obj);
+    }
+    return objects;
+}
+
+// Tokenizes everything in objects that the cache doesn't have, across threads. The tokens stay on each object for _RegisterFields and then _Compile.
+// Nothing compiles an object before its fields are registered, so this doesn't need _compileMutex as long as they aren't registered yet.
+void _TokenizeForFields(const std::vector<CRCodeObject*>& objects, unsigned int threadCount) {
+    _ParallelFor(objects.size(), threadCount, [&](size_t i) {
+        if (!_FindCacheEntry(objects[i])) objects[i]->_tokens = GM8Emulator::Compiler::TokenList(objects[i]->_code, objects[i]->_length);
+    });
+}
+
+// Adds the code of every script and object that the code in objects mentions by name, then the code that code mentions, and so on, tokenizing
+// all of it. Code run at the start calls scripts and makes instances of other objects, which would otherwise wait for the whole game to be tokenized.
+// Code that's in the cache doesn't get tokenized, so nothing's added for what it mentions, but there's nothing to wait for when the cache is there.
+void _AddReferencedCode(std::vector<CRCodeObject*>* objects, std::vector<bool>* listed, unsigned int threadCount) {
+    std::unordered_map<std::string_view, std::vector<CodeObject>> named;
+    for (unsigned int i = 0; i < AssetManager::GetScriptCount(); i++) {
+        const Script* script = AssetManager::GetScript(i);
+        if (script->exists && script->name) named[script->name].push_back(script->codeObj);
+    }
+    for (unsigned int i = 0; i < AssetManager::GetObjectCount(); i++) {
+        const Object* o = AssetManager::GetObject(i);
+        if (!o->exists || !o->name) continue;
+        for (unsigned int identity : o->identities) {
+            CodeActionManager::GetCodeObjects(AssetManager::GetObject(identity), &named[o->name]);
+        }
+    }
+
+    size_t tokenized = 0;
+    while (tokenized < objects->size()) {
+        size_t end = objects->size();
+        _TokenizeForFields(std::vector<CRCodeObject*>(objects->begin() + tokenized, objects->end()), threadCount);
+        for (size_t i = tokenized; i < end; i++) {
+            for (const GM8Emulator::Compiler::Token& token : (*objects)[i]->_tokens.tokens) {
+                if (token.type != GM8Emulator::Compiler::Token::token_type::Identifier) continue;
+                auto found = named.find(token.value.str);
+                if (found == named.end()) continue;
+                for (CodeObject code : found->second) {
+                    if (code >= _codeObjects.size() || (*listed)[code] || _codeObjects[code].state != CODE_DEFERRED) continue;
+                    (*listed)[code] = true;
+                    objects->push_back(&_codeObjects[code]);
+                }
+                named.erase(found);  // Everything it has is listed now
+            }
+        }
+        tokenized = end;
+    }
+}
+
+// Registers the identifiers in each object's tokens, one object at a time. After this, every field any of this code uses has a number,
+// and which number it got only depends on the code and the order it's in here, not on how threads were scheduled. The caller has to hold _compileMutex.
+void _RegisterFields(const std::vector<CRCodeObject*>& objects) {
+    for (CRCodeObject* obj : objects) {
+        GM8Emulator::Compiler::RegisterIdentifiers(obj->_tokens);
+        obj->_fieldsRegistered = true;
+    }
+}
+
+bool CodeManager::CompileAll(unsigned int threadCount) {
+    std::lock_guard<std::mutex> lock(_compileMutex);
+    std::vector<CRCodeObject*> objects = _DeferredObjects();
+    _TokenizeForFields(objects, threadCount);
+    _RegisterFields(objects);
+    _allFieldsRegistered = true;
+
+    std::atomic<bool> success(true);
+    _ParallelFor(objects.size(), threadCount, [&](size_t i) {
+        if (!_Compile(objects[i])) success = false;
+    });
+    return success;
+}
+
+// Lets the game's own threads have the CPU first
+void _LowerThreadPriority() {
+#ifdef _WIN32
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+#elif defined(__linux__)
+    // Linux keeps a nice value per thread
+    setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 10);
+#endif
+}
+
+void _BackgroundCompile(const std::vector<CodeObject>& order, unsigned int threadCount) {
+    // Field numbers still have to come out the same however the game's code ends up getting compiled, so they're handed out before anything
+    // compiles, in a fixed order: the code that was asked for first and whatever it mentions, then everything else in the order it was registered.
+    // The game waits for the first lot before it runs anything, so that happens before the thread lowers its priority, and the rest happens while the game runs.
+    std::vector<CRCodeObject*> first;
+    std::vector<CRCodeObject*> rest;
+    {
+        std::lock_guard<std::mutex> lock(_compileMutex);
+        std::vector<bool> isFirst(_codeObjects.size(), false);
+        for (CodeObject object : order) {
+            if (object >= _codeObjects.size() || isFirst[object] || _codeObjects[object].state != CODE_DEFERRED) continue;
+            isFirst[object] = true;
+            first.push_back(&_codeObjects[object]);
+        }
+        _AddReferencedCode(&first, &isFirst, threadCount);
+        for (CodeObject object = 0; object < _codeObjects.size(); object++) {
+            if (!isFirst[object] && _codeObjects[object].state == CODE_DEFERRED) rest.push_back(&_codeObjects[object]);
+        }
+        _RegisterFields(first);
+    }
+    _fieldsReady.notify_all();
+    _LowerThreadPriority();
+
+    // Code that isn't in the first lot waits in _EnsureCompiled until this is done, but the lock is only held for the registering,
+    // so the first room's code can still compile while the rest is tokenized
+    if (_stopCompiling) return;
+    _TokenizeForFields(rest, threadCount);
+    {
+        std::lock_guard<std::mutex> lock(_compileMutex);
+        _RegisterFields(rest);
+        _allFieldsRegistered = true;
+    }
+    _fieldsReady.notify_all();
+
+    // Compiled in the same order, the first lot and then everything else
+    first.insert(first.end(), rest.begin(), rest.end());
+    for (CRCodeObject* obj : first) {
+        if (_stopCompiling) return;
+        if (obj->state.load(std::memory_order_acquire) != CODE_DEFERRED) continue;
+
+        // Locked one object at a time, so code that's needed right now never waits long
+        std::lock_guard<std::mutex> lock(_compileMutex);
+        if (obj->state.load(std::memory_order_acquire) == CODE_DEFERRED) _Compile(obj);
+    }
+
+    // Everything's compiled now, so the cache can be written out with all of it
+    std::lock_guard<std::mutex> lock(_compileMutex);
+    CodeManager::SaveCache();
+}
+
+void CodeManager::StartBackgroundCompile(const std::vector<CodeObject>& first, unsigned int threadCount) { _compileThread = std::thread(_BackgroundCompile, first, threadCount); }
+
 bool CodeManager::Run(CodeObject code, InstanceHandle self, InstanceHandle other, int ev, int sub, unsigned int asObjId, unsigned int argc, GMLType* argv) {
+    if (!_EnsureCompiled(&_codeObjects[code])) return false;
     return Runtime::Execute(_codeObjects[code]._actions, self, other, ev, sub, asObjId, argc, argv);
 }
 
 bool CodeManager::Query(CodeObject code, InstanceHandle self, InstanceHandle other, int ev, int sub, unsigned int asObjId, bool* response, unsigned int argc, GMLType* argv) {
+    if (!_EnsureCompiled(&_codeObjects[code])) return false;
     GMLType t;
     if (!Runtime::EvalExpression(_codeObjects[code]._expression, self, other, ev, sub, asObjId, &t, argc, argv)) return false;
     (*response) = Runtime::_isTrue(&t);
@@ -91,6 +490,7 @@ bool CodeManager::Query(CodeObject code, InstanceHandle self, InstanceHandle oth
 }
 
 bool CodeManager::Query(CodeObject code, InstanceHandle self, InstanceHandle other, int ev, int sub, unsigned int asObjId, GMLType* response) {
+    if (!_EnsureCompiled(&_codeObjects[code])) return false;
     GMLType t;
     if (!Runtime::EvalExpression(_codeObjects[code]._expression, self, other, ev, sub, asObjId, &t)) return false;
     (*response) = t;
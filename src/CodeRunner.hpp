@@ -1,5 +1,7 @@
 #pragma once
 
+#include <vector>
+
 struct GlobalValues;
 struct GMLType;
 enum struct GMLTypeState;
@@ -17,16 +19,37 @@ namespace CodeManager {
     // Set a specific room order. Usually done after loading the room order from the exe.
     void SetRoomOrder(unsigned int** order, unsigned int count);
 
+    // Forgets every code object registered so far, for starting a load over after it failed part way. Only safe before anything's been compiled.
+    void ClearRegistered();
+
     // Register a code block to be compiled. Returns a unique reference to that code action to be later Compile()d and Run().
     CodeObject Register(const char* code, unsigned int length);
 
     // Register a code expression to be compiled. Returns a unique reference to that code action to be later Compile()d and Query()d.
     CodeObject RegisterQuestion(const char* code, unsigned int length);
 
-    // Compile a code object that has been returned by Register(). Returns true on success, false on error (ie. game should close.)
-    // Be sure to call this only after the AssetManager is fully loaded.
+    // Queue a code object that has been returned by Register() for compiling. It then gets compiled by CompileAll(), or when it's first run.
+    // Be sure to call this only after the AssetManager is fully loaded. This can't fail, compile errors come from CompileAll() or from running the code.
     bool Compile(CodeObject object);
 
+    // Compile everything Compile() has queued, spread over threadCount threads (0 for one per hardware thread). Returns false if any of it failed to compile.
+    // Every field's number is decided before anything compiles, so they come out the same however the threads get scheduled.
+    bool CompileAll(unsigned int threadCount = 0);
+
+    // Instead of CompileAll(), compile code as it's first run, and start a low priority thread that compiles everything else Compile() has queued,
+    // beginning with the code objects in first. Compile errors come out as runtime errors when the code runs.
+    // The background thread hands out field numbers before compiling, using threadCount threads, in an order that only depends on the game's code:
+    // first's, which code run at the start waits for, then the rest, which code outside first waits for.
+    // The background thread writes the compiled code cache when it's done, so don't call SaveCache() as well.
+    void StartBackgroundCompile(const std::vector<CodeObject>& first, unsigned int threadCount = 0);
+
+    // Opens the compiled code cache at path, if there's one that was made from the same exe. Call this before compiling anything.
+    // After that, Compile() takes code from the cache when it has an entry for the exact same source, and only interprets what it doesn't.
+    void LoadCache(const char* path, unsigned int exeLength, unsigned long long exeHash);
+
+    // Closes the cache, first rewriting it if anything had to be compiled from source. Returns false if the new cache couldn't be written.
+    bool SaveCache();
+
     // Run a compiled code object. Returns true on success, false on error (ie. the game should close.)
     // Most be passed the instance ID of the "self" and "other" instances in this context. (both may be NULL)
     // ev and sub indicate the event that's being run. For more info, check the "COMPILED OBJECT EVENTS" section of notes.txt
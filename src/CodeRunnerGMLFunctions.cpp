@@ -5,6 +5,7 @@
 #include "Collision.hpp"
 #include "Compiler/CRRuntime.hpp"
 #include "Constants.hpp"
+#include "Game.hpp"
 #include "GlobalValues.hpp"
 #include "InputHandler.hpp"
 #include "Instance.hpp"
@@ -12,10 +13,16 @@
 #include "RNG.hpp"
 #include "Renderer.hpp"
 
+#include <algorithm>
 #include <fstream>
 #include <math.h>
 #include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 // Private vars
 namespace Runtime {
@@ -26,6 +33,57 @@ namespace Runtime {
     int _drawHalign = 0;
     double _drawAlpha = 1.0;
 
+    // Text measured by string_width and string_height and laid out by draw_text. HUDs draw the same strings every frame, so each (font, string)
+    // gets its size worked out once, and each (font, string, alignment) that gets drawn gets its glyphs worked out once, and they're reused after that.
+    // Size doesn't depend on alignment, so measuring never builds glyphs. Glyph positions are relative to the rounded x and y it's drawn at.
+    // Fonts don't change once the game's loaded, so neither cache goes stale. If font_add and friends ever get implemented, they'll need to empty them.
+    struct _TextSize {
+        unsigned int width;  // What string_width returns
+        unsigned int height;  // What string_height returns
+        unsigned int tallest;  // Tallest glyph, which is also how far apart lines are
+        unsigned int lines;
+    };
+    struct _TextSizeKey {
+        unsigned int font;
+        std::string text;
+        bool operator==(const _TextSizeKey& other) const { return font == other.font && text == other.text; }
+    };
+    struct _TextSizeKeyHash {
+        size_t operator()(const _TextSizeKey& key) const { return std::hash<std::string>()(key.text) ^ (( size_t )key.font << 4); }
+    };
+    std::unordered_map<_TextSizeKey, _TextSize, _TextSizeKeyHash> _textSizes;
+    _TextSizeKey _textSizeLookup;  // Reused for lookups so the string's buffer is too
+
+    struct _GlyphQuad {
+        int x;
+        int y;
+        unsigned int partX;
+        unsigned int partY;
+        unsigned int partW;
+        unsigned int partH;
+    };
+    struct _GlyphRunKey {
+        unsigned int font;
+        int halign;
+        int valign;
+        std::string text;
+        bool operator==(const _GlyphRunKey& other) const { return font == other.font && halign == other.halign && valign == other.valign && text == other.text; }
+    };
+    struct _GlyphRunKeyHash {
+        size_t operator()(const _GlyphRunKey& key) const { return std::hash<std::string>()(key.text) ^ ((( size_t )key.font << 4) | (( size_t )(key.halign & 3) << 2) | (key.valign & 3)); }
+    };
+    std::unordered_map<_GlyphRunKey, std::vector<_GlyphQuad>, _GlyphRunKeyHash> _glyphRuns;
+    _GlyphRunKey _glyphRunLookup;
+
+    // A number that changes every frame makes a new entry every frame, so each cache just gets emptied when it's this full
+    constexpr size_t TEXT_CACHE_LIMIT = 4096;
+
+    // Gets the size of a string in the current font, measuring it if it isn't cached
+    _TextSize _GetTextSize(Font* font, const char* str);
+
+    // Gets the glyphs for a string in the current font and alignment, laying it out if it isn't cached
+    const std::vector<_GlyphQuad>& _GetGlyphRun(Font* font, const char* str);
+
     // User files
     std::fstream _userFiles[32];
 
@@ -90,6 +148,67 @@ bool Runtime::arctan(unsigned int argc, GMLType* argv, GMLType* out) {
     return true;
 }
 
+bool Runtime::background_create_color(unsigned int argc, GMLType* argv, GMLType* out) {
+    if (!_assertArgs(argc, argv, 3, true, GMLTypeState::Double, GMLTypeState::Double, GMLTypeState::Double)) return false;
+    int w = _round(argv[0].dVal);
+    int h = _round(argv[1].dVal);
+    if (w <= 0 || h <= 0) {
+        Runtime::SetReturnCause(ReturnCause::ExitError);
+        Runtime::PushErrorMessage("Invalid size passed to background_create_color");
+        return false;
+    }
+
+    // GML colours are 0xBBGGRR, and the renderer wants RGBA bytes
+    unsigned int col = static_cast<unsigned int>(_round(argv[2].dVal));
+    size_t pixelCount = ( size_t )w * h;
+    unsigned char* pixels = ( unsigned char* )malloc(pixelCount * 4);
+    if (!pixels) {
+        Runtime::SetReturnCause(ReturnCause::ExitError);
+        Runtime::PushErrorMessage("Out of memory in background_create_color");
+        return false;
+    }
+    for (size_t i = 0; i < pixelCount; i++) {
+        pixels[i * 4] = col & 0xFF;
+        pixels[i * 4 + 1] = (col >> 8) & 0xFF;
+        pixels[i * 4 + 2] = (col >> 16) & 0xFF;
+        pixels[i * 4 + 3] = 0xFF;
+    }
+
+    // Named the way GM8 names them, since looking backgrounds up by name expects every one to have one
+    unsigned int index = AssetManager::GetBackgroundCount();
+    std::string name = "__newbackground" + std::to_string(index);
+    Background* bg = AssetManager::AddBackground();
+    bg->name = ( char* )malloc(name.size() + 1);
+    memcpy(bg->name, name.c_str(), name.size() + 1);
+    bg->width = w;
+    bg->height = h;
+    bg->image = RMakeImage(w, h, 0, 0, pixels);
+    free(pixels);
+
+    if (out) {
+        out->state = GMLTypeState::Double;
+        out->dVal = index;
+    }
+    return true;
+}
+
+bool Runtime::background_delete(unsigned int argc, GMLType* argv, GMLType* out) {
+    if (!_assertArgs(argc, argv, 1, true, GMLTypeState::Double)) return false;
+    int index = _round(argv[0].dVal);
+    if (index < 0 || index >= static_cast<int>(AssetManager::GetBackgroundCount()) || !AssetManager::GetBackground(index)->exists) {
+        Runtime::SetReturnCause(ReturnCause::ExitError);
+        Runtime::PushErrorMessage("Non-existent background passed to background_delete");
+        return false;
+    }
+
+    // Its space in the atlas gets reused once the frames that might still draw it are done. If it's still waiting to be streamed in,
+    // its pixels get dropped when they turn up.
+    Background* bg = AssetManager::GetBackground(index);
+    bg->exists = false;
+    if (bg->width > 0 && bg->height > 0) RFreeImage(bg->image);
+    return true;
+}
+
 bool Runtime::ceil(unsigned int argc, GMLType* argv, GMLType* out) {
     if (!_assertArgs(argc, argv, 1, true, GMLTypeState::Double)) return false;
     if (out) {
@@ -219,6 +338,7 @@ bool Runtime::draw_self(unsigned int argc, GMLType* argv, GMLType* out) {
     if (self.sprite_index < 0) return true;
     Sprite* spr = AssetManager::GetSprite(self.sprite_index);
     if (spr->exists) {
+        GameWaitForSprite(self.sprite_index);
         RDrawImage(spr->frames[static_cast<int>(self.image_index) % spr->frameCount], self.x, self.y, self.image_xscale, self.image_yscale, self.image_angle, self.image_blend, self.image_alpha);
     }
     return true;
@@ -260,6 +380,7 @@ bool Runtime::draw_sprite(unsigned int argc, GMLType* argv, GMLType* out) {
     Instance& self = InstanceList::GetInstance(GetContext().self);
     int frame = _round(argv[1].dVal);
     if (frame < 0) frame = static_cast<int>(::floor(self.image_index));
+    GameWaitForSprite(_round(argv[0].dVal));
     RDrawImage(spr->frames[frame % spr->frameCount], argv[2].dVal, argv[3].dVal, 1.0, 1.0, 0.0, 0xFFFFFFFF, 1.0);
     return true;
 }
@@ -272,6 +393,7 @@ bool Runtime::draw_sprite_ext(unsigned int argc, GMLType* argv, GMLType* out) {
     Instance& self = InstanceList::GetInstance(GetContext().self);
     int frame = _round(argv[1].dVal);
     if (frame < 0) frame = static_cast<int>(::floor(self.image_index));
+    GameWaitForSprite(_round(argv[0].dVal));
     RDrawImage(spr->frames[frame % spr->frameCount], argv[2].dVal, argv[3].dVal, argv[4].dVal, argv[5].dVal, argv[6].dVal, _round(argv[7].dVal), argv[8].dVal);
     return true;
 }
@@ -279,87 +401,122 @@ bool Runtime::draw_sprite_ext(unsigned int argc, GMLType* argv, GMLType* out) {
 bool Runtime::draw_text(unsigned int argc, GMLType* argv, GMLType* out) {
     if (argc != 3) return false;
     const char* str = argv[2].sVal.c_str();
-    std::string st;
+    char number[512];
     if (argv[2].state == GMLTypeState::Double) {
-        std::stringstream ss;
-        ss.precision(_round(argv[2].dVal) == argv[2].dVal ? 0 : 2);
-        ss << std::fixed << argv[2].dVal;
-        st = ss.str();
-        str = st.c_str();
+        // Same as formatting it with std::fixed, without making a stream every time
+        snprintf(number, sizeof(number), "%.*f", _round(argv[2].dVal) == argv[2].dVal ? 0 : 2, argv[2].dVal);
+        str = number;
     }
 
     Font* font = AssetManager::GetFont(_drawFont);
     if (font && font->exists) {
-        int cursorX = _round(argv[0].dVal);
-        int cursorY = _round(argv[1].dVal);
-
-        unsigned tallest = 0;
-        for (const char* pC = str; (*pC) != '\0'; pC++) {
-            const char c = *pC;
-            if (c == '#' && (pC == str || *(pC - 1) != '\\')) continue;
-            unsigned int h = font->dmap[(c * 6) + 3];
-            if (h > tallest) tallest = h;
+        int x = _round(argv[0].dVal);
+        int y = _round(argv[1].dVal);
+        for (const _GlyphQuad& glyph : _GetGlyphRun(font, str)) {
+            RDrawPartialImage(font->image, x + glyph.x, y + glyph.y, 1, 1, 0.0, _drawColour, _drawAlpha, glyph.partX, glyph.partY, glyph.partW, glyph.partH);
         }
+    }
+    else {
+        // Should use the default font here
+    }
 
-        if (_drawValign == 1 || _drawValign == 2) {
-            unsigned int lineCount = 1;
-            for (const char* pC = str; (*pC) != '\0'; pC++) {
-                const char c = *pC;
-                if (c == '#' && (pC == str || *(pC - 1) != '\\')) {
-                    lineCount++;
-                }
-            }
-            lineCount = lineCount * tallest;
-            if (_drawValign == 1) lineCount /= 2;
-            cursorY -= lineCount;
-        }
+    return true;
+}
 
-        bool recalcX = true;
-        for (const char* pC = str; (*pC) != '\0'; pC++) {
-            const char c = *pC;
-            if (c == '#' && (pC == str || *(pC - 1) != '\\')) {
-                recalcX = true;
-                cursorY += tallest;
-                continue;
-            }
-            else if (c == '\\' && *(pC + 1) == '#') {
-                continue;
-            }
+Runtime::_TextSize Runtime::_GetTextSize(Font* font, const char* str) {
+    _textSizeLookup.font = _drawFont;
+    _textSizeLookup.text = str;
+    auto found = _textSizes.find(_textSizeLookup);
+    if (found != _textSizes.end()) return found->second;
 
-            if (recalcX) {
-                cursorX = _round(argv[0].dVal);
-                if (_drawHalign == 1 || _drawHalign == 2) {
-                    unsigned int lineWidth = 0;
-                    for (const char* tC = pC; (*tC) != '\0'; tC++) {
-                        if ((*tC) == '#' && (tC == str || *(tC - 1) != '\\')) break;
-                        if ((*tC) == '\\' && *(tC + 1) == '#') continue;
-                        lineWidth += font->dmap[((*tC) * 6) + 4];
-                    }
-                    if (_drawHalign == 1) lineWidth /= 2;
-                    cursorX -= lineWidth;
+    // The way string_width and string_height have always worked it out
+    unsigned int tallest = 0, lines = 1, longestLine = 1, curLength = 0;
+    for (const char* pC = str; (*pC) != '\0'; pC++) {
+        const char c = *pC;
+        if (c == '#' && (pC == str || *(pC - 1) != '\\')) {
+            lines++;
+            if (curLength > longestLine) longestLine = curLength;
+            curLength = 0;
+            continue;
+        }
+        unsigned int h = font->dmap[(c * 6) + 3];
+        if (h > tallest) tallest = h;
+        curLength += font->dmap[(c * 6) + 4];
+    }
+    if (curLength > longestLine) longestLine = curLength;
+
+    if (_textSizes.size() >= TEXT_CACHE_LIMIT) _textSizes.clear();
+    _TextSize& size = _textSizes[_textSizeLookup];
+    size.width = longestLine;
+    size.height = std::max(tallest, 1u) * lines;
+    size.tallest = tallest;
+    size.lines = lines;
+    return size;
+}
+
+const std::vector<Runtime::_GlyphQuad>& Runtime::_GetGlyphRun(Font* font, const char* str) {
+    _glyphRunLookup.font = _drawFont;
+    _glyphRunLookup.halign = _drawHalign;
+    _glyphRunLookup.valign = _drawValign;
+    _glyphRunLookup.text = str;
+    auto found = _glyphRuns.find(_glyphRunLookup);
+    if (found != _glyphRuns.end()) return found->second;
+
+    _TextSize size = _GetTextSize(font, str);
+    unsigned int tallest = size.tallest;
+    if (_glyphRuns.size() >= TEXT_CACHE_LIMIT) _glyphRuns.clear();
+    std::vector<_GlyphQuad>& run = _glyphRuns[_glyphRunLookup];
+
+    // The way draw_text places them. "\#" is a literal #, anything else with # starts a new line.
+    int cursorX = 0;
+    int cursorY = 0;
+    if (_drawValign == 1 || _drawValign == 2) {
+        unsigned int lineHeight = size.lines * tallest;
+        if (_drawValign == 1) lineHeight /= 2;
+        cursorY -= lineHeight;
+    }
+
+    bool recalcX = true;
+    for (const char* pC = str; (*pC) != '\0'; pC++) {
+        const char c = *pC;
+        if (c == '#' && (pC == str || *(pC - 1) != '\\')) {
+            recalcX = true;
+            cursorY += tallest;
+            continue;
+        }
+        else if (c == '\\' && *(pC + 1) == '#') {
+            continue;
+        }
+
+        if (recalcX) {
+            cursorX = 0;
+            if (_drawHalign == 1 || _drawHalign == 2) {
+                unsigned int lineWidth = 0;
+                for (const char* tC = pC; (*tC) != '\0'; tC++) {
+                    if ((*tC) == '#' && (tC == str || *(tC - 1) != '\\')) break;
+                    if ((*tC) == '\\' && *(tC + 1) == '#') continue;
+                    lineWidth += font->dmap[((*tC) * 6) + 4];
                 }
-                recalcX = false;
+                if (_drawHalign == 1) lineWidth /= 2;
+                cursorX -= lineWidth;
             }
+            recalcX = false;
+        }
 
-            if (font->rangeBegin <= static_cast<unsigned int>(c) && font->rangeEnd >= static_cast<unsigned int>(c)) {
-                unsigned int* dmapPos = font->dmap + (c * 6);
-                unsigned int cX = *(dmapPos);
-                unsigned int cY = *(dmapPos + 1);
-                unsigned int cW = *(dmapPos + 2);
-                unsigned int cH = *(dmapPos + 3);
-                unsigned int cCW = *(dmapPos + 4);
-                unsigned int cCO = *(dmapPos + 5);
-
-                RDrawPartialImage(font->image, cursorX + static_cast<int>(cCO), cursorY, 1, 1, 0.0, _drawColour, _drawAlpha, cX, cY, cW, cH);
-                cursorX += cCW;
-            }
+        if (font->rangeBegin <= static_cast<unsigned int>(c) && font->rangeEnd >= static_cast<unsigned int>(c)) {
+            unsigned int* dmapPos = font->dmap + (c * 6);
+            _GlyphQuad glyph;
+            glyph.x = cursorX + static_cast<int>(*(dmapPos + 5));
+            glyph.y = cursorY;
+            glyph.partX = *(dmapPos);
+            glyph.partY = *(dmapPos + 1);
+            glyph.partW = *(dmapPos + 2);
+            glyph.partH = *(dmapPos + 3);
+            run.push_back(glyph);
+            cursorX += *(dmapPos + 4);
         }
     }
-    else {
-        // Should use the default font here
-    }
-
-    return true;
+    return run;
 }
 
 bool Runtime::event_inherited(unsigned int argc, GMLType* argv, GMLType* out) {
@@ -1418,20 +1575,7 @@ bool Runtime::string_width(unsigned int argc, GMLType* argv, GMLType* out) {
             return true;
         }
 
-        unsigned int longestLine = 1;
-        unsigned int curLength = 0;
-        for (const char* pC = argv[0].sVal.c_str(); (*pC) != '\0'; pC++) {
-            const char c = *pC;
-            if (c == '#' && (pC == argv[0].sVal || *(pC - 1) != '\\')) {
-                if (curLength > longestLine) longestLine = curLength;
-                curLength = 0;
-                continue;
-            }
-            curLength += font->dmap[(c * 6) + 4];
-        }
-
-        if (curLength > longestLine) longestLine = curLength;
-        out->dVal = longestLine;
+        out->dVal = _GetTextSize(font, argv[0].sVal.c_str()).width;
     }
     return true;
 }
@@ -1452,19 +1596,7 @@ bool Runtime::string_height(unsigned int argc, GMLType* argv, GMLType* out) {
             return true;
         }
 
-        unsigned tallest = 1;
-        unsigned int lines = 1;
-        for (const char* pC = argv[0].sVal.c_str(); (*pC) != '\0'; pC++) {
-            const char c = *pC;
-            if (c == '#' && (pC == argv[0].sVal || *(pC - 1) != '\\')) {
-                lines++;
-                continue;
-            }
-            unsigned int h = font->dmap[(c * 6) + 3];
-            if (h > tallest) tallest = h;
-        }
-
-        out->dVal = tallest * lines;
+        out->dVal = _GetTextSize(font, argv[0].sVal.c_str()).height;
     }
     return true;
 }
@@ -1,5 +1,6 @@
 #include "AssetManager.hpp"
 #include "Collision.hpp"
+#include "Game.hpp"
 #include "Instance.hpp"
 #include "InstanceList.hpp"
 #include <cmath>
@@ -37,6 +38,7 @@ void RefreshInstanceBbox(Instance* i) {
         }
         else {
             Sprite* s = AssetManager::GetSprite(spriteIndex);
+            GameWaitForSprite(spriteIndex);  // Collision boxes can still be decoding with progressive loading
             CollisionMap* map = (s->separateCollision ? (s->collisionMaps + (( int )(i->image_index) % s->frameCount)) : s->collisionMaps);
 
             double tlX = (i->x - (s->originX * i->image_xscale)) + (static_cast<int>(map->left) * i->image_xscale);
@@ -107,12 +109,14 @@ bool CollisionCheck(Instance* i1, Instance* i2) {
     if(spriteIndex < 0) return false;
     Sprite* spr1 = AssetManager::GetSprite(spriteIndex);
     if(!spr1->exists) return false;
+    GameWaitForSprite(spriteIndex);  // Collision masks can still be decoding with progressive loading
     CollisionMap* map1 = (spr1->separateCollision ? (spr1->collisionMaps + (static_cast<int>(i1->image_index) % spr1->frameCount)) : spr1->collisionMaps);
     spriteIndex = i2->mask_index;
     if (spriteIndex == -1) spriteIndex = i2->sprite_index;
     if (spriteIndex < 0) return false;
     Sprite* spr2 = AssetManager::GetSprite(spriteIndex);
     if(!spr2->exists) return false;
+    GameWaitForSprite(spriteIndex);  // Collision masks can still be decoding with progressive loading
     CollisionMap* map2 = (spr2->separateCollision ? (spr2->collisionMaps + (static_cast<int>(i2->image_index) % spr2->frameCount)) : spr2->collisionMaps);
 
     int x1 = dRound(i1->x);
@@ -171,6 +175,7 @@ bool CollisionPointCheck(Instance* i1, int x, int y) {
     if (spriteIndex < 0) return false;
     Sprite* spr1 = AssetManager::GetSprite(spriteIndex);
     if (!spr1->exists) return false;
+    GameWaitForSprite(spriteIndex);  // Collision masks can still be decoding with progressive loading
     CollisionMap* map1 = (spr1->separateCollision ? (spr1->collisionMaps + (static_cast<int>(i1->image_index) % spr1->frameCount)) : spr1->collisionMaps);
     double a1 = i1->image_angle * PI / 180.0;
     double s1 = sin(a1);
@@ -207,6 +212,7 @@ bool CollisionRectangleCheck(Instance* i1, int x1, int y1, int x2, int y2, bool
     if (spriteIndex < 0) return false;
     Sprite* spr1 = AssetManager::GetSprite(spriteIndex);
     if (!spr1->exists) return false;
+    GameWaitForSprite(spriteIndex);  // Collision masks can still be decoding with progressive loading
     CollisionMap* map1 = (spr1->separateCollision ? (spr1->collisionMaps + (static_cast<int>(i1->image_index) % spr1->frameCount)) : spr1->collisionMaps);
     double a1 = i1->image_angle * PI / 180.0;
     double s1 = sin(a1);
@@ -59,6 +59,8 @@ namespace Runtime {
     bool arcsin(unsigned int argc, GMLType* argv, GMLType* out);
     bool arccos(unsigned int argc, GMLType* argv, GMLType* out);
     bool arctan(unsigned int argc, GMLType* argv, GMLType* out);
+    bool background_create_color(unsigned int argc, GMLType* argv, GMLType* out);
+    bool background_delete(unsigned int argc, GMLType* argv, GMLType* out);
     bool ceil(unsigned int argc, GMLType* argv, GMLType* out);
     bool choose(unsigned int argc, GMLType* argv, GMLType* out);
     bool collision_rectangle(unsigned int argc, GMLType* argv, GMLType* out);
@@ -0,0 +1,696 @@
+#include "CRSerialize.hpp"
+#include "Compiled.hpp"
+#include <string.h>
+
+// Tags written before each action and expression value so the reader knows which constructor to call.
+// These are stored in cache files, so only ever add to the end of these lists.
+enum CRActionTag : unsigned char {
+    TAG_ACTION_NULL,
+    TAG_BIND_VARS,
+    TAG_ASSIGNMENT_FIELD,
+    TAG_ASSIGNMENT_ARRAY,
+    TAG_ASSIGNMENT_INSTANCE_VAR,
+    TAG_ASSIGNMENT_GAME_VAR,
+    TAG_BLOCK,
+    TAG_RUN_FUNCTION,
+    TAG_RUN_SCRIPT,
+    TAG_IF_ELSE,
+    TAG_WITH,
+    TAG_REPEAT,
+    TAG_WHILE,
+    TAG_FOR,
+    TAG_DO_UNTIL,
+    TAG_SWITCH,
+    TAG_BREAK,
+    TAG_CONTINUE,
+    TAG_EXIT,
+    TAG_RETURN,
+};
+
+enum CRExpressionTag : unsigned char {
+    TAG_LITERAL,
+    TAG_FUNCTION,
+    TAG_SCRIPT,
+    TAG_NESTED_EXPRESSION,
+    TAG_FIELD,
+    TAG_ARRAY,
+    TAG_INSTANCE_VAR,
+    TAG_GAME_VAR,
+};
+
+
+// Writer
+
+void CRWriter::WriteDword(unsigned int value) {
+    _data.push_back(value & 0xFF);
+    _data.push_back((value >> 8) & 0xFF);
+    _data.push_back((value >> 16) & 0xFF);
+    _data.push_back(value >> 24);
+}
+
+void CRWriter::WriteDouble(double value) {
+    unsigned char bytes[sizeof(double)];
+    memcpy(bytes, &value, sizeof(double));
+    _data.insert(_data.end(), bytes, bytes + sizeof(double));
+}
+
+void CRWriter::WriteString(const std::string& value) {
+    WriteDword(static_cast<unsigned int>(value.size()));
+    _data.insert(_data.end(), value.begin(), value.end());
+}
+
+void CRWriter::WriteValue(const GMLType& value) {
+    if (value.state == GMLTypeState::String) {
+        WriteByte(1);
+        WriteString(value.sVal);
+    }
+    else {
+        WriteByte(0);
+        WriteDouble(value.dVal);
+    }
+}
+
+void CRWriter::WriteAction(const CRAction* action) {
+    if (action) {
+        action->Write(this);
+    }
+    else {
+        WriteByte(TAG_ACTION_NULL);
+    }
+}
+
+void _WriteExpressions(CRWriter* out, const std::vector<CRExpression>& expressions) {
+    out->WriteDword(static_cast<unsigned int>(expressions.size()));
+    for (const CRExpression& exp : expressions) {
+        exp.Write(out);
+    }
+}
+
+void CRActionList::Write(CRWriter* out) const {
+    out->WriteDword(static_cast<unsigned int>(_actions.size()));
+    for (const CRAction* action : _actions) {
+        action->Write(out);
+    }
+}
+
+void CRExpression::Write(CRWriter* out) const {
+    out->WriteDword(static_cast<unsigned int>(_values.size()));
+    for (const CRExpressionValue* value : _values) {
+        value->Write(out);
+    }
+}
+
+void CRExpressionValue::_WriteOperators(CRWriter* out) const {
+    out->WriteDword(_operator);
+    out->WriteDword(static_cast<unsigned int>(_unary.size()));
+    for (CRUnaryOperator op : _unary) {
+        out->WriteDword(op);
+    }
+}
+
+void CRActionBindVars::Write(CRWriter* out) const { out->WriteByte(TAG_BIND_VARS); }
+
+void CRActionAssignmentField::Write(CRWriter* out) const {
+    out->WriteByte(TAG_ASSIGNMENT_FIELD);
+    out->WriteDword(_field);
+    out->WriteDword(_method);
+    out->WriteByte(_isLocal);
+    out->WriteByte(_hasDeref);
+    if (_hasDeref) _deref.Write(out);
+    _expression.Write(out);
+}
+
+void CRActionAssignmentArray::Write(CRWriter* out) const {
+    out->WriteByte(TAG_ASSIGNMENT_ARRAY);
+    out->WriteDword(_field);
+    out->WriteDword(_method);
+    out->WriteByte(_isLocal);
+    _WriteExpressions(out, _dimensions);
+    out->WriteByte(_hasDeref);
+    if (_hasDeref) _deref.Write(out);
+    _expression.Write(out);
+}
+
+void CRActionAssignmentInstanceVar::Write(CRWriter* out) const {
+    out->WriteByte(TAG_ASSIGNMENT_INSTANCE_VAR);
+    out->WriteDword(_var);
+    out->WriteDword(_method);
+    _WriteExpressions(out, _dimensions);
+    out->WriteByte(_hasDeref);
+    if (_hasDeref) _deref.Write(out);
+    _expression.Write(out);
+}
+
+void CRActionAssignmentGameVar::Write(CRWriter* out) const {
+    out->WriteByte(TAG_ASSIGNMENT_GAME_VAR);
+    out->WriteDword(_var);
+    out->WriteDword(_method);
+    _WriteExpressions(out, _dimensions);
+    _expression.Write(out);
+}
+
+void CRActionBlock::Write(CRWriter* out) const {
+    out->WriteByte(TAG_BLOCK);
+    _list.Write(out);
+}
+
+void CRActionRunFunction::Write(CRWriter* out) const {
+    out->WriteByte(TAG_RUN_FUNCTION);
+    out->WriteDword(_function);
+    _WriteExpressions(out, _args);
+}
+
+void CRActionRunScript::Write(CRWriter* out) const {
+    out->WriteByte(TAG_RUN_SCRIPT);
+    out->WriteDword(_scriptID);
+    _WriteExpressions(out, _args);
+}
+
+void CRActionIfElse::Write(CRWriter* out) const {
+    out->WriteByte(TAG_IF_ELSE);
+    _expression.Write(out);
+    out->WriteAction(_if);
+    out->WriteAction(_else);
+}
+
+void CRActionWith::Write(CRWriter* out) const {
+    out->WriteByte(TAG_WITH);
+    _expression.Write(out);
+    out->WriteAction(_code);
+}
+
+void CRActionRepeat::Write(CRWriter* out) const {
+    out->WriteByte(TAG_REPEAT);
+    _expression.Write(out);
+    out->WriteAction(_code);
+}
+
+void CRActionWhile::Write(CRWriter* out) const {
+    out->WriteByte(TAG_WHILE);
+    _expression.Write(out);
+    out->WriteAction(_code);
+}
+
+void CRActionFor::Write(CRWriter* out) const {
+    out->WriteByte(TAG_FOR);
+    out->WriteAction(_initializer);
+    _check.Write(out);
+    out->WriteAction(_finalizer);
+    out->WriteAction(_code);
+}
+
+void CRActionDoUntil::Write(CRWriter* out) const {
+    out->WriteByte(TAG_DO_UNTIL);
+    _expression.Write(out);
+    out->WriteAction(_code);
+}
+
+void CRActionSwitch::Write(CRWriter* out) const {
+    out->WriteByte(TAG_SWITCH);
+    _expression.Write(out);
+    _actions.Write(out);
+    out->WriteDword(static_cast<unsigned int>(_cases.size()));
+    for (const SwitchCase& c : _cases) {
+        c.expression.Write(out);
+        out->WriteDword(c.offset);
+    }
+    out->WriteDword(_defaultOffset);
+}
+
+void CRActionBreak::Write(CRWriter* out) const { out->WriteByte(TAG_BREAK); }
+
+void CRActionContinue::Write(CRWriter* out) const { out->WriteByte(TAG_CONTINUE); }
+
+void CRActionExit::Write(CRWriter* out) const { out->WriteByte(TAG_EXIT); }
+
+void CRActionReturn::Write(CRWriter* out) const {
+    out->WriteByte(TAG_RETURN);
+    _expression.Write(out);
+}
+
+void CRExpLiteral::Write(CRWriter* out) const {
+    out->WriteByte(TAG_LITERAL);
+    _WriteOperators(out);
+    out->WriteValue(_value);
+}
+
+void CRExpFunction::Write(CRWriter* out) const {
+    out->WriteByte(TAG_FUNCTION);
+    _WriteOperators(out);
+    out->WriteDword(_function);
+    _WriteExpressions(out, _args);
+}
+
+void CRExpScript::Write(CRWriter* out) const {
+    out->WriteByte(TAG_SCRIPT);
+    _WriteOperators(out);
+    out->WriteDword(_script);
+    _WriteExpressions(out, _args);
+}
+
+void CRExpNestedExpression::Write(CRWriter* out) const {
+    out->WriteByte(TAG_NESTED_EXPRESSION);
+    _WriteOperators(out);
+    _expression.Write(out);
+}
+
+void CRExpField::Write(CRWriter* out) const {
+    out->WriteByte(TAG_FIELD);
+    _WriteOperators(out);
+    out->WriteDword(_fieldNumber);
+    out->WriteByte(_isLocal);
+    out->WriteByte(_hasDeref);
+    if (_hasDeref) _deref.Write(out);
+}
+
+void CRExpArray::Write(CRWriter* out) const {
+    out->WriteByte(TAG_ARRAY);
+    _WriteOperators(out);
+    out->WriteDword(_fieldNumber);
+    out->WriteByte(_isLocal);
+    _WriteExpressions(out, _dimensions);
+    out->WriteByte(_hasDeref);
+    if (_hasDeref) _deref.Write(out);
+}
+
+void CRExpInstanceVar::Write(CRWriter* out) const {
+    out->WriteByte(TAG_INSTANCE_VAR);
+    _WriteOperators(out);
+    out->WriteDword(_var);
+    _WriteExpressions(out, _dimensions);
+    out->WriteByte(_hasDeref);
+    if (_hasDeref) _deref.Write(out);
+}
+
+void CRExpGameVar::Write(CRWriter* out) const {
+    out->WriteByte(TAG_GAME_VAR);
+    _WriteOperators(out);
+    out->WriteDword(_var);
+    _WriteExpressions(out, _dimensions);
+}
+
+
+// Reader
+
+bool CRReader::_Has(unsigned int length) {
+    if (_failed || length > _length - _pos) {
+        _failed = true;
+        return false;
+    }
+    return true;
+}
+
+unsigned char CRReader::ReadByte() {
+    if (!_Has(1)) return 0;
+    return _data[_pos++];
+}
+
+unsigned int CRReader::ReadDword() {
+    if (!_Has(4)) return 0;
+    unsigned int val = _data[_pos] + (_data[_pos + 1] << 8) + (_data[_pos + 2] << 16) + (_data[_pos + 3] << 24);
+    _pos += 4;
+    return val;
+}
+
+double CRReader::ReadDouble() {
+    if (!_Has(sizeof(double))) return 0.0;
+    double val;
+    memcpy(&val, _data + _pos, sizeof(double));
+    _pos += sizeof(double);
+    return val;
+}
+
+std::string CRReader::ReadString() {
+    unsigned int length = ReadDword();
+    if (!_Has(length)) return std::string();
+    std::string val(reinterpret_cast<const char*>(_data + _pos), length);
+    _pos += length;
+    return val;
+}
+
+unsigned int CRReader::ReadField() {
+    unsigned int field = ReadDword();
+    if (field >= _fieldMap->size()) {
+        _failed = true;
+        return 0;
+    }
+    return (*_fieldMap)[field];
+}
+
+unsigned int CRReader::ReadEnum(unsigned int count) {
+    unsigned int value = ReadDword();
+    if (value >= count) {
+        _failed = true;
+        return 0;
+    }
+    return value;
+}
+
+void CRReader::ReadValue(GMLType* value) {
+    if (ReadByte()) {
+        value->state = GMLTypeState::String;
+        value->sVal = ReadString();
+    }
+    else {
+        value->state = GMLTypeState::Double;
+        value->dVal = ReadDouble();
+    }
+}
+
+bool CRReader::ReadActionList(CRActionList* list) {
+    unsigned int count = ReadDword();
+    for (; count > 0 && !_failed; count--) {
+        CRAction* action = ReadAction();
+        if (action) list->Append(action);
+    }
+    if (_failed) {
+        list->Finalize();
+        (*list) = CRActionList();
+    }
+    return !_failed;
+}
+
+bool CRReader::ReadExpression(CRExpression* expression) {
+    unsigned int count = ReadDword();
+    for (; count > 0 && !_failed; count--) {
+        CRExpressionTag tag = static_cast<CRExpressionTag>(ReadByte());
+
+        // Every expression value starts with its operators
+        CROperator op = static_cast<CROperator>(ReadEnum(OPERATOR_NONE + 1));
+        std::vector<CRUnaryOperator> unary;
+        unsigned int unaryCount = ReadDword();
+        for (; unaryCount > 0 && !_failed; unaryCount--) {
+            unary.push_back(static_cast<CRUnaryOperator>(ReadEnum(OPERATOR_POSITIVE + 1)));
+        }
+        if (_failed) break;
+
+        CRExpressionValue* value = NULL;
+        switch (tag) {
+            case TAG_LITERAL: {
+                GMLType v;
+                ReadValue(&v);
+                if (v.state == GMLTypeState::String) {
+                    value = new CRExpLiteral(v.sVal);
+                }
+                else {
+                    value = new CRExpLiteral(v.dVal);
+                }
+                break;
+            }
+            case TAG_FUNCTION: {
+                CRInternalFunction function = static_cast<CRInternalFunction>(ReadEnum(_INTERNAL_FUNC_COUNT));
+                std::vector<CRExpression> args;
+                if (ReadExpressions(&args)) value = new CRExpFunction(function, args);
+                break;
+            }
+            case TAG_SCRIPT: {
+                unsigned int script = ReadDword();
+                std::vector<CRExpression> args;
+                if (ReadExpressions(&args)) value = new CRExpScript(script, args);
+                break;
+            }
+            case TAG_NESTED_EXPRESSION: {
+                CRExpression nested;
+                if (ReadExpression(&nested)) value = new CRExpNestedExpression(nested);
+                break;
+            }
+            case TAG_FIELD: {
+                unsigned int field = ReadField();
+                bool isLocal = ReadByte();
+                if (ReadByte()) {
+                    CRExpression deref;
+                    if (ReadExpression(&deref)) value = new CRExpField(field, deref, isLocal);
+                }
+                else if (!_failed) {
+                    value = new CRExpField(field, isLocal);
+                }
+                break;
+            }
+            case TAG_ARRAY: {
+                unsigned int field = ReadField();
+                bool isLocal = ReadByte();
+                std::vector<CRExpression> dimensions;
+                if (!ReadExpressions(&dimensions)) break;
+                if (ReadByte()) {
+                    CRExpression deref;
+                    if (ReadExpression(&deref)) value = new CRExpArray(field, dimensions, deref, isLocal);
+                }
+                else if (!_failed) {
+                    value = new CRExpArray(field, dimensions, isLocal);
+                }
+                if (!value) {
+                    for (CRExpression& exp : dimensions) exp.Finalize();
+                }
+                break;
+            }
+            case TAG_INSTANCE_VAR: {
+                CRInstanceVar var = static_cast<CRInstanceVar>(ReadEnum(_INSTANCE_VAR_COUNT));
+                std::vector<CRExpression> dimensions;
+                if (!ReadExpressions(&dimensions)) break;
+                if (ReadByte()) {
+                    CRExpression deref;
+                    if (ReadExpression(&deref)) value = new CRExpInstanceVar(var, dimensions, deref);
+                }
+                else if (!_failed) {
+                    value = new CRExpInstanceVar(var, dimensions);
+                }
+                if (!value) {
+                    for (CRExpression& exp : dimensions) exp.Finalize();
+                }
+                break;
+            }
+            case TAG_GAME_VAR: {
+                CRGameVar var = static_cast<CRGameVar>(ReadEnum(_GAME_VALUE_COUNT));
+                std::vector<CRExpression> dimensions;
+                if (ReadExpressions(&dimensions)) value = new CRExpGameVar(var, dimensions);
+                break;
+            }
+            default:
+                _failed = true;
+                break;
+        }
+
+        if (value) {
+            value->SetOperator(op);
+            value->SetUnaries(std::move(unary));
+            expression->Append(value);
+        }
+        else {
+            _failed = true;
+        }
+    }
+
+    if (_failed) {
+        expression->Finalize();
+        (*expression) = CRExpression();
+    }
+    return !_failed;
+}
+
+bool CRReader::ReadExpressions(std::vector<CRExpression>* expressions) {
+    unsigned int count = ReadDword();
+    for (; count > 0 && !_failed; count--) {
+        CRExpression exp;
+        if (!ReadExpression(&exp)) break;
+        expressions->push_back(exp);
+    }
+    if (_failed) {
+        for (CRExpression& exp : *expressions) exp.Finalize();
+        expressions->clear();
+    }
+    return !_failed;
+}
+
+// Deletes an action that was read before something after it failed
+void _DiscardAction(CRAction* action) {
+    if (action) {
+        action->Finalize();
+        delete action;
+    }
+}
+
+CRAction* CRReader::ReadAction() {
+    CRActionTag tag = static_cast<CRActionTag>(ReadByte());
+    if (_failed) return NULL;
+
+    switch (tag) {
+        case TAG_ACTION_NULL:
+            return NULL;
+        case TAG_BIND_VARS:
+            return new CRActionBindVars();
+        case TAG_BREAK:
+            return new CRActionBreak();
+        case TAG_CONTINUE:
+            return new CRActionContinue();
+        case TAG_EXIT:
+            return new CRActionExit();
+
+        case TAG_ASSIGNMENT_FIELD: {
+            unsigned int field = ReadField();
+            CRSetMethod method = static_cast<CRSetMethod>(ReadEnum(SM_BITWISE_XOR + 1));
+            bool isLocal = ReadByte();
+            bool hasDeref = ReadByte();
+            CRExpression deref, exp;
+            if (hasDeref && !ReadExpression(&deref)) return NULL;
+            if (!ReadExpression(&exp)) {
+                deref.Finalize();
+                return NULL;
+            }
+            if (hasDeref) return new CRActionAssignmentField(field, method, deref, exp, isLocal);
+            return new CRActionAssignmentField(field, method, exp, isLocal);
+        }
+
+        case TAG_ASSIGNMENT_ARRAY: {
+            unsigned int field = ReadField();
+            CRSetMethod method = static_cast<CRSetMethod>(ReadEnum(SM_BITWISE_XOR + 1));
+            bool isLocal = ReadByte();
+            std::vector<CRExpression> dimensions;
+            if (!ReadExpressions(&dimensions)) return NULL;
+            bool hasDeref = ReadByte();
+            CRExpression deref, exp;
+            if ((hasDeref && !ReadExpression(&deref)) || !ReadExpression(&exp)) {
+                deref.Finalize();
+                for (CRExpression& d : dimensions) d.Finalize();
+                return NULL;
+            }
+            if (hasDeref) return new CRActionAssignmentArray(field, method, dimensions, deref, exp, isLocal);
+            return new CRActionAssignmentArray(field, method, dimensions, exp, isLocal);
+        }
+
+        case TAG_ASSIGNMENT_INSTANCE_VAR: {
+            CRInstanceVar var = static_cast<CRInstanceVar>(ReadEnum(_INSTANCE_VAR_COUNT));
+            CRSetMethod method = static_cast<CRSetMethod>(ReadEnum(SM_BITWISE_XOR + 1));
+            std::vector<CRExpression> dimensions;
+            if (!ReadExpressions(&dimensions)) return NULL;
+            bool hasDeref = ReadByte();
+            CRExpression deref, exp;
+            if ((hasDeref && !ReadExpression(&deref)) || !ReadExpression(&exp)) {
+                deref.Finalize();
+                for (CRExpression& d : dimensions) d.Finalize();
+                return NULL;
+            }
+            if (hasDeref) return new CRActionAssignmentInstanceVar(var, method, dimensions, deref, exp);
+            return new CRActionAssignmentInstanceVar(var, method, dimensions, exp);
+        }
+
+        case TAG_ASSIGNMENT_GAME_VAR: {
+            CRGameVar var = static_cast<CRGameVar>(ReadEnum(_GAME_VALUE_COUNT));
+            CRSetMethod method = static_cast<CRSetMethod>(ReadEnum(SM_BITWISE_XOR + 1));
+            std::vector<CRExpression> dimensions;
+            if (!ReadExpressions(&dimensions)) return NULL;
+            CRExpression exp;
+            if (!ReadExpression(&exp)) {
+                for (CRExpression& d : dimensions) d.Finalize();
+                return NULL;
+            }
+            return new CRActionAssignmentGameVar(var, method, dimensions, exp);
+        }
+
+        case TAG_BLOCK: {
+            CRActionList list;
+            if (!ReadActionList(&list)) return NULL;
+            return new CRActionBlock(list);
+        }
+
+        case TAG_RUN_FUNCTION: {
+            CRInternalFunction function = static_cast<CRInternalFunction>(ReadEnum(_INTERNAL_FUNC_COUNT));
+            std::vector<CRExpression> args;
+            if (!ReadExpressions(&args)) return NULL;
+            return new CRActionRunFunction(function, args);
+        }
+
+        case TAG_RUN_SCRIPT: {
+            unsigned int script = ReadDword();
+            std::vector<CRExpression> args;
+            if (!ReadExpressions(&args)) return NULL;
+            return new CRActionRunScript(script, args);
+        }
+
+        case TAG_IF_ELSE: {
+            CRExpression exp;
+            if (!ReadExpression(&exp)) return NULL;
+            CRAction* ifAction = ReadAction();
+            CRAction* elseAction = _failed ? NULL : ReadAction();
+            if (_failed || !ifAction) {
+                _failed = true;
+                _DiscardAction(ifAction);
+                _DiscardAction(elseAction);
+                exp.Finalize();
+                return NULL;
+            }
+            return new CRActionIfElse(ifAction, elseAction, exp);
+        }
+
+        case TAG_WITH:
+        case TAG_REPEAT:
+        case TAG_WHILE:
+        case TAG_DO_UNTIL: {
+            CRExpression exp;
+            if (!ReadExpression(&exp)) return NULL;
+            CRAction* code = ReadAction();
+            if (_failed || !code) {
+                _failed = true;
+                _DiscardAction(code);
+                exp.Finalize();
+                return NULL;
+            }
+            if (tag == TAG_WITH) return new CRActionWith(exp, code);
+            if (tag == TAG_REPEAT) return new CRActionRepeat(exp, code);
+            if (tag == TAG_WHILE) return new CRActionWhile(exp, code);
+            return new CRActionDoUntil(exp, code);
+        }
+
+        case TAG_FOR: {
+            CRAction* init = ReadAction();
+            CRExpression check;
+            if (!_failed) ReadExpression(&check);
+            CRAction* final = _failed ? NULL : ReadAction();
+            CRAction* code = _failed ? NULL : ReadAction();
+            if (_failed || !init || !final || !code) {
+                _failed = true;
+                _DiscardAction(init);
+                _DiscardAction(final);
+                _DiscardAction(code);
+                check.Finalize();
+                return NULL;
+            }
+            return new CRActionFor(init, check, final, code);
+        }
+
+        case TAG_SWITCH: {
+            CRExpression exp;
+            if (!ReadExpression(&exp)) return NULL;
+            CRActionList actions;
+            if (!ReadActionList(&actions)) {
+                exp.Finalize();
+                return NULL;
+            }
+            std::vector<SwitchCase> cases;
+            unsigned int count = ReadDword();
+            for (; count > 0 && !_failed; count--) {
+                CRExpression caseExp;
+                if (!ReadExpression(&caseExp)) break;
+                unsigned int offset = ReadDword();
+                cases.push_back(SwitchCase(caseExp, offset));
+            }
+            unsigned int defaultOffset = ReadDword();
+            if (_failed) {
+                exp.Finalize();
+                actions.Finalize();
+                for (SwitchCase& c : cases) c.expression.Finalize();
+                return NULL;
+            }
+            return new CRActionSwitch(exp, actions, cases, defaultOffset);
+        }
+
+        case TAG_RETURN: {
+            CRExpression exp;
+            if (!ReadExpression(&exp)) return NULL;
+            return new CRActionReturn(exp);
+        }
+
+        default:
+            _failed = true;
+            return NULL;
+    }
+}
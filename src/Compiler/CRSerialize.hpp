@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+class CRAction;
+class CRActionList;
+class CRExpression;
+struct GMLType;
+
+// Byte buffer that compiled actions and expressions write themselves into for the compiled code cache.
+// Everything is little-endian, the same as ReadDword reads.
+class CRWriter {
+  private:
+    std::vector<unsigned char> _data;
+
+  public:
+    void WriteByte(unsigned char value) { _data.push_back(value); }
+    void WriteDword(unsigned int value);
+    void WriteDouble(double value);
+    void WriteString(const std::string& value);
+    void WriteValue(const GMLType& value);
+    void WriteAction(const CRAction* action);  // Can be NULL
+
+    void Clear() { _data.clear(); }
+    const unsigned char* Data() const { return _data.data(); }
+    unsigned int Length() const { return static_cast<unsigned int>(_data.size()); }
+};
+
+// Reads back what a CRWriter wrote. Running off the end of the data sets a flag instead of reading past it, so a bad entry turns into a cache miss.
+// Field numbers are remapped through fieldMap, since the cache's field table won't be in the same order as this run's.
+class CRReader {
+  private:
+    const unsigned char* _data;
+    unsigned int _length;
+    unsigned int _pos;
+    const std::vector<unsigned int>* _fieldMap;
+    bool _failed;
+
+    bool _Has(unsigned int length);
+
+  public:
+    CRReader(const unsigned char* data, unsigned int length, const std::vector<unsigned int>* fieldMap) : _data(data), _length(length), _pos(0), _fieldMap(fieldMap), _failed(false) {}
+
+    unsigned char ReadByte();
+    unsigned int ReadDword();
+    double ReadDouble();
+    std::string ReadString();
+    unsigned int ReadField();
+    unsigned int ReadEnum(unsigned int count);  // Fails on anything that isn't below count, so a value from a different build can't index past a table
+    void ReadValue(GMLType* value);
+    void Skip(unsigned int length) {
+        if (_Has(length)) _pos += length;
+    }
+
+    // These construct through the same public constructors the interpreter uses. On failure, whatever was already built gets finalized and deleted.
+    CRAction* ReadAction();  // Returns NULL for a NULL action, and also on failure, so check Failed()
+    bool ReadActionList(CRActionList* list);
+    bool ReadExpression(CRExpression* expression);
+    bool ReadExpressions(std::vector<CRExpression>* expressions);
+
+    bool Failed() const { return _failed; }
+    bool AtEnd() const { return _pos == _length; }
+    unsigned int Position() const { return _pos; }
+};
@@ -2,11 +2,13 @@
 
 #include "CREnums.hpp"
 #include "CRGMLType.hpp"
+#include "CRSerialize.hpp"
 
 // Abstract super-class for compiled actions
 class CRAction {
   public:
     virtual bool Run() = 0;
+    virtual void Write(CRWriter* out) const = 0;  // For the compiled code cache, read back by CRReader::ReadAction
     virtual void Finalize() {}
     virtual ~CRAction() {}
 };
@@ -19,9 +21,11 @@ class CRExpressionValue {
 
   protected:
     virtual bool _evaluate(GMLType* output) = 0;
+    void _WriteOperators(CRWriter* out) const;
 
   public:
     bool Evaluate(GMLType* output);
+    virtual void Write(CRWriter* out) const = 0;  // For the compiled code cache, read back by CRReader::ReadExpression
     virtual void Finalize() {}
     virtual ~CRExpressionValue() {}
 
@@ -39,6 +43,7 @@ class CRActionList {
   public:
     inline void Append(CRAction* a) { _actions.push_back(a); }
     bool Run(unsigned int start = 0);
+    void Write(CRWriter* out) const;
     virtual void Finalize();
 
     inline size_t Count() { return _actions.size(); }
@@ -52,6 +57,7 @@ class CRExpression {
   public:
     inline void Append(CRExpressionValue* a) { _values.push_back(a); }
     bool Evaluate(GMLType* output);
+    void Write(CRWriter* out) const;
     inline std::vector<CRExpressionValue*>* GetValues() { return &_values; }
     virtual void Finalize();
 };
@@ -62,6 +68,7 @@ class CRExpression {
 class CRActionBindVars : public CRAction {
   public:
     virtual bool Run() override;
+    virtual void Write(CRWriter* out) const override;
     CRActionBindVars() {}
 };
 
@@ -79,6 +86,7 @@ class CRActionAssignmentField : public CRAction {
     CRActionAssignmentField(unsigned int field, CRSetMethod method, CRExpression deref, CRExpression exp, bool isLocal)
         : _field(field), _method(method), _deref(deref), _expression(exp), _hasDeref(true), _isLocal(isLocal) {}
     virtual bool Run() override;
+    virtual void Write(CRWriter* out) const override;
     virtual void Finalize() override {
         _deref.Finalize();
         _expression.Finalize();
@@ -101,6 +109,7 @@ class CRActionAssignmentArray : public CRAction {
     CRActionAssignmentArray(unsigned int field, CRSetMethod method, std::vector<CRExpression>& dimensions, CRExpression deref, CRExpression exp, bool isLocal)
         : _field(field), _method(method), _dimensions(dimensions), _deref(deref), _expression(exp), _hasDeref(true), _isLocal(isLocal) {}
     virtual bool Run() override;
+    virtual void Write(CRWriter* out) const override;
     virtual void Finalize() override {
         _deref.Finalize();
         _expression.Finalize();
@@ -125,6 +134,7 @@ class CRActionAssignmentInstanceVar : public CRAction {
     CRActionAssignmentInstanceVar(CRInstanceVar var, CRSetMethod method, std::vector<CRExpression>& dimensions, CRExpression deref, CRExpression exp)
         : _var(var), _method(method), _dimensions(dimensions), _deref(deref), _expression(exp), _hasDeref(true) {}
     virtual bool Run() override;
+    virtual void Write(CRWriter* out) const override;
     virtual void Finalize() override {
         _deref.Finalize();
         _expression.Finalize();
@@ -145,6 +155,7 @@ class CRActionAssignmentGameVar : public CRAction {
     CRActionAssignmentGameVar(CRGameVar var, CRSetMethod method, std::vector<CRExpression>& dimensions, CRExpression expression)
         : _var(var), _method(method), _dimensions(dimensions), _expression(expression) {}
     virtual bool Run() override;
+    virtual void Write(CRWriter* out) const override;
     virtual void Finalize() override {
         _expression.Finalize();
         for (CRExpression& exp : _dimensions) {
@@ -160,6 +171,7 @@ class CRActionBlock : public CRAction {
   public:
     CRActionBlock(CRActionList list) : _list(list) {}
     virtual bool Run() override;
+    virtual void Write(CRWriter* out) const override;
     virtual void Finalize() override { _list.Finalize(); }
 };
 
@@ -171,6 +183,7 @@ class CRActionRunFunction : public CRAction {
   public:
     CRActionRunFunction(CRInternalFunction func, std::vector<CRExpression>& args) : _function(func), _args(args) {}
     virtual bool Run() override;
+    virtual void Write(CRWriter* out) const override;
     virtual void Finalize() override {
         for (CRExpression& exp : _args) {
             exp.Finalize();
@@ -186,6 +199,7 @@ class CRActionRunScript : public CRAction {
   public:
     CRActionRunScript(unsigned int id, std::vector<CRExpression>& args) : _scriptID(id), _args(args) {}
     virtual bool Run() override;
+    virtual void Write(CRWriter* out) const override;
     virtual void Finalize() override {
         for (CRExpression& exp : _args) {
             exp.Finalize();
@@ -202,6 +216,7 @@ class CRActionIfElse : public CRAction {
   public:
     CRActionIfElse(CRAction* i, CRAction* e, CRExpression exp) : _if(i), _else(e), _expression(exp) {}
     virtual bool Run() override;
+    virtual void Write(CRWriter* out) const override;
     virtual void Finalize() override {
         _if->Finalize();
         delete _if;
@@ -221,6 +236,7 @@ class CRActionWith : public CRAction {
   public:
     CRActionWith(CRExpression exp, CRAction* code) : _expression(exp), _code(code) {}
     virtual bool Run() override;
+    virtual void Write(CRWriter* out) const override;
     virtual void Finalize() override {
         _code->Finalize();
         delete _code;
@@ -236,6 +252,7 @@ class CRActionRepeat : public CRAction {
   public:
     CRActionRepeat(CRExpression exp, CRAction* code) : _expression(exp), _code(code) {}
     virtual bool Run() override;
+    virtual void Write(CRWriter* out) const override;
     virtual void Finalize() override {
         _code->Finalize();
         delete _code;
@@ -251,6 +268,7 @@ class CRActionWhile : public CRAction {
   public:
     CRActionWhile(CRExpression exp, CRAction* code) : _expression(exp), _code(code) {}
     virtual bool Run() override;
+    virtual void Write(CRWriter* out) const override;
     virtual void Finalize() override {
         _code->Finalize();
         delete _code;
@@ -268,6 +286,7 @@ class CRActionFor : public CRAction {
   public:
     CRActionFor(CRAction* init, CRExpression exp, CRAction* final, CRAction* code) : _initializer(init), _check(exp), _finalizer(final), _code(code) {}
     virtual bool Run() override;
+    virtual void Write(CRWriter* out) const override;
     virtual void Finalize() override {
         _initializer->Finalize();
         delete _initializer;
@@ -287,6 +306,7 @@ class CRActionDoUntil : public CRAction {
   public:
     CRActionDoUntil(CRExpression exp, CRAction* code) : _expression(exp), _code(code) {}
     virtual bool Run() override;
+    virtual void Write(CRWriter* out) const override;
     virtual void Finalize() override {
         _code->Finalize();
         delete _code;
@@ -310,6 +330,7 @@ class CRActionSwitch : public CRAction {
   public:
     CRActionSwitch(CRExpression exp, CRActionList actions, std::vector<SwitchCase>& offsets, unsigned int def) : _expression(exp), _actions(actions), _cases(offsets), _defaultOffset(def) {}
     virtual bool Run() override;
+    virtual void Write(CRWriter* out) const override;
     virtual void Finalize() override {
         _expression.Finalize();
         _actions.Finalize();
@@ -323,18 +344,21 @@ class CRActionBreak : public CRAction {
   public:
     CRActionBreak() {}
     virtual bool Run() override;
+    virtual void Write(CRWriter* out) const override;
 };
 
 class CRActionContinue : public CRAction {
   public:
     CRActionContinue() {}
     virtual bool Run() override;
+    virtual void Write(CRWriter* out) const override;
 };
 
 class CRActionExit : public CRAction {
   public:
     CRActionExit() {}
     virtual bool Run() override;
+    virtual void Write(CRWriter* out) const override;
 };
 
 class CRActionReturn : public CRAction {
@@ -344,6 +368,7 @@ class CRActionReturn : public CRAction {
   public:
     CRActionReturn(CRExpression exp) : _expression(exp) {}
     virtual bool Run() override;
+    virtual void Write(CRWriter* out) const override;
     virtual void Finalize() override { _expression.Finalize(); }
 };
 
@@ -363,6 +388,7 @@ class CRExpLiteral : public CRExpressionValue {
         _value.sVal = s;
     }
     bool _evaluate(GMLType* output) override;
+    void Write(CRWriter* out) const override;
 };
 
 class CRExpFunction : public CRExpressionValue {
@@ -373,6 +399,7 @@ class CRExpFunction : public CRExpressionValue {
   public:
     CRExpFunction(CRInternalFunction func, std::vector<CRExpression>& args) : _function(func), _args(args) {}
     bool _evaluate(GMLType* output) override;
+    void Write(CRWriter* out) const override;
     void Finalize() override {
         for (CRExpression& arg : _args) {
             arg.Finalize();
@@ -388,6 +415,7 @@ class CRExpScript : public CRExpressionValue {
   public:
     CRExpScript(unsigned int id, std::vector<CRExpression>& args) : _script(id), _args(args) {}
     bool _evaluate(GMLType* output) override;
+    void Write(CRWriter* out) const override;
     void Finalize() override {
         for (CRExpression& arg : _args) {
             arg.Finalize();
@@ -402,6 +430,7 @@ class CRExpNestedExpression : public CRExpressionValue {
   public:
     CRExpNestedExpression(CRExpression exp) : _expression(exp) {}
     bool _evaluate(GMLType* output) override;
+    void Write(CRWriter* out) const override;
     void Finalize() override { _expression.Finalize(); }
 };
 
@@ -416,6 +445,7 @@ class CRExpField : public CRExpressionValue {
     CRExpField(unsigned int field, bool isLocal) : _fieldNumber(field), _hasDeref(false), _isLocal(isLocal) {}
     CRExpField(unsigned int field, CRExpression deref, bool isLocal) : _fieldNumber(field), _deref(deref), _hasDeref(true), _isLocal(isLocal) {}
     bool _evaluate(GMLType* output) override;
+    void Write(CRWriter* out) const override;
     void Finalize() override { _deref.Finalize(); }
 };
 
@@ -432,6 +462,7 @@ class CRExpArray : public CRExpressionValue {
     CRExpArray(unsigned int field, std::vector<CRExpression>& dimensions, CRExpression deref, bool isLocal)
         : _fieldNumber(field), _dimensions(dimensions), _deref(deref), _hasDeref(true), _isLocal(isLocal) {}
     bool _evaluate(GMLType* output) override;
+    void Write(CRWriter* out) const override;
     void Finalize() override {
         for (CRExpression& arg : _dimensions) {
             arg.Finalize();
@@ -451,6 +482,7 @@ class CRExpInstanceVar : public CRExpressionValue {
     CRExpInstanceVar(CRInstanceVar var, std::vector<CRExpression>& dimensions) : _var(var), _dimensions(dimensions), _hasDeref(false) {}
     CRExpInstanceVar(CRInstanceVar var, std::vector<CRExpression>& dimensions, CRExpression deref) : _var(var), _dimensions(dimensions), _deref(deref), _hasDeref(true) {}
     bool _evaluate(GMLType* output) override;
+    void Write(CRWriter* out) const override;
     void Finalize() override {
         for (CRExpression& arg : _dimensions) {
             arg.Finalize();
@@ -467,6 +499,7 @@ class CRExpGameVar : public CRExpressionValue {
   public:
     CRExpGameVar(CRGameVar var, std::vector<CRExpression>& dimensions) : _var(var), _dimensions(dimensions) {}
     bool _evaluate(GMLType* output) override;
+    void Write(CRWriter* out) const override;
     void Finalize() override {
         for (CRExpression& arg : _dimensions) {
             arg.Finalize();
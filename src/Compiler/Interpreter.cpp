@@ -3,7 +3,12 @@
 #include "CRRuntime.hpp"
 #include "Compiled.hpp"
 #include "Constants.hpp"
+#include "GameCache.hpp"
 #include <algorithm>
+#include <mutex>
+#include <shared_mutex>
+#include <string.h>
+#include <unordered_map>
 
 namespace GM8Emulator {
     namespace Compiler {
@@ -39,7 +44,10 @@ namespace GM8Emulator {
         enum VarType { VARTYPE_INSTANCE, VARTYPE_FIELD, VARTYPE_GAME };
         VarType _getVarType(std::string_view& name, unsigned int* index = nullptr);
 
+        // Several threads can be compiling at once, so the field registry is behind a lock. Nearly every lookup is for a field that's already there.
         std::vector<std::string> _fieldNames;
+        std::unordered_map<std::string, unsigned int> _fieldNumbers;
+        std::shared_mutex _fieldMutex;
         unsigned int _RegisterField(const std::string_view& name);
 
         std::vector<const char*> _gameValueNames;
@@ -460,7 +468,7 @@ bool GM8Emulator::Compiler::Init(GlobalValues* globals) {
                 break;
             case BACKGROUND_CREATE_COLOR:
                 _internalFuncNames.push_back("background_create_color");
-                _gmlFuncs.push_back(&Runtime::unimplemented);
+                _gmlFuncs.push_back(&Runtime::background_create_color);
                 break;
             case BACKGROUND_CREATE_FROM_SCREEN:
                 _internalFuncNames.push_back("background_create_from_screen");
@@ -476,7 +484,7 @@ bool GM8Emulator::Compiler::Init(GlobalValues* globals) {
                 break;
             case BACKGROUND_DELETE:
                 _internalFuncNames.push_back("background_delete");
-                _gmlFuncs.push_back(&Runtime::unimplemented);
+                _gmlFuncs.push_back(&Runtime::background_delete);
                 break;
             case BACKGROUND_DUPLICATE:
                 _internalFuncNames.push_back("background_duplicate");
@@ -4724,18 +4732,48 @@ bool GM8Emulator::Compiler::Init(GlobalValues* globals) {
 }
 
 unsigned int GM8Emulator::Compiler::_RegisterField(const std::string_view& name) {
-    for (unsigned int i = 0; i < _fieldNames.size(); i++) {
-        if (name == _fieldNames[i]) {
-            return i;
-        }
+    std::string key(name);
+    {
+        std::shared_lock<std::shared_mutex> lock(_fieldMutex);
+        auto it = _fieldNumbers.find(key);
+        if (it != _fieldNumbers.end()) return it->second;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(_fieldMutex);
+    auto it = _fieldNumbers.find(key);
+    if (it != _fieldNumbers.end()) return it->second;
+    unsigned int number = ( unsigned int )_fieldNames.size();
+    _fieldNames.push_back(key);
+    _fieldNumbers[key] = number;
+    return number;
+}
+
+void GM8Emulator::Compiler::RegisterIdentifiers(const TokenList& list) {
+    for (const Token& token : list.tokens) {
+        if (token.type == Token::token_type::Identifier) _RegisterField(token.value.str);
     }
-    _fieldNames.push_back(std::string(name));
-    return ( unsigned int )(_fieldNames.size() - 1);
 }
 
-std::set<unsigned int> _locals;
+const std::vector<std::string>& GM8Emulator::Compiler::GetFieldNames() { return _fieldNames; }
+
+unsigned int GM8Emulator::Compiler::RegisterField(const std::string& name) { return _RegisterField(name); }
+
+// Locals belong to whatever's being compiled on this thread
+thread_local std::set<unsigned int> _locals;
 void GM8Emulator::Compiler::FlushLocals() { _locals.clear(); }
 
+unsigned long long GM8Emulator::Compiler::GetNameTableHash() {
+    Hasher64 hasher;
+    for (const std::vector<const char*>* names : {&_internalFuncNames, &_gameValueNames, &_instanceVarNames}) {
+        unsigned int count = static_cast<unsigned int>(names->size());
+        hasher.Update(&count, sizeof(count));
+        for (const char* name : *names) {
+            hasher.Update(name, strlen(name) + 1);
+        }
+    }
+    return hasher.Final();
+}
+
 bool GM8Emulator::Compiler::Interpret(const TokenList& list, CRActionList* output) {
     unsigned int pos = 0;
     CRAction* action;
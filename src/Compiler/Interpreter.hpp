@@ -1,6 +1,8 @@
 #pragma once
 
 #include "Tokenizer.hxx"
+#include <string>
+#include <vector>
 
 class CRActionList;
 class CRExpression;
@@ -13,6 +15,22 @@ namespace GM8Emulator {
         bool Interpret(const TokenList& list, CRActionList* output);
         bool InterpretExpression(const TokenList& list, CRExpression* output, unsigned int* pos = nullptr, char precedence = 5, char lowestAllowedPrec = 0);
 
+        // Interpret and InterpretExpression can be called from several threads at once. Each thread has its own locals, which this clears.
         void FlushLocals();
+
+        // Field names in the order they were registered, so a field's number is its index in here.
+        // The compiled code cache stores this so it can map its field numbers onto this run's with RegisterField.
+        // Don't call GetFieldNames while anything is compiling.
+        const std::vector<std::string>& GetFieldNames();
+        unsigned int RegisterField(const std::string& name);
+
+        // Registers every identifier in list as a field, in the order they appear. Doing this for all the code before compiling any of it
+        // gives every field the same number no matter which order the code then gets compiled in. Some of the names will turn out not
+        // to be fields, but a spare field number costs nothing.
+        void RegisterIdentifiers(const TokenList& list);
+
+        // Hash of every internal function, game value and instance variable name in enum order. Compiled code stores those as enum values,
+        // so the compiled code cache is keyed on this and gets rebuilt whenever one of those enums changes. Only meaningful after Init.
+        unsigned long long GetNameTableHash();
     };
 };
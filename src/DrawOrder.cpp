@@ -0,0 +1,67 @@
+#include "DrawOrder.hpp"
+#include <cstring>
+#include <utility>
+
+void SortDrawOrder(std::vector<DrawEntry>* order, std::vector<DrawEntry>* scratch, size_t outOfPlace) {
+    if (outOfPlace == 0) return;
+    std::vector<DrawEntry>& entries = *order;
+
+    // A few instances that changed depth or got created since last frame are quickest to slot back in one at a time.
+    // Past that the radix sort is quicker, since it doesn't care what order things started in. Even a few can have moved a long way, though,
+    // and every entry they pass costs a move, so once the moves add up to about what the radix sort costs it takes over from there.
+    if (outOfPlace <= 8 || outOfPlace * 32 <= entries.size()) {
+        size_t moves = 0;
+        size_t maxMoves = entries.size() * 8;
+        for (size_t i = 1; i < entries.size(); i++) {
+            if (!DrawsBefore(entries[i], entries[i - 1])) continue;
+            if (moves > maxMoves) {
+                RadixSortDrawOrder(order, scratch);
+                return;
+            }
+            DrawEntry entry = entries[i];
+            size_t j = i;
+            for (; j > 0 && DrawsBefore(entry, entries[j - 1]); j--) {
+                entries[j] = entries[j - 1];
+            }
+            entries[j] = entry;
+            moves += i - j;
+        }
+    }
+    else {
+        RadixSortDrawOrder(order, scratch);
+    }
+}
+
+void RadixSortDrawOrder(std::vector<DrawEntry>* order, std::vector<DrawEntry>* scratch) {
+    size_t n = order->size();
+    if (n == 0) return;
+    scratch->resize(n);
+    DrawEntry* from = order->data();
+    DrawEntry* to = scratch->data();
+
+    // The id is the least important part, so it goes first, then the key from its lowest byte up
+    for (unsigned int pass = 0; pass < 12; pass++) {
+        auto digit = [pass](const DrawEntry& entry) -> unsigned int {
+            return (pass < 4) ? ((entry.id >> (pass * 8)) & 0xFF) : ( unsigned int )((entry.key >> ((pass - 4) * 8)) & 0xFF);
+        };
+
+        size_t counts[256];
+        memset(counts, 0, sizeof(counts));
+        for (size_t i = 0; i < n; i++) {
+            counts[digit(from[i])]++;
+        }
+        if (counts[digit(from[0])] == n) continue;  // Every entry has the same byte here, so this pass wouldn't move anything
+
+        size_t offset = 0;
+        for (size_t& count : counts) {
+            size_t c = count;
+            count = offset;
+            offset += c;
+        }
+        for (size_t i = 0; i < n; i++) {
+            to[counts[digit(from[i])]++] = from[i];
+        }
+        std::swap(from, to);
+    }
+    if (from != order->data()) memcpy(order->data(), from, n * sizeof(DrawEntry));
+}
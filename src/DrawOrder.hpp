@@ -0,0 +1,39 @@
+#pragma once
+
+#include <ostream>
+#include <vector>
+
+struct PooledInstance;
+
+// An instance in the draw order. Instances are drawn by depth (deepest first), then object index, then instance ID, with the higher object index
+// and ID going first, so that's an ascending sort on the key and ~id. The key is worked out again every frame in one pass, since GML can change depth
+// at any time without going through InstanceList, and it's compared as two plain integers instead of calling back into the instance for every comparison.
+struct DrawEntry {
+    unsigned long long key;  // Depth in the high 32 bits and object index in the low 32 bits, both flipped so that bigger sorts first
+    int depth;  // As it was when the key was made, so changing it during the draw event doesn't move tile layers around
+    unsigned int id;  // ~ of the instance ID
+    PooledInstance* instance;
+};
+
+// Flipping the sign bit puts ints in the same order as unsigned ints, then flipping everything makes the biggest come first
+inline unsigned int DrawDescendingBits(int value) { return ~(( unsigned int )value ^ 0x80000000u); }
+
+// Fills in an entry's key, depth and id
+inline void DrawSetKey(DrawEntry* entry, int depth, int objectIndex, unsigned int id) {
+    entry->key = (( unsigned long long )DrawDescendingBits(depth) << 32) | DrawDescendingBits(objectIndex);
+    entry->depth = depth;
+    entry->id = ~id;
+}
+
+inline bool DrawsBefore(const DrawEntry& l, const DrawEntry& r) { return (l.key == r.key) ? (l.id < r.id) : (l.key < r.key); }
+
+// Puts the draw order back in order, given how many entries draw before the one in front of them. It's almost always close to in order already,
+// so a few get slotted back in one at a time, and otherwise it's a radix sort. Scratch is somewhere to keep between calls for the radix sort to use.
+void SortDrawOrder(std::vector<DrawEntry>* order, std::vector<DrawEntry>* scratch, size_t outOfPlace);
+
+// LSD radix sort on the key and id, a byte at a time. Bytes that are the same in every entry (most of them, usually) are skipped.
+void RadixSortDrawOrder(std::vector<DrawEntry>* order, std::vector<DrawEntry>* scratch);
+
+// Sorts draw orders that are in order, nearly in order, and nowhere near, and checks they come out the same as a stable sort on depth,
+// object index and ID would put them. Writes what it's checking to out, and returns false if anything was wrong.
+bool DrawOrderUnitTest(std::ostream& out);
@@ -0,0 +1,140 @@
+#include "DrawOrder.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <random>
+#include <stdint.h>
+
+// What an entry's key gets made from, like the instance's variables would be
+struct _DrawTestInstance {
+    int depth;
+    int objectIndex;
+    unsigned int id;
+};
+
+// Entries point at nothing real, so their instance pointer is only used to tell which one ended up where
+PooledInstance* _DrawTestTag(size_t i) { return ( PooledInstance* )(uintptr_t)(i + 1); }
+size_t _DrawTestIndex(const DrawEntry& entry) { return ( size_t )(uintptr_t)entry.instance - 1; }
+
+// The order they should come out in, straight from what GM8 does rather than from the packed keys: deepest first, then the higher object index,
+// then the higher ID. Anything the same on all three stays in the order it started in.
+std::vector<size_t> _DrawTestExpected(const std::vector<_DrawTestInstance>& instances) {
+    std::vector<size_t> order(instances.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&instances](size_t l, size_t r) {
+        const _DrawTestInstance& a = instances[l];
+        const _DrawTestInstance& b = instances[r];
+        if (a.depth != b.depth) return a.depth > b.depth;
+        if (a.objectIndex != b.objectIndex) return a.objectIndex > b.objectIndex;
+        return a.id > b.id;
+    });
+    return order;
+}
+
+bool _DrawTestMatches(std::ostream& out, const char* sort, const std::vector<DrawEntry>& entries, const std::vector<_DrawTestInstance>& instances,
+                      const std::vector<size_t>& expected) {
+    bool ok = true;
+    for (size_t i = 0; i < entries.size() && ok; i++) {
+        size_t index = _DrawTestIndex(entries[i]);
+        if (index != expected[i]) {
+            out << " -> FAILED! " << sort << " put instance " << index << " at " << i << ", expected " << expected[i] << "\n";
+            ok = false;
+        }
+
+        // Tile layers get drawn in between by comparing against each entry's depth, so that has to travel with it and come out deepest first
+        else if (entries[i].depth != instances[index].depth || (i && entries[i].depth > entries[i - 1].depth)) {
+            out << " -> FAILED! " << sort << " left the wrong depth at " << i << "\n";
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// Makes the entries for the instances in the order they're in, then sorts them the way InstanceList does, and with the radix sort on its own
+bool _DrawTestSort(std::ostream& out, const char* what, const std::vector<_DrawTestInstance>& instances) {
+    out << "Asserting " << what << " sort the same as a stable sort ..\n";
+    std::vector<DrawEntry> entries(instances.size());
+    size_t outOfPlace = 0;
+    for (size_t i = 0; i < entries.size(); i++) {
+        entries[i].instance = _DrawTestTag(i);
+        DrawSetKey(&entries[i], instances[i].depth, instances[i].objectIndex, instances[i].id);
+        if (i && DrawsBefore(entries[i], entries[i - 1])) outOfPlace++;
+    }
+    std::vector<DrawEntry> radix = entries;
+    std::vector<DrawEntry> scratch;
+
+    std::vector<size_t> expected = _DrawTestExpected(instances);
+    SortDrawOrder(&entries, &scratch, outOfPlace);
+    bool ok = _DrawTestMatches(out, "SortDrawOrder", entries, instances, expected);
+    RadixSortDrawOrder(&radix, &scratch);
+    ok &= _DrawTestMatches(out, "RadixSortDrawOrder", radix, instances, expected);
+    return ok;
+}
+
+// Puts instances in the order they'd have been left in after the last frame
+void _DrawTestPresort(std::vector<_DrawTestInstance>* instances) {
+    std::vector<size_t> order = _DrawTestExpected(*instances);
+    std::vector<_DrawTestInstance> sorted;
+    for (size_t i : order) sorted.push_back((*instances)[i]);
+    (*instances) = sorted;
+}
+
+bool DrawOrderUnitTest(std::ostream& out) {
+    std::mt19937 rng(23);
+    const int depths[] = {INT_MIN, -1000000, -100, -1, 0, 1, 100, 1000000, INT_MAX};
+    std::uniform_int_distribution<size_t> anyDepth(0, sizeof(depths) / sizeof(depths[0]) - 1);
+    std::uniform_int_distribution<int> anyObject(0, 5);
+
+    // Few depths and objects, so there are lots of equal keys that only the id tells apart
+    auto makeInstances = [&](size_t count) {
+        std::vector<_DrawTestInstance> instances(count);
+        for (size_t i = 0; i < count; i++) {
+            instances[i] = {depths[anyDepth(rng)], anyObject(rng), static_cast<unsigned int>(100000 + i)};
+        }
+        std::shuffle(instances.begin(), instances.end(), rng);
+        return instances;
+    };
+
+    bool ok = true;
+    ok &= _DrawTestSort(out, "no instances", {});
+    ok &= _DrawTestSort(out, "one instance", {{-5, 0, 100001}});
+
+    // Ids near the top of the range, and object indices that don't fit in a byte, so every pass of the radix sort has something to do
+    ok &= _DrawTestSort(out, "ids and object indices using every byte",
+                        {{-1, 70000, 0xFFFFFF00u}, {-1, 70000, 0x00FFFFFFu}, {-1, 256, 5}, {-1, 65536, 5}, {INT_MIN, 0, 0}, {INT_MAX, 0, UINT_MAX}, {0, 0, 1}});
+
+    // Same depth, object index and id (which GM8 never does, but the sorts shouldn't care) keep the order they were in
+    ok &= _DrawTestSort(out, "completely equal keys", {{3, 1, 7}, {3, 1, 7}, {-3, 1, 7}, {3, 1, 7}, {-3, 1, 7}});
+
+    std::vector<_DrawTestInstance> instances = makeInstances(3000);
+    ok &= _DrawTestSort(out, "shuffled instances with negative depths and equal keys", instances);
+
+    _DrawTestPresort(&instances);
+    ok &= _DrawTestSort(out, "instances already in order", instances);
+
+    // A handful swapped with their neighbours, which slots them back in one at a time
+    for (int i = 0; i < 6; i++) {
+        size_t at = ( size_t )rng() % (instances.size() - 1);
+        std::swap(instances[at], instances[at + 1]);
+    }
+    ok &= _DrawTestSort(out, "a few instances that moved a short way", instances);
+
+    // New instances go on the end, which is a few out of place but far from where they belong
+    _DrawTestPresort(&instances);
+    for (unsigned int i = 0; i < 40; i++) instances.push_back({depths[anyDepth(rng)], anyObject(rng), 200000 + i});
+    ok &= _DrawTestSort(out, "new instances on the end", instances);
+
+    // Few enough out of place for the insertion sort, but they all have to go the whole length, so it gives up partway and the radix sort
+    // has to finish from a half-sorted order
+    _DrawTestPresort(&instances);
+    for (size_t i = instances.size() - 16; i < instances.size(); i++) instances[i].depth = INT_MAX;
+    ok &= _DrawTestSort(out, "a few instances that moved a long way", instances);
+
+    // Depths spread out over everything, so the keys barely repeat
+    std::uniform_int_distribution<int> wideDepth(INT_MIN, INT_MAX);
+    for (_DrawTestInstance& inst : instances) inst.depth = wideDepth(rng);
+    ok &= _DrawTestSort(out, "instances at random depths", instances);
+
+    out << (ok ? "Draw order OK\n" : "Draw order FAILED\n");
+    return ok;
+}
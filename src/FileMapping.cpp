@@ -0,0 +1,132 @@
+#include "FileMapping.hpp"
+#include <fstream>
+#include <new>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Maps the file with copy-on-write pages. Pages are only read from disk when they're touched, and only copied when they're written to.
+bool _MapFile(const char* filename, FileMapping* out) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+
+    // PAGE_WRITECOPY + FILE_MAP_COPY is Windows' version of MAP_PRIVATE
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    CloseHandle(file);  // The mapping keeps its own reference to the file
+    if (mapping == NULL) return false;
+
+    void* view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    if (view == NULL) {
+        CloseHandle(mapping);
+        return false;
+    }
+
+    out->data = static_cast<unsigned char*>(view);
+    out->length = static_cast<size_t>(size.QuadPart);
+    out->mapped = true;
+    out->_mapHandle = mapping;
+    return true;
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    void* view = mmap(NULL, static_cast<size_t>(st.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);  // The mapping keeps its own reference to the file
+    if (view == MAP_FAILED) return false;
+
+    out->data = static_cast<unsigned char*>(view);
+    out->length = static_cast<size_t>(st.st_size);
+    out->mapped = true;
+    return true;
+#endif
+}
+
+// Reads the whole file into a heap buffer. This is how GameLoad always used to do it.
+bool _ReadFile(const char* filename, FileMapping* out) {
+    std::ifstream ifs(filename, std::ios::binary | std::ios::ate);
+    if (!ifs.is_open() || ifs.bad()) return false;
+
+    std::streamsize fileSize = ifs.tellg();
+    if (fileSize <= 0) return false;
+
+    unsigned char* buffer;
+    try {
+        buffer = new unsigned char[static_cast<size_t>(fileSize)];
+    }
+    catch (const std::bad_alloc&) {
+        return false;
+    }
+
+    ifs.seekg(std::ios::beg);
+    ifs.read(reinterpret_cast<char*>(buffer), fileSize);
+    if (ifs.gcount() != fileSize) {
+        delete[] buffer;
+        return false;
+    }
+
+    out->data = buffer;
+    out->length = static_cast<size_t>(fileSize);
+    out->mapped = false;
+    return true;
+}
+
+bool FileMap(const char* filename, FileMapping* out, bool map) {
+    (*out) = FileMapping();
+    if (map && _MapFile(filename, out)) return true;
+    return _ReadFile(filename, out);
+}
+
+void FileUnmap(FileMapping* file) {
+    if (file->data) {
+        if (file->mapped) {
+#ifdef _WIN32
+            UnmapViewOfFile(file->data);
+            CloseHandle(file->_mapHandle);
+#else
+            munmap(file->data, file->length);
+#endif
+        }
+        else {
+            delete[] file->data;
+        }
+    }
+    (*file) = FileMapping();
+}
+
+size_t GetPeakMemoryUsage() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return counters.PeakWorkingSetSize;
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss);  // bytes on macOS
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;  // kilobytes everywhere else
+#endif
+#endif
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stddef.h>
+
+// A whole file loaded into memory, either mapped with private copy-on-write pages or read into a heap buffer.
+// The data is always writable, so it can be decrypted in place, but writes never make it back to the file on disk.
+struct FileMapping {
+    unsigned char* data = nullptr;
+    size_t length = 0;
+    bool mapped = false;  // true if data is a view of the file, false if it's a heap buffer
+#ifdef _WIN32
+    void* _mapHandle = nullptr;
+#endif
+};
+
+// Opens a file and makes its contents available in out->data. If map is false, or mapping fails, it falls back to reading the whole file.
+// Returns true on success. On failure nothing needs to be cleaned up.
+bool FileMap(const char* filename, FileMapping* out, bool map = true);
+
+// Releases the memory behind a FileMapping. Safe to call on a FileMapping that was never opened, or more than once.
+void FileUnmap(FileMapping* file);
+
+// Gets the peak resident set size of this process in bytes, or 0 if the platform doesn't tell us.
+size_t GetPeakMemoryUsage();
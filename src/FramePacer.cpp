@@ -0,0 +1,105 @@
+#include "FramePacer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <mmsystem.h>
+#endif
+
+// Sleeps are done a millisecond at a time so each one can be measured
+constexpr auto SLEEP_SLICE = std::chrono::milliseconds(1);
+
+FramePacer::FramePacer(FramePacePolicy policy, unsigned int maxCatchUp) {
+    _policy = policy;
+    _maxCatchUp = maxCatchUp;
+    _sleepMean = 0.001;
+    _sleepM2 = 0;
+    _sleepCount = 1;
+    _sleepEstimate = 0.002;  // Safe until there are some measurements, the real thing is usually closer to 1.1ms
+    memset(_histogram, 0, sizeof(_histogram));
+
+#ifdef _WIN32
+    // Windows' timer ticks every 15.6ms by default, which would make every slice that long and leave nearly the whole wait to the spin
+    timeBeginPeriod(1);
+#endif
+    Start();
+}
+
+FramePacer::~FramePacer() {
+#ifdef _WIN32
+    timeEndPeriod(1);
+#endif
+}
+
+void FramePacer::Start() {
+    _frameStart = Clock::now();
+    _next = _frameStart;
+}
+
+void FramePacer::Wait(double interval) {
+    Clock::time_point now = Clock::now();
+    double work = std::chrono::duration<double>(now - _frameStart).count();
+    _stats.workSeconds += work;
+    _stats.minWorkSeconds = _stats.frames ? std::min(_stats.minWorkSeconds, work) : work;
+    _stats.maxWorkSeconds = std::max(_stats.maxWorkSeconds, work);
+    _stats.frames++;
+    _histogram[std::min(( unsigned int )(work * 10000), HISTOGRAM_BUCKETS - 1)]++;
+
+    // The next start time comes from the last one rather than from now, so the time spent waking up doesn't get added on every frame
+    auto step = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(interval));
+    _next += step;
+    if (now > _next) {
+        _stats.lateFrames++;
+        unsigned long long behind = ( unsigned long long )((now - _next) / step);
+        if (_policy == PACE_SKIP || behind >= _maxCatchUp) {
+            // Drop the missed start times and go again as soon as possible
+            _stats.skippedFrames += behind;
+            _next = now;
+        }
+        // Otherwise the next frame starts straight away, and so on until the schedule's caught up
+    }
+    else {
+        _SleepUntil(_next);
+        now = Clock::now();
+        _stats.oversleepSeconds += std::chrono::duration<double>(now - _next).count();
+    }
+    _frameStart = now;
+}
+
+void FramePacer::_SleepUntil(Clock::time_point until) {
+    // Sleep while there's clearly time for another slice, learning how long a slice really takes as it goes
+    while (true) {
+        Clock::time_point now = Clock::now();
+        if (std::chrono::duration<double>(until - now).count() <= _sleepEstimate) break;
+        std::this_thread::sleep_for(SLEEP_SLICE);
+        double took = std::chrono::duration<double>(Clock::now() - now).count();
+
+        // Welford's running mean and variance. The estimate is a couple of standard deviations over the mean, so it's rare for a slice to overrun it.
+        _sleepCount++;
+        double delta = took - _sleepMean;
+        _sleepMean += delta / _sleepCount;
+        _sleepM2 += delta * (took - _sleepMean);
+        _sleepEstimate = _sleepMean + 2 * std::sqrt(_sleepM2 / (_sleepCount - 1));
+    }
+
+    // Spin for the rest, giving the core up whenever there's anything else that wants it
+    while (Clock::now() < until) {
+        std::this_thread::yield();
+    }
+}
+
+double FramePacer::WorkPercentile(double p) const {
+    if (_stats.frames == 0) return 0;
+    unsigned long long rank = ( unsigned long long )std::ceil(p * _stats.frames);
+    if (rank == 0) rank = 1;
+    unsigned long long seen = 0;
+    for (unsigned int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += _histogram[i];
+        if (seen >= rank) return (i == HISTOGRAM_BUCKETS - 1) ? _stats.maxWorkSeconds : (i + 1) / 10000.0;
+    }
+    return _stats.maxWorkSeconds;
+}
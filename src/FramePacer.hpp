@@ -0,0 +1,65 @@
+#pragma once
+
+#include <chrono>
+
+// What to do when a frame finishes after the next one was meant to start
+enum FramePacePolicy {
+    PACE_SKIP,  // Start the next frame straight away, and count the start times that were missed as skipped instead of trying to make them up
+    PACE_CATCH_UP,  // Keep to the original schedule, running late frames back to back until it's caught up (up to a limit, see FramePacer)
+};
+
+struct FramePacerStats {
+    unsigned long long frames = 0;
+    unsigned long long lateFrames = 0;  // Frames that finished after the next one should have started
+    unsigned long long skippedFrames = 0;  // Start times that got dropped, with PACE_SKIP or when catching up would take too long
+    double workSeconds = 0;  // Total time spent in frames, not counting waiting
+    double minWorkSeconds = 0;
+    double maxWorkSeconds = 0;
+    double oversleepSeconds = 0;  // Total time the waits went past when the next frame should have started
+};
+
+// Waits between frames so the game runs at its room speed. It sleeps for most of the wait and only spins for the last bit,
+// so a game that's keeping up uses hardly any CPU while it waits. Frame start times are kept on an absolute schedule,
+// so rounding and oversleeping don't add up over time and make the game run slow.
+class FramePacer {
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    FramePacePolicy _policy;
+    unsigned int _maxCatchUp;
+    Clock::time_point _frameStart;
+    Clock::time_point _next;  // When the next frame should start
+    FramePacerStats _stats;
+
+    // How long a short sleep really takes, learned as it goes, so it knows when to stop sleeping and start spinning
+    double _sleepMean;
+    double _sleepM2;
+    unsigned long long _sleepCount;
+    double _sleepEstimate;
+
+    // Frame work times in 0.1ms buckets, the last one being everything over 100ms, for percentiles
+    static constexpr unsigned int HISTOGRAM_BUCKETS = 1001;
+    unsigned int _histogram[HISTOGRAM_BUCKETS];
+
+    void _SleepUntil(Clock::time_point until);
+
+  public:
+    // maxCatchUp is how many frames behind PACE_CATCH_UP is allowed to get before it gives up on them and starts again from now
+    // On Windows the system timer runs at 1ms for as long as there's a FramePacer, so it can't be copied.
+    FramePacer(FramePacePolicy policy = PACE_SKIP, unsigned int maxCatchUp = 5);
+    ~FramePacer();
+    FramePacer(const FramePacer&) = delete;
+    FramePacer& operator=(const FramePacer&) = delete;
+
+    // Call just before the first frame
+    void Start();
+
+    // Call after each frame, with how long a frame should take. Records how long this one took and returns when the next one should start.
+    void Wait(double interval);
+
+    const FramePacerStats& Stats() const { return _stats; }
+
+    // The frame work time that p (0 to 1) of all frames came in under. It's the top of the 0.1ms bucket that frame fell in, so it's up to 0.1ms
+    // over, never under. Past 100ms it's the slowest frame there's been.
+    double WorkPercentile(double p) const;
+};
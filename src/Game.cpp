@@ -1,17 +1,19 @@
 #include "Game.hpp"
+#include "AssetStreamer.hpp"
+#include "BlockInflater.hpp"
 #include "CodeActionManager.hpp"
 #include "CodeRunner.hpp"
+#include "FileMapping.hpp"
+#include "GameCache.hpp"
 #include "GamePrivateGlobals.hpp"
 #include "InputHandler.hpp"
 #include "Instance.hpp"
+#include "PixelUtil.hpp"
 #include "Renderer.hpp"
 #include "StreamUtil.hpp"
-#include <fstream>
-#include <new>
+#include <chrono>
 #include <string.h>
-#include <zlib.h>
-
-constexpr unsigned int ZLIB_BUF_START = 65536;
+#include <string>
 
 #pragma region Helper functions for parsing the filestream - no need for these to be member functions.
 
@@ -142,95 +144,6 @@ bool DecryptData(unsigned char* pStream, unsigned int* pPos) {
 }
 
 
-// Read and inflate a data block from a byte stream
-// OutBuffer must already be initialized and the size of it must be passed in OutSize. A bigger buffer will result in less iterations, thus a faster return.
-// On success, the function will overwrite OutBuffer and OutBufferSize with the new buffer and max size. OutSize contains the number of bytes in the output.
-bool InflateBlock(unsigned char* pStream, unsigned int* pPos, unsigned char** pOutBuffer, unsigned int* pOutBufferSize, unsigned int* pOutSize) {
-    // The first dword is the length in bytes of the compressed data following it.
-    unsigned int len = ReadDword(pStream, pPos);
-
-    // Start inflation
-    z_stream strm;
-    unsigned char* inflatedDataTmp;
-    unsigned int inflatedDataSize = 0;
-    int ret;
-
-    strm.zalloc = Z_NULL;
-    strm.zfree = Z_NULL;
-    strm.opaque = Z_NULL;
-
-    if (inflateInit(&strm) != Z_OK) {
-        // Error starting inflation
-        return false;
-    }
-
-    // Input chunk
-    strm.next_in = pStream + (*pPos);
-    strm.avail_in = len;
-    strm.next_out = (*pOutBuffer);
-    strm.avail_out = (*pOutBufferSize);
-
-    ret = inflate(&strm, Z_NO_FLUSH);
-    if (ret == Z_STREAM_END) {
-        // Success - output stream already ended, let's go home early
-        inflateEnd(&strm);
-        (*pOutSize) = (*pOutBufferSize) - strm.avail_out;
-        (*pPos) += len;
-        return true;
-    }
-    else if (ret != Z_OK) {
-        // Error inflating
-        inflateEnd(&strm);
-        return false;
-    }
-
-    // Copy new data to inflatedData
-    unsigned int availOut = (*pOutBufferSize) - strm.avail_out;
-    unsigned char* inflatedData = ( unsigned char* )malloc(availOut);
-    memcpy(inflatedData, (*pOutBuffer), availOut);
-    inflatedDataSize = availOut;
-
-    // There may be more data to be output by inflate(), so we grab that until Z_STREAM_END if we don't have it already.
-    while (ret != Z_STREAM_END) {
-        strm.next_out = (*pOutBuffer);
-        strm.avail_out = (*pOutBufferSize);
-        strm.next_in = pStream + (*pPos) + (len - strm.avail_in);
-
-        ret = inflate(&strm, Z_NO_FLUSH);
-        if ((ret != Z_OK) && (ret != Z_STREAM_END)) {
-            // Error inflating
-            inflateEnd(&strm);
-            free(inflatedData);
-            return false;
-        }
-
-        // Copy new data to inflatedData
-        availOut = (*pOutBufferSize) - strm.avail_out;
-        inflatedDataTmp = ( unsigned char* )malloc(availOut + inflatedDataSize);
-        memcpy(inflatedDataTmp, inflatedData, inflatedDataSize);
-        memcpy((inflatedDataTmp + inflatedDataSize), (*pOutBuffer), availOut);
-        free(inflatedData);
-        inflatedData = inflatedDataTmp;
-        inflatedDataSize += availOut;
-    }
-
-    // Clean up and exit
-    if (inflatedDataSize > (*pOutBufferSize)) {
-        free(*pOutBuffer);
-        (*pOutBuffer) = inflatedData;
-        (*pOutBufferSize) = inflatedDataSize;
-    }
-    else {
-        memcpy((*pOutBuffer), inflatedData, inflatedDataSize);
-        free(inflatedData);
-    }
-
-    (*pOutSize) = inflatedDataSize;
-    inflateEnd(&strm);
-    (*pPos) += len;
-    return true;
-}
-
 #pragma endregion
 
 #pragma region Global extern definitions
@@ -251,6 +164,8 @@ void GameInit() {
     _lastUsedRoomSpeed = 0;
 }
 
+void _StopStreaming();
+
 void GameTerminate() {
     // Run "Game End" events
     InstanceList::Iterator iter;
@@ -260,6 +175,7 @@ void GameTerminate() {
     }
 
     // Clean up
+    _StopStreaming();
     free(_info.caption);
     free(_info.gameInfo);
     delete[] _roomOrder;
@@ -269,346 +185,678 @@ void GameTerminate() {
     CodeActionManager::Finalize();
 }
 
-bool GameLoad(const char* pFilename) {
-    // Init DND manager
-    if (!CodeActionManager::Init()) {
-        return false;
+// Where everything after the extensions is in the exe, found by _IndexGameData without inflating anything
+struct GameDataIndex {
+    std::vector<DataBlock> blocks;  // Every block in file order
+    size_t sectionStart[SECTION_COUNT + 1];  // The blocks of a section go from its sectionStart to the next section's
+    unsigned int constantsPos;  // Constants, last IDs and room order aren't in blocks, so these point straight at them
+    unsigned int lastIdsPos;
+    unsigned int roomOrderPos;
+
+    size_t First(GameDataSection section) const { return sectionStart[section]; }
+    size_t End(GameDataSection section) const { return sectionStart[section + 1]; }
+    size_t Count(GameDataSection section) const { return End(section) - First(section); }
+};
+
+// Checks that there are at least len bytes left in the stream after pos
+bool _CanRead(unsigned int streamLength, unsigned int pos, unsigned int len) { return pos <= streamLength && len <= streamLength - pos; }
+
+// Adds a section of blocks to the index and skips over it. Game information is a single block, every other section starts with a block count.
+bool _IndexSection(const unsigned char* pStream, unsigned int streamLength, unsigned int* pPos, GameDataIndex* index, GameDataSection section) {
+    if (!_CanRead(streamLength, *pPos, 8)) return false;
+    (*pPos) += 4;
+    unsigned int count = (section == SECTION_GAME_INFO) ? 1 : ReadDword(pStream, pPos);
+
+    index->sectionStart[section] = index->blocks.size();
+    for (; count > 0; count--) {
+        if (!_CanRead(streamLength, *pPos, 4)) return false;
+        DataBlock block;
+        block.pos = (*pPos);
+        unsigned int len = ReadDword(pStream, pPos);
+        if (!_CanRead(streamLength, *pPos, len)) return false;
+        (*pPos) += len;
+        index->blocks.push_back(block);
     }
+    index->sectionStart[section + 1] = index->blocks.size();
+    return true;
+}
 
-    // Init the runner
-    if (!CodeManager::Init(&_globals)) {
-        return false;
+// Walks everything after the extensions, recording where it all is. Returns false if anything runs off the end of the stream.
+bool _IndexGameData(const unsigned char* pStream, unsigned int streamLength, unsigned int pos, GameDataIndex* index) {
+    if (!_IndexSection(pStream, streamLength, &pos, index, SECTION_TRIGGERS)) return false;
+
+    // Constants are pairs of strings
+    if (!_CanRead(streamLength, pos, 8)) return false;
+    pos += 4;
+    index->constantsPos = pos;
+    unsigned int count = ReadDword(pStream, &pos);
+    for (count *= 2; count > 0; count--) {
+        if (!_CanRead(streamLength, pos, 4)) return false;
+        unsigned int len = ReadDword(pStream, &pos);
+        if (!_CanRead(streamLength, pos, len)) return false;
+        pos += len;
     }
 
-    // Load the entirety of the file into a memory buffer
-    // fs::path(pFilename)
-    std::ifstream ifs(pFilename, std::ios::binary | std::ios::ate);
+    for (int section = SECTION_SOUNDS; section <= SECTION_ROOMS; section++) {
+        if (!_IndexSection(pStream, streamLength, &pos, index, ( GameDataSection )section)) return false;
+    }
 
-    if (!ifs.is_open() || ifs.bad()) {
-        // This really should be more verbose.
-        // Failed to open file.
-        return false;
+    if (!_CanRead(streamLength, pos, 8)) return false;
+    index->lastIdsPos = pos;
+    pos += 8;
+
+    if (!_IndexSection(pStream, streamLength, &pos, index, SECTION_INCLUDE_FILES)) return false;
+    if (!_IndexSection(pStream, streamLength, &pos, index, SECTION_GAME_INFO)) return false;
+
+    // Garbage?
+    if (!_CanRead(streamLength, pos, 8)) return false;
+    pos += 4;
+    count = ReadDword(pStream, &pos);
+    for (; count > 0; count--) {
+        if (!_CanRead(streamLength, pos, 4)) return false;
+        unsigned int len = ReadDword(pStream, &pos);
+        if (!_CanRead(streamLength, pos, len)) return false;
+        pos += len;
+    }
+
+    // Room order
+    if (!_CanRead(streamLength, pos, 8)) return false;
+    pos += 4;
+    index->roomOrderPos = pos;
+    unsigned int roomOrderCount = ReadDword(pStream, &pos);
+    return roomOrderCount <= (streamLength - pos) / 4;
+}
+
+#pragma region Load stats
+// Only collected while GameLoad is running with GameLoadOptions::stats set
+GameLoadStats* _loadStats = NULL;
+int _decodingSection = -1;  // Section of the last block _GetBlock handed out. It's being decoded until the next call.
+double _decodeStart;
+
+const char* GameLoadPhaseName(GameLoadPhase phase) {
+    static const char* names[LOAD_PHASE_COUNT] = {"map", "hash", "cache_read", "header_scan", "decrypt81", "settings", "decrypt_data", "extensions",
+                                                  "index", "assets", "first_room", "cache_write", "object_identities", "gml_cache_read", "gml_compile", "gml_cache_write"};
+    return names[phase];
+}
+
+const char* GameDataSectionName(GameDataSection section) {
+    static const char* names[SECTION_COUNT] = {"triggers", "sounds", "sprites", "backgrounds", "paths", "scripts", "fonts", "timelines", "objects", "rooms", "include_files", "game_info"};
+    return names[section];
+}
+
+double _Now() { return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+
+// Adds the time since start to a phase
+void _EndPhase(GameLoadPhase phase, double start, unsigned long long bytes = 0) {
+    if (!_loadStats) return;
+    _loadStats->phases[phase].seconds += _Now() - start;
+    _loadStats->phases[phase].bytes += bytes;
+}
+
+void _EndDecode(double now) {
+    if (_decodingSection >= 0) _loadStats->sections[_decodingSection].decodeSeconds += now - _decodeStart;
+    _decodingSection = -1;
+}
+
+// Adds up what the inflater's workers did, once they're done
+void _CollectInflateStats(const unsigned char* pStream, const GameDataIndex& index) {
+    if (!_loadStats) return;
+    for (int section = 0; section < SECTION_COUNT; section++) {
+        GameLoadSectionStats& stats = _loadStats->sections[section];
+        for (size_t b = index.First(( GameDataSection )section); b < index.End(( GameDataSection )section); b++) {
+            unsigned int pos = index.blocks[b].pos;
+            stats.compressedBytes += ReadDword(pStream, &pos);
+            stats.inflateSeconds += index.blocks[b].inflateSeconds;
+        }
     }
+}
+#pragma endregion
+
+// Reads a sprite's frames and collision masks, starting at its first frame. The pixels are converted to RGBA in place, and where each frame's width is goes in frameOffsets.
+// The collision maps are allocated and unpacked, but the sprite's size and frames are left to the caller. Returns false if a frame's size doesn't add up.
+bool _ReadSpriteFrames(unsigned char* data, unsigned int* pDataPos, Sprite* sprite, std::vector<unsigned int>* frameOffsets) {
+    unsigned int dataPos = *pDataPos;
+
+    // Frame data
+    unsigned int i;
+    for (i = 0; i < sprite->frameCount; i++) {
+        dataPos += 4;
+        frameOffsets->push_back(dataPos);
+
+        unsigned int frameW = ReadDword(data, &dataPos);
+        unsigned int frameH = ReadDword(data, &dataPos);
+        unsigned int pixelDataLength = ReadDword(data, &dataPos);
 
-    std::streamsize file_size = ifs.tellg();
-    unsigned char* buffer;
+        if (pixelDataLength != (frameW * frameH * 4)) {
+            // This should never happen
+            return false;
+        }
 
-    try {
-        buffer = new unsigned char[static_cast<unsigned int>(file_size)];
+        // Convert BGRA to RGBA
+        SwapRedBlue(data + dataPos, pixelDataLength / 4);
+        dataPos += pixelDataLength;
     }
-    catch (const std::bad_alloc&) {
-        // This really should be more verbose.
-        // Failed to allocate memory.
-        return false;
+
+    // Collision data
+    sprite->separateCollision = ReadDword(data, &dataPos);
+    unsigned int mapCount = sprite->separateCollision ? sprite->frameCount : 1;
+    sprite->collisionMaps = new CollisionMap[mapCount];
+    for (i = 0; i < mapCount; i++) {
+        dataPos += 4;
+
+        CollisionMap* map = &(sprite->collisionMaps[i]);
+        map->width = ReadDword(data, &dataPos);
+        map->height = ReadDword(data, &dataPos);
+        map->left = ReadDword(data, &dataPos);
+        map->right = ReadDword(data, &dataPos);
+        map->bottom = ReadDword(data, &dataPos);
+        map->top = ReadDword(data, &dataPos);
+
+        unsigned int maskSize = map->width * map->height;
+        map->collision = new bool[maskSize];
+        UnpackMask(data + dataPos, map->collision, maskSize);
+        dataPos += maskSize * 4;
     }
 
-    ifs.seekg(std::ios::beg);
-    ifs.read(reinterpret_cast<char*>(buffer), file_size);
-    ifs.close();
+    (*pDataPos) = dataPos;
+    return true;
+}
 
-    // Check if this is a valid exe
+#pragma region Progressive loading
+// A sprite or background that was loaded from just the start of its block, enough for its name and size. A job inflates the rest straight out of the exe,
+// then converts its pixels and unpacks its collision masks.
+struct _DeferredAsset {
+    GameDataSection section;  // SECTION_SPRITES or SECTION_BACKGROUNDS
+    unsigned int index;
+    unsigned int pos;  // Where its block is in _streamFile
+    RImageIndex image;  // A background's image, looked up now since background_create_color can move the backgrounds while jobs run
+};
+std::vector<_DeferredAsset> _deferredAssets;
+std::vector<int> _spriteJobs;  // Each sprite's job in _deferredAssets, or -1 if it was decoded during the load
+std::vector<int> _backgroundJobs;
+AssetStreamer* _streamer = NULL;
+FileMapping _streamFile;  // The exe, kept mapped until the last deferred asset has been inflated out of it
+
+// Inflates the start of a sprite or background block: its exists flag, its name, and fixedLength bytes after that.
+// Anything past the end of the block reads as zeroes. Returns false if the block can't be inflated.
+bool _InflateAssetHeader(unsigned char* stream, const DataBlock& block, unsigned int fixedLength, std::vector<unsigned char>* header) {
+    constexpr unsigned int FIRST_GUESS = 256;
+    header->assign(FIRST_GUESS, 0);
+    unsigned int length;
+    if (!InflateBlockStart(stream, block.pos, header->data(), FIRST_GUESS, &length)) return false;
+    if (length < FIRST_GUESS) return true;
+
+    // Only a long name gets this far
+    unsigned int namePos = 4;
+    unsigned int wanted = 8 + ReadDword(header->data(), &namePos) + fixedLength;
+    if (wanted <= FIRST_GUESS) return true;
+    header->assign(wanted, 0);
+    return InflateBlockStart(stream, block.pos, header->data(), wanted, &length);
+}
 
-    if (static_cast<unsigned int>(file_size) < 0x1B) {
-        // Invalid file, too small to be an exe
-        delete[] buffer;
-        return false;
+// Loads a sprite's name, origin and size from the start of its block, and leaves the rest for a job. Its frames get their places in the atlases now.
+// GM8 gives every frame of a sprite the same size, so they're all made the size of the first one.
+bool _ReadDeferredSprite(unsigned char* stream, const DataBlock& block, unsigned int spriteIndex, Sprite* sprite) {
+    std::vector<unsigned char> header;
+    if (!_InflateAssetHeader(stream, block, 28, &header)) return false;
+    unsigned char* data = header.data();
+
+    unsigned int dataPos = 0;
+    if (!ReadDword(data, &dataPos)) {
+        sprite->exists = false;
+        return true;
+    }
+    sprite->name = ReadString(data, &dataPos);
+    dataPos += 4;
+    sprite->originX = ReadDword(data, &dataPos);
+    sprite->originY = ReadDword(data, &dataPos);
+    sprite->frameCount = ReadDword(data, &dataPos);
+    if (!sprite->frameCount) {
+        // No frames
+        sprite->width = 1;
+        sprite->height = 1;
+        return true;
     }
 
-    if (!(buffer[0] == 'M' && buffer[1] == 'Z')) {
-        // Invalid file, not an exe
-        delete[] buffer;
-        return false;
+    dataPos += 4;
+    sprite->width = ReadDword(data, &dataPos);
+    sprite->height = ReadDword(data, &dataPos);
+    sprite->frames = ( RImageIndex* )malloc(sizeof(RImageIndex) * sprite->frameCount);
+    for (unsigned int i = 0; i < sprite->frameCount; i++) {
+        sprite->frames[i] = RMakeImageDeferred(sprite->width, sprite->height, sprite->originX, sprite->originY);
     }
+    _spriteJobs[spriteIndex] = static_cast<int>(_deferredAssets.size());
+    _deferredAssets.push_back({SECTION_SPRITES, spriteIndex, block.pos, 0});
+    return true;
+}
 
-    // Find game version by searching for headers
+// Loads a background's name and size from the start of its block, and leaves its pixels for a job
+bool _ReadDeferredBackground(unsigned char* stream, const DataBlock& block, unsigned int backgroundIndex, Background* background) {
+    std::vector<unsigned char> header;
+    if (!_InflateAssetHeader(stream, block, 16, &header)) return false;
+    unsigned char* data = header.data();
 
-    unsigned int pos;
-    int version = 0;
+    unsigned int dataPos = 0;
+    if (!ReadDword(data, &dataPos)) {
+        background->exists = false;
+        return true;
+    }
+    background->name = ReadString(data, &dataPos);
+    dataPos += 8;
+    background->width = ReadDword(data, &dataPos);
+    background->height = ReadDword(data, &dataPos);
+    if (background->width > 0 && background->height > 0) {
+        background->image = RMakeImageDeferred(background->width, background->height, 0, 0);
+        _backgroundJobs[backgroundIndex] = static_cast<int>(_deferredAssets.size());
+        _deferredAssets.push_back({SECTION_BACKGROUNDS, backgroundIndex, block.pos, background->image});
+    }
+    return true;
+}
 
-    // GM8.0 header
-    pos = 2000000;
-    if (ReadDword(buffer, &pos) == 1234321) {
-        version = 800;
-        pos += 8;
+// Inflates a deferred asset and decodes it the same way _ReadGameData would have, then hands its pixels to the renderer.
+// The pixels have to be handed over before the block is kept, or the renderer could free it before it knows what's in it.
+void _DecodeDeferred(size_t job) {
+    const _DeferredAsset& asset = _deferredAssets[job];
+    unsigned int pos = asset.pos;
+    unsigned int bufferSize = ZLIB_BUF_START;
+    unsigned int length = 0;
+    unsigned char* block = ( unsigned char* )malloc(bufferSize);
+    if (block && !InflateBlock(_streamFile.data, &pos, &block, &bufferSize, &length)) {
+        free(block);
+        block = NULL;
     }
-    else {
-        // GM8.1 header
-        pos = 3800004;
-        for (int i = 0; i < 1024; i++) {
-            if ((ReadDword(buffer, &pos) & 0xFF00FF00) == 0xF7000000) {
-                if ((ReadDword(buffer, &pos) & 0x00FF00FF) == 0x00140067) {
 
-                    version = 810;
-                    Decrypt81(buffer, static_cast<unsigned int>(file_size), &pos);
+    // Past the exists flag and the name
+    unsigned int dataPos = 4;
+    if (block) dataPos += ReadDword(block, &dataPos);
+
+    if (asset.section == SECTION_BACKGROUNDS) {
+        if (!block) return;
+        dataPos += 16;
+        unsigned int len = ReadDword(block, &dataPos);
+        SwapRedBlue(block + dataPos, len / 4);
+        RSetImagePixels(asset.image, block + dataPos);
+        RKeepBuffer(block);
+        return;
+    }
 
-                    pos += 16;
-                    break;
-                }
-                else {
-                    pos -= 4;
-                }
-            }
-        }
+    Sprite* sprite = AssetManager::GetSprite(asset.index);
+    std::vector<unsigned int> frameOffsets;
+    dataPos += 16;
+    if (!block || !_ReadSpriteFrames(block, &dataPos, sprite, &frameOffsets)) {
+        // It can't be drawn, but collision checks still need a mask, so it gets one that never collides
+        free(block);
+        sprite->separateCollision = false;
+        sprite->collisionMaps = new CollisionMap[1];
+        sprite->collisionMaps[0] = {0, 0, 0, 0, 1, 1, new bool[1]()};
+        return;
     }
 
-    if (!version) {
-        // No game version found
-        delete[] buffer;
-        return false;
+    // Like a sprite decoded during the load, the block is cut down to the frames and they're drawn straight out of it
+    unsigned int framesEnd = frameOffsets.back() + 8;
+    framesEnd += ReadDword(block, &framesEnd);
+    unsigned char* trimmed = ( unsigned char* )realloc(block, framesEnd);
+    if (trimmed) block = trimmed;
+    for (size_t i = 0; i < frameOffsets.size(); i++) {
+        unsigned int framePos = frameOffsets[i];
+        unsigned int frameW = ReadDword(block, &framePos);
+        unsigned int frameH = ReadDword(block, &framePos);
+
+        // A frame that isn't the size of the first one doesn't fit the image made for it, so it's left blank
+        if (frameW == sprite->width && frameH == sprite->height) RSetImagePixels(sprite->frames[i], block + framePos + 4);
     }
+    RKeepBuffer(block);
+}
 
-    // Read all the data blocks.
+// Adds the jobs for everything a room draws or collides with: its backgrounds and tiles, and the sprites and masks of the objects it has instances of
+void _RoomJobs(unsigned int roomIndex, std::vector<size_t>* jobs) {
+    if (roomIndex >= AssetManager::GetRoomCount() || !AssetManager::GetRoom(roomIndex)->exists) return;
+    Room* room = AssetManager::GetRoom(roomIndex);
 
-    // Init variables
-    unsigned int dataLength = ZLIB_BUF_START;
-    unsigned char* data = ( unsigned char* )malloc(dataLength);
-    unsigned int outputSize;
+    auto addJob = [jobs](const std::vector<int>& assetJobs, int index) {
+        if (index >= 0 && index < static_cast<int>(assetJobs.size()) && assetJobs[index] >= 0) jobs->push_back(assetJobs[index]);
+    };
+    for (unsigned int i = 0; i < room->backgroundCount; i++) {
+        addJob(_backgroundJobs, room->backgrounds[i].backgroundIndex);
+    }
+    for (unsigned int i = 0; i < room->tileCount; i++) {
+        addJob(_backgroundJobs, room->tiles[i].backgroundIndex);
+    }
+    for (unsigned int i = 0; i < room->instanceCount; i++) {
+        if (room->instances[i].objectIndex < AssetManager::GetObjectCount()) {
+            Object* o = AssetManager::GetObject(room->instances[i].objectIndex);
+            addJob(_spriteJobs, o->spriteIndex);
+            addJob(_spriteJobs, o->maskIndex);
+        }
+    }
+}
 
-    // Settings Data Chunk
-    pos += 4;
-    if (!InflateBlock(buffer, &pos, &data, &dataLength, &outputSize)) {
-        // Error reading settings block
-        free(data);
-        delete[] buffer;
-        return false;
+// Starts decoding everything that was deferred, rooms in room order, and waits for what the first room needs
+void _StartStreaming() {
+    if (_deferredAssets.empty()) return;
+    std::vector<size_t> order;
+    for (unsigned int i = 0; i < _roomOrderCount; i++) {
+        _RoomJobs(_roomOrder[i], &order);
     }
-    else {
+    // The exe's pages are dirty from being decrypted in place (or it's a heap copy with --no-mmap), so it goes as soon as nothing needs it
+    _streamer = new AssetStreamer(_deferredAssets.size(), _DecodeDeferred, []() { FileUnmap(&_streamFile); }, order);
+    if (_roomOrderCount) GameWaitForRoomAssets(_roomOrder[0]);
+}
 
-        unsigned int settingsPos = 0;
-        settings.fullscreen = ReadDword(data, &settingsPos);
-        settings.interpolate = ReadDword(data, &settingsPos);
-        settings.drawBorder = !ReadDword(data, &settingsPos);
-        settings.displayCursor = ReadDword(data, &settingsPos);
-        settings.scaling = ReadDword(data, &settingsPos);
-        settings.allowWindowResize = ReadDword(data, &settingsPos);
-        settings.onTop = ReadDword(data, &settingsPos);
-        settings.colourOutsideRoom = ReadDword(data, &settingsPos);
-        settings.setResolution = ReadDword(data, &settingsPos);
-        settings.colourDepth = ReadDword(data, &settingsPos);
-        settings.resolution = ReadDword(data, &settingsPos);
-        settings.frequency = ReadDword(data, &settingsPos);
-        settings.showButtons = !ReadDword(data, &settingsPos);
-        settings.vsync = ReadDword(data, &settingsPos);
-        settings.disableScreen = ReadDword(data, &settingsPos);
-        settings.letF4 = ReadDword(data, &settingsPos);
-        settings.letF1 = ReadDword(data, &settingsPos);
-        settings.letEsc = ReadDword(data, &settingsPos);
-        settings.letF5 = ReadDword(data, &settingsPos);
-        settings.letF9 = ReadDword(data, &settingsPos);
-        settings.treatCloseAsEsc = ReadDword(data, &settingsPos);
-        settings.priority = ReadDword(data, &settingsPos);
-        settings.freeze = ReadDword(data, &settingsPos);
+void _StopStreaming() {
+    // Anything decoded belongs to the renderer now, and nothing else was ever inflated
+    if (_streamer) _streamer->Stop();
+    delete _streamer;
+    _streamer = NULL;
+    FileUnmap(&_streamFile);  // Still mapped if it stopped before every job was done
+    _deferredAssets.clear();
+    _spriteJobs.clear();
+    _backgroundJobs.clear();
+}
 
-        settings.loadingBar = ReadDword(data, &settingsPos);
-        if (settings.loadingBar) {
-            unsigned int loadingDataLength = ZLIB_BUF_START;
-            unsigned char* loadingData = ( unsigned char* )malloc(loadingDataLength);
+void GameWaitForSprite(unsigned int index) {
+    if (_streamer && index < _spriteJobs.size() && _spriteJobs[index] >= 0) _streamer->Wait(_spriteJobs[index]);
+}
 
-            if (ReadDword(data, &settingsPos)) {
-                // read backdata
-                if (!InflateBlock(data, &settingsPos, &loadingData, &loadingDataLength, &outputSize)) {
-                    // Error reading backdata
-                    free(loadingData);
-                    free(data);
-                    delete[] buffer;
-                    return false;
-                }
+void GameWaitForBackground(unsigned int index) {
+    if (_streamer && index < _backgroundJobs.size() && _backgroundJobs[index] >= 0) _streamer->Wait(_backgroundJobs[index]);
+}
 
-                // BackData is in loadingData and has length of loadingDataLength. Do whatever with it
-                // But don't keep it there because it will be overwritten and then freed.
-            }
-            if (ReadDword(data, &settingsPos)) {
-                // read frontdata
-                if (!InflateBlock(data, &settingsPos, &loadingData, &loadingDataLength, &outputSize)) {
-                    // Error reading frontdata
-                    free(loadingData);
-                    free(data);
-                    delete[] buffer;
-                    return false;
-                }
+void GameWaitForRoomAssets(unsigned int room) {
+    if (!_streamer) return;
+    std::vector<size_t> jobs;
+    _RoomJobs(room, &jobs);
+    for (size_t job : jobs) {
+        _streamer->Wait(job);
+    }
+}
+#pragma endregion
 
-                // FrontData is in loadingData and has length of loadingDataLength. Do whatever with it
-                // But don't keep it there because it will be freed.
+// Gets a block's data. When there's no inflater the blocks are coming from a cache, and the index already points at their data.
+unsigned char* _GetBlock(const GameDataIndex& index, BlockInflater* inflater, size_t b, unsigned int* pLength) {
+    double start = 0;
+    if (_loadStats) {
+        start = _Now();
+        _EndDecode(start);
+    }
+
+    unsigned char* data;
+    if (inflater) {
+        data = inflater->Wait(b, pLength);
+    }
+    else {
+        (*pLength) = index.blocks[b].length;
+        data = index.blocks[b].data;
+    }
+
+    if (_loadStats) {
+        int section = SECTION_TRIGGERS;
+        while (b >= index.End(( GameDataSection )section)) section++;
+        GameLoadSectionStats& stats = _loadStats->sections[section];
+        _decodeStart = _Now();
+        _decodingSection = section;
+        stats.waitSeconds += _decodeStart - start;
+        stats.blocks++;
+        stats.inflatedBytes += (*pLength);
+    }
+    return data;
+}
+
+// Sprites, backgrounds and fonts are cached already decoded: RGBA pixels, one byte per collision mask pixel, and fonts' alpha expanded to RGBA.
+// Everything else is cached exactly as it was inflated from the exe.
+
+void _WriteCachedExtension(GameCacheWriter* cache, const Extension* extension) {
+    cache->BeginRecord();
+    cache->WriteString(extension->name);
+    cache->WriteString(extension->folderName);
+    cache->WriteDword(extension->fileCount);
+    for (unsigned int i = 0; i < extension->fileCount; i++) {
+        const ExtensionFile* extfile = extension->files + i;
+        cache->WriteString(extfile->filename);
+        cache->WriteDword(extfile->kind);
+        cache->WriteString(extfile->initializer);
+        cache->WriteString(extfile->finalizer);
+
+        cache->WriteDword(extfile->functionCount);
+        for (unsigned int ii = 0; ii < extfile->functionCount; ii++) {
+            const ExtensionFileFunction* function = extfile->functions + ii;
+            cache->WriteString(function->name);
+            cache->WriteString(function->externalName);
+            cache->WriteDword(function->convention);
+            cache->WriteDword(function->argCount);
+            for (unsigned int j = 0; j < 17; j++) {
+                cache->WriteDword(function->argTypes[j]);
             }
+            cache->WriteDword(function->returnType);
+        }
 
-            free(loadingData);
+        cache->WriteDword(extfile->constCount);
+        for (unsigned int ii = 0; ii < extfile->constCount; ii++) {
+            cache->WriteString(extfile->consts[ii].name);
+            cache->WriteString(extfile->consts[ii].value);
         }
 
-        settings.customLoadImage = ReadDword(data, &settingsPos);
-        if (settings.customLoadImage) {
-            // Read load image data
-            unsigned int imageDataLength = ZLIB_BUF_START;
-            unsigned char* imageData = ( unsigned char* )malloc(imageDataLength);
+        cache->WriteDword(extfile->dataLength);
+        cache->WriteBytes(extfile->data, extfile->dataLength);
+    }
+    cache->EndRecord();
+}
 
-            if (!InflateBlock(data, &settingsPos, &imageData, &imageDataLength, &outputSize)) {
-                // Error reading custom load image
-                free(imageData);
-                free(data);
-                delete[] buffer;
-                return false;
+void _ReadCachedExtension(unsigned char* data, Extension* extension) {
+    unsigned int dataPos = 0;
+    extension->name = ReadString(data, &dataPos);
+    extension->folderName = ReadString(data, &dataPos);
+    extension->fileCount = ReadDword(data, &dataPos);
+    extension->files = new ExtensionFile[extension->fileCount];
+    for (unsigned int i = 0; i < extension->fileCount; i++) {
+        ExtensionFile* extfile = extension->files + i;
+        extfile->filename = ReadString(data, &dataPos);
+        extfile->kind = ReadDword(data, &dataPos);
+        extfile->initializer = ReadString(data, &dataPos);
+        extfile->finalizer = ReadString(data, &dataPos);
+
+        extfile->functionCount = ReadDword(data, &dataPos);
+        extfile->functions = new ExtensionFileFunction[extfile->functionCount];
+        for (unsigned int ii = 0; ii < extfile->functionCount; ii++) {
+            ExtensionFileFunction* function = extfile->functions + ii;
+            function->name = ReadString(data, &dataPos);
+            function->externalName = ReadString(data, &dataPos);
+            function->convention = ReadDword(data, &dataPos);
+            function->argCount = ReadDword(data, &dataPos);
+            for (unsigned int j = 0; j < 17; j++) {
+                function->argTypes[j] = ReadDword(data, &dataPos);
             }
+            function->returnType = ReadDword(data, &dataPos);
+        }
 
-            // Custom image data is loaded in the format of a BMP file (Always BMP I assume? Check?) Do whatever with it but don't keep it there because it will be freed.
-
-            free(imageData);
+        extfile->constCount = ReadDword(data, &dataPos);
+        extfile->consts = new ExtensionFileConst[extfile->constCount];
+        for (unsigned int ii = 0; ii < extfile->constCount; ii++) {
+            extfile->consts[ii].name = ReadString(data, &dataPos);
+            extfile->consts[ii].value = ReadString(data, &dataPos);
         }
 
-        settings.transparent = ReadDword(data, &settingsPos);
-        settings.translucency = ReadDword(data, &settingsPos);
-        settings.scaleProgressBar = ReadDword(data, &settingsPos);
-        settings.errorDisplay = ReadDword(data, &settingsPos);
-        settings.errorLog = ReadDword(data, &settingsPos);
-        settings.errorAbort = ReadDword(data, &settingsPos);
+        extfile->dataLength = ReadDword(data, &dataPos);
+        extfile->data = ( unsigned char* )malloc(extfile->dataLength);
+        memcpy(extfile->data, data + dataPos, extfile->dataLength);
+        dataPos += extfile->dataLength;
+    }
+}
 
-        unsigned int uninit = ReadDword(data, &settingsPos);
-        if (version == 810) {
-            settings.treatAsZero = uninit & 1;
-            settings.errorOnUninitialization = uninit & 2;
+// Writes a sprite to the cache. frameOffsets are where each frame's width is in the (already swizzled) block data.
+void _WriteCachedSprite(GameCacheWriter* cache, const Sprite* sprite, const unsigned char* data, const std::vector<unsigned int>& frameOffsets) {
+    cache->BeginRecord();
+    cache->WriteDword(sprite->exists);
+    if (sprite->exists) {
+        cache->WriteString(sprite->name);
+        cache->WriteDword(sprite->originX);
+        cache->WriteDword(sprite->originY);
+        cache->WriteDword(sprite->frameCount);
+        cache->WriteDword(sprite->width);
+        cache->WriteDword(sprite->height);
+        for (unsigned int offset : frameOffsets) {
+            unsigned int w = ReadDword(data, &offset);
+            unsigned int h = ReadDword(data, &offset);
+            cache->WriteDword(w);
+            cache->WriteDword(h);
+            cache->WriteBytes(data + offset + 4, w * h * 4);
         }
-        else {
-            settings.treatAsZero = uninit;
-            settings.errorOnUninitialization = true;
+
+        if (sprite->frameCount) {
+            cache->WriteDword(sprite->separateCollision);
+            unsigned int mapCount = sprite->separateCollision ? sprite->frameCount : 1;
+            for (unsigned int i = 0; i < mapCount; i++) {
+                const CollisionMap* map = sprite->collisionMaps + i;
+                cache->WriteDword(map->width);
+                cache->WriteDword(map->height);
+                cache->WriteDword(map->left);
+                cache->WriteDword(map->right);
+                cache->WriteDword(map->bottom);
+                cache->WriteDword(map->top);
+                cache->WriteBytes(map->collision, map->width * map->height);
+            }
         }
     }
+    cache->EndRecord();
+}
 
-    // Skip over the D3D wrapper
-    pos += ReadDword(buffer, &pos);
-    pos += ReadDword(buffer, &pos);
+void _ReadCachedSprite(unsigned char* data, Sprite* sprite) {
+    static_assert(sizeof(bool) == 1, "collision masks are cached one byte per pixel");
 
-    // There's yet another encryption layer on the rest of the data paragraphs.
-    if (!DecryptData(buffer, &pos)) {
-        // Error decrypting
-        free(data);
-        delete[] buffer;
-        return false;
+    unsigned int dataPos = 0;
+    if (!ReadDword(data, &dataPos)) {
+        sprite->exists = false;
+        return;
     }
 
-    // Garbage fields
-    pos += (ReadDword(buffer, &pos) + 6) * 4;
-
-
-    // Extensions
-
-    pos += 4;
-    unsigned char* charTable = NULL;
-    unsigned int count = ReadDword(buffer, &pos);
-    if (count) charTable = ( unsigned char* )malloc(0x200);
-    AssetManager::ReserveExtensions(count);
-    for (; count > 0; count--) {
-        Extension* extension = AssetManager::AddExtension();
-
-        pos += 4;  // Data version, 700
-        extension->name = ReadString(buffer, &pos);
-        extension->folderName = ReadString(buffer, &pos);
-
-        // The list of files inside the extension
-        extension->fileCount = ReadDword(buffer, &pos);
-        extension->files = new ExtensionFile[extension->fileCount];
-        for (unsigned int i = 0; i < extension->fileCount; i++) {
-            ExtensionFile* extfile = extension->files + i;
-
-            pos += 4;  // Data version, 700
-            extfile->filename = ReadString(buffer, &pos);
-            extfile->kind = ReadDword(buffer, &pos);
-            extfile->initializer = ReadString(buffer, &pos);
-            extfile->finalizer = ReadString(buffer, &pos);
-
-            // Functions
-            extfile->functionCount = ReadDword(buffer, &pos);
-            extfile->functions = new ExtensionFileFunction[extfile->functionCount];
-            for (unsigned int ii = 0; ii < extfile->functionCount; ii++) {
-                pos += 4;  // Data version 700
-                extfile->functions[ii].name = ReadString(buffer, &pos);
-                extfile->functions[ii].externalName = ReadString(buffer, &pos);
-                extfile->functions[ii].convention = ReadDword(buffer, &pos);
-                pos += 4;  // always 0?
-                extfile->functions[ii].argCount = ReadDword(buffer, &pos);
-
-                for (unsigned int j = 0; j < 17; j++) {
-                    extfile->functions[ii].argTypes[j] = ReadDword(buffer, &pos);  // arg type - 1 for string, 2 for real
-                }
-
-                extfile->functions[ii].returnType = ReadDword(buffer, &pos);  // function return type - 1 for string, 2 for real
-            }
-
-            // Constants
-            extfile->constCount = ReadDword(buffer, &pos);
-            extfile->consts = new ExtensionFileConst[extfile->constCount];
-            for (unsigned int ii = 0; ii < extfile->constCount; ii++) {
-                pos += 4;  // Data version 700
-                extfile->consts[ii].name = ReadString(buffer, &pos);
-                extfile->consts[ii].value = ReadString(buffer, &pos);
-            }
-        }
+    sprite->name = ReadString(data, &dataPos);
+    sprite->originX = ReadDword(data, &dataPos);
+    sprite->originY = ReadDword(data, &dataPos);
+    sprite->frameCount = ReadDword(data, &dataPos);
+    sprite->width = ReadDword(data, &dataPos);
+    sprite->height = ReadDword(data, &dataPos);
+    if (!sprite->frameCount) return;
 
-        // Actual file data, including decryption
-        unsigned int endpos = ReadDword(buffer, &pos);
-        unsigned int dataPos = pos;
-        pos += endpos;
+    sprite->frames = ( RImageIndex* )malloc(sizeof(RImageIndex) * sprite->frameCount);
+    for (unsigned int i = 0; i < sprite->frameCount; i++) {
+        unsigned int w = ReadDword(data, &dataPos);
+        unsigned int h = ReadDword(data, &dataPos);
+        sprite->frames[i] = RMakeImage(w, h, sprite->originX, sprite->originY, data + dataPos);
+        dataPos += w * h * 4;
+    }
 
-        // File decryption - generate byte table
-        int seed1 = ReadDword(buffer, &dataPos);
-        int seed2 = (seed1 % 0xFA) + 6;
-        seed1 /= 0xFA;
-        if (seed1 < 0) seed1 += 100;
-        if (seed2 < 0) seed2 += 100;
+    sprite->separateCollision = ReadDword(data, &dataPos);
+    unsigned int mapCount = sprite->separateCollision ? sprite->frameCount : 1;
+    sprite->collisionMaps = new CollisionMap[mapCount];
+    for (unsigned int i = 0; i < mapCount; i++) {
+        CollisionMap* map = sprite->collisionMaps + i;
+        map->width = ReadDword(data, &dataPos);
+        map->height = ReadDword(data, &dataPos);
+        map->left = ReadDword(data, &dataPos);
+        map->right = ReadDword(data, &dataPos);
+        map->bottom = ReadDword(data, &dataPos);
+        map->top = ReadDword(data, &dataPos);
+
+        unsigned int maskSize = map->width * map->height;
+        map->collision = new bool[maskSize];
+        memcpy(map->collision, data + dataPos, maskSize);
+        dataPos += maskSize;
+    }
+}
 
-        for (unsigned int i = 0; i < 0x200; i++) {
-            charTable[i] = i;
-        }
+void _WriteCachedBackground(GameCacheWriter* cache, const Background* background, const unsigned char* pixels) {
+    cache->BeginRecord();
+    cache->WriteDword(background->exists);
+    if (background->exists) {
+        cache->WriteString(background->name);
+        cache->WriteDword(background->width);
+        cache->WriteDword(background->height);
+        if (pixels) cache->WriteBytes(pixels, background->width * background->height * 4);
+    }
+    cache->EndRecord();
+}
 
-        // File decryption - byte table first pass
-        for (unsigned int i = 1; i < 0x2711; i++) {
-            unsigned int AX = (((i * seed2) + seed1) % 0xFE) + 1;
-            unsigned char b1 = charTable[AX];
-            unsigned char b2 = charTable[AX + 1];
-            charTable[AX] = b2;
-            charTable[AX + 1] = b1;
-        }
+void _ReadCachedBackground(unsigned char* data, Background* background) {
+    unsigned int dataPos = 0;
+    if (!ReadDword(data, &dataPos)) {
+        background->exists = false;
+        return;
+    }
 
-        // File decryption - byte table second pass
-        for (unsigned int i = 0; i < 0x100; i++) {
-            unsigned char DX = charTable[i + 1];
-            charTable[DX + 0x100] = i + 1;
-        }
+    background->name = ReadString(data, &dataPos);
+    background->width = ReadDword(data, &dataPos);
+    background->height = ReadDword(data, &dataPos);
+    if (background->width > 0 && background->height > 0) {
+        background->image = RMakeImage(background->width, background->height, 0, 0, data + dataPos);
+    }
+}
 
-        // File decryption - decrypting data block
-        for (unsigned int i = dataPos + 1; i < pos; i++) {
-            buffer[i] = charTable[buffer[i] + 0x100];
+void _WriteCachedFont(GameCacheWriter* cache, const Font* font, unsigned int w, unsigned int h, const unsigned char* pixels) {
+    cache->BeginRecord();
+    cache->WriteDword(font->exists);
+    if (font->exists) {
+        cache->WriteString(font->name);
+        cache->WriteString(font->fontName);
+        cache->WriteDword(font->size);
+        cache->WriteDword(font->bold);
+        cache->WriteDword(font->italic);
+        cache->WriteDword(font->charset);
+        cache->WriteDword(font->aaLevel);
+        cache->WriteDword(font->rangeBegin);
+        cache->WriteDword(font->rangeEnd);
+        for (unsigned int i = 0; i < 0x600; i++) {
+            cache->WriteDword(font->dmap[i]);
         }
+        cache->WriteDword(w);
+        cache->WriteDword(h);
+        cache->WriteBytes(pixels, w * h * 4);
+    }
+    cache->EndRecord();
+}
 
-        // Read the files
-        for (unsigned int i = 0; i < extension->fileCount; i++) {
-            if (!InflateBlock(buffer, &dataPos, &data, &dataLength, &outputSize)) {
-                // Error reading file
-                free(data);
-                delete[] buffer;
-                free(charTable);
-                return true;
-            }
+void _ReadCachedFont(unsigned char* data, Font* font) {
+    unsigned int dataPos = 0;
+    if (!ReadDword(data, &dataPos)) {
+        font->exists = false;
+        return;
+    }
 
-            extension->files[i].dataLength = outputSize;
-            extension->files[i].data = ( unsigned char* )malloc(outputSize);
-            memcpy(extension->files[i].data, data, outputSize);
-        }
+    font->name = ReadString(data, &dataPos);
+    font->fontName = ReadString(data, &dataPos);
+    font->size = ReadDword(data, &dataPos);
+    font->bold = ReadDword(data, &dataPos);
+    font->italic = ReadDword(data, &dataPos);
+    font->charset = ReadDword(data, &dataPos);
+    font->aaLevel = ReadDword(data, &dataPos);
+    font->rangeBegin = ReadDword(data, &dataPos);
+    font->rangeEnd = ReadDword(data, &dataPos);
+    for (unsigned int i = 0; i < 0x600; i++) {
+        font->dmap[i] = ReadDword(data, &dataPos);
     }
-    free(charTable);
 
+    unsigned int w = ReadDword(data, &dataPos);
+    unsigned int h = ReadDword(data, &dataPos);
+    font->image = RMakeImage(w, h, 0, 0, data + dataPos);
+}
 
-    // Triggers
+// Parses everything in the index. Blocks come from the inflater, which is inflating them in the background, or straight from the cache if there's no inflater.
+// If cache is set, everything gets written to it as it's read.
+// With progressive set, the inflater skips sprites and backgrounds. They're only read as far as their names and sizes, and the rest is left for _DecodeDeferred.
+bool _ReadGameData(unsigned char* buffer, const GameDataIndex& index, BlockInflater* inflater, int version, GameCacheWriter* cache, bool progressive) {
+    bool fromCache = (inflater == NULL);
 
-    pos += 4;
-    count = ReadDword(buffer, &pos);
-    unsigned int triggerCount = count;
-    AssetManager::ReserveTriggers(count);
-    for (; count > 0; count--) {
+    // Triggers
 
-        if (!InflateBlock(buffer, &pos, &data, &dataLength, &outputSize)) {
+    AssetManager::ReserveTriggers(( unsigned int )index.Count(SECTION_TRIGGERS));
+    if (cache) cache->WriteSection(index.Count(SECTION_TRIGGERS));
+    for (size_t b = index.First(SECTION_TRIGGERS); b < index.End(SECTION_TRIGGERS); b++) {
+        unsigned int dataLength;
+        unsigned char* data = _GetBlock(index, inflater, b, &dataLength);
+        if (data == NULL) {
             // Error reading trigger
-            free(data);
-            delete[] buffer;
             return false;
         }
+        if (cache) cache->WriteRecord(data, dataLength);
 
         Trigger* trigger = AssetManager::AddTrigger();
 
@@ -631,29 +879,29 @@ bool GameLoad(const char* pFilename) {
 
     // Constants
 
-    pos += 4;
-    count = ReadDword(buffer, &pos);
+    unsigned int pos = index.constantsPos;
+    unsigned int count = ReadDword(buffer, &pos);
     AssetManager::ReserveConstants(count);
     for (; count > 0; count--) {
         Constant* constant = AssetManager::AddConstant();
         constant->name = ReadString(buffer, &pos);
         constant->value = ReadString(buffer, &pos);
     }
+    if (cache) cache->WriteBytes(buffer + index.constantsPos - 4, pos - (index.constantsPos - 4));
 
 
     // Sounds
 
-    pos += 4;
-    count = ReadDword(buffer, &pos);
-    AssetManager::ReserveSounds(count);
-    for (; count > 0; count--) {
-
-        if (!InflateBlock(buffer, &pos, &data, &dataLength, &outputSize)) {
+    AssetManager::ReserveSounds(( unsigned int )index.Count(SECTION_SOUNDS));
+    if (cache) cache->WriteSection(index.Count(SECTION_SOUNDS));
+    for (size_t b = index.First(SECTION_SOUNDS); b < index.End(SECTION_SOUNDS); b++) {
+        unsigned int dataLength;
+        unsigned char* data = _GetBlock(index, inflater, b, &dataLength);
+        if (data == NULL) {
             // Error reading sound
-            free(data);
-            delete[] buffer;
             return false;
         }
+        if (cache) cache->WriteRecord(data, dataLength);
 
         Sound* sound = AssetManager::AddSound();
 
@@ -669,10 +917,11 @@ bool GameLoad(const char* pFilename) {
         sound->fileType = ReadString(data, &dataPos);
         sound->fileName = ReadString(data, &dataPos);
 
+        unsigned int soundDataPos = 0;
         if (ReadDword(data, &dataPos)) {
-            unsigned int l = ReadDword(data, &dataPos);
-            sound->data = ( unsigned char* )malloc(l);
-            memcpy(sound->data, (data + dataPos), l);
+            sound->dataLength = ReadDword(data, &dataPos);
+            soundDataPos = dataPos;
+            dataPos += sound->dataLength;
         }
         else {
             sound->data = NULL;
@@ -684,28 +933,56 @@ bool GameLoad(const char* pFilename) {
         sound->volume = ReadDouble(data, &dataPos);
         sound->pan = ReadDouble(data, &dataPos);
         sound->preload = ReadDword(data, &dataPos);
+
+        if (sound->dataLength) {
+            if (inflater) {
+                // The sound file is used right where it was inflated, and the block goes with the sound
+                sound->storage = inflater->Take(b);
+                sound->data = sound->storage + soundDataPos;
+            }
+            else {
+                // The cache gets unmapped once the game's loaded
+                sound->storage = ( unsigned char* )malloc(sound->dataLength);
+                memcpy(sound->storage, data + soundDataPos, sound->dataLength);
+                sound->data = sound->storage;
+            }
+        }
     }
 
 
     // Sprites
 
-    pos += 4;
-    count = ReadDword(buffer, &pos);
-    AssetManager::ReserveSprites(count);
-    for (; count > 0; count--) {
+    AssetManager::ReserveSprites(( unsigned int )index.Count(SECTION_SPRITES));
+    if (cache) cache->WriteSection(index.Count(SECTION_SPRITES));
+    if (progressive) _spriteJobs.assign(index.Count(SECTION_SPRITES), -1);
+    for (size_t b = index.First(SECTION_SPRITES); b < index.End(SECTION_SPRITES); b++) {
+        if (progressive) {
+            // The inflater left these blocks alone, so only their starts get inflated here
+            if (!_ReadDeferredSprite(buffer, index.blocks[b], static_cast<unsigned int>(b - index.First(SECTION_SPRITES)), AssetManager::AddSprite())) {
+                // Error reading sprite
+                return false;
+            }
+            continue;
+        }
 
-        if (!InflateBlock(buffer, &pos, &data, &dataLength, &outputSize)) {
+        unsigned int dataLength;
+        unsigned char* data = _GetBlock(index, inflater, b, &dataLength);
+        if (data == NULL) {
             // Error reading sprite
-            free(data);
-            delete[] buffer;
             return false;
         }
 
         Sprite* sprite = AssetManager::AddSprite();
+        if (fromCache) {
+            _ReadCachedSprite(data, sprite);
+            continue;
+        }
 
+        std::vector<unsigned int> frameOffsets;
         unsigned int dataPos = 0;
         if (!ReadDword(data, &dataPos)) {
             sprite->exists = false;
+            if (cache) _WriteCachedSprite(cache, sprite, data, frameOffsets);
             continue;
         }
 
@@ -717,85 +994,32 @@ bool GameLoad(const char* pFilename) {
 
         sprite->frameCount = ReadDword(data, &dataPos);
         if (sprite->frameCount) {
-            sprite->frames = ( RImageIndex* )malloc(sizeof(RImageIndex*) * sprite->frameCount);
-
-            // Frame data
-            unsigned int i;
-            for (i = 0; i < sprite->frameCount; i++) {
-                dataPos += 4;
-
-                unsigned int frameW = ReadDword(data, &dataPos);
-                unsigned int frameH = ReadDword(data, &dataPos);
-                unsigned int pixelDataLength = ReadDword(data, &dataPos);
-
-                if (pixelDataLength != (frameW * frameH * 4)) {
-                    // This should never happen
-                    free(data);
-                    delete[] buffer;
-                    return false;
-                }
-
-                // Convert BGRA to RGBA
-                unsigned char* pixelData = (data + dataPos);
-                unsigned int pixelDataEnd = (dataPos + pixelDataLength);
-                unsigned char tmp;
-                for (; dataPos < pixelDataEnd; dataPos += 4) {
-                    tmp = data[dataPos];
-                    data[dataPos] = data[dataPos + 2];
-                    data[dataPos + 2] = tmp;
-                }
-
-                sprite->frames[i] = RMakeImage(frameW, frameH, sprite->originX, sprite->originY, pixelData);
-
-                // Sprite inherits its width and size from the first frame of animation
-                if (i == 0) {
-                    sprite->width = frameW;
-                    sprite->height = frameH;
-                }
-            }
-
-            // Collision data
-            sprite->separateCollision = ReadDword(data, &dataPos);
-            if (sprite->separateCollision) {
-                // Separate maps
-                sprite->collisionMaps = new CollisionMap[sprite->frameCount];
-                for (i = 0; i < sprite->frameCount; i++) {
-                    dataPos += 4;
-
-                    CollisionMap* map = &(sprite->collisionMaps[i]);
-                    map->width = ReadDword(data, &dataPos);
-                    map->height = ReadDword(data, &dataPos);
-                    map->left = ReadDword(data, &dataPos);
-                    map->right = ReadDword(data, &dataPos);
-                    map->bottom = ReadDword(data, &dataPos);
-                    map->top = ReadDword(data, &dataPos);
-
-                    unsigned int maskSize = map->width * map->height;
-                    map->collision = new bool[maskSize];
-                    for (unsigned int ii = 0; ii < maskSize; ii++) {
-                        map->collision[ii] = ReadDword(data, &dataPos);
-                    }
-                }
+            sprite->frames = ( RImageIndex* )malloc(sizeof(RImageIndex) * sprite->frameCount);
+            if (!_ReadSpriteFrames(data, &dataPos, sprite, &frameOffsets)) {
+                // Error reading sprite
+                return false;
             }
-            else {
-                // One map
-
-                dataPos += 4;
 
-                CollisionMap* map = new CollisionMap();
-                sprite->collisionMaps = map;
-                map->width = ReadDword(data, &dataPos);
-                map->height = ReadDword(data, &dataPos);
-                map->left = ReadDword(data, &dataPos);
-                map->right = ReadDword(data, &dataPos);
-                map->bottom = ReadDword(data, &dataPos);
-                map->top = ReadDword(data, &dataPos);
-
-                unsigned int maskSize = map->width * map->height;
-                map->collision = new bool[maskSize];
-                for (unsigned int ii = 0; ii < maskSize; ii++) {
-                    map->collision[ii] = ReadDword(data, &dataPos);
-                }
+            // Sprite inherits its width and size from the first frame of animation
+            unsigned int sizePos = frameOffsets[0];
+            sprite->width = ReadDword(data, &sizePos);
+            sprite->height = ReadDword(data, &sizePos);
+
+            // The frames are drawn straight out of the block, so it's kept for as long as the renderer is around. The collision data after the last frame has
+            // been unpacked by now, so the block gets cut down to just the frames first. If that moves it, data follows.
+            unsigned int framesEnd = frameOffsets.back() + 8;
+            framesEnd += ReadDword(data, &framesEnd);
+            unsigned char* block = inflater->Take(b);
+            unsigned char* trimmed = ( unsigned char* )realloc(block, framesEnd);
+            if (trimmed) block = trimmed;
+            data = block;
+            RKeepBuffer(block);
+
+            for (unsigned int i = 0; i < sprite->frameCount; i++) {
+                unsigned int framePos = frameOffsets[i];
+                unsigned int frameW = ReadDword(data, &framePos);
+                unsigned int frameH = ReadDword(data, &framePos);
+                sprite->frames[i] = RMakeImageInPlace(frameW, frameH, sprite->originX, sprite->originY, data + framePos + 4);
             }
         }
         else {
@@ -803,28 +1027,42 @@ bool GameLoad(const char* pFilename) {
             sprite->width = 1;
             sprite->height = 1;
         }
+
+        if (cache) _WriteCachedSprite(cache, sprite, data, frameOffsets);
     }
 
 
     // Backgrounds
 
-    pos += 4;
-    count = ReadDword(buffer, &pos);
-    AssetManager::ReserveBackgrounds(count);
-    for (; count > 0; count--) {
+    AssetManager::ReserveBackgrounds(( unsigned int )index.Count(SECTION_BACKGROUNDS));
+    if (cache) cache->WriteSection(index.Count(SECTION_BACKGROUNDS));
+    if (progressive) _backgroundJobs.assign(index.Count(SECTION_BACKGROUNDS), -1);
+    for (size_t b = index.First(SECTION_BACKGROUNDS); b < index.End(SECTION_BACKGROUNDS); b++) {
+        if (progressive) {
+            if (!_ReadDeferredBackground(buffer, index.blocks[b], static_cast<unsigned int>(b - index.First(SECTION_BACKGROUNDS)), AssetManager::AddBackground())) {
+                // Error reading background
+                return false;
+            }
+            continue;
+        }
 
-        if (!InflateBlock(buffer, &pos, &data, &dataLength, &outputSize)) {
+        unsigned int dataLength;
+        unsigned char* data = _GetBlock(index, inflater, b, &dataLength);
+        if (data == NULL) {
             // Error reading background
-            free(data);
-            delete[] buffer;
             return false;
         }
 
         Background* background = AssetManager::AddBackground();
+        if (fromCache) {
+            _ReadCachedBackground(data, background);
+            continue;
+        }
 
         unsigned int dataPos = 0;
         if (!ReadDword(data, &dataPos)) {
             background->exists = false;
+            if (cache) _WriteCachedBackground(cache, background, NULL);
             continue;
         }
 
@@ -833,37 +1071,37 @@ bool GameLoad(const char* pFilename) {
         background->width = ReadDword(data, &dataPos);
         background->height = ReadDword(data, &dataPos);
 
+        unsigned char* pixels = NULL;
         if (background->width > 0 && background->height > 0) {
             unsigned int len = ReadDword(data, &dataPos);
             unsigned int dStart = dataPos;
 
             // Convert RGBA to BGRA
-            unsigned int pixelDataEnd = dataPos + len;
-            unsigned char tmp;
-            for (; dataPos < pixelDataEnd; dataPos += 4) {
-                tmp = data[dataPos];
-                data[dataPos] = data[dataPos + 2];
-                data[dataPos + 2] = tmp;
-            }
+            SwapRedBlue(data + dataPos, len / 4);
+            dataPos += len;
 
-            background->image = RMakeImage(background->width, background->height, 0, 0, (data + dStart));
+            // The pixels are the tail of the block, so the whole block is kept for the renderer rather than copying them out
+            pixels = data + dStart;
+            RKeepBuffer(inflater->Take(b));
+            background->image = RMakeImageInPlace(background->width, background->height, 0, 0, pixels);
         }
+
+        if (cache) _WriteCachedBackground(cache, background, pixels);
     }
 
 
     // Paths
 
-    pos += 4;
-    count = ReadDword(buffer, &pos);
-    AssetManager::ReservePaths(count);
-    for (; count > 0; count--) {
-
-        if (!InflateBlock(buffer, &pos, &data, &dataLength, &outputSize)) {
+    AssetManager::ReservePaths(( unsigned int )index.Count(SECTION_PATHS));
+    if (cache) cache->WriteSection(index.Count(SECTION_PATHS));
+    for (size_t b = index.First(SECTION_PATHS); b < index.End(SECTION_PATHS); b++) {
+        unsigned int dataLength;
+        unsigned char* data = _GetBlock(index, inflater, b, &dataLength);
+        if (data == NULL) {
             // Error reading path
-            free(data);
-            delete[] buffer;
             return false;
         }
+        if (cache) cache->WriteRecord(data, dataLength);
 
         Path* path = AssetManager::AddPath();
 
@@ -893,18 +1131,16 @@ bool GameLoad(const char* pFilename) {
 
     // Scripts
 
-    pos += 4;
-    count = ReadDword(buffer, &pos);
-    unsigned int scriptCount = count;
-    AssetManager::ReserveScripts(count);
-    for (; count > 0; count--) {
-
-        if (!InflateBlock(buffer, &pos, &data, &dataLength, &outputSize)) {
+    AssetManager::ReserveScripts(( unsigned int )index.Count(SECTION_SCRIPTS));
+    if (cache) cache->WriteSection(index.Count(SECTION_SCRIPTS));
+    for (size_t b = index.First(SECTION_SCRIPTS); b < index.End(SECTION_SCRIPTS); b++) {
+        unsigned int dataLength;
+        unsigned char* data = _GetBlock(index, inflater, b, &dataLength);
+        if (data == NULL) {
             // Error reading script
-            free(data);
-            delete[] buffer;
             return false;
         }
+        if (cache) cache->WriteRecord(data, dataLength);
 
         Script* script = AssetManager::AddScript();
 
@@ -925,23 +1161,26 @@ bool GameLoad(const char* pFilename) {
 
     // Fonts
 
-    pos += 4;
-    count = ReadDword(buffer, &pos);
-    AssetManager::ReserveFonts(count);
-    for (; count > 0; count--) {
-
-        if (!InflateBlock(buffer, &pos, &data, &dataLength, &outputSize)) {
+    AssetManager::ReserveFonts(( unsigned int )index.Count(SECTION_FONTS));
+    if (cache) cache->WriteSection(index.Count(SECTION_FONTS));
+    for (size_t b = index.First(SECTION_FONTS); b < index.End(SECTION_FONTS); b++) {
+        unsigned int dataLength;
+        unsigned char* data = _GetBlock(index, inflater, b, &dataLength);
+        if (data == NULL) {
             // Error reading font
-            free(data);
-            delete[] buffer;
             return false;
         }
 
         Font* font = AssetManager::AddFont();
+        if (fromCache) {
+            _ReadCachedFont(data, font);
+            continue;
+        }
 
         unsigned int dataPos = 0;
         if (!ReadDword(data, &dataPos)) {
             font->exists = false;
+            if (cache) _WriteCachedFont(cache, font, 0, 0, NULL);
             continue;
         }
 
@@ -971,38 +1210,31 @@ bool GameLoad(const char* pFilename) {
         unsigned int dlen = ReadDword(data, &dataPos);
         if (w * h != dlen) {
             // Bad font data
-            free(data);
-            delete[] buffer;
             return false;
         }
 
         unsigned char* d = ( unsigned char* )malloc(dlen * 4);
-        unsigned int dp = 3;
-        memset(d, 0xFF, dlen * 4);
-        for (; dlen; dlen--) {
-            d[dp] = *(data + dataPos);
-            dataPos++;
-            dp += 4;
-        }
+        ExpandAlpha(data + dataPos, d, dlen);
+        dataPos += dlen;
 
-        font->image = RMakeImage(w, h, 0, 0, ( unsigned char* )d);
-        free(d);
+        // The expanded image is only used by the renderer, so it keeps it
+        RKeepBuffer(d);
+        font->image = RMakeImageInPlace(w, h, 0, 0, d);
+        if (cache) _WriteCachedFont(cache, font, w, h, d);
     }
 
     // Timelines
 
-    pos += 4;
-    count = ReadDword(buffer, &pos);
-    unsigned int timelineCount = count;
-    AssetManager::ReserveTimelines(count);
-    for (; count > 0; count--) {
-
-        if (!InflateBlock(buffer, &pos, &data, &dataLength, &outputSize)) {
+    AssetManager::ReserveTimelines(( unsigned int )index.Count(SECTION_TIMELINES));
+    if (cache) cache->WriteSection(index.Count(SECTION_TIMELINES));
+    for (size_t b = index.First(SECTION_TIMELINES); b < index.End(SECTION_TIMELINES); b++) {
+        unsigned int dataLength;
+        unsigned char* data = _GetBlock(index, inflater, b, &dataLength);
+        if (data == NULL) {
             // Error reading timeline
-            free(data);
-            delete[] buffer;
             return false;
         }
+        if (cache) cache->WriteRecord(data, dataLength);
 
         Timeline* timeline = AssetManager::AddTimeline();
 
@@ -1027,8 +1259,6 @@ bool GameLoad(const char* pFilename) {
             for (unsigned int j = 0; j < timeline->moments[index].actionCount; j++) {
                 if (!CodeActionManager::Read(data, &dataPos, timeline->moments[index].actions + j)) {
                     // Error reading action
-                    free(data);
-                    delete[] buffer;
                     return false;
                 }
             }
@@ -1038,18 +1268,16 @@ bool GameLoad(const char* pFilename) {
 
     // Objects
 
-    pos += 4;
-    count = ReadDword(buffer, &pos);
-    unsigned int objectCount = count;
-    AssetManager::ReserveObjects(count);
-    for (; count > 0; count--) {
-
-        if (!InflateBlock(buffer, &pos, &data, &dataLength, &outputSize)) {
+    AssetManager::ReserveObjects(( unsigned int )index.Count(SECTION_OBJECTS));
+    if (cache) cache->WriteSection(index.Count(SECTION_OBJECTS));
+    for (size_t b = index.First(SECTION_OBJECTS); b < index.End(SECTION_OBJECTS); b++) {
+        unsigned int dataLength;
+        unsigned char* data = _GetBlock(index, inflater, b, &dataLength);
+        if (data == NULL) {
             // Error reading object
-            free(data);
-            delete[] buffer;
             return false;
         }
+        if (cache) cache->WriteRecord(data, dataLength);
 
         Object* object = AssetManager::AddObject();
 
@@ -1087,8 +1315,6 @@ bool GameLoad(const char* pFilename) {
                     if (!CodeActionManager::Read(data, &dataPos, e.actions + j)) {
                         // Error reading action
                         delete[] e.actions;
-                        free(data);
-                        delete[] buffer;
                         return false;
                     }
                 }
@@ -1103,18 +1329,16 @@ bool GameLoad(const char* pFilename) {
 
     // Rooms
 
-    pos += 4;
-    count = ReadDword(buffer, &pos);
-    unsigned int roomCount = count;
-    AssetManager::ReserveRooms(count);
-    for (; count > 0; count--) {
-
-        if (!InflateBlock(buffer, &pos, &data, &dataLength, &outputSize)) {
+    AssetManager::ReserveRooms(( unsigned int )index.Count(SECTION_ROOMS));
+    if (cache) cache->WriteSection(index.Count(SECTION_ROOMS));
+    for (size_t b = index.First(SECTION_ROOMS); b < index.End(SECTION_ROOMS); b++) {
+        unsigned int dataLength;
+        unsigned char* data = _GetBlock(index, inflater, b, &dataLength);
+        if (data == NULL) {
             // Error reading room
-            free(data);
-            delete[] buffer;
             return false;
         }
+        if (cache) cache->WriteRecord(data, dataLength);
 
         Room* room = AssetManager::AddRoom();
 
@@ -1211,23 +1435,24 @@ bool GameLoad(const char* pFilename) {
     }
 
     // Last instance and tile ID placed
+    pos = index.lastIdsPos;
     unsigned int lastInstanceID = ReadDword(buffer, &pos);
     unsigned int lastTileID = ReadDword(buffer, &pos);
     InstanceList::SetLastIDs(lastInstanceID, lastTileID);
+    if (cache) cache->WriteBytes(buffer + index.lastIdsPos, 8);
 
     // Include files
 
-    pos += 4;
-    count = ReadDword(buffer, &pos);
-    AssetManager::ReserveIncludeFiles(count);
-    for (; count > 0; count--) {
-
-        if (!InflateBlock(buffer, &pos, &data, &dataLength, &outputSize)) {
+    AssetManager::ReserveIncludeFiles(( unsigned int )index.Count(SECTION_INCLUDE_FILES));
+    if (cache) cache->WriteSection(index.Count(SECTION_INCLUDE_FILES));
+    for (size_t b = index.First(SECTION_INCLUDE_FILES); b < index.End(SECTION_INCLUDE_FILES); b++) {
+        unsigned int dataLength;
+        unsigned char* data = _GetBlock(index, inflater, b, &dataLength);
+        if (data == NULL) {
             // Error reading whatever this is
-            free(data);
-            delete[] buffer;
             return false;
         }
+        if (cache) cache->WriteRecord(data, dataLength);
 
         IncludeFile* file = AssetManager::AddIncludeFile();
 
@@ -1260,13 +1485,17 @@ bool GameLoad(const char* pFilename) {
 
 
     // Game information data (the thing that comes up when you press F1)
-    pos += 4;
-    if (!InflateBlock(buffer, &pos, &data, &dataLength, &outputSize)) {
+    unsigned int dataLength;
+    unsigned char* data = _GetBlock(index, inflater, index.First(SECTION_GAME_INFO), &dataLength);
+    if (data == NULL) {
         // Error reading game information
-        free(data);
-        delete[] buffer;
         return false;
     }
+    if (cache) {
+        cache->WriteDword(0);
+        cache->WriteRecord(data, dataLength);
+        cache->WriteSection(0);  // Garbage
+    }
 
     unsigned int dataPos = 0;
     _info.backgroundColour = ReadDword(data, &dataPos);
@@ -1283,48 +1512,92 @@ bool GameLoad(const char* pFilename) {
     _info.gameInfo = ReadString(data, &dataPos);
 
 
-    // Garbage?
-    pos += 4;
-    count = ReadDword(buffer, &pos);
-    for (; count > 0; count--) {
-        pos += ReadDword(buffer, &pos);
-    }
-
-
     // Room order
-    pos += 4;
+    pos = index.roomOrderPos;
     _roomOrderCount = ReadDword(buffer, &pos);
     _roomOrder = new unsigned int[_roomOrderCount];
     for (unsigned int i = 0; i < _roomOrderCount; i++) {
         _roomOrder[i] = ReadDword(buffer, &pos);
     }
+    if (cache) cache->WriteBytes(buffer + index.roomOrderPos - 4, pos - (index.roomOrderPos - 4));
+    CodeManager::SetRoomOrder(&_roomOrder, _roomOrderCount);
+
+    if (_loadStats) _EndDecode(_Now());
+    return true;
+}
+
+void _ClearLoadedGame() {
+    AssetManager::Clear();
+    CodeManager::ClearRegistered();
+    CodeActionManager::Clear();
+    RClearImages();
+    free(_info.caption);
+    free(_info.gameInfo);
+    _info.caption = NULL;
+    _info.gameInfo = NULL;
+    delete[] _roomOrder;
+    _roomOrder = NULL;
+    _roomOrderCount = 0;
     CodeManager::SetRoomOrder(&_roomOrder, _roomOrderCount);
+}
+
+// Loads everything from a cache that GameCacheOpen has already checked. Nothing here needs decrypting or inflating.
+bool _ReadGameCache(FileMapping* cache, int version) {
+    unsigned char* stream = cache->data;
+    unsigned int streamLength = static_cast<unsigned int>(cache->length);
+    unsigned int pos = sizeof(GameCacheHeader);
+
+    // Settings are cached as the struct itself
+    if (ReadDword(stream, &pos) != sizeof(settings)) return false;
+    memcpy(&settings, stream + pos, sizeof(settings));
+    pos += sizeof(settings);
+
+    unsigned int count = ReadDword(stream, &pos);
+    AssetManager::ReserveExtensions(count);
+    for (; count > 0; count--) {
+        unsigned int length = ReadDword(stream, &pos);
+        _ReadCachedExtension(stream + pos, AssetManager::AddExtension());
+        pos += length;
+    }
+
+    // The rest is laid out like the exe, but with every block already inflated
+    GameDataIndex index;
+    if (!_IndexGameData(stream, streamLength, pos, &index)) return false;
+    for (DataBlock& block : index.blocks) {
+        unsigned int blockPos = block.pos;
+        block.length = ReadDword(stream, &blockPos);
+        block.data = stream + blockPos;
+    }
+
+    return _ReadGameData(stream, index, NULL, version, NULL, false);
+}
 
+// Queues all the game's code for compiling, once all the assets are loaded
+bool _CompileCode() {
     // Compile object parented event lists and identities
+    double start = _Now();
     AssetManager::CompileObjectIdentities();
+    _EndPhase(LOAD_OBJECT_IDENTITIES, start);
+    start = _Now();
 
     // Compile scripts
-    for (unsigned int i = 0; i < scriptCount; i++) {
+    for (unsigned int i = 0; i < AssetManager::GetScriptCount(); i++) {
         Script* s = AssetManager::GetScript(i);
         if (s->exists) {
             if (!CodeManager::Compile(s->codeObj)) {
                 // Error compiling script
-                free(data);
-                delete[] buffer;
                 return false;
             }
         }
     }
     // Compile timelines
-    for (unsigned int i = 0; i < timelineCount; i++) {
+    for (unsigned int i = 0; i < AssetManager::GetTimelineCount(); i++) {
         Timeline* t = AssetManager::GetTimeline(i);
         if (t->exists) {
             for (const auto& j : t->moments) {
                 for (unsigned int k = 0; k < j.second.actionCount; k++) {
                     if (!CodeActionManager::Compile(j.second.actions[k])) {
                         // Error compiling script
-                        free(data);
-                        delete[] buffer;
                         return false;
                     }
                 }
@@ -1332,7 +1605,7 @@ bool GameLoad(const char* pFilename) {
         }
     }
     // Compile object events
-    for (unsigned int i = 0; i < objectCount; i++) {
+    for (unsigned int i = 0; i < AssetManager::GetObjectCount(); i++) {
         Object* o = AssetManager::GetObject(i);
         if (o->exists) {
             for (unsigned int j = 0; j < 12; j++) {
@@ -1340,8 +1613,6 @@ bool GameLoad(const char* pFilename) {
                     for (unsigned int k = 0; k < ev.second.actionCount; k++) {
                         if (!CodeActionManager::Compile(ev.second.actions[k])) {
                             // Error compiling script
-                            free(data);
-                            delete[] buffer;
                             return false;
                         }
                     }
@@ -1350,44 +1621,525 @@ bool GameLoad(const char* pFilename) {
         }
     }
     // Compile triggers
-    for (unsigned int i = 0; i < triggerCount; i++) {
+    for (unsigned int i = 0; i < AssetManager::GetTriggerCount(); i++) {
         Trigger* t = AssetManager::GetTrigger(i);
         if (t->exists) {
             if (!CodeManager::Compile(t->codeObj)) {
                 // Error compiling script
-                free(data);
-                delete[] buffer;
                 return false;
             }
         }
     }
     // Compile room creation code (includes creation code of room-instances)
-    for (unsigned int i = 0; i < roomCount; i++) {
+    for (unsigned int i = 0; i < AssetManager::GetRoomCount(); i++) {
         Room* r = AssetManager::GetRoom(i);
         if (r->exists) {
             if (!CodeManager::Compile(r->creationCode)) {
                 // Error compiling script
-                free(data);
-                delete[] buffer;
                 return false;
             }
             for (unsigned int j = 0; j < r->instanceCount; j++) {
                 if (!CodeManager::Compile(r->instances[j].creation)) {
                     // Error compiling script
-                    free(data);
-                    delete[] buffer;
                     return false;
                 }
             }
         }
     }
 
+    _EndPhase(LOAD_GML_COMPILE, start);
+    return true;
+}
 
-    // Cleaning up
-    free(data);
-    delete[] buffer;
+// Lists the code the first room runs when it starts: its creation code, its instances' creation code, and the events of
+// every object it has instances of, including the events they inherit
+std::vector<CodeObject> _FirstRoomCode() {
+    std::vector<CodeObject> code;
+    if (_roomOrderCount == 0 || _roomOrder[0] >= AssetManager::GetRoomCount() || !AssetManager::GetRoom(_roomOrder[0])->exists) return code;
+    Room* room = AssetManager::GetRoom(_roomOrder[0]);
+    code.push_back(room->creationCode);
+
+    std::set<unsigned int> objects;
+    for (unsigned int i = 0; i < room->instanceCount; i++) {
+        code.push_back(room->instances[i].creation);
+        if (room->instances[i].objectIndex < AssetManager::GetObjectCount()) {
+            const std::set<unsigned int>& identities = AssetManager::GetObject(room->instances[i].objectIndex)->identities;
+            objects.insert(identities.begin(), identities.end());
+        }
+    }
 
-    return true;
+    for (unsigned int i : objects) {
+        CodeActionManager::GetCodeObjects(AssetManager::GetObject(i), &code);
+    }
+    return code;
+}
+
+// Compiles the game's code, taking whatever it can from the .gmlcache next to the exe if useCache is set.
+// With lazyCompile set, this only marks the code for compiling and leaves the work to the background compiler and the first run of each piece of code.
+bool _CompileGame(const char* pFilename, const GameLoadOptions& options, unsigned int exeLength, unsigned long long exeHash) {
+    double start = _Now();
+    if (options.useCache) {
+        CodeManager::LoadCache((std::string(pFilename) + ".gmlcache").c_str(), exeLength, exeHash);
+    }
+    _EndPhase(LOAD_GML_CACHE_READ, start);
+
+    if (!_CompileCode()) {
+        CodeManager::SaveCache();
+        return false;
+    }
+    start = _Now();
+    if (options.lazyCompile) {
+        // The first room is what we need straight away, so that goes first. The background compiler writes the cache when it's done.
+        CodeManager::StartBackgroundCompile(_FirstRoomCode(), options.compileThreads);
+        _EndPhase(LOAD_GML_COMPILE, start);
+        return true;
+    }
+
+    bool success = CodeManager::CompileAll(options.compileThreads);
+    _EndPhase(LOAD_GML_COMPILE, start);
+
+    // Not being able to write the cache only makes the next load slower
+    start = _Now();
+    CodeManager::SaveCache();
+    _EndPhase(LOAD_GML_CACHE_WRITE, start);
+    return success;
+}
+
+// Every image is registered by now, so the atlas can be packed while the code compiles. It goes in a .atlascache next to the exe if useCache is set.
+void _StartAtlasLayout(const char* pFilename, const GameLoadOptions& options) {
+    if (options.useCache) RStartAtlasLayout((std::string(pFilename) + ".atlascache").c_str());
+    else RStartAtlasLayout(NULL);
+}
+
+bool _GameLoad(const char* pFilename, const GameLoadOptions& options) {
+    // Init DND manager
+    if (!CodeActionManager::Init()) {
+        return false;
+    }
+
+    // Init the runner
+    if (!CodeManager::Init(&_globals)) {
+        return false;
+    }
+
+    // Get the entirety of the file into memory. Mapping it means we never read the runner code at the start of the exe,
+    // and any pages we don't decrypt stay backed by the file instead of counting towards our memory usage.
+    double start = _Now();
+    FileMapping file;
+    if (!FileMap(pFilename, &file, options.mapFile)) {
+        // This really should be more verbose.
+        // Failed to open or allocate memory for the file.
+        return false;
+    }
+    unsigned char* buffer = file.data;
+    unsigned int fileSize = static_cast<unsigned int>(file.length);
+    _EndPhase(LOAD_MAP, start, fileSize);
+    if (_loadStats) _loadStats->mapped = file.mapped;
+
+    // Check if this is a valid exe
+
+    if (fileSize < 0x1B) {
+        // Invalid file, too small to be an exe
+        FileUnmap(&file);
+        return false;
+    }
+
+    if (!(buffer[0] == 'M' && buffer[1] == 'Z')) {
+        // Invalid file, not an exe
+        FileUnmap(&file);
+        return false;
+    }
+
+    // If this exe has been loaded before, everything it decodes to is in the cache and we can skip decrypting and inflating it.
+    // The cache is keyed on a hash of the whole exe, which has to be taken before anything gets decrypted in place.
+    std::string cachePath = std::string(pFilename) + ".gm8cache";
+    unsigned long long exeHash = 0;
+    if (options.useCache) {
+        start = _Now();
+        exeHash = Hash64(buffer, fileSize);
+        _EndPhase(LOAD_HASH, start, fileSize);
+
+        start = _Now();
+        FileMapping cacheFile;
+        int cacheVersion;
+        if (GameCacheOpen(cachePath.c_str(), {GAME_CACHE_MAGIC, GAME_CACHE_FORMAT_VERSION, fileSize, exeHash, 0}, &cacheFile, &cacheVersion)) {
+            size_t cacheLength = cacheFile.length;
+            bool success = _ReadGameCache(&cacheFile, cacheVersion);
+            FileUnmap(&cacheFile);
+            _EndPhase(LOAD_CACHE_READ, start, cacheLength);
+            if (success) {
+                FileUnmap(&file);
+                if (_loadStats) _loadStats->fromCache = true;
+                _StartAtlasLayout(pFilename, options);
+                return _CompileGame(pFilename, options, fileSize, exeHash);
+            }
+
+            // It matched the exe but didn't make sense, so throw away whatever it got through and load from the exe instead,
+            // which writes a new cache over it
+            _ClearLoadedGame();
+        }
+    }
+
+    // Find game version by searching for headers
+
+    start = _Now();
+    unsigned int pos;
+    int version = 0;
+
+    // GM8.0 header
+    pos = 2000000;
+    if (fileSize >= pos + 4 && ReadDword(buffer, &pos) == 1234321) {
+        version = 800;
+        pos += 8;
+    }
+    else {
+        // GM8.1 header
+        pos = 3800004;
+        for (int i = 0; i < 1024 && pos + 8 <= fileSize; i++) {
+            if ((ReadDword(buffer, &pos) & 0xFF00FF00) == 0xF7000000) {
+                if ((ReadDword(buffer, &pos) & 0x00FF00FF) == 0x00140067) {
+
+                    version = 810;
+                    _EndPhase(LOAD_HEADER_SCAN, start);
+                    start = _Now();
+                    unsigned int decryptStart = pos;
+                    Decrypt81(buffer, fileSize, &pos);
+                    _EndPhase(LOAD_DECRYPT81, start, fileSize - decryptStart);
+                    start = _Now();
+
+                    pos += 16;
+                    break;
+                }
+                else {
+                    pos -= 4;
+                }
+            }
+        }
+    }
+
+    if (!version) {
+        // No game version found
+        FileUnmap(&file);
+        return false;
+    }
+    _EndPhase(LOAD_HEADER_SCAN, start);
+
+    // No usable cache, so build one as we go. If it can't be written the game still loads, just without one.
+    GameCacheWriter cacheWriter;
+    GameCacheWriter* cache = (options.useCache && !options.progressive && cacheWriter.Open(cachePath.c_str())) ? &cacheWriter : NULL;
+
+    // Read all the data blocks.
+
+    // Init variables
+    unsigned int dataLength = ZLIB_BUF_START;
+    unsigned char* data = ( unsigned char* )malloc(dataLength);
+    unsigned int outputSize;
+
+    // Settings Data Chunk
+    start = _Now();
+    pos += 4;
+    if (!InflateBlock(buffer, &pos, &data, &dataLength, &outputSize)) {
+        // Error reading settings block
+        free(data);
+        FileUnmap(&file);
+        return false;
+    }
+    else {
+
+        unsigned int settingsPos = 0;
+        settings.fullscreen = ReadDword(data, &settingsPos);
+        settings.interpolate = ReadDword(data, &settingsPos);
+        settings.drawBorder = !ReadDword(data, &settingsPos);
+        settings.displayCursor = ReadDword(data, &settingsPos);
+        settings.scaling = ReadDword(data, &settingsPos);
+        settings.allowWindowResize = ReadDword(data, &settingsPos);
+        settings.onTop = ReadDword(data, &settingsPos);
+        settings.colourOutsideRoom = ReadDword(data, &settingsPos);
+        settings.setResolution = ReadDword(data, &settingsPos);
+        settings.colourDepth = ReadDword(data, &settingsPos);
+        settings.resolution = ReadDword(data, &settingsPos);
+        settings.frequency = ReadDword(data, &settingsPos);
+        settings.showButtons = !ReadDword(data, &settingsPos);
+        settings.vsync = ReadDword(data, &settingsPos);
+        settings.disableScreen = ReadDword(data, &settingsPos);
+        settings.letF4 = ReadDword(data, &settingsPos);
+        settings.letF1 = ReadDword(data, &settingsPos);
+        settings.letEsc = ReadDword(data, &settingsPos);
+        settings.letF5 = ReadDword(data, &settingsPos);
+        settings.letF9 = ReadDword(data, &settingsPos);
+        settings.treatCloseAsEsc = ReadDword(data, &settingsPos);
+        settings.priority = ReadDword(data, &settingsPos);
+        settings.freeze = ReadDword(data, &settingsPos);
+
+        settings.loadingBar = ReadDword(data, &settingsPos);
+        if (settings.loadingBar) {
+            unsigned int loadingDataLength = ZLIB_BUF_START;
+            unsigned char* loadingData = ( unsigned char* )malloc(loadingDataLength);
+
+            if (ReadDword(data, &settingsPos)) {
+                // read backdata
+                if (!InflateBlock(data, &settingsPos, &loadingData, &loadingDataLength, &outputSize)) {
+                    // Error reading backdata
+                    free(loadingData);
+                    free(data);
+                    FileUnmap(&file);
+                    return false;
+                }
+
+                // BackData is in loadingData and has length of loadingDataLength. Do whatever with it
+                // But don't keep it there because it will be overwritten and then freed.
+            }
+            if (ReadDword(data, &settingsPos)) {
+                // read frontdata
+                if (!InflateBlock(data, &settingsPos, &loadingData, &loadingDataLength, &outputSize)) {
+                    // Error reading frontdata
+                    free(loadingData);
+                    free(data);
+                    FileUnmap(&file);
+                    return false;
+                }
+
+                // FrontData is in loadingData and has length of loadingDataLength. Do whatever with it
+                // But don't keep it there because it will be freed.
+            }
+
+            free(loadingData);
+        }
+
+        settings.customLoadImage = ReadDword(data, &settingsPos);
+        if (settings.customLoadImage) {
+            // Read load image data
+            unsigned int imageDataLength = ZLIB_BUF_START;
+            unsigned char* imageData = ( unsigned char* )malloc(imageDataLength);
+
+            if (!InflateBlock(data, &settingsPos, &imageData, &imageDataLength, &outputSize)) {
+                // Error reading custom load image
+                free(imageData);
+                free(data);
+                FileUnmap(&file);
+                return false;
+            }
+
+            // Custom image data is loaded in the format of a BMP file (Always BMP I assume? Check?) Do whatever with it but don't keep it there because it will be freed.
+
+            free(imageData);
+        }
+
+        settings.transparent = ReadDword(data, &settingsPos);
+        settings.translucency = ReadDword(data, &settingsPos);
+        settings.scaleProgressBar = ReadDword(data, &settingsPos);
+        settings.errorDisplay = ReadDword(data, &settingsPos);
+        settings.errorLog = ReadDword(data, &settingsPos);
+        settings.errorAbort = ReadDword(data, &settingsPos);
+
+        unsigned int uninit = ReadDword(data, &settingsPos);
+        if (version == 810) {
+            settings.treatAsZero = uninit & 1;
+            settings.errorOnUninitialization = uninit & 2;
+        }
+        else {
+            settings.treatAsZero = uninit;
+            settings.errorOnUninitialization = true;
+        }
+
+        if (cache) cache->WriteRecord(&settings, sizeof(settings));
+        _EndPhase(LOAD_SETTINGS, start, outputSize);
+    }
+
+    // Skip over the D3D wrapper
+    pos += ReadDword(buffer, &pos);
+    pos += ReadDword(buffer, &pos);
+
+    // There's yet another encryption layer on the rest of the data paragraphs.
+    start = _Now();
+    if (!DecryptData(buffer, &pos)) {
+        // Error decrypting
+        free(data);
+        FileUnmap(&file);
+        return false;
+    }
+    unsigned int decryptedPos = pos - 4;  // DecryptData leaves pos just after the length of what it decrypted
+    _EndPhase(LOAD_DECRYPT_DATA, start, ReadDword(buffer, &decryptedPos));
+
+    // Garbage fields
+    pos += (ReadDword(buffer, &pos) + 6) * 4;
+
+
+    // Extensions
+
+    start = _Now();
+    unsigned int extensionsPos = pos;
+    pos += 4;
+    unsigned char* charTable = NULL;
+    unsigned int count = ReadDword(buffer, &pos);
+    if (count) charTable = ( unsigned char* )malloc(0x200);
+    AssetManager::ReserveExtensions(count);
+    if (cache) cache->WriteDword(count);
+    for (; count > 0; count--) {
+        Extension* extension = AssetManager::AddExtension();
+
+        pos += 4;  // Data version, 700
+        extension->name = ReadString(buffer, &pos);
+        extension->folderName = ReadString(buffer, &pos);
+
+        // The list of files inside the extension
+        extension->fileCount = ReadDword(buffer, &pos);
+        extension->files = new ExtensionFile[extension->fileCount];
+        for (unsigned int i = 0; i < extension->fileCount; i++) {
+            ExtensionFile* extfile = extension->files + i;
+
+            pos += 4;  // Data version, 700
+            extfile->filename = ReadString(buffer, &pos);
+            extfile->kind = ReadDword(buffer, &pos);
+            extfile->initializer = ReadString(buffer, &pos);
+            extfile->finalizer = ReadString(buffer, &pos);
+
+            // Functions
+            extfile->functionCount = ReadDword(buffer, &pos);
+            extfile->functions = new ExtensionFileFunction[extfile->functionCount];
+            for (unsigned int ii = 0; ii < extfile->functionCount; ii++) {
+                pos += 4;  // Data version 700
+                extfile->functions[ii].name = ReadString(buffer, &pos);
+                extfile->functions[ii].externalName = ReadString(buffer, &pos);
+                extfile->functions[ii].convention = ReadDword(buffer, &pos);
+                pos += 4;  // always 0?
+                extfile->functions[ii].argCount = ReadDword(buffer, &pos);
+
+                for (unsigned int j = 0; j < 17; j++) {
+                    extfile->functions[ii].argTypes[j] = ReadDword(buffer, &pos);  // arg type - 1 for string, 2 for real
+                }
+
+                extfile->functions[ii].returnType = ReadDword(buffer, &pos);  // function return type - 1 for string, 2 for real
+            }
+
+            // Constants
+            extfile->constCount = ReadDword(buffer, &pos);
+            extfile->consts = new ExtensionFileConst[extfile->constCount];
+            for (unsigned int ii = 0; ii < extfile->constCount; ii++) {
+                pos += 4;  // Data version 700
+                extfile->consts[ii].name = ReadString(buffer, &pos);
+                extfile->consts[ii].value = ReadString(buffer, &pos);
+            }
+        }
+
+        // Actual file data, including decryption
+        unsigned int endpos = ReadDword(buffer, &pos);
+        unsigned int dataPos = pos;
+        pos += endpos;
+
+        // File decryption - generate byte table
+        int seed1 = ReadDword(buffer, &dataPos);
+        int seed2 = (seed1 % 0xFA) + 6;
+        seed1 /= 0xFA;
+        if (seed1 < 0) seed1 += 100;
+        if (seed2 < 0) seed2 += 100;
+
+        for (unsigned int i = 0; i < 0x200; i++) {
+            charTable[i] = i;
+        }
+
+        // File decryption - byte table first pass
+        for (unsigned int i = 1; i < 0x2711; i++) {
+            unsigned int AX = (((i * seed2) + seed1) % 0xFE) + 1;
+            unsigned char b1 = charTable[AX];
+            unsigned char b2 = charTable[AX + 1];
+            charTable[AX] = b2;
+            charTable[AX + 1] = b1;
+        }
+
+        // File decryption - byte table second pass
+        for (unsigned int i = 0; i < 0x100; i++) {
+            unsigned char DX = charTable[i + 1];
+            charTable[DX + 0x100] = i + 1;
+        }
+
+        // File decryption - decrypting data block
+        for (unsigned int i = dataPos + 1; i < pos; i++) {
+            buffer[i] = charTable[buffer[i] + 0x100];
+        }
+
+        // Read the files
+        for (unsigned int i = 0; i < extension->fileCount; i++) {
+            if (!InflateBlock(buffer, &dataPos, &data, &dataLength, &outputSize)) {
+                // Error reading file
+                free(data);
+                FileUnmap(&file);
+                free(charTable);
+                return true;
+            }
+
+            extension->files[i].dataLength = outputSize;
+            extension->files[i].data = ( unsigned char* )malloc(outputSize);
+            memcpy(extension->files[i].data, data, outputSize);
+        }
+
+        if (cache) _WriteCachedExtension(cache, extension);
+    }
+    free(charTable);
+    _EndPhase(LOAD_EXTENSIONS, start, pos - extensionsPos);
+
+
+    // Find every block in the rest of the file before parsing any of it, so they can be inflated on other threads while we parse
+    start = _Now();
+    GameDataIndex index;
+    if (!_IndexGameData(buffer, fileSize, pos, &index)) {
+        // Data runs off the end of the file
+        free(data);
+        FileUnmap(&file);
+        return false;
+    }
+    free(data);
+    _EndPhase(LOAD_INDEX, start, fileSize - pos);
+
+    start = _Now();
+    bool success;
+    if (options.progressive) {
+        for (size_t b = index.First(SECTION_SPRITES); b < index.End(SECTION_SPRITES); b++) {
+            index.blocks[b].deferred = true;
+        }
+        for (size_t b = index.First(SECTION_BACKGROUNDS); b < index.End(SECTION_BACKGROUNDS); b++) {
+            index.blocks[b].deferred = true;
+        }
+    }
+    {
+        BlockInflater inflater(buffer, &index.blocks, options.inflateThreads);
+        success = _ReadGameData(buffer, index, &inflater, version, cache, options.progressive);
+    }  // The inflater has to stop its workers before the file goes away
+    _CollectInflateStats(buffer, index);
+    if (success && !_deferredAssets.empty()) {
+        // The deferred sprites and backgrounds get inflated straight out of it, so it's unmapped once the last of them is done
+        _streamFile = file;
+    }
+    else {
+        FileUnmap(&file);
+    }
+    if (!success) {
+        // Error reading game data
+        return false;
+    }
+    _EndPhase(LOAD_ASSETS, start, fileSize - pos);
+
+    start = _Now();
+    _StartStreaming();
+    _EndPhase(LOAD_FIRST_ROOM, start);
+
+    start = _Now();
+    if (cache) cache->Finish({GAME_CACHE_MAGIC, GAME_CACHE_FORMAT_VERSION, fileSize, exeHash, 0}, version);
+    _EndPhase(LOAD_CACHE_WRITE, start);
+
+    _StartAtlasLayout(pFilename, options);
+    return _CompileGame(pFilename, options, fileSize, exeHash);
+}
+
+bool GameLoad(const char* pFilename, const GameLoadOptions& options) {
+    _loadStats = options.stats;
+    if (_loadStats) (*_loadStats) = GameLoadStats();
+    double start = _Now();
+    bool success = _GameLoad(pFilename, options);
+    if (_loadStats) _loadStats->totalSeconds = _Now() - start;
+    _loadStats = NULL;
+    _decodingSection = -1;
+    return success;
 }
 
 bool GameStart() {
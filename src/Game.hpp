@@ -10,9 +10,94 @@ class CodeRunner;
 void GameInit();
 void GameTerminate();
 
+// Sections of the game data that are made of zlib blocks, in the order they appear in the exe
+enum GameDataSection {
+    SECTION_TRIGGERS,
+    SECTION_SOUNDS,
+    SECTION_SPRITES,
+    SECTION_BACKGROUNDS,
+    SECTION_PATHS,
+    SECTION_SCRIPTS,
+    SECTION_FONTS,
+    SECTION_TIMELINES,
+    SECTION_OBJECTS,
+    SECTION_ROOMS,
+    SECTION_INCLUDE_FILES,
+    SECTION_GAME_INFO,
+    SECTION_COUNT
+};
+
+// The steps GameLoad goes through, in the order it goes through them. Which ones run depends on the options and on whether there's a usable cache.
+enum GameLoadPhase {
+    LOAD_MAP,  // Mapping or reading the exe
+    LOAD_HASH,  // Hashing the exe to key the caches
+    LOAD_CACHE_READ,  // Everything up to compiling, when it all comes from a .gm8cache
+    LOAD_HEADER_SCAN,  // Finding the game version, not counting Decrypt81
+    LOAD_DECRYPT81,
+    LOAD_SETTINGS,  // Inflating and reading the settings block
+    LOAD_DECRYPT_DATA,
+    LOAD_EXTENSIONS,
+    LOAD_INDEX,  // Finding every block in the asset sections
+    LOAD_ASSETS,  // Inflating and decoding the asset sections, with the split per section in GameLoadStats::sections
+    LOAD_FIRST_ROOM,  // With progressive set, decoding the sprites and backgrounds the first room needs
+    LOAD_CACHE_WRITE,  // Finishing the .gm8cache
+    LOAD_OBJECT_IDENTITIES,  // CompileObjectIdentities
+    LOAD_GML_CACHE_READ,  // Loading the .gmlcache
+    LOAD_GML_COMPILE,  // Compiling, or with lazyCompile just getting the background compiler going
+    LOAD_GML_CACHE_WRITE,
+    LOAD_PHASE_COUNT
+};
+
+struct GameLoadPhaseStats {
+    double seconds = 0;
+    unsigned long long bytes = 0;  // How much data the phase got through, where that means anything
+};
+
+struct GameLoadSectionStats {
+    unsigned int blocks = 0;
+    unsigned long long compressedBytes = 0;
+    unsigned long long inflatedBytes = 0;
+    double inflateSeconds = 0;  // Added up over the inflater's workers, so it can be more than the time the section took
+    double waitSeconds = 0;  // How long the loader sat waiting for blocks to be inflated
+    double decodeSeconds = 0;  // Parsing and converting blocks once they're inflated
+};
+
+// Where the time goes during GameLoad, filled in if GameLoadOptions::stats is set. Used by the load benchmark in bench/.
+struct GameLoadStats {
+    double totalSeconds = 0;
+    bool fromCache = false;
+    bool mapped = false;  // Whether the exe really got mapped, since it gets read into a buffer instead if mapping fails
+    GameLoadPhaseStats phases[LOAD_PHASE_COUNT];
+    GameLoadSectionStats sections[SECTION_COUNT];
+};
+
+// Short lowercase names for the above, for reports
+const char* GameLoadPhaseName(GameLoadPhase phase);
+const char* GameDataSectionName(GameDataSection section);
+
+// Optional loader behaviour. The defaults are what you want unless you're comparing loader modes.
+struct GameLoadOptions {
+    bool mapFile = true;  // Map the exe into memory with copy-on-write pages instead of reading all of it into a heap buffer
+    bool useCache = true;  // Load from, or build, a .gm8cache, .gmlcache and .atlascache next to the exe so later loads can skip decrypting, inflating, compiling and atlas packing
+    bool lazyCompile = true;  // Compile code when it first runs, with a background thread getting through the rest, instead of compiling all of it before the game starts
+    unsigned int compileThreads = 0;  // Threads for compiling code (or, with lazyCompile, for the tokenizing it does up front), 0 for one per hardware thread
+    unsigned int inflateThreads = 0;  // Worker threads for inflating asset blocks, 0 for one per hardware thread
+    GameLoadStats* stats = nullptr;  // If set, gets filled in with timings for each phase of the load
+
+    // Only decode the sprites and backgrounds the first room uses before starting, and decode the rest on worker threads while the game runs.
+    // The .gm8cache holds decoded assets, so it isn't written on a load like this, but one that's already there still gets used.
+    bool progressive = false;
+};
+
 // Load in game data from a file stream. Returns true on success, false on failure.
 // The Game object should be deleted on failure as it will be in an undefined state.
-bool GameLoad(const char* filename);
+bool GameLoad(const char* filename, const GameLoadOptions& options = GameLoadOptions());
+
+// With progressive loading, these wait until a sprite, a background, or everything a room uses, has been decoded. They return straight away otherwise.
+// Anything that draws or collides with a sprite or background waits for it first, so what a frame looks like never depends on how the decoding threads got scheduled.
+void GameWaitForSprite(unsigned int index);
+void GameWaitForBackground(unsigned int index);
+void GameWaitForRoomAssets(unsigned int room);
 
 // Opens a window for the game and loads the first room.
 // Returns true if successful, otherwise false.
@@ -0,0 +1,190 @@
+#include "GameCache.hpp"
+#include <string.h>
+
+// Multipliers from xxHash64
+constexpr unsigned long long HASH_PRIME_1 = 0x9E3779B185EBCA87ULL;
+constexpr unsigned long long HASH_PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr unsigned long long HASH_PRIME_3 = 0x165667B19E3779F9ULL;
+
+inline unsigned long long _Rotl64(unsigned long long x, int r) { return (x << r) | (x >> (64 - r)); }
+
+inline unsigned long long _HashRound(unsigned long long state, unsigned long long word) { return _Rotl64(state ^ (word * HASH_PRIME_2), 31) * HASH_PRIME_1; }
+
+inline unsigned long long _ReadWord(const unsigned char* p) {
+    unsigned long long word = 0;
+    for (int i = 7; i >= 0; i--) word = (word << 8) | p[i];
+    return word;
+}
+
+Hasher64::Hasher64() {
+    _state = HASH_PRIME_3;
+    _length = 0;
+    _tailLength = 0;
+}
+
+void Hasher64::Update(const void* data, size_t length) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    _length += length;
+
+    // Finish off a word left over from last time
+    if (_tailLength) {
+        while (_tailLength < 8 && length) {
+            _tail[_tailLength++] = *p++;
+            length--;
+        }
+        if (_tailLength < 8) return;
+        _state = _HashRound(_state, _ReadWord(_tail));
+        _tailLength = 0;
+    }
+
+    for (; length >= 8; length -= 8, p += 8) {
+        _state = _HashRound(_state, _ReadWord(p));
+    }
+
+    memcpy(_tail, p, length);
+    _tailLength = static_cast<unsigned int>(length);
+}
+
+unsigned long long Hasher64::Final() const {
+    unsigned long long h = _state ^ _length;
+    for (unsigned int i = 0; i < _tailLength; i++) {
+        h = _Rotl64(h ^ (_tail[i] * HASH_PRIME_3), 11) * HASH_PRIME_1;
+    }
+
+    // Avalanche
+    h ^= h >> 33;
+    h *= HASH_PRIME_2;
+    h ^= h >> 29;
+    h *= HASH_PRIME_3;
+    h ^= h >> 32;
+    return h;
+}
+
+unsigned long long Hash64(const void* data, size_t length) {
+    Hasher64 hasher;
+    hasher.Update(data, length);
+    return hasher.Final();
+}
+
+bool GameCacheOpen(const char* path, const GameCacheKey& key, FileMapping* cache, int* pGameVersion) {
+    if (!FileMap(path, cache)) return false;
+
+    GameCacheHeader header;
+    if (cache->length < sizeof(header)) {
+        FileUnmap(cache);
+        return false;
+    }
+    memcpy(&header, cache->data, sizeof(header));
+
+    bool valid = header.magic == key.magic && header.formatVersion == key.formatVersion && header.exeLength == key.exeLength && header.exeHash == key.exeHash &&
+                 header.buildHash == key.buildHash &&
+                 header.bodyLength == cache->length - sizeof(header) && header.bodyHash == Hash64(cache->data + sizeof(header), static_cast<size_t>(header.bodyLength));
+    if (!valid) {
+        // Stale or damaged, whoever opened it will write a new one
+        FileUnmap(cache);
+        return false;
+    }
+
+    (*pGameVersion) = static_cast<int>(header.gameVersion);
+    return true;
+}
+
+GameCacheWriter::GameCacheWriter() {
+    _file = NULL;
+    _length = 0;
+    _inRecord = false;
+    _failed = false;
+}
+
+GameCacheWriter::~GameCacheWriter() {
+    if (_file) {
+        fclose(_file);
+        remove(_tmpPath.c_str());
+    }
+}
+
+bool GameCacheWriter::Open(const char* path) {
+    _path = path;
+    _tmpPath = _path + ".tmp";
+    _file = fopen(_tmpPath.c_str(), "wb");
+    if (!_file) return false;
+
+    // Leave room for the header, it gets written last
+    GameCacheHeader header = {};
+    if (fwrite(&header, sizeof(header), 1, _file) != 1) _failed = true;
+    return !_failed;
+}
+
+void GameCacheWriter::_Write(const void* data, size_t length) {
+    if (_inRecord) {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        _record.insert(_record.end(), p, p + length);
+        return;
+    }
+    if (_failed || length == 0) return;
+    if (fwrite(data, 1, length, _file) != length) {
+        _failed = true;
+        return;
+    }
+    _hasher.Update(data, length);
+    _length += length;
+}
+
+void GameCacheWriter::WriteBytes(const void* data, size_t length) { _Write(data, length); }
+
+void GameCacheWriter::WriteDword(unsigned int value) {
+    unsigned char bytes[4] = {( unsigned char )(value & 0xFF), ( unsigned char )((value >> 8) & 0xFF), ( unsigned char )((value >> 16) & 0xFF), ( unsigned char )(value >> 24)};
+    _Write(bytes, 4);
+}
+
+void GameCacheWriter::WriteString(const char* str) {
+    unsigned int length = str ? static_cast<unsigned int>(strlen(str)) : 0;
+    WriteDword(length);
+    _Write(str, length);
+}
+
+void GameCacheWriter::WriteSection(size_t count) {
+    WriteDword(0);  // Where the exe has a data version
+    WriteDword(static_cast<unsigned int>(count));
+}
+
+void GameCacheWriter::WriteRecord(const void* data, unsigned int length) {
+    WriteDword(length);
+    _Write(data, length);
+}
+
+void GameCacheWriter::BeginRecord() {
+    _record.clear();
+    _inRecord = true;
+}
+
+void GameCacheWriter::EndRecord() {
+    _inRecord = false;
+    WriteRecord(_record.data(), static_cast<unsigned int>(_record.size()));
+}
+
+bool GameCacheWriter::Finish(const GameCacheKey& key, int gameVersion) {
+    if (!_file) return false;
+
+    GameCacheHeader header;
+    header.magic = key.magic;
+    header.formatVersion = key.formatVersion;
+    header.gameVersion = static_cast<unsigned int>(gameVersion);
+    header.exeLength = key.exeLength;
+    header.exeHash = key.exeHash;
+    header.bodyLength = _length;
+    header.bodyHash = _hasher.Final();
+    header.buildHash = key.buildHash;
+
+    if (!_failed && (fseek(_file, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, _file) != 1)) _failed = true;
+    if (fclose(_file) != 0) _failed = true;
+    _file = NULL;
+
+    // rename() won't replace an existing file on Windows
+    if (!_failed) {
+        remove(_path.c_str());
+        if (rename(_tmpPath.c_str(), _path.c_str()) != 0) _failed = true;
+    }
+    if (_failed) remove(_tmpPath.c_str());
+    return !_failed;
+}
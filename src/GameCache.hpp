@@ -0,0 +1,97 @@
+#pragma once
+
+#include "FileMapping.hpp"
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+constexpr unsigned int GAME_CACHE_MAGIC = 0x43384D47;  // "GM8C"
+constexpr unsigned int CODE_CACHE_MAGIC = 0x434C4D47;  // "GMLC"
+constexpr unsigned int ATLAS_CACHE_MAGIC = 0x41384D47;  // "GM8A"
+
+// Bump this whenever anything about what gets written to a .gm8cache changes, so old caches get rebuilt instead of misread
+constexpr unsigned int GAME_CACHE_FORMAT_VERSION = 2;
+
+// Fast 64-bit streaming hash. It keys the cache on the exe's contents and catches caches that got damaged on disk.
+// It's not cryptographic, it only has to notice that something changed.
+class Hasher64 {
+  private:
+    unsigned long long _state;
+    unsigned long long _length;
+    unsigned char _tail[8];
+    unsigned int _tailLength;
+
+  public:
+    Hasher64();
+    void Update(const void* data, size_t length);
+    unsigned long long Final() const;
+};
+
+// Hashes a whole buffer in one go
+unsigned long long Hash64(const void* data, size_t length);
+
+// What a cache file has to match to be used: which kind of cache it is, which version of that format, the exe it was built from,
+// and anything about this build of the emulator that the contents depend on (0 if nothing)
+struct GameCacheKey {
+    unsigned int magic;
+    unsigned int formatVersion;
+    unsigned int exeLength;
+    unsigned long long exeHash;
+    unsigned long long buildHash;
+};
+
+// Sits at the start of every cache file. Everything after it is the body.
+struct GameCacheHeader {
+    unsigned int magic;
+    unsigned int formatVersion;
+    unsigned int gameVersion;
+    unsigned int exeLength;
+    unsigned long long exeHash;
+    unsigned long long bodyLength;
+    unsigned long long bodyHash;
+    unsigned long long buildHash;
+};
+
+// Maps the cache at path, checking that it matches the key and that its body is intact.
+// On success the body starts at cache->data + sizeof(GameCacheHeader) and the game version it was built with goes in pGameVersion.
+// Returns false, with nothing to clean up, if there's no usable cache.
+bool GameCacheOpen(const char* path, const GameCacheKey& key, FileMapping* cache, int* pGameVersion);
+
+// Writes a cache file: a .gm8cache while GameLoad reads the exe, or a compiled code cache for CodeManager. The body is written to a temp file as it goes, and only replaces the real cache once Finish succeeds,
+// so a load that fails or crashes half way never leaves a broken cache behind.
+// Everything is written in the same little-endian format ReadDword and ReadString read.
+class GameCacheWriter {
+  private:
+    FILE* _file;
+    std::string _path;
+    std::string _tmpPath;
+    Hasher64 _hasher;
+    unsigned long long _length;
+    std::vector<unsigned char> _record;
+    bool _inRecord;
+    bool _failed;
+
+    void _Write(const void* data, size_t length);
+
+  public:
+    GameCacheWriter();
+    ~GameCacheWriter();  // Throws the temp file away if Finish was never called
+
+    // Starts writing a cache that will end up at path. Returns false if the temp file can't be created.
+    bool Open(const char* path);
+
+    void WriteBytes(const void* data, size_t length);
+    void WriteDword(unsigned int value);
+    void WriteString(const char* str);
+
+    // Starts a section of count records. Sections are laid out the same way they are in the exe, so the same indexing code can walk both.
+    void WriteSection(size_t count);
+
+    // Writes a length-prefixed record. Between BeginRecord and EndRecord, everything written is collected and then written as a single record.
+    void WriteRecord(const void* data, unsigned int length);
+    void BeginRecord();
+    void EndRecord();
+
+    // Fills in the header and moves the cache into place. Returns false if anything went wrong along the way, in which case there's no cache.
+    bool Finish(const GameCacheKey& key, int gameVersion);
+};
@@ -20,6 +20,9 @@ bool GameLoadRoom(int id) {
     // Check room exists
     if (!room->exists) return false;
 
+    // If the room's sprites and backgrounds are still being decoded in the background, they have to be done before it starts
+    GameWaitForRoomAssets(id);
+
     InstanceList::Iterator iter;
     InstanceHandle i;
     while ((i = iter.Next()) != InstanceList::NoInstance) {
@@ -131,6 +134,29 @@ bool GameLoadRoom(int id) {
 }
 
 
+// Draws a room background or foreground as one quad, with the copies coming from the texture wrapping rather than from a draw for each one.
+// It covers the same copies the old loop over them did: whole copies, from one before the background's position (or from 0 if it doesn't tile that way)
+// until the room's covered.
+void _DrawRoomBackground(Room* room, const RoomBackground& bg) {
+    if (bg.backgroundIndex < 0) return;
+    Background* b = AssetManager::GetBackground(bg.backgroundIndex);
+    if (!b->exists) return;
+    GameWaitForBackground(bg.backgroundIndex);
+
+    unsigned int stretchedW = (bg.stretch ? room->width : b->width);
+    unsigned int stretchedH = (bg.stretch ? room->height : b->height);
+    if (stretchedW == 0 || stretchedH == 0) return;
+    double scaleX = (bg.stretch ? (( double )room->width / b->width) : 1);
+    double scaleY = (bg.stretch ? (( double )room->height / b->height) : 1);
+
+    int startX = (bg.tileHor ? ( int )(bg.x - stretchedW) : 0);
+    int startY = (bg.tileVert ? ( int )(bg.y - stretchedH) : 0);
+    if (startX >= ( int )room->width || startY >= ( int )room->height) return;
+    double repeatX = std::ceil(( double )(( int )room->width - startX) / stretchedW);
+    double repeatY = std::ceil(( double )(( int )room->height - startY) / stretchedH);
+    RDrawImageTiled(b->image, startX, startY, scaleX, scaleY, repeatX, repeatY, 0xFFFFFFFF, 1);
+}
+
 bool GameFrame() {
     InstanceHandle instance;
     InstanceList::Iterator iter;
@@ -421,22 +447,7 @@ bool GameFrame() {
     // Draw room backgrounds
     Room* room = AssetManager::GetRoom(_globals.room);
     for (unsigned int i = 0; i < room->backgroundCount; i++) {
-        RoomBackground bg = room->backgrounds[i];
-        if (bg.visible && !bg.foreground && bg.backgroundIndex >= 0) {
-            Background* b = AssetManager::GetBackground(bg.backgroundIndex);
-            if (b->exists) {
-                unsigned int stretchedW = (bg.stretch ? room->width : b->width);
-                unsigned int stretchedH = (bg.stretch ? room->height : b->height);
-                double scaleX = (bg.stretch ? (( double )room->width / b->width) : 1);
-                double scaleY = (bg.stretch ? (( double )room->height / b->height) : 1);
-
-                for (int startY = (bg.tileVert ? (bg.y - stretchedH) : 0); startY < ( int )room->height; startY += stretchedH) {
-                    for (int startX = (bg.tileHor ? (bg.x - stretchedW) : 0); startX < ( int )room->width; startX += stretchedW) {
-                        RDrawImage(b->image, startX, startY, scaleX, scaleY, 0, 0xFFFFFFFF, 1);
-                    }
-                }
-            }
-        }
+        if (room->backgrounds[i].visible && !room->backgrounds[i].foreground) _DrawRoomBackground(room, room->backgrounds[i]);
     }
 
     /*
@@ -499,20 +510,7 @@ bool GameFrame() {
 
     // Draw room foregrounds
     for (unsigned int i = 0; i < room->backgroundCount; i++) {
-        RoomBackground bg = room->backgrounds[i];
-        if (bg.visible && bg.foreground) {
-            Background* b = AssetManager::GetBackground(bg.backgroundIndex);
-            unsigned int stretchedW = (bg.stretch ? room->width : b->width);
-            unsigned int stretchedH = (bg.stretch ? room->height : b->height);
-            double scaleX = (bg.stretch ? (( double )room->width / b->width) : 1);
-            double scaleY = (bg.stretch ? (( double )room->height / b->height) : 1);
-
-            for (int startY = (bg.tileVert ? (bg.y - stretchedH) : 0); startY < ( int )room->height; startY += stretchedH) {
-                for (int startX = (bg.tileHor ? (bg.x - stretchedW) : 0); startX < ( int )room->width; startX += stretchedW) {
-                    RDrawImage(b->image, startX, startY, scaleX, scaleY, 0, 0xFFFFFFFF, 1);
-                }
-            }
-        }
+        if (room->backgrounds[i].visible && room->backgrounds[i].foreground) _DrawRoomBackground(room, room->backgrounds[i]);
     }
 
     // Draw screen
@@ -535,7 +533,10 @@ bool GameFrame() {
                 if (!CodeActionManager::RunInstanceEvent(7, 7, instance, InstanceList::NoInstance, inst.object_index)) return false;  // Animation End event
                 if (_globals.changeRoom) return GameLoadRoom(_globals.roomTarget);
             }
-            if (inst.image_speed && s->separateCollision) inst.bboxIsStale = true;
+            if (inst.image_speed) {
+                GameWaitForSprite(inst.sprite_index);  // Whether it has a mask per frame isn't known until it's decoded with progressive loading
+                if (s->separateCollision) inst.bboxIsStale = true;
+            }
         }
     }
 
@@ -138,14 +138,14 @@ void InputInit(GLFWwindow* window) {
     memset(_current, 0, sizeof(bool) * NUM_KEYS);
     memset(_pressed, 0, sizeof(bool) * NUM_KEYS);
     memset(_released, 0, sizeof(bool) * NUM_KEYS);
-    glfwSetKeyCallback(window, key_callback);
+    if (window) glfwSetKeyCallback(window, key_callback);
     win = window;
 }
 
 void InputUpdate() {
     memset(_pressed, 0, sizeof(bool) * NUM_KEYS);
     memset(_released, 0, sizeof(bool) * NUM_KEYS);
-    glfwPollEvents();
+    if (win) glfwPollEvents();
 }
 
 
@@ -174,7 +174,7 @@ bool InputCheckKeyDirect(int code) {
         default:
             return false;
     }
-    return glfwGetKey(win, c);
+    return win && glfwGetKey(win, c);
 }
 
 bool InputCheckKeyPressed(int code) {
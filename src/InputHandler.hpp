@@ -4,6 +4,7 @@
 
 struct GLFWwindow;
 
+// window can be NULL when there isn't one, and then no keys are ever pressed
 void InputInit(GLFWwindow* window);
 void InputUpdate();
 void InputClearKeys();
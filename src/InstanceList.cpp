@@ -2,6 +2,8 @@
 #include "AssetManager.hpp"
 #include "CRGMLType.hpp"
 #include "CodeActionManager.hpp"
+#include "DrawOrder.hpp"
+#include "Game.hpp"
 #include "Instance.hpp"
 #include "Renderer.hpp"
 #include "Tile.hpp"
@@ -13,22 +15,16 @@
 struct PooledType {
     bool used = false;
     virtual bool Draw() = 0;
-    virtual int GetDepth() = 0;
-    virtual int GetObjectIndex() = 0;
 };
 
 struct PooledInstance : public PooledType {
     Instance instance;
     bool Draw();
-    int GetDepth() {return instance.depth;}
-    int GetObjectIndex() {return instance.object_index;}
 };
 
 struct PooledTile : public PooledType {
     Tile tile;
     bool Draw();
-    int GetDepth() {return tile.depth;}
-    int GetObjectIndex() {return -1;}
 };
 
 // Template class for creating memory pools
@@ -61,7 +57,26 @@ size_t _largestPoolSize;
 
 std::vector<PooledInstance*> _iterationOrder;
 std::vector<PooledTile*> _tiles;
-std::vector<PooledType*> _drawOrder;
+std::vector<DrawEntry> _drawOrder;  // Instances only, tiles get drawn from _tileLayers. Still sorted from last frame until _SortDrawOrder is called.
+std::vector<DrawEntry> _drawScratch;  // Second buffer for RadixSortDrawOrder
+
+// Brings the keys up to date and puts _drawOrder back in order. It's almost always in order already or close to it, so that's checked for first.
+void _SortDrawOrder();
+
+DrawEntry _MakeDrawEntry(PooledInstance* inst) { return DrawEntry{0, 0, 0, inst}; }
+
+// Tiles hardly ever change, so all the ones at each depth get recorded into a renderer cache and drawn in one go.
+// The layers are remade the next time everything's drawn after tiles get added or removed.
+struct TileLayer {
+    int depth;
+    RCacheIndex cache;
+};
+std::vector<TileLayer> _tileLayers;  // Deepest first, the order they get drawn in
+bool _tileLayersStale = false;
+
+// Throws away the tile layers and makes them again from _tiles. Returns false if a tile couldn't be drawn.
+bool _BuildTileLayers();
+void _FreeTileLayers();
 
 Pool<PooledInstance>& _addInstancePool(size_t size) {
     size_t poolCount = _instancePools.size();
@@ -93,6 +108,7 @@ void InstanceList::Finalize() {
     _instancePools.clear();
     _iterationOrder.clear();
     _drawOrder.clear();
+    _tileLayers.clear();
 }
 
 InstanceHandle InstanceList::AddInstance(InstanceID id, double x, double y, unsigned int objectId) {
@@ -131,7 +147,7 @@ InstanceHandle InstanceList::AddInstance(InstanceID id, double x, double y, unsi
 
     InstanceHandle ret = static_cast<InstanceHandle>(_iterationOrder.size());
     _iterationOrder.push_back(place);
-    _drawOrder.push_back(place);
+    _drawOrder.push_back(_MakeDrawEntry(place));
     if (_InitInstance(&place->instance, id, x, y, objectId)) {
         return ret;
     }
@@ -180,7 +196,7 @@ unsigned int InstanceList::AddTile(unsigned int id, int background, int left, in
     }
 
     _tiles.push_back(place);
-    _drawOrder.push_back(place);
+    _tileLayersStale = true;
     place->tile = Tile(x, y, background, left, top, width, height, depth, id);
     return id;
 }
@@ -202,7 +218,7 @@ void InstanceList::AddInstances(const std::vector<Instance>& instances) {
                     pooledInst.instance = instances[pos];
                     pooledInst.used = true;
                     _iterationOrder.push_back(&pooledInst);
-                    _drawOrder.push_back(&pooledInst);
+                    _drawOrder.push_back(_MakeDrawEntry(&pooledInst));
                     pos++;
                     if (pos == instances.size()) return;
                 }
@@ -235,6 +251,7 @@ void InstanceList::ClearAll() {
     _iterationOrder.clear();
     _drawOrder.clear();
     _tiles.clear();
+    _tileLayersStale = true;
 }
 
 void InstanceList::ClearNonPersistent() {
@@ -251,9 +268,10 @@ void InstanceList::ClearNonPersistent() {
     }
     auto it = std::remove_if(_iterationOrder.begin(), _iterationOrder.end(), [](PooledInstance* inst) { return !inst->used; });
     _iterationOrder.erase(it, _iterationOrder.end());
-    auto it2 = std::remove_if(_drawOrder.begin(), _drawOrder.end(), [](PooledType* inst) { return !inst->used; });
+    auto it2 = std::remove_if(_drawOrder.begin(), _drawOrder.end(), [](const DrawEntry& entry) { return !entry.instance->used; });
     _drawOrder.erase(it2, _drawOrder.end());
     _tiles.clear();
+    _tileLayersStale = true;
 }
 
 void InstanceList::ClearDeleted() {
@@ -267,20 +285,72 @@ void InstanceList::ClearDeleted() {
     }
     auto it = std::remove_if(_iterationOrder.begin(), _iterationOrder.end(), [](PooledInstance* inst) { return !inst->used; });
     _iterationOrder.erase(it, _iterationOrder.end());
-    auto it2 = std::remove_if(_drawOrder.begin(), _drawOrder.end(), [](PooledType* inst) { return !inst->used; });
+    auto it2 = std::remove_if(_drawOrder.begin(), _drawOrder.end(), [](const DrawEntry& entry) { return !entry.instance->used; });
     _drawOrder.erase(it2, _drawOrder.end());
 }
 
 bool InstanceList::DrawEverything() {
-    std::sort(_drawOrder.begin(), _drawOrder.end(), [](PooledType*& l, PooledType*& r) {
-        return (l->GetDepth() == r->GetDepth()) ? (l->GetObjectIndex() > r->GetObjectIndex()) : (l->GetDepth() > r->GetDepth());
-    });
-    for (PooledType*& toDraw : _drawOrder) {
-        if (!toDraw->Draw()) return false;
+    if (_tileLayersStale) {
+        if (!_BuildTileLayers()) return false;
+    }
+
+    _SortDrawOrder();
+
+    // Tile layers go in between the instances. At the same depth, tiles go on top, like they did when they were sorted in with the instances.
+    auto layer = _tileLayers.begin();
+    for (const DrawEntry& toDraw : _drawOrder) {
+        for (; layer != _tileLayers.end() && layer->depth > toDraw.depth; layer++) {
+            RDrawCache(layer->cache);
+        }
+        if (!toDraw.instance->Draw()) return false;
+    }
+    for (; layer != _tileLayers.end(); layer++) {
+        RDrawCache(layer->cache);
+    }
+    return true;
+}
+
+void _SortDrawOrder() {
+    size_t outOfPlace = 0;
+    for (size_t i = 0; i < _drawOrder.size(); i++) {
+        DrawEntry& entry = _drawOrder[i];
+        const Instance& inst = entry.instance->instance;
+        DrawSetKey(&entry, inst.depth, inst.object_index, inst.id);
+        if (i && DrawsBefore(entry, _drawOrder[i - 1])) outOfPlace++;
     }
+    SortDrawOrder(&_drawOrder, &_drawScratch, outOfPlace);
+}
+
+bool _BuildTileLayers() {
+    _FreeTileLayers();
+
+    // Tiles at the same depth stay in the order they were added
+    std::vector<PooledTile*> tiles = _tiles;
+    std::stable_sort(tiles.begin(), tiles.end(), [](PooledTile* l, PooledTile* r) { return l->tile.depth > r->tile.depth; });
+    for (size_t i = 0; i < tiles.size();) {
+        TileLayer layer;
+        layer.depth = tiles[i]->tile.depth;
+        layer.cache = RStartCache();
+        _tileLayers.push_back(layer);
+        for (; i < tiles.size() && tiles[i]->tile.depth == layer.depth; i++) {
+            if (!tiles[i]->Draw()) {
+                REndCache();
+                return false;
+            }
+        }
+        REndCache();
+    }
+    _tileLayersStale = false;
     return true;
 }
 
+void _FreeTileLayers() {
+    for (const TileLayer& layer : _tileLayers) {
+        RFreeCache(layer.cache);
+    }
+    _tileLayers.clear();
+}
+
 Instance* InstanceList::GetInstanceByNumber(unsigned int num, size_t startPos, size_t* endPos) {
     if (num > 100000) {
         // Instance ID
@@ -502,6 +572,7 @@ bool PooledInstance::Draw() {
             if (instance.sprite_index >= 0) {
                 Sprite* sprite = AssetManager::GetSprite(instance.sprite_index);
                 if (sprite->exists) {
+                    GameWaitForSprite(instance.sprite_index);
                     RDrawImage(sprite->frames[static_cast<int>(instance.image_index) % sprite->frameCount], instance.x, instance.y, instance.image_xscale, instance.image_yscale, instance.image_angle,
                         instance.image_blend, instance.image_alpha);
                 }
@@ -519,6 +590,7 @@ bool PooledTile::Draw() {
     if (tile.backgroundIndex < 0) return false;
     Background* bg = AssetManager::GetBackground(tile.backgroundIndex);
     if (!bg->exists) return false;
+    GameWaitForBackground(tile.backgroundIndex);
     RDrawPartialImage(bg->image, tile.x, tile.y, 1, 1, 0, 0xFFFFFFFF, 1, tile.tileX, tile.tileY, tile.width, tile.height);
     return true;
 }
\ No newline at end of file
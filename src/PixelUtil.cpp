@@ -0,0 +1,300 @@
+#include "PixelUtil.hpp"
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PIXEL_SSE2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__aarch64__) || defined(_M_ARM64)
+#define PIXEL_NEON
+#include <arm_neon.h>
+#endif
+
+// AVX2 kernels get built whatever the compiler's target is, and only run if the CPU has it
+#if defined(__GNUC__) || defined(__clang__)
+#define PIXEL_AVX2 __attribute__((target("avx2")))
+#else
+#define PIXEL_AVX2
+#endif
+
+static_assert(sizeof(bool) == 1, "collision masks are written one byte per pixel");
+
+void PixelScalar::SwapRedBlue(unsigned char* pixels, size_t count) {
+    for (; count; count--, pixels += 4) {
+        unsigned char tmp = pixels[0];
+        pixels[0] = pixels[2];
+        pixels[2] = tmp;
+    }
+}
+
+void PixelScalar::UnpackMask(const unsigned char* data, bool* mask, size_t count) {
+    for (size_t i = 0; i < count; i++, data += 4) {
+        mask[i] = (data[0] | data[1] | data[2] | data[3]) != 0;
+    }
+}
+
+void PixelScalar::ExpandAlpha(const unsigned char* alpha, unsigned char* rgba, size_t count) {
+    for (size_t i = 0; i < count; i++, rgba += 4) {
+        rgba[0] = 0xFF;
+        rgba[1] = 0xFF;
+        rgba[2] = 0xFF;
+        rgba[3] = alpha[i];
+    }
+}
+
+// x / 255, rounded to nearest, for x up to 255 * 255. The vector kernels work this out the same way.
+inline unsigned int _Div255(unsigned int x) { return ((x + 128) * 257) >> 16; }
+
+void PixelScalar::BlendPixels(unsigned char* dst, const unsigned char* src, size_t count, unsigned int blend, unsigned char alpha) {
+    const unsigned int r = blend & 0xFF, g = (blend >> 8) & 0xFF, b = (blend >> 16) & 0xFF;
+    const bool plain = (blend & 0xFFFFFF) == 0xFFFFFF && alpha == 0xFF;
+    for (; count; count--, src += 4, dst += 4) {
+        if (src[3] == 0) continue;
+        if (plain && src[3] == 0xFF) {
+            memcpy(dst, src, 4);
+            continue;
+        }
+        unsigned int a = _Div255(src[3] * alpha);
+        unsigned int inv = 0xFF - a;
+        dst[0] = ( unsigned char )_Div255(_Div255(src[0] * r) * a + dst[0] * inv);
+        dst[1] = ( unsigned char )_Div255(_Div255(src[1] * g) * a + dst[1] * inv);
+        dst[2] = ( unsigned char )_Div255(_Div255(src[2] * b) * a + dst[2] * inv);
+        dst[3] = ( unsigned char )_Div255(a * a + dst[3] * inv);
+    }
+}
+
+#ifdef PIXEL_SSE2
+void _SwapRedBlueSSE2(unsigned char* pixels, size_t count) {
+    const __m128i keep = _mm_set1_epi32(( int )0xFF00FF00);
+    const __m128i low = _mm_set1_epi32(0x000000FF);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4, pixels += 16) {
+        __m128i v = _mm_loadu_si128(( const __m128i* )pixels);
+        __m128i swapped = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(v, 16), low), _mm_slli_epi32(_mm_and_si128(v, low), 16));
+        _mm_storeu_si128(( __m128i* )pixels, _mm_or_si128(_mm_and_si128(v, keep), swapped));
+    }
+    PixelScalar::SwapRedBlue(pixels, count - i);
+}
+
+void _UnpackMaskSSE2(const unsigned char* data, bool* mask, size_t count) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16, data += 64) {
+        __m128i a = _mm_cmpeq_epi32(_mm_loadu_si128(( const __m128i* )data), zero);
+        __m128i b = _mm_cmpeq_epi32(_mm_loadu_si128(( const __m128i* )(data + 16)), zero);
+        __m128i c = _mm_cmpeq_epi32(_mm_loadu_si128(( const __m128i* )(data + 32)), zero);
+        __m128i d = _mm_cmpeq_epi32(_mm_loadu_si128(( const __m128i* )(data + 48)), zero);
+        __m128i isZero = _mm_packs_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+        _mm_storeu_si128(( __m128i* )(mask + i), _mm_andnot_si128(isZero, one));
+    }
+    PixelScalar::UnpackMask(data, mask + i, count - i);
+}
+
+void _ExpandAlphaSSE2(const unsigned char* alpha, unsigned char* rgba, size_t count) {
+    const __m128i white = _mm_set1_epi8(( char )0xFF);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16, rgba += 64) {
+        __m128i a = _mm_loadu_si128(( const __m128i* )(alpha + i));
+        __m128i lo = _mm_unpacklo_epi8(white, a);
+        __m128i hi = _mm_unpackhi_epi8(white, a);
+        _mm_storeu_si128(( __m128i* )rgba, _mm_unpacklo_epi16(white, lo));
+        _mm_storeu_si128(( __m128i* )(rgba + 16), _mm_unpackhi_epi16(white, lo));
+        _mm_storeu_si128(( __m128i* )(rgba + 32), _mm_unpacklo_epi16(white, hi));
+        _mm_storeu_si128(( __m128i* )(rgba + 48), _mm_unpackhi_epi16(white, hi));
+    }
+    PixelScalar::ExpandAlpha(alpha + i, rgba, count - i);
+}
+
+inline __m128i _Div255SSE2(__m128i x) { return _mm_mulhi_epu16(_mm_add_epi16(x, _mm_set1_epi16(128)), _mm_set1_epi16(257)); }
+
+// Blends two pixels that have been widened to 16 bits a channel
+inline __m128i _BlendHalfSSE2(__m128i s, __m128i d, __m128i mul) {
+    s = _Div255SSE2(_mm_mullo_epi16(s, mul));
+    __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xFF), 0xFF);
+    __m128i inv = _mm_sub_epi16(_mm_set1_epi16(0xFF), a);
+    return _Div255SSE2(_mm_add_epi16(_mm_mullo_epi16(s, a), _mm_mullo_epi16(d, inv)));
+}
+
+void _BlendPixelsSSE2(unsigned char* dst, const unsigned char* src, size_t count, unsigned int blend, unsigned char alpha) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alphaMask = _mm_set1_epi32(( int )0xFF000000);
+    const short r = blend & 0xFF, g = (blend >> 8) & 0xFF, b = (blend >> 16) & 0xFF;
+    const __m128i mul = _mm_setr_epi16(r, g, b, alpha, r, g, b, alpha);
+    const bool plain = (blend & 0xFFFFFF) == 0xFFFFFF && alpha == 0xFF;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4, src += 16, dst += 16) {
+        __m128i s = _mm_loadu_si128(( const __m128i* )src);
+        __m128i sAlpha = _mm_and_si128(s, alphaMask);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(sAlpha, zero)) == 0xFFFF) continue;
+        if (plain && _mm_movemask_epi8(_mm_cmpeq_epi32(sAlpha, alphaMask)) == 0xFFFF) {
+            _mm_storeu_si128(( __m128i* )dst, s);
+            continue;
+        }
+        __m128i d = _mm_loadu_si128(( const __m128i* )dst);
+        __m128i lo = _BlendHalfSSE2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero), mul);
+        __m128i hi = _BlendHalfSSE2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero), mul);
+        _mm_storeu_si128(( __m128i* )dst, _mm_packus_epi16(lo, hi));
+    }
+    PixelScalar::BlendPixels(dst, src, count - i, blend, alpha);
+}
+
+PIXEL_AVX2 void _SwapRedBlueAVX2(unsigned char* pixels, size_t count) {
+    const __m256i order = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15, 2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8, pixels += 32) {
+        __m256i v = _mm256_loadu_si256(( const __m256i* )pixels);
+        _mm256_storeu_si256(( __m256i* )pixels, _mm256_shuffle_epi8(v, order));
+    }
+    _SwapRedBlueSSE2(pixels, count - i);
+}
+
+PIXEL_AVX2 void _UnpackMaskAVX2(const unsigned char* data, bool* mask, size_t count) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi8(1);
+    // The packs work within each 128-bit half, this puts the dwords they produce back in order
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32, data += 128) {
+        __m256i a = _mm256_cmpeq_epi32(_mm256_loadu_si256(( const __m256i* )data), zero);
+        __m256i b = _mm256_cmpeq_epi32(_mm256_loadu_si256(( const __m256i* )(data + 32)), zero);
+        __m256i c = _mm256_cmpeq_epi32(_mm256_loadu_si256(( const __m256i* )(data + 64)), zero);
+        __m256i d = _mm256_cmpeq_epi32(_mm256_loadu_si256(( const __m256i* )(data + 96)), zero);
+        __m256i isZero = _mm256_permutevar8x32_epi32(_mm256_packs_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d)), order);
+        _mm256_storeu_si256(( __m256i* )(mask + i), _mm256_andnot_si256(isZero, one));
+    }
+    _UnpackMaskSSE2(data, mask + i, count - i);
+}
+
+PIXEL_AVX2 void _ExpandAlphaAVX2(const unsigned char* alpha, unsigned char* rgba, size_t count) {
+    const __m256i white = _mm256_set1_epi32(0x00FFFFFF);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8, rgba += 32) {
+        __m256i a = _mm256_cvtepu8_epi32(_mm_loadl_epi64(( const __m128i* )(alpha + i)));
+        _mm256_storeu_si256(( __m256i* )rgba, _mm256_or_si256(_mm256_slli_epi32(a, 24), white));
+    }
+    _ExpandAlphaSSE2(alpha + i, rgba, count - i);
+}
+
+bool _HasAVX2() {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_cpu_supports("avx2");
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    bool osSavesYmm = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6;
+    __cpuidex(info, 7, 0);
+    return osSavesYmm && (info[1] & (1 << 5));
+#else
+    return false;
+#endif
+}
+#endif
+
+#ifdef PIXEL_NEON
+void _SwapRedBlueNEON(unsigned char* pixels, size_t count) {
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16, pixels += 64) {
+        uint8x16x4_t v = vld4q_u8(pixels);
+        uint8x16_t tmp = v.val[0];
+        v.val[0] = v.val[2];
+        v.val[2] = tmp;
+        vst4q_u8(pixels, v);
+    }
+    PixelScalar::SwapRedBlue(pixels, count - i);
+}
+
+void _UnpackMaskNEON(const unsigned char* data, bool* mask, size_t count) {
+    const uint8x16_t one = vdupq_n_u8(1);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16, data += 64) {
+        uint32x4_t a = vreinterpretq_u32_u8(vld1q_u8(data));
+        uint32x4_t b = vreinterpretq_u32_u8(vld1q_u8(data + 16));
+        uint32x4_t c = vreinterpretq_u32_u8(vld1q_u8(data + 32));
+        uint32x4_t d = vreinterpretq_u32_u8(vld1q_u8(data + 48));
+        uint16x8_t ab = vcombine_u16(vmovn_u32(vtstq_u32(a, a)), vmovn_u32(vtstq_u32(b, b)));
+        uint16x8_t cd = vcombine_u16(vmovn_u32(vtstq_u32(c, c)), vmovn_u32(vtstq_u32(d, d)));
+        vst1q_u8(( unsigned char* )(mask + i), vandq_u8(vcombine_u8(vmovn_u16(ab), vmovn_u16(cd)), one));
+    }
+    PixelScalar::UnpackMask(data, mask + i, count - i);
+}
+
+void _ExpandAlphaNEON(const unsigned char* alpha, unsigned char* rgba, size_t count) {
+    uint8x16x4_t v;
+    v.val[0] = vdupq_n_u8(0xFF);
+    v.val[1] = v.val[0];
+    v.val[2] = v.val[0];
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16, rgba += 64) {
+        v.val[3] = vld1q_u8(alpha + i);
+        vst4q_u8(rgba, v);
+    }
+    PixelScalar::ExpandAlpha(alpha + i, rgba, count - i);
+}
+
+inline uint8x8_t _Div255NEON(uint16x8_t x) {
+    x = vaddq_u16(x, vdupq_n_u16(128));
+    return vshrn_n_u16(vaddq_u16(x, vshrq_n_u16(x, 8)), 8);
+}
+
+void _BlendPixelsNEON(unsigned char* dst, const unsigned char* src, size_t count, unsigned int blend, unsigned char alpha) {
+    const uint8x8_t r = vdup_n_u8(blend & 0xFF), g = vdup_n_u8((blend >> 8) & 0xFF), b = vdup_n_u8((blend >> 16) & 0xFF);
+    const uint8x8_t alphas = vdup_n_u8(alpha);
+    const uint8x8_t full = vdup_n_u8(0xFF);
+    const bool plain = (blend & 0xFFFFFF) == 0xFFFFFF && alpha == 0xFF;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8, src += 32, dst += 32) {
+        uint8x8x4_t s = vld4_u8(src);
+        if (vget_lane_u64(vreinterpret_u64_u8(s.val[3]), 0) == 0) continue;
+        if (plain && vget_lane_u64(vreinterpret_u64_u8(vmvn_u8(s.val[3])), 0) == 0) {
+            vst4_u8(dst, s);
+            continue;
+        }
+        uint8x8x4_t d = vld4_u8(dst);
+        uint8x8_t a = _Div255NEON(vmull_u8(s.val[3], alphas));
+        uint8x8_t inv = vsub_u8(full, a);
+        d.val[0] = _Div255NEON(vmlal_u8(vmull_u8(_Div255NEON(vmull_u8(s.val[0], r)), a), d.val[0], inv));
+        d.val[1] = _Div255NEON(vmlal_u8(vmull_u8(_Div255NEON(vmull_u8(s.val[1], g)), a), d.val[1], inv));
+        d.val[2] = _Div255NEON(vmlal_u8(vmull_u8(_Div255NEON(vmull_u8(s.val[2], b)), a), d.val[2], inv));
+        d.val[3] = _Div255NEON(vmlal_u8(vmull_u8(a, a), d.val[3], inv));
+        vst4_u8(dst, d);
+    }
+    PixelScalar::BlendPixels(dst, src, count - i, blend, alpha);
+}
+#endif
+
+struct PixelKernels {
+    void (*swapRedBlue)(unsigned char*, size_t);
+    void (*unpackMask)(const unsigned char*, bool*, size_t);
+    void (*expandAlpha)(const unsigned char*, unsigned char*, size_t);
+    void (*blendPixels)(unsigned char*, const unsigned char*, size_t, unsigned int, unsigned char);
+    const char* name;
+};
+
+PixelKernels _ChooseKernels() {
+#ifdef PIXEL_SSE2
+    if (_HasAVX2()) return {_SwapRedBlueAVX2, _UnpackMaskAVX2, _ExpandAlphaAVX2, _BlendPixelsSSE2, "avx2"};
+    return {_SwapRedBlueSSE2, _UnpackMaskSSE2, _ExpandAlphaSSE2, _BlendPixelsSSE2, "sse2"};
+#elif defined(PIXEL_NEON)
+    return {_SwapRedBlueNEON, _UnpackMaskNEON, _ExpandAlphaNEON, _BlendPixelsNEON, "neon"};
+#else
+    return {PixelScalar::SwapRedBlue, PixelScalar::UnpackMask, PixelScalar::ExpandAlpha, PixelScalar::BlendPixels, "scalar"};
+#endif
+}
+
+const PixelKernels& _Kernels() {
+    static const PixelKernels kernels = _ChooseKernels();
+    return kernels;
+}
+
+void SwapRedBlue(unsigned char* pixels, size_t count) { _Kernels().swapRedBlue(pixels, count); }
+
+void UnpackMask(const unsigned char* data, bool* mask, size_t count) { _Kernels().unpackMask(data, mask, count); }
+
+void ExpandAlpha(const unsigned char* alpha, unsigned char* rgba, size_t count) { _Kernels().expandAlpha(alpha, rgba, count); }
+
+void BlendPixels(unsigned char* dst, const unsigned char* src, size_t count, unsigned int blend, unsigned char alpha) { _Kernels().blendPixels(dst, src, count, blend, alpha); }
+
+const char* PixelKernelName() { return _Kernels().name; }
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stddef.h>
+
+// Conversions the loader runs over every pixel of every sprite, background and font, and the blend the software renderer draws with.
+// Each one picks the widest kernel the CPU supports the first time it's called: AVX2 or SSE2 on x86, NEON on ARM, plain C++ otherwise.
+
+// Swaps the first and third byte of every 4-byte pixel in place, which turns BGRA into RGBA and back.
+void SwapRedBlue(unsigned char* pixels, size_t count);
+
+// Reads count little-endian dwords and writes whether each one was non-zero. This is how the exe stores collision masks.
+void UnpackMask(const unsigned char* data, bool* mask, size_t count);
+
+// Turns count alpha bytes into white RGBA pixels with that alpha, the way font images are drawn.
+void ExpandAlpha(const unsigned char* alpha, unsigned char* rgba, size_t count);
+
+// Draws count RGBA pixels from src over dst the way the OpenGL renderer's shader does: colour multiplied by blend (a GM colour, 0xBBGGRR), alpha by alpha,
+// then src-alpha/one-minus-src-alpha blending. Everything is done in integers with the same rounding in every kernel, so the result doesn't depend on the CPU.
+void BlendPixels(unsigned char* dst, const unsigned char* src, size_t count, unsigned int blend, unsigned char alpha);
+
+// Which kernels the functions above are using, for the benchmark and for logging
+const char* PixelKernelName();
+
+// The plain C++ versions, which the fast ones are checked against
+namespace PixelScalar {
+    void SwapRedBlue(unsigned char* pixels, size_t count);
+    void UnpackMask(const unsigned char* data, bool* mask, size_t count);
+    void ExpandAlpha(const unsigned char* alpha, unsigned char* rgba, size_t count);
+    void BlendPixels(unsigned char* dst, const unsigned char* src, size_t count, unsigned int blend, unsigned char alpha);
+};
@@ -1,7 +1,11 @@
 #define PI 3.14159265358979324
 #include "Renderer.hpp"
+#include "AtlasAllocator.hpp"
+#include "GameCache.hpp"
 #include "GameSettings.hpp"
 #include "InputHandler.hpp"
+#include "SoftwareRenderer.hpp"
+#include "StreamUtil.hpp"
 
 // It's supposed to be in GLAD *then* GLFW, don't remove the newline inbetween.
 #include <glad/glad.h>
@@ -9,70 +13,88 @@
 #include <GLFW/glfw3.h>
 #include <finders_interface.h>  // rectpack2D
 
+#include <atomic>
+#include <climits>
 #include <cmath>
+#include <condition_variable>
 #include <cstring>
 #include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
 
 const GLchar* fragmentShaderCode =
     "#version 330\n"
-    "uniform sampler2D tex;\n"
+    "uniform sampler2DArray tex;\n"
     "in float objAlpha;\n"
     "in vec3 objBlend;\n"
     "in vec2 atlasXY;\n"
     "in vec2 atlasWH;\n"
     "in vec2 fragTexCoord;\n"
+    "flat in float atlasLayer;\n"
+    "flat in float tiled;\n"
     "out vec4 colourOut;\n"
     "void main() {\n"
-    "vec4 col = texture(tex, vec2(atlasXY.x + (fragTexCoord.x * atlasWH.x), atlasXY.y + (fragTexCoord.y * atlasWH.y)));\n"
+    "vec2 t = (tiled > 0.5) ? fract(fragTexCoord) : fragTexCoord;\n"
+    "vec4 col = texture(tex, vec3(atlasXY.x + (t.x * atlasWH.x), atlasXY.y + (t.y * atlasWH.y), atlasLayer));\n"
     "colourOut = vec4((col.x * objBlend.x), (col.y * objBlend.y), (col.z * objBlend.z), (col.w * objAlpha));\n"
     "}";
 
+// Each instance is one draw command, and the transform that used to be built on the CPU for every draw is built here instead:
+// the unit quad is moved so the origin is at 0,0, scaled to the size being drawn, rotated, then moved to its position and into clip space.
+// Tiled draws (see RDrawImageTiled) have no origin or angle, and use the origin attribute for how many times the image repeats across the quad instead.
 const GLchar* vertexShaderCode =
     "#version 330\n"
+    "uniform vec2 screenScale;\n"
+    "uniform vec2 atlasSize;\n"
     "in vec3 vert;\n"
     "in vec2 vertTexCoord;\n"
-    "in float vObjAlpha;\n"
-    "in vec3 vObjBlend;\n"
-    "in vec2 vAtlasXY;\n"
-    "in vec2 vAtlasWH;\n"
-    "in mat4 project;\n"
+    "in vec2 vPosition;\n"
+    "in vec2 vOrigin;\n"
+    "in vec2 vSize;\n"
+    "in float vAngle;\n"
+    "in vec4 vAtlasRect;\n"
+    "in float vAtlasLayer;\n"
+    "in float vFlags;\n"
+    "in vec4 vBlend;\n"
     "out float objAlpha;\n"
     "out vec3 objBlend;\n"
     "out vec2 atlasXY;\n"
     "out vec2 atlasWH;\n"
     "out vec2 fragTexCoord;\n"
+    "flat out float atlasLayer;\n"
+    "flat out float tiled;\n"
     "void main() {\n"
-    "fragTexCoord = vertTexCoord;\n"
-    "objAlpha = vObjAlpha;\n"
-    "objBlend = vObjBlend;\n"
-    "atlasXY = vAtlasXY;\n"
-    "atlasWH = vAtlasWH;\n"
-    "gl_Position = project * vec4(vert.x, vert.y, vert.z, 1);\n"
+    "tiled = mod(vFlags, 2.0);\n"
+    "vec2 origin = (tiled > 0.5) ? vec2(0.0) : vOrigin;\n"
+    "float angle = (tiled > 0.5) ? 0.0 : vAngle;\n"
+    "fragTexCoord = (tiled > 0.5) ? vertTexCoord * vOrigin : vertTexCoord;\n"
+    "atlasLayer = vAtlasLayer;\n"
+    "objAlpha = vBlend.a;\n"
+    "objBlend = vBlend.rgb;\n"
+    "atlasXY = vAtlasRect.xy / atlasSize;\n"
+    "atlasWH = vAtlasRect.zw / atlasSize;\n"
+    "vec2 p = (vert.xy - origin) * vec2(vSize.x, -vSize.y);\n"
+    "float c = cos(angle);\n"
+    "float s = sin(angle);\n"
+    "p = vec2((p.x * c) - (p.y * s), (p.x * s) + (p.y * c));\n"
+    "gl_Position = vec4((p.x + vPosition.x) * screenScale.x - 1.0, 1.0 - ((vPosition.y - p.y) * screenScale.y), vert.z, 1);\n"
     "}";
 
 
-void mat4Mult(const GLfloat* lhs, const GLfloat* rhs, GLfloat* out) {
-    for (unsigned int y = 0; y < 4; y++) {
-        for (unsigned int x = 0; x < 4; x++) {
-            out[(y * 4) + x] = (lhs[y * 4] * rhs[x]) + (lhs[(y * 4) + 1] * rhs[x + 4]) + (lhs[(y * 4) + 2] * rhs[x + 8]) + (lhs[(y * 4) + 3] * rhs[x + 12]);
-        }
-    }
-}
-
 // Images that need to be batched into an atlas - linked list structure to allow for easy sorting
 struct RPreImage {
     unsigned int w;
     unsigned int h;
     unsigned char* data;
+    bool ownsData;  // false if data points into one of _keptBuffers
+                    // With OpenGL, data is freed (and set to NULL) once it's in the atlas, the software backend keeps it to draw from
     unsigned int imgIndex;
-
-    unsigned int _x;
-    unsigned int _y;
 };
 
 // References to images that may or may not have yet been put into an atlas (usually happens in RMakeGameWindow)
 struct RAtlasImage {
-    unsigned int atlasId;
+    unsigned int layer;  // Which page of the atlas array it's on
     unsigned int x;
     unsigned int y;
     unsigned int w;
@@ -81,35 +103,151 @@ struct RAtlasImage {
     unsigned int originY;
 };
 
-// Represents a command to draw a single image
+// Represents a command to draw a single image. These go to the GPU as they are, one per instance, so they're kept small.
 struct RDrawCommand {
-    GLfloat transform[16];
-    GLfloat alpha;
-    GLfloat blend[3];
-    GLfloat atlasXY[2];
-    GLfloat atlasWH[2];
-
-    unsigned int atlasId;
-    unsigned int imageIndex;
-    GLint atlasGlTex;
+    GLfloat position[2];  // Where the origin goes, in window pixels
+    GLfloat origin[2];  // The origin as a fraction of the image's size, or with RDRAW_TILED, how many times the image repeats each way
+    GLfloat size[2];  // Size of the part being drawn after scaling, in pixels. Negative for mirrored.
+    GLfloat angle;  // Anticlockwise, in radians
+    GLushort atlasRect[4];  // x, y, w, h of the part in its atlas page, in texels
+    GLushort atlasLayer;  // Which page
+    GLushort flags;  // RDrawFlags
+    GLubyte blend[4];  // Blend colour as RGB, then alpha
 };
+enum RDrawFlags : GLushort {
+    RDRAW_TILED = 1,  // Repeats the part across the quad instead of stretching it, see RDrawImageTiled
+};
+static_assert(sizeof(RDrawCommand) == 44, "draw commands are uploaded as they are, so they shouldn't have any padding");
 std::vector<RDrawCommand> _drawCommands;
+RFrameStats _frameStats;
+
+// Stats that come from whichever thread draws, so they're handed back to the game thread through these
+std::atomic<unsigned long long> _pixelBytesUploaded;  // Since the game thread last took them
+std::atomic<double> _gpuSeconds;  // The latest timer query result, or -1
+
+// GPU timers go in a ring and get read once they're ready, which is usually a frame or two later. If they're all still waiting, a frame just doesn't get timed.
+constexpr unsigned int GPU_TIMER_COUNT = 4;
+GLuint _gpuTimers[GPU_TIMER_COUNT];
+bool _gpuTimerWaiting[GPU_TIMER_COUNT];
+unsigned int _gpuTimerNext;  // The one the next frame uses
+unsigned int _gpuTimerOldest;  // The one to check for a result next
+
+// Reads back any timers that are ready without waiting for the rest
+void _CollectGpuTimers();
+
+// The stats overlay's history and the 1x1 white image its bars are drawn with, which is made the first time the overlay's drawn
+constexpr unsigned int OVERLAY_FRAMES = 120;
+bool _overlayEnabled = false;
+bool _overlayImageMade;
+RImageIndex _overlayImage;
+RFrameStats _overlayHistory[OVERLAY_FRAMES];
+unsigned int _overlayNext;  // Where the next frame's stats go in _overlayHistory
+
+// Draws the overlay with the backend's normal drawing, after the frame's stats have been taken so it doesn't show up in them
+void _DrawStatsOverlay();
+
+// A draw as the software backend gets it, since it draws straight away instead of making draw commands
+struct RSoftwareDraw {
+    RImageIndex ix;
+    double x, y, xscale, yscale, rot, alpha;
+    unsigned int blend, partX, partY, partW, partH;
+    double repeatX = 0, repeatY = 0;  // Only set for RDrawImageTiled
+};
 
-// Atlas structure, can exist without being used
-struct RAtlas {
-    GLuint glTex;
-    unsigned int w;
-    unsigned int h;
+// Draws recorded between RStartCache and REndCache, in whichever form the backend uses
+struct RCache {
+    bool used;
+    std::vector<RDrawCommand> commands;
+    std::vector<RSoftwareDraw> softwareDraws;
 };
+std::vector<RCache> _caches;
+RCache* _recording;  // The cache draws are going into instead of the frame, if any
+
+// Draws an image with the software backend, which RDrawPartialImage has already clipped the part for
+void _DrawSoftware(const RSoftwareDraw& draw);
+
+// Fills in a draw command's blend colour and alpha
+void _SetBlend(RDrawCommand& command, unsigned int blend, double alpha);
+
+// Culling: anything that can't touch the window gets thrown away before it becomes a draw command. Views aren't drawn yet, so the window,
+// which shows the room from 0, 0, is the only thing to check against.
+// left, top, right and bottom are the edges of the image after scaling, relative to its origin at x, y, before rotating by rot degrees.
+bool _OnScreen(double x, double y, double left, double top, double right, double bottom, double rot);
+bool _OnScreen(const RDrawCommand& command);
+unsigned int _culled;  // Images culled so far this frame
+unsigned int _softwareDraws;  // Images drawn so far this frame by the software backend, which doesn't keep draw commands
 
 std::vector<RPreImage> _preImages;
+std::vector<void*> _keptBuffers;  // See RKeepBuffer
+std::vector<std::pair<RImageIndex, unsigned char*>> _pendingPixels;  // Pixels from RSetImagePixels that haven't been uploaded yet
+std::mutex _pendingMutex;  // Guards _keptBuffers and _pendingPixels, which loader threads add to
+size_t _compileBufferBytes;  // Size of the buffer _Compile copied atlas pages through
 std::vector<RAtlasImage> _atlasImages;
-RAtlas _atlases[32];
-int boundAtlas;
 
+// Every atlas page is a layer of one array texture, so the whole frame can be drawn without changing textures. Layers are all the size of the
+// biggest page, and the smaller pages just use their top-left corner.
+GLuint _atlasArray;
+unsigned int _atlasW;
+unsigned int _atlasH;
+unsigned int _atlasLayers;
+
+// Makes the atlas array at the given size, bound to texture unit 0, and copies whatever was in the old one (if any) into it.
+// That's a copy on the GPU, so it's slow-ish but nothing like packing everything again.
+void _ResizeAtlas(unsigned int w, unsigned int h, unsigned int layers);
+
+// Free space on the atlas pages for images made after it was built. It belongs to the game thread, and the array texture gets resized to match on
+// whichever thread draws, in _UploadPendingPixels.
+RAtlasSpace _atlasSpace;
+unsigned int _wantedAtlasW;  // The size the array texture needs to be, guarded by _pendingMutex
+unsigned int _wantedAtlasH;
+unsigned int _wantedAtlasLayers;
+unsigned long long _frameNumber;  // Frames passed to RRenderFrame so far, which is also the number of the one being built
 
-// Builds all added images into atlases so that they can be drawn. Must be called before attempting to draw. Only intended to be called once.
-bool _Compile(unsigned int firstAtlas = 0);
+// Sets up _atlasSpace from where _Compile put everything
+void _InitPages();
+
+
+// Builds all added images into atlas pages so that they can be drawn. Must be called before attempting to draw. Only intended to be called once.
+bool _Compile();
+
+// Frees buffers taken from _keptBuffers, whether or not what's in them made it into the atlas
+void _FreeBuffers(const std::vector<void*>& buffers);
+
+// Where each image goes in the atlas. Working it out is the slow part of _Compile for games with lots of images, so RStartAtlasLayout does it
+// on another thread while the game loads, and keeps it in a cache file for next time.
+struct RAtlasPlacement {
+    unsigned int layer;
+    unsigned int x;
+    unsigned int y;
+};
+struct RAtlasLayout {
+    unsigned int maxSide = 0;  // The biggest a page was allowed to be
+    std::vector<rectpack2D::rect_wh> pageSizes;
+    std::vector<RAtlasPlacement> placements;  // One per image, in image order. Empty if there's no layout yet.
+};
+RAtlasLayout _layout;
+std::thread _layoutThread;  // Writes _layout, so it has to be joined before anything looks at it
+
+constexpr unsigned int ATLAS_PACK_SIDE = 4096;
+constexpr unsigned int ATLAS_CACHE_FORMAT_VERSION = 2;
+
+// The width and height of every image, in image order
+std::vector<rectpack2D::rect_wh> _ImageSizes();
+
+// Packs images of the given sizes onto as few pages as it can, none of them bigger than maxSide. Returns false if it needs more than maxPages.
+bool _PackAtlas(const std::vector<rectpack2D::rect_wh>& sizes, unsigned int maxSide, unsigned int maxPages, RAtlasLayout* layout);
+
+bool _ReadAtlasCache(const char* path, const GameCacheKey& key, const std::vector<rectpack2D::rect_wh>& sizes, unsigned int maxSide, RAtlasLayout* layout);
+void _WriteAtlasCache(const char* path, const GameCacheKey& key, const RAtlasLayout& layout);
+
+// Registers a pre-image for the next _Compile. ownsData says whether the renderer should free bytes itself.
+RImageIndex _MakeImage(unsigned int w, unsigned int h, unsigned int originX, unsigned int originY, unsigned char* bytes, bool ownsData);
+
+// Same, but for an image made once the OpenGL atlas already exists, so it gets a place straight away and its pixels go on the upload queue
+RImageIndex _MakeRuntimeImage(unsigned int w, unsigned int h, unsigned int originX, unsigned int originY, unsigned char* bytes, bool ownsData);
+
+// Copies any pixels RSetImagePixels has been given into the atlases
+void _UploadPendingPixels();
 
 unsigned int _tallest;
 unsigned int _widest;
@@ -118,17 +256,92 @@ unsigned int _pixelCount;
 unsigned int _colourOutsideRoom;
 unsigned int _roomBGColour;
 
+RBackend _backend = RBACKEND_OPENGL;
 GLFWwindow* _window;
-bool _contextSet;
+bool _contextSet;  // Set once RMakeGameWindow succeeds, whichever backend it's using
 unsigned int _windowW;
 unsigned int _windowH;
 
-unsigned int _maxTextures;
+unsigned int _maxLayers;
 unsigned int _maxTextureSize;
 
 GLuint _glProgram;
 GLuint _vao;
 GLuint _vbo;
+GLint _texUniform;
+GLint _screenScaleUniform;
+GLint _atlasSizeUniform;
+
+// Fixed locations for the shader inputs, bound before linking so the VAO can be set up without asking for them
+enum RAttribute : GLuint {
+    ATTRIB_VERT,
+    ATTRIB_TEX_COORD,
+    ATTRIB_POSITION,
+    ATTRIB_ORIGIN,
+    ATTRIB_SIZE,
+    ATTRIB_ANGLE,
+    ATTRIB_ATLAS_RECT,
+    ATTRIB_ATLAS_LAYER,
+    ATTRIB_FLAGS,
+    ATTRIB_BLEND,
+    ATTRIB_COUNT,
+};
+
+// Draw commands get streamed through one buffer that lives as long as the window. With ARB_buffer_storage it's mapped once and split into
+// RING_SEGMENTS parts, each frame writing into the part after the last one's and waiting on a fence only if the GPU is still reading from it.
+// Without it, the buffer gets orphaned every frame, which lets the driver hand out fresh storage instead of stalling.
+constexpr unsigned int RING_SEGMENTS = 3;
+constexpr size_t RING_MIN_COMMANDS = 1024;
+GLuint _ringBuffer;
+size_t _ringSegmentSize;  // Bytes in each segment
+unsigned int _ringSegment;  // The segment the next frame writes to
+unsigned char* _ringMapping;  // Where the whole buffer is mapped, or NULL if it's being orphaned
+GLsync _ringFences[RING_SEGMENTS];
+
+// GL 4.x functions GLAD wasn't generated with, loaded through GLFW when the driver has them
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+typedef void(APIENTRYP RBufferStorageProc)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+RBufferStorageProc _glBufferStorage;
+
+// Makes the ring buffer big enough for at least commands draw commands a frame
+void _RingCreate(size_t commands);
+void _RingDestroy();
+
+// Copies a frame's draw commands into the ring and returns their offset in _ringBuffer
+GLintptr _RingWrite(const void* data, size_t bytes);
+
+// Points the per-instance attributes at draw commands starting at offset in _ringBuffer
+void _PointInstanceAttributes(GLintptr offset);
+
+// Everything the GL side needs to draw a frame, so it can be drawn on another thread while the game gets on with the next one
+struct RFrame {
+    std::vector<RDrawCommand> commands;
+    unsigned int colourOutsideRoom;
+    unsigned int roomBGColour;
+    unsigned int w;  // Size of the room area the commands were made for
+    unsigned int h;
+    int windowW;  // Actual size of the window, which the user might have changed
+    int windowH;
+};
+
+// Clears, draws and presents a frame. Has to be called on the thread the context is current on.
+void _DrawFrame(const RFrame& frame);
+
+// With RSetRenderThread, the context belongs to the render thread from the first RRenderFrame on, and frames are double buffered:
+// the game fills _drawCommands while the render thread draws _renderFrame. Nothing goes back from the render thread to the game,
+// so the game runs the same whether it's on or not. Window events still get polled on the game thread, which GLFW needs anyway.
+bool _useRenderThread = false;
+std::thread _renderThread;
+std::mutex _renderMutex;
+std::condition_variable _renderCond;
+RFrame _renderFrame;
+bool _renderPending;  // _renderFrame has been handed over and not drawn yet
+bool _renderStop;
+void _RenderThread();
+
+// Waits for the frame being drawn to finish and takes the context back
+void _StopRenderThread();
 
 
 void RInit() {
@@ -137,20 +350,98 @@ void RInit() {
     _tallest = 0;
     _widest = 0;
     _pixelCount = 0;
-    boundAtlas = -1;
+    _atlasArray = 0;
+    _atlasW = 0;
+    _atlasH = 0;
+    _atlasLayers = 0;
+    _compileBufferBytes = 0;
+    _atlasSpace = RAtlasSpace();
+    _frameNumber = 0;
+    _wantedAtlasW = 0;
+    _wantedAtlasH = 0;
+    _wantedAtlasLayers = 0;
+    _ringBuffer = 0;
+    _ringMapping = NULL;
+    _glBufferStorage = NULL;
+    _frameStats = RFrameStats();
+    _pixelBytesUploaded = 0;
+    _gpuSeconds = -1;
+    memset(_gpuTimers, 0, sizeof(_gpuTimers));
+    memset(_gpuTimerWaiting, 0, sizeof(_gpuTimerWaiting));
+    _gpuTimerNext = 0;
+    _gpuTimerOldest = 0;
+    _overlayImageMade = false;
+    _overlayNext = 0;
+    for (RFrameStats& stats : _overlayHistory) stats = RFrameStats();
+    _caches.clear();
+    _recording = NULL;
 }
 
 void RTerminate() {
+    if (_layoutThread.joinable()) _layoutThread.join();
     for (const RPreImage& n : _preImages) {
-        free(n.data);
+        if (n.ownsData) free(n.data);
+    }
+    for (void* buffer : _keptBuffers) {
+        free(buffer);
+    }
+    if (_backend == RBACKEND_SOFTWARE) {
+        SoftwareRenderer::Terminate();
+        return;
     }
+    _StopRenderThread();
+    if (_ringBuffer) _RingDestroy();
+    if (_gpuTimers[0]) glDeleteQueries(GPU_TIMER_COUNT, _gpuTimers);
     glfwDestroyWindow(_window);  // This function is allowed be called on NULL
     glfwTerminate();
 }
 
+void RClearImages() {
+    if (_contextSet) return;
+    if (_layoutThread.joinable()) _layoutThread.join();
+    for (const RPreImage& n : _preImages) {
+        if (n.ownsData) free(n.data);
+    }
+    {
+        std::lock_guard<std::mutex> lock(_pendingMutex);
+        for (void* buffer : _keptBuffers) {
+            free(buffer);
+        }
+        _keptBuffers.clear();
+        _pendingPixels.clear();
+        _atlasImages.clear();
+    }
+    _preImages.clear();
+    _layout = RAtlasLayout();
+    _tallest = 0;
+    _widest = 0;
+    _pixelCount = 0;
+}
+
+void RSetBackend(RBackend backend) {
+    if (!_contextSet) _backend = backend;
+}
+
+RBackend RGetBackend() { return _backend; }
+
+void RSetRenderThread(bool enabled) {
+    if (!_contextSet) _useRenderThread = enabled;
+}
+
 bool RMakeGameWindow(GameSettings* settings, unsigned int w, unsigned int h) {
     // Fail if we already did this
     if (_contextSet) return false;
+
+    if (_backend == RBACKEND_SOFTWARE) {
+        // Nothing goes into an atlas, images get drawn from their pre-images, which stay in image order
+        SoftwareRenderer::Resize(w, h);
+        _windowW = w;
+        _windowH = h;
+        _colourOutsideRoom = settings->colourOutsideRoom;
+        _contextSet = true;
+        InputInit(NULL);
+        return true;
+    }
     
     glfwSetErrorCallback([] (int code, const char *desc) -> void {
         std::cout << "GLFW Error " << code << ": " << desc << std::endl;
@@ -191,7 +482,7 @@ bool RMakeGameWindow(GameSettings* settings, unsigned int w, unsigned int h) {
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     glDisable(GL_LIGHTING);
     glEnable(GL_SCISSOR_TEST);
-    glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, ( GLint* )(&_maxTextures));
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, ( GLint* )(&_maxLayers));
     glGetIntegerv(GL_MAX_TEXTURE_SIZE, ( GLint* )(&_maxTextureSize));
     _colourOutsideRoom = settings->colourOutsideRoom;
     glClear(GL_COLOR_BUFFER_BIT);
@@ -228,6 +519,16 @@ bool RMakeGameWindow(GameSettings* settings, unsigned int w, unsigned int h) {
     _glProgram = glCreateProgram();
     glAttachShader(_glProgram, vertexShader);
     glAttachShader(_glProgram, fragmentShader);
+    glBindAttribLocation(_glProgram, ATTRIB_VERT, "vert");
+    glBindAttribLocation(_glProgram, ATTRIB_TEX_COORD, "vertTexCoord");
+    glBindAttribLocation(_glProgram, ATTRIB_POSITION, "vPosition");
+    glBindAttribLocation(_glProgram, ATTRIB_ORIGIN, "vOrigin");
+    glBindAttribLocation(_glProgram, ATTRIB_SIZE, "vSize");
+    glBindAttribLocation(_glProgram, ATTRIB_ANGLE, "vAngle");
+    glBindAttribLocation(_glProgram, ATTRIB_ATLAS_RECT, "vAtlasRect");
+    glBindAttribLocation(_glProgram, ATTRIB_ATLAS_LAYER, "vAtlasLayer");
+    glBindAttribLocation(_glProgram, ATTRIB_FLAGS, "vFlags");
+    glBindAttribLocation(_glProgram, ATTRIB_BLEND, "vBlend");
     glLinkProgram(_glProgram);
     glGetProgramiv(_glProgram, GL_LINK_STATUS, &linked);
     if (!linked) {
@@ -235,22 +536,40 @@ bool RMakeGameWindow(GameSettings* settings, unsigned int w, unsigned int h) {
         return false;
     }
     glUseProgram(_glProgram);
+    _texUniform = glGetUniformLocation(_glProgram, "tex");
+    _screenScaleUniform = glGetUniformLocation(_glProgram, "screenScale");
+    _atlasSizeUniform = glGetUniformLocation(_glProgram, "atlasSize");
 
-    // Make texture atlases
+    // Make texture atlases. The array stays bound to texture unit 0 from here on.
     if (!_Compile()) return false;
+    glUniform1i(_texUniform, 0);
+    glUniform2f(_atlasSizeUniform, ( GLfloat )_atlasW, ( GLfloat )_atlasH);
 
     // Make VAO
     glGenVertexArrays(1, &_vao);
     glBindVertexArray(_vao);
 
-    // Make VBO
+    // Make VBO. The texture coordinates are the first two components of the vertex positions.
     glGenBuffers(1, &_vbo);
     glBindBuffer(GL_ARRAY_BUFFER, _vbo);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
     GLfloat vertexData[] = {0.0f, 1.0f, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f};
     glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 12, vertexData, GL_STATIC_DRAW);
+    glVertexAttribPointer(ATTRIB_VERT, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), NULL);
+    glVertexAttribPointer(ATTRIB_TEX_COORD, 2, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), NULL);
+    glEnableVertexAttribArray(ATTRIB_VERT);
+    glEnableVertexAttribArray(ATTRIB_TEX_COORD);
+
+    // Everything else comes from the draw commands, one per instance. Only where they are in the ring changes after this.
+    for (GLuint attribute = ATTRIB_POSITION; attribute < ATTRIB_COUNT; attribute++) {
+        glEnableVertexAttribArray(attribute);
+        glVertexAttribDivisor(attribute, 1);
+    }
 
-    glEnableVertexAttribArray(0);
+    if (GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 4) || glfwExtensionSupported("GL_ARB_buffer_storage")) {
+        _glBufferStorage = ( RBufferStorageProc )glfwGetProcAddress("glBufferStorage");
+    }
+    _RingCreate(RING_MIN_COMMANDS);
+    glGenQueries(GPU_TIMER_COUNT, _gpuTimers);
 
     if (auto err = glGetError(); err != GL_NO_ERROR) {
         const char *error = "";
@@ -270,15 +589,24 @@ bool RMakeGameWindow(GameSettings* settings, unsigned int w, unsigned int h) {
 void RResizeGameWindow(unsigned int w, unsigned int h) {
     // Only do this if the w and h settings aren't equal to what size the window was last set to - even if the user has resized it since then.
     if (w != _windowW || h != _windowH) {
-        glfwSetWindowSize(_window, w, h);
+        if (_backend == RBACKEND_SOFTWARE) SoftwareRenderer::Resize(w, h);
+        else glfwSetWindowSize(_window, w, h);
         _windowW = w;
         _windowH = h;
     }
 }
 
-void RSetGameWindowTitle(const char* title) { glfwSetWindowTitle(_window, title); }
+void RSetGameWindowTitle(const char* title) {
+    if (_backend == RBACKEND_OPENGL) glfwSetWindowTitle(_window, title);
+}
 
 void RGetCursorPos(int* xpos, int* ypos) {
+    if (_backend == RBACKEND_SOFTWARE) {
+        // There's no mouse without a window, so it stays in the corner
+        if (xpos) (*xpos) = 0;
+        if (ypos) (*ypos) = 0;
+        return;
+    }
     double xp, yp;
     int actualWinW, actualWinH;
     glfwGetCursorPos(_window, &xp, &yp);
@@ -291,22 +619,76 @@ void RGetCursorPos(int* xpos, int* ypos) {
     if (ypos) (*ypos) = ( int )yp;
 }
 
-bool RShouldClose() { return glfwWindowShouldClose(_window); }
+bool RShouldClose() { return _backend == RBACKEND_OPENGL && glfwWindowShouldClose(_window); }
 
 void RSetBGColour(unsigned int col) { _roomBGColour = col; }
 
 RImageIndex RMakeImage(unsigned int w, unsigned int h, unsigned int originX, unsigned int originY, unsigned char* bytes) {
-    if (_contextSet) {
-        // Image being registered after the game is already loaded - what do we do here!?
-        abort();  // I don't know exactly what this does, but it's definitely better than what would happen if I didn't do it
+    unsigned char* copy = ( unsigned char* )malloc(w * h * 4);
+    memcpy(copy, bytes, (w * h * 4));
+    return _MakeImage(w, h, originX, originY, copy, true);
+}
+
+RImageIndex RMakeImageInPlace(unsigned int w, unsigned int h, unsigned int originX, unsigned int originY, unsigned char* bytes) { return _MakeImage(w, h, originX, originY, bytes, false); }
+
+void RKeepBuffer(void* buffer) {
+    std::lock_guard<std::mutex> lock(_pendingMutex);
+    _keptBuffers.push_back(buffer);
+}
+
+RImageIndex RMakeImageDeferred(unsigned int w, unsigned int h, unsigned int originX, unsigned int originY) { return _MakeImage(w, h, originX, originY, NULL, false); }
+
+void RSetImagePixels(RImageIndex ix, unsigned char* bytes) {
+    std::lock_guard<std::mutex> lock(_pendingMutex);
+    _pendingPixels.push_back({ix, bytes});
+}
+
+void _UploadPendingPixels() {
+    std::vector<std::pair<RAtlasImage, unsigned char*>> pending;
+    std::vector<void*> uploaded;
+    unsigned int wantedW, wantedH, wantedLayers;
+    {
+        std::lock_guard<std::mutex> lock(_pendingMutex);
+        if (_pendingPixels.empty() && _keptBuffers.empty()) return;
+
+        // The game thread can be adding images while this runs on the render thread, so where they go gets looked up while it's locked out
+        for (const auto& p : _pendingPixels) {
+            pending.push_back({_atlasImages[p.first], p.second});
+        }
+        _pendingPixels.clear();
+
+        // Pixels are always handed over before the buffer they're in is kept, so everything in these buffers is in pending
+        uploaded.swap(_keptBuffers);
+        wantedW = _wantedAtlasW;
+        wantedH = _wantedAtlasH;
+        wantedLayers = _wantedAtlasLayers;
+    }
+
+    if (wantedW > _atlasW || wantedH > _atlasH || wantedLayers > _atlasLayers) {
+        _ResizeAtlas(std::max(wantedW, _atlasW), std::max(wantedH, _atlasH), std::max(wantedLayers, _atlasLayers));
+    }
+    for (const auto& p : pending) {
+        const RAtlasImage& aImg = p.first;
+        if (aImg.w == 0 || aImg.h == 0) continue;  // Freed before it got here
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, aImg.x, aImg.y, aImg.layer, aImg.w, aImg.h, 1, GL_RGBA, GL_UNSIGNED_BYTE, p.second);
+        _pixelBytesUploaded += ( unsigned long long )aImg.w * aImg.h * 4;
     }
 
-    // Make pre-image object for later compiling into an atlas
+    // The GL has its own copy once glTexSubImage3D returns
+    for (void* buffer : uploaded) {
+        free(buffer);
+    }
+}
+
+RImageIndex _MakeImage(unsigned int w, unsigned int h, unsigned int originX, unsigned int originY, unsigned char* bytes, bool ownsData) {
+    if (_contextSet && _backend == RBACKEND_OPENGL) return _MakeRuntimeImage(w, h, originX, originY, bytes, ownsData);
+
+    // Make pre-image object for later compiling into an atlas (the software backend just draws from it, whenever it was made)
     RPreImage pImg;
     pImg.w = w;
     pImg.h = h;
-    pImg.data = ( unsigned char* )malloc(w * h * 4);
-    memcpy(pImg.data, bytes, (w * h * 4));
+    pImg.data = bytes;
+    pImg.ownsData = ownsData;
 
     // Make reference object for this image
     RAtlasImage aImg;
@@ -315,7 +697,10 @@ RImageIndex RMakeImage(unsigned int w, unsigned int h, unsigned int originX, uns
     aImg.originX = originX;
     aImg.originY = originY;
     pImg.imgIndex = static_cast<unsigned int>(_atlasImages.size());
-    _atlasImages.push_back(aImg);
+    {
+        std::lock_guard<std::mutex> lock(_pendingMutex);
+        _atlasImages.push_back(aImg);
+    }
 
     // Put pre-image into list
     _preImages.push_back(pImg);
@@ -328,14 +713,79 @@ RImageIndex RMakeImage(unsigned int w, unsigned int h, unsigned int originX, uns
     return pImg.imgIndex;
 }
 
+RImageIndex _MakeRuntimeImage(unsigned int w, unsigned int h, unsigned int originX, unsigned int originY, unsigned char* bytes, bool ownsData) {
+    // Its place might have had something else in it, so a deferred image needs clearing to keep it transparent until its pixels turn up
+    if (!bytes) {
+        bytes = ( unsigned char* )calloc(( size_t )w * h, 4);
+        ownsData = true;
+    }
+
+    RAtlasImage aImg;
+    aImg.w = w;
+    aImg.h = h;
+    aImg.originX = originX;
+    aImg.originY = originY;
+    RAtlasSlot slot;
+    if (RAtlasPlace(&_atlasSpace, w, h, &slot)) {
+        aImg.layer = slot.layer;
+        aImg.x = slot.rect.x;
+        aImg.y = slot.rect.y;
+    }
+    else {
+        std::cout << "Couldn't fit a " << w << "x" << h << " image into the texture atlas, it won't be drawn" << std::endl;
+        aImg.w = 0;
+        aImg.h = 0;
+    }
+
+    // Never drawn from after this, it's only here so image indices line up with _preImages
+    RPreImage pImg;
+    pImg.w = aImg.w;
+    pImg.h = aImg.h;
+    pImg.data = NULL;
+    pImg.ownsData = false;
+    pImg.imgIndex = static_cast<unsigned int>(_atlasImages.size());
+    _preImages.push_back(pImg);
+
+    {
+        std::lock_guard<std::mutex> lock(_pendingMutex);
+        _atlasImages.push_back(aImg);
+        _wantedAtlasW = _atlasSpace.pageW;
+        _wantedAtlasH = _atlasSpace.pageH;
+        _wantedAtlasLayers = static_cast<unsigned int>(_atlasSpace.pages.size());
+
+        // Same order as RSetImagePixels then RKeepBuffer, so the copy is freed once it's uploaded
+        if (aImg.w && aImg.h) _pendingPixels.push_back({pImg.imgIndex, bytes});
+        if (ownsData) _keptBuffers.push_back(bytes);
+    }
+    return pImg.imgIndex;
+}
+
+void RFreeImage(RImageIndex ix) {
+    RAtlasImage freed;
+    {
+        // Pixels for it might still be waiting to be uploaded, and zero size is what tells _UploadPendingPixels to skip them
+        std::lock_guard<std::mutex> lock(_pendingMutex);
+        RAtlasImage& aImg = _atlasImages[ix];
+        freed = aImg;
+        aImg.w = 0;
+        aImg.h = 0;
+    }
+    if (freed.w == 0 || freed.h == 0) return;
+
+    RPreImage& pImg = _preImages[ix];
+    if (pImg.ownsData) free(pImg.data);
+    pImg.data = NULL;
+    pImg.ownsData = false;
+    if (_backend != RBACKEND_OPENGL) return;
+    RAtlasRetire(&_atlasSpace, RAtlasSlot{freed.layer, RAtlasRect{freed.x, freed.y, freed.w, freed.h}}, _frameNumber);
+}
+
 void RDrawImage(RImageIndex ix, double x, double y, double xscale, double yscale, double rot, unsigned int blend, double alpha) {
     RAtlasImage* r = _atlasImages.data() + ix;
     RDrawPartialImage(ix, x, y, xscale, yscale, rot, blend, alpha, 0, 0, r->w, r->h);
 }
 
 void RDrawPartialImage(RImageIndex ix, double x, double y, double xscale, double yscale, double rot, unsigned int blend, double alpha, unsigned int partX, unsigned int partY, unsigned int partW, unsigned int partH) {
-    RDrawCommand command;
-
     RAtlasImage* aImg = _atlasImages.data() + ix;
 
     if (partX >= aImg->w) return;
@@ -343,225 +793,763 @@ void RDrawPartialImage(RImageIndex ix, double x, double y, double xscale, double
     if (partX + partW > aImg->w) partW = aImg->w - partX;
     if (partY + partH > aImg->h) partH = aImg->h - partY;
 
-    // Calculate a single matrix for scaling and transforming the sprite
-    double dRot = rot * PI / 180;
-    GLfloat sinRot = ( GLfloat )sin(dRot);
-    GLfloat cosRot = ( GLfloat )cos(dRot);
-    GLfloat dx = (( GLfloat )aImg->originX / aImg->w);
-    GLfloat dy = (( GLfloat )aImg->originY / aImg->h);
-
-    // TODO: We can optimize this a lot by pre-calculating the final matrix instead of multiplying a ton of hard-coded values for every draw.
-    //       But that should wait until we've implemented views, as that will affect the result.
-    GLfloat toMiddle[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, -dx, -dy, 0, 1};
-    GLfloat scale[16] = {(GLfloat)(partW * xscale), 0, 0, 0, 0, (GLfloat)(partH * -yscale), 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
-    GLfloat rotate[16] = {cosRot, sinRot, 0, 0, -sinRot, cosRot, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
-    GLfloat scale2[16] = {2.0f / _windowW, 0, 0, 0, 0, 2.0f / _windowH, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
-    GLfloat transform[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, (GLfloat)(x * 2.0f / _windowW) - 1, -(GLfloat)((y * 2.0f / _windowH) - 1), 0, 1};
-
-
-    GLfloat tmp[16];
-    GLfloat project[16];
-
-    mat4Mult(toMiddle, scale, tmp);
-    mat4Mult(tmp, rotate, project);
-    mat4Mult(project, scale2, tmp);
-    mat4Mult(tmp, transform, project);
-
-    RAtlas* atlas = &_atlases[aImg->atlasId];
-
-    // Create draw command
-    memcpy(command.transform, project, 16 * sizeof(GLfloat));
-    command.alpha = ( GLfloat )alpha;
-    command.blend[0] = (GLfloat)(blend & 0xFF) / 0xFF;
-    command.blend[1] = (GLfloat)(blend & 0xFF00) / 0xFF00;
-    command.blend[2] = (GLfloat)(blend & 0xFF0000) / 0xFF0000;
-    command.atlasXY[0] = (GLfloat)(( double )(aImg->x + partX) / ( double )atlas->w);
-    command.atlasXY[1] = (GLfloat)(( double )(aImg->y + partY) / ( double )atlas->h);
-    command.atlasWH[0] = (GLfloat)(( double )(partW) / ( double )atlas->w);
-    command.atlasWH[1] = (GLfloat)(( double )(partH) / ( double )atlas->h);
-    command.imageIndex = ix;
-    command.atlasId = aImg->atlasId;
-    command.atlasGlTex = atlas->glTex;
-    _drawCommands.push_back(command);
+    if (_backend == RBACKEND_SOFTWARE) {
+        RSoftwareDraw draw = {ix, x, y, xscale, yscale, rot, alpha, blend, partX, partY, partW, partH};
+        if (_recording) _recording->softwareDraws.push_back(draw);
+        else _DrawSoftware(draw);
+        return;
+    }
+
+    // Cached draws get culled when they're played back, since the window might be a different size by then
+    if (!_recording) {
+        double originX = ( double )aImg->originX / aImg->w * partW;
+        double originY = ( double )aImg->originY / aImg->h * partH;
+        if (!_OnScreen(x, y, -originX * xscale, -originY * yscale, (partW - originX) * xscale, (partH - originY) * yscale, rot)) {
+            _culled++;
+            return;
+        }
+    }
+
+    // Create draw command, the vertex shader does the rest
+    RDrawCommand command;
+    command.position[0] = ( GLfloat )x;
+    command.position[1] = ( GLfloat )y;
+    command.origin[0] = ( GLfloat )aImg->originX / aImg->w;
+    command.origin[1] = ( GLfloat )aImg->originY / aImg->h;
+    command.size[0] = ( GLfloat )(partW * xscale);
+    command.size[1] = ( GLfloat )(partH * yscale);
+    command.angle = ( GLfloat )(rot * PI / 180);
+    command.atlasRect[0] = ( GLushort )(aImg->x + partX);
+    command.atlasRect[1] = ( GLushort )(aImg->y + partY);
+    command.atlasRect[2] = ( GLushort )partW;
+    command.atlasRect[3] = ( GLushort )partH;
+    command.atlasLayer = ( GLushort )aImg->layer;
+    command.flags = 0;
+    _SetBlend(command, blend, alpha);
+    if (_recording) _recording->commands.push_back(command);
+    else _drawCommands.push_back(command);
+}
+
+void RDrawImageTiled(RImageIndex ix, double x, double y, double xscale, double yscale, double repeatX, double repeatY, unsigned int blend, double alpha) {
+    if (repeatX <= 0 || repeatY <= 0) return;
+    RAtlasImage* aImg = _atlasImages.data() + ix;
+
+    if (_backend == RBACKEND_SOFTWARE) {
+        RSoftwareDraw draw = {ix, x, y, xscale, yscale, 0, alpha, blend, 0, 0, aImg->w, aImg->h, repeatX, repeatY};
+        if (_recording) _recording->softwareDraws.push_back(draw);
+        else _DrawSoftware(draw);
+        return;
+    }
+    if (!_recording && !_OnScreen(x, y, 0, 0, aImg->w * xscale * repeatX, aImg->h * yscale * repeatY, 0)) {
+        _culled++;
+        return;
+    }
+
+    RDrawCommand command;
+    command.position[0] = ( GLfloat )x;
+    command.position[1] = ( GLfloat )y;
+    command.origin[0] = ( GLfloat )repeatX;
+    command.origin[1] = ( GLfloat )repeatY;
+    command.size[0] = ( GLfloat )(aImg->w * xscale * repeatX);
+    command.size[1] = ( GLfloat )(aImg->h * yscale * repeatY);
+    command.angle = 0;
+    command.atlasRect[0] = ( GLushort )aImg->x;
+    command.atlasRect[1] = ( GLushort )aImg->y;
+    command.atlasRect[2] = ( GLushort )aImg->w;
+    command.atlasRect[3] = ( GLushort )aImg->h;
+    command.atlasLayer = ( GLushort )aImg->layer;
+    command.flags = RDRAW_TILED;
+    _SetBlend(command, blend, alpha);
+    if (_recording) _recording->commands.push_back(command);
+    else _drawCommands.push_back(command);
+}
+
+void _SetBlend(RDrawCommand& command, unsigned int blend, double alpha) {
+    command.blend[0] = ( GLubyte )(blend & 0xFF);
+    command.blend[1] = ( GLubyte )((blend >> 8) & 0xFF);
+    command.blend[2] = ( GLubyte )((blend >> 16) & 0xFF);
+    command.blend[3] = ( GLubyte )(alpha <= 0 ? 0 : alpha >= 1 ? 0xFF : alpha * 0xFF + 0.5);
+}
+
+bool _OnScreen(double x, double y, double left, double top, double right, double bottom, double rot) {
+    if (left > right) std::swap(left, right);
+    if (top > bottom) std::swap(top, bottom);
+    if (rot != 0) {
+        // Whichever way it's rotated, it stays inside the circle around the origin that reaches its furthest corner
+        double reach = std::sqrt(std::max(left * left, right * right) + std::max(top * top, bottom * bottom));
+        left = top = -reach;
+        right = bottom = reach;
+    }
+
+    // A pixel gets drawn if its centre is inside, so touching the edge of the window isn't enough. The extra pixel all round covers
+    // the difference between working it out here in doubles and the GPU doing it in floats.
+    return x + right > -1 && x + left < _windowW + 1 && y + bottom > -1 && y + top < _windowH + 1;
+}
+
+bool _OnScreen(const RDrawCommand& command) {
+    if (command.flags & RDRAW_TILED) return _OnScreen(command.position[0], command.position[1], 0, 0, command.size[0], command.size[1], 0);
+    double left = -command.origin[0] * command.size[0], top = -command.origin[1] * command.size[1];
+    return _OnScreen(command.position[0], command.position[1], left, top, left + command.size[0], top + command.size[1], command.angle * 180 / PI);
+}
+
+void _DrawSoftware(const RSoftwareDraw& draw) {
+    const RAtlasImage* aImg = _atlasImages.data() + draw.ix;
+    const RPreImage& pImg = _preImages[draw.ix];
+    double originX = ( double )aImg->originX / aImg->w * draw.partW;
+    double originY = ( double )aImg->originY / aImg->h * draw.partH;
+    double w = draw.partW * (draw.repeatX > 0 ? draw.repeatX : 1), h = draw.partH * (draw.repeatY > 0 ? draw.repeatY : 1);
+    if (draw.repeatX > 0) originX = originY = 0;
+    if (!_OnScreen(draw.x, draw.y, -originX * draw.xscale, -originY * draw.yscale, (w - originX) * draw.xscale, (h - originY) * draw.yscale, draw.rot)) {
+        _culled++;
+        return;
+    }
+
+    _softwareDraws++;
+    if (draw.repeatX > 0) {
+        SoftwareRenderer::DrawTiled(pImg.data, pImg.w, pImg.h, draw.x, draw.y, draw.xscale, draw.yscale, draw.repeatX, draw.repeatY, draw.blend, draw.alpha);
+        return;
+    }
+    // Same origin the vertex shader works out: a fraction of the whole image's size, applied to the part being drawn
+    SoftwareRenderer::Draw(pImg.data, pImg.w, draw.partX, draw.partY, draw.partW, draw.partH, originX, originY, draw.x, draw.y, draw.xscale, draw.yscale, draw.rot, draw.blend,
+                           draw.alpha);
+}
+
+RCacheIndex RStartCache() {
+    size_t index = 0;
+    while (index < _caches.size() && _caches[index].used) index++;
+    if (index == _caches.size()) _caches.emplace_back();
+    RCache& cache = _caches[index];
+    cache.used = true;
+    cache.commands.clear();
+    cache.softwareDraws.clear();
+    _recording = &cache;
+    return static_cast<RCacheIndex>(index);
+}
+
+void REndCache() { _recording = NULL; }
+
+void RDrawCache(RCacheIndex ix) {
+    const RCache& cache = _caches[ix];
+    if (_backend == RBACKEND_SOFTWARE) {
+        for (const RSoftwareDraw& draw : cache.softwareDraws) {
+            _DrawSoftware(draw);
+        }
+    }
+    else {
+        for (const RDrawCommand& command : cache.commands) {
+            if (_OnScreen(command)) _drawCommands.push_back(command);
+            else _culled++;
+        }
+    }
+}
+
+void RFreeCache(RCacheIndex ix) {
+    RCache& cache = _caches[ix];
+    cache.used = false;
+    std::vector<RDrawCommand>().swap(cache.commands);
+    std::vector<RSoftwareDraw>().swap(cache.softwareDraws);
 }
 
 
 void RStartFrame() {
-    int actualWinW, actualWinH;
-    glfwGetWindowSize(_window, &actualWinW, &actualWinH);
-    glClearColor((GLclampf)(_colourOutsideRoom & 0xFF) / 0xFF, (GLclampf)((_colourOutsideRoom >> 8) & 0xFF) / 0xFF, (GLclampf)((_colourOutsideRoom >> 16) & 0xFF) / 0xFF, ( GLclampf )1.0);
-    glViewport(0, 0, actualWinW, actualWinH);
-    glScissor(0, 0, actualWinW, actualWinH);
+    if (_backend == RBACKEND_SOFTWARE) {
+        // Pixels from RSetImagePixels just get pointed to, the same as if they'd been there from the start
+        {
+            std::lock_guard<std::mutex> lock(_pendingMutex);
+            for (const auto& p : _pendingPixels) {
+                _preImages[p.first].data = p.second;
+            }
+            _pendingPixels.clear();
+        }
+        // Only the room's colour shows, the same as in _DrawFrame
+        SoftwareRenderer::Clear(_roomBGColour);
+        _softwareDraws = 0;
+        _culled = 0;
+        return;
+    }
+
+    _drawCommands.clear();
+    _culled = 0;
+}
+
+void RRenderFrame() {
+    if (_backend == RBACKEND_SOFTWARE) {
+        // Everything was drawn as it came in, each image on its own
+        _frameStats.commands = _softwareDraws;
+        _frameStats.batches = _softwareDraws;
+        _frameStats.drawCalls = 0;
+        _frameStats.culled = _culled;
+        _frameStats.atlasSwitches = 0;
+        _frameStats.uploadedBytes = 0;
+        _frameStats.gpuSeconds = -1;
+        if (_overlayEnabled) _DrawStatsOverlay();
+        return;
+    }
+
+    // Every command can go in one instanced draw, since they all sample the same array texture
+    _frameStats.commands = static_cast<unsigned int>(_drawCommands.size());
+    _frameStats.batches = _drawCommands.empty() ? 0 : 1;
+    _frameStats.drawCalls = _frameStats.batches;
+    _frameStats.culled = _culled;
+    _frameStats.atlasSwitches = 0;
+    for (size_t i = 1; i < _drawCommands.size(); i++) {
+        if (_drawCommands[i].atlasLayer != _drawCommands[i - 1].atlasLayer) _frameStats.atlasSwitches++;
+    }
+    _frameStats.uploadedBytes = sizeof(RDrawCommand) * _drawCommands.size() + _pixelBytesUploaded.exchange(0);
+    _frameStats.gpuSeconds = _gpuSeconds;
+    if (_overlayEnabled) _DrawStatsOverlay();
+
+    RFrame frame;
+    frame.commands.swap(_drawCommands);
+    frame.colourOutsideRoom = _colourOutsideRoom;
+    frame.roomBGColour = _roomBGColour;
+    frame.w = _windowW;
+    frame.h = _windowH;
+    glfwGetWindowSize(_window, &frame.windowW, &frame.windowH);
+
+    if (!_useRenderThread) {
+        _DrawFrame(frame);
+        _drawCommands.swap(frame.commands);  // Keeps its capacity for the next frame
+        RAtlasReturnRetired(&_atlasSpace, _frameNumber);
+        _frameNumber++;
+        return;
+    }
+
+    if (!_renderThread.joinable()) {
+        // The context can only be current on one thread at a time, and from here on that's the render thread
+        glfwMakeContextCurrent(NULL);
+        _renderPending = false;
+        _renderStop = false;
+        _renderThread = std::thread(_RenderThread);
+    }
+
+    // Wait for the last frame to be drawn, then hand this one over and take the last one's command list to fill next
+    {
+        std::unique_lock<std::mutex> lock(_renderMutex);
+        _renderCond.wait(lock, []() { return !_renderPending; });
+        std::swap(_renderFrame, frame);
+        _renderPending = true;
+    }
+    _renderCond.notify_all();
+    _drawCommands.swap(frame.commands);
+
+    // The last frame's been drawn, but this one hasn't, so only space freed before it started can be used again
+    if (_frameNumber > 0) RAtlasReturnRetired(&_atlasSpace, _frameNumber - 1);
+    _frameNumber++;
+}
+
+void _DrawFrame(const RFrame& frame) {
+    _UploadPendingPixels();
+
+    _CollectGpuTimers();
+    bool timed = !_gpuTimerWaiting[_gpuTimerNext];
+    if (timed) glBeginQuery(GL_TIME_ELAPSED, _gpuTimers[_gpuTimerNext]);
+
+    glClearColor((GLclampf)(frame.colourOutsideRoom & 0xFF) / 0xFF, (GLclampf)((frame.colourOutsideRoom >> 8) & 0xFF) / 0xFF, (GLclampf)((frame.colourOutsideRoom >> 16) & 0xFF) / 0xFF, ( GLclampf )1.0);
+    glViewport(0, 0, frame.windowW, frame.windowH);
+    glScissor(0, 0, frame.windowW, frame.windowH);
     glClear(GL_COLOR_BUFFER_BIT);
 
     // Later, we'll use this for clearing the background of each active view's viewport. But views aren't supported right now.
-    glClearColor((GLclampf)(_roomBGColour & 0xFF) / 0xFF, (GLclampf)((_roomBGColour >> 8) & 0xFF) / 0xFF, (GLclampf)((_roomBGColour >> 16) & 0xFF) / 0xFF, ( GLclampf )1.0);
-    glViewport(0, 0, actualWinW, actualWinH);
-    glScissor(0, 0, actualWinW, actualWinH);
+    glClearColor((GLclampf)(frame.roomBGColour & 0xFF) / 0xFF, (GLclampf)((frame.roomBGColour >> 8) & 0xFF) / 0xFF, (GLclampf)((frame.roomBGColour >> 16) & 0xFF) / 0xFF, ( GLclampf )1.0);
+    glViewport(0, 0, frame.windowW, frame.windowH);
+    glScissor(0, 0, frame.windowW, frame.windowH);
     glClear(GL_COLOR_BUFFER_BIT);
 
-    _drawCommands.clear();
+    if (!frame.commands.empty()) {
+        GLintptr offset = _RingWrite(frame.commands.data(), sizeof(RDrawCommand) * frame.commands.size());
+        _PointInstanceAttributes(offset);
+        glUniform2f(_screenScaleUniform, 2.0f / frame.w, 2.0f / frame.h);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, ( GLsizei )frame.commands.size());
+
+        // The GPU is done with this segment once everything up to here has been drawn
+        if (_ringMapping) {
+            _ringFences[_ringSegment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            _ringSegment = (_ringSegment + 1) % RING_SEGMENTS;
+        }
+    }
+
+    if (timed) {
+        glEndQuery(GL_TIME_ELAPSED);
+        _gpuTimerWaiting[_gpuTimerNext] = true;
+        _gpuTimerNext = (_gpuTimerNext + 1) % GPU_TIMER_COUNT;
+    }
+
+    glViewport(0, 0, frame.windowW, frame.windowH);
+    glfwSwapBuffers(_window);
 }
 
-void RRenderFrame() {
-    int actualWinW, actualWinH;
-    glfwGetWindowSize(_window, &actualWinW, &actualWinH);
+void _CollectGpuTimers() {
+    // They finish in the order they were started, so the first one that isn't ready means none of the later ones are either
+    while (_gpuTimerWaiting[_gpuTimerOldest]) {
+        GLint ready = 0;
+        glGetQueryObjectiv(_gpuTimers[_gpuTimerOldest], GL_QUERY_RESULT_AVAILABLE, &ready);
+        if (!ready) break;
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(_gpuTimers[_gpuTimerOldest], GL_QUERY_RESULT, &nanoseconds);
+        _gpuSeconds = nanoseconds / 1000000000.0;
+        _gpuTimerWaiting[_gpuTimerOldest] = false;
+        _gpuTimerOldest = (_gpuTimerOldest + 1) % GPU_TIMER_COUNT;
+    }
+}
 
-    // Buffer all draw commands into VBO
-    GLuint commandsVBO;
-    glGenBuffers(1, &commandsVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, commandsVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(RDrawCommand) * _drawCommands.size(), _drawCommands.data(), GL_STATIC_DRAW);
-
-    unsigned int drawn = 0;
-    while (drawn < _drawCommands.size()) {
-        // Calculate how many commands to process in this instanced draw
-        unsigned int toDraw = 0;
-        for (unsigned int i = drawn; i < _drawCommands.size(); i++) {
-            if (_drawCommands[i].atlasId != _drawCommands[drawn].atlasId) {
-                break;
-            }
-            toDraw++;
-        }
+void RSetStatsOverlay(bool enabled) { _overlayEnabled = enabled; }
 
-        // Activate atlas texture
-        if (boundAtlas != _drawCommands[drawn].atlasId) {
-            glActiveTexture(GL_TEXTURE0 + _drawCommands[drawn].atlasId);
-            glBindTexture(GL_TEXTURE_2D, _drawCommands[drawn].atlasGlTex);
-            boundAtlas = _drawCommands[drawn].atlasId;
+void _DrawStatsOverlay() {
+    if (!_overlayImageMade) {
+        unsigned char white[4] = {0xFF, 0xFF, 0xFF, 0xFF};
+        _overlayImage = RMakeImage(1, 1, 0, 0, white);
+        _overlayImageMade = true;
+    }
+    _overlayHistory[_overlayNext] = _frameStats;
+    _overlayNext = (_overlayNext + 1) % OVERLAY_FRAMES;
+
+    // Images are scaled to the most drawn in any frame shown, so the graph's always using its full height
+    constexpr double barW = 2, graphH = 48, margin = 4;
+    constexpr double gpuScale = graphH / (2.0 / 60.0);
+    unsigned int mostImages = 1;
+    for (const RFrameStats& stats : _overlayHistory) {
+        mostImages = std::max(mostImages, stats.commands + stats.culled);
+    }
+
+    // Drawn straight to the frame rather than into whatever cache is being recorded, and not counted or culled since the stats are already taken
+    RCache* recording = _recording;
+    _recording = NULL;
+    unsigned int culledBefore = _culled, softwareDrawsBefore = _softwareDraws;
+
+    RDrawImage(_overlayImage, 0, 0, OVERLAY_FRAMES * barW + margin * 2, graphH * 2 + margin * 3, 0, 0x000000, 0.6);
+    RDrawImage(_overlayImage, margin, margin + graphH / 2, OVERLAY_FRAMES * barW, 1, 0, 0x808080, 1);
+    for (unsigned int i = 0; i < OVERLAY_FRAMES; i++) {
+        const RFrameStats& stats = _overlayHistory[(_overlayNext + i) % OVERLAY_FRAMES];
+        double x = margin + i * barW;
+        if (stats.gpuSeconds > 0) {
+            double h = std::min(stats.gpuSeconds * gpuScale, graphH);
+            RDrawImage(_overlayImage, x, margin + graphH - h, barW, h, 0, stats.gpuSeconds > 1.0 / 60.0 ? 0x4040FF : 0x40FF40, 0.9);
         }
+        double drawnH = graphH * stats.commands / mostImages;
+        double culledH = graphH * stats.culled / mostImages;
+        double bottom = margin * 2 + graphH * 2;
+        RDrawImage(_overlayImage, x, bottom - drawnH, barW, drawnH, 0, 0xFFC040, 0.9);
+        RDrawImage(_overlayImage, x, bottom - drawnH - culledH, barW, culledH, 0, 0x808080, 0.9);
+    }
 
-        // Bind instanced inputs
-        glUniform1i(glGetUniformLocation(_glProgram, "tex"), _drawCommands[drawn].atlasId);
-
-        GLint shaderAlpha = glGetAttribLocation(_glProgram, "vObjAlpha");
-        GLint shaderBlend = glGetAttribLocation(_glProgram, "vObjBlend");
-        GLint shaderXY = glGetAttribLocation(_glProgram, "vAtlasXY");
-        GLint shaderWH = glGetAttribLocation(_glProgram, "vAtlasWH");
-        GLint shaderProject = glGetAttribLocation(_glProgram, "project");
-
-        glEnableVertexAttribArray(shaderAlpha);
-        glVertexAttribPointer(shaderAlpha, 1, GL_FLOAT, GL_FALSE, sizeof(RDrawCommand), ( void* )(offsetof(struct RDrawCommand, alpha) + (sizeof(RDrawCommand) * drawn)));
-        glEnableVertexAttribArray(shaderBlend);
-        glVertexAttribPointer(shaderBlend, 3, GL_FLOAT, GL_FALSE, sizeof(RDrawCommand), ( void* )(offsetof(struct RDrawCommand, blend) + (sizeof(RDrawCommand) * drawn)));
-        glEnableVertexAttribArray(shaderXY);
-        glVertexAttribPointer(shaderXY, 2, GL_FLOAT, GL_FALSE, sizeof(RDrawCommand), ( void* )(offsetof(struct RDrawCommand, atlasXY) + (sizeof(RDrawCommand) * drawn)));
-        glEnableVertexAttribArray(shaderWH);
-        glVertexAttribPointer(shaderWH, 2, GL_FLOAT, GL_FALSE, sizeof(RDrawCommand), ( void* )(offsetof(struct RDrawCommand, atlasWH) + (sizeof(RDrawCommand) * drawn)));
-        glEnableVertexAttribArray(shaderProject);
-        glVertexAttribPointer(shaderProject, 4, GL_FLOAT, GL_FALSE, sizeof(RDrawCommand), ( void* )(offsetof(struct RDrawCommand, transform) + (sizeof(RDrawCommand) * drawn)));
-        glEnableVertexAttribArray(shaderProject + 1);
-        glVertexAttribPointer(
-            shaderProject + 1, 4, GL_FLOAT, GL_FALSE, sizeof(RDrawCommand), ( void* )(offsetof(struct RDrawCommand, transform) + (sizeof(RDrawCommand) * drawn) + (sizeof(GLfloat) * 4)));
-        glEnableVertexAttribArray(shaderProject + 2);
-        glVertexAttribPointer(
-            shaderProject + 2, 4, GL_FLOAT, GL_FALSE, sizeof(RDrawCommand), ( void* )(offsetof(struct RDrawCommand, transform) + (sizeof(RDrawCommand) * drawn) + (sizeof(GLfloat) * 8)));
-        glEnableVertexAttribArray(shaderProject + 3);
-        glVertexAttribPointer(
-            shaderProject + 3, 4, GL_FLOAT, GL_FALSE, sizeof(RDrawCommand), ( void* )(offsetof(struct RDrawCommand, transform) + (sizeof(RDrawCommand) * drawn) + (sizeof(GLfloat) * 12)));
-
-        glVertexAttribDivisor(shaderAlpha, 1);
-        glVertexAttribDivisor(shaderBlend, 1);
-        glVertexAttribDivisor(shaderXY, 1);
-        glVertexAttribDivisor(shaderWH, 1);
-        glVertexAttribDivisor(shaderProject, 1);
-        glVertexAttribDivisor(shaderProject + 1, 1);
-        glVertexAttribDivisor(shaderProject + 2, 1);
-        glVertexAttribDivisor(shaderProject + 3, 1);
-
-        // Do instanced draw
-        glUseProgram(_glProgram);
-        glBindBuffer(GL_ARRAY_BUFFER, _vbo);
-        glEnableVertexAttribArray(glGetAttribLocation(_glProgram, "vertTexCoord"));
-        glVertexAttribPointer(glGetAttribLocation(_glProgram, "vertTexCoord"), 2, GL_FLOAT, GL_TRUE, 3 * sizeof(GLfloat), 0);
-        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, toDraw);
-
-        drawn += toDraw;
-    }
-
-    glDeleteBuffers(1, &commandsVBO);
-    glViewport(0, 0, actualWinW, actualWinH);
-    glfwSwapBuffers(_window);
+    _recording = recording;
+    _culled = culledBefore;
+    _softwareDraws = softwareDrawsBefore;
+}
+
+void _RenderThread() {
+    glfwMakeContextCurrent(_window);
+    std::unique_lock<std::mutex> lock(_renderMutex);
+    while (true) {
+        _renderCond.wait(lock, []() { return _renderPending || _renderStop; });
+        if (!_renderPending) break;
+
+        // The game thread leaves _renderFrame alone until it's been drawn
+        lock.unlock();
+        _DrawFrame(_renderFrame);
+        lock.lock();
+        _renderPending = false;
+        _renderCond.notify_all();
+    }
+    lock.unlock();
+    glfwMakeContextCurrent(NULL);
 }
 
+void _StopRenderThread() {
+    if (!_renderThread.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(_renderMutex);
+        _renderStop = true;
+    }
+    _renderCond.notify_all();
+    _renderThread.join();
+    glfwMakeContextCurrent(_window);
+}
 
-bool _Compile(unsigned int firstAtlas) {
+void _RingCreate(size_t commands) {
+    _ringSegmentSize = sizeof(RDrawCommand) * commands;
+    _ringSegment = 0;
+    _ringMapping = NULL;
+    for (GLsync& fence : _ringFences) fence = NULL;
+
+    glGenBuffers(1, &_ringBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, _ringBuffer);
+    if (_glBufferStorage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        _glBufferStorage(GL_ARRAY_BUFFER, _ringSegmentSize * RING_SEGMENTS, NULL, flags);
+        _ringMapping = ( unsigned char* )glMapBufferRange(GL_ARRAY_BUFFER, 0, _ringSegmentSize * RING_SEGMENTS, flags);
+        if (_ringMapping) return;
+
+        // Storage made with glBufferStorage can't be resized, so start again with a buffer that can
+        glDeleteBuffers(1, &_ringBuffer);
+        _glBufferStorage = NULL;
+        glGenBuffers(1, &_ringBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, _ringBuffer);
+    }
+    glBufferData(GL_ARRAY_BUFFER, _ringSegmentSize, NULL, GL_STREAM_DRAW);
+}
+
+void _RingDestroy() {
+    for (GLsync& fence : _ringFences) {
+        if (fence) glDeleteSync(fence);
+        fence = NULL;
+    }
+    if (_ringMapping) {
+        glBindBuffer(GL_ARRAY_BUFFER, _ringBuffer);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        _ringMapping = NULL;
+    }
+    glDeleteBuffers(1, &_ringBuffer);
+    _ringBuffer = 0;
+}
+
+GLintptr _RingWrite(const void* data, size_t bytes) {
+    if (bytes > _ringSegmentSize) {
+        // Grow to the next power of two that fits, so a room that keeps adding instances doesn't remake the buffer every frame
+        size_t commands = RING_MIN_COMMANDS;
+        while (sizeof(RDrawCommand) * commands < bytes) commands *= 2;
+        _RingDestroy();
+        _RingCreate(commands);
+    }
+
+    if (!_ringMapping) {
+        glBindBuffer(GL_ARRAY_BUFFER, _ringBuffer);
+        glBufferData(GL_ARRAY_BUFFER, _ringSegmentSize, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, data);
+        return 0;
+    }
+
+    // Only waits if the GPU is more than RING_SEGMENTS - 1 frames behind
+    GLsync& fence = _ringFences[_ringSegment];
+    if (fence) {
+        while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {}
+        glDeleteSync(fence);
+        fence = NULL;
+    }
+    GLintptr offset = ( GLintptr )(_ringSegmentSize * _ringSegment);
+    memcpy(_ringMapping + offset, data, bytes);
+    return offset;
+}
+
+void _PointInstanceAttributes(GLintptr offset) {
+    glBindBuffer(GL_ARRAY_BUFFER, _ringBuffer);
+    glVertexAttribPointer(ATTRIB_POSITION, 2, GL_FLOAT, GL_FALSE, sizeof(RDrawCommand), ( void* )(offset + offsetof(RDrawCommand, position)));
+    glVertexAttribPointer(ATTRIB_ORIGIN, 2, GL_FLOAT, GL_FALSE, sizeof(RDrawCommand), ( void* )(offset + offsetof(RDrawCommand, origin)));
+    glVertexAttribPointer(ATTRIB_SIZE, 2, GL_FLOAT, GL_FALSE, sizeof(RDrawCommand), ( void* )(offset + offsetof(RDrawCommand, size)));
+    glVertexAttribPointer(ATTRIB_ANGLE, 1, GL_FLOAT, GL_FALSE, sizeof(RDrawCommand), ( void* )(offset + offsetof(RDrawCommand, angle)));
+    glVertexAttribPointer(ATTRIB_ATLAS_RECT, 4, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(RDrawCommand), ( void* )(offset + offsetof(RDrawCommand, atlasRect)));
+    glVertexAttribPointer(ATTRIB_ATLAS_LAYER, 1, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(RDrawCommand), ( void* )(offset + offsetof(RDrawCommand, atlasLayer)));
+    glVertexAttribPointer(ATTRIB_FLAGS, 1, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(RDrawCommand), ( void* )(offset + offsetof(RDrawCommand, flags)));
+    glVertexAttribPointer(ATTRIB_BLEND, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(RDrawCommand), ( void* )(offset + offsetof(RDrawCommand, blend)));
+}
+
+
+const RFrameStats& RGetFrameStats() { return _frameStats; }
+
+unsigned long long RFrameHash() { return _backend == RBACKEND_SOFTWARE ? SoftwareRenderer::Hash() : 0; }
+
+
+bool _Compile() {
     // Sanity checks
     if (_tallest > _maxTextureSize) return false;
     if (_widest > _maxTextureSize) return false;
-    if (firstAtlas > _maxTextures) return false;
     if (_pixelCount == 0) return true;
 
+    // Deferred images whose pixels have turned up already can go in with everything else. Every buffer kept so far only has pixels
+    // for images that are in the atlas by the time this returns, so they can all go once it's made.
+    std::vector<void*> uploaded;
+    {
+        std::lock_guard<std::mutex> lock(_pendingMutex);
+        for (const auto& p : _pendingPixels) {
+            _preImages[p.first].data = p.second;
+        }
+        _pendingPixels.clear();
+        uploaded.swap(_keptBuffers);
+    }
+
+    // Use the layout RStartAtlasLayout worked out if it's for these images and fits this GPU, otherwise pack them now
+    if (_layoutThread.joinable()) _layoutThread.join();
+    if (_layout.placements.size() != _preImages.size() || _layout.maxSide > _maxTextureSize || _layout.pageSizes.size() > _maxLayers) {
+        if (!_PackAtlas(_ImageSizes(), _maxTextureSize, _maxLayers, &_layout)) {
+            _FreeBuffers(uploaded);
+            return false;
+        }
+    }
+
+    std::vector<std::vector<unsigned int>> pages(_layout.pageSizes.size());
+    for (unsigned int i = 0; i < _layout.placements.size(); i++) {
+        const RAtlasPlacement& place = _layout.placements[i];
+        RAtlasImage& aImg = _atlasImages[i];
+        aImg.x = place.x;
+        aImg.y = place.y;
+        aImg.layer = place.layer;
+        pages[place.layer].push_back(i);
+    }
+    unsigned int atlasW = 0, atlasH = 0;
+    for (const rectpack2D::rect_wh& page : _layout.pageSizes) {
+        atlasW = std::max(atlasW, ( unsigned int )page.w);
+        atlasH = std::max(atlasH, ( unsigned int )page.h);
+    }
+
+    // Make the array, then copy each page into pixeldata and upload it to its layer
+    _ResizeAtlas(atlasW, atlasH, static_cast<unsigned int>(pages.size()));
+
+    unsigned char* pixelData = ( unsigned char* )malloc(( size_t )_atlasW * _atlasH * 4);
+    if (!pixelData) {
+        _FreeBuffers(uploaded);
+        return false;
+    }
+    for (unsigned int layer = 0; layer < _atlasLayers; layer++) {
+        unsigned int pageW = _layout.pageSizes[layer].w;
+        unsigned int pageH = _layout.pageSizes[layer].h;
+        memset(pixelData, 0, ( size_t )pageW * pageH * 4);
+        for (unsigned int i : pages[layer]) {
+            const RPreImage& img = _preImages[i];
+            const RAtlasImage& aImg = _atlasImages[i];
+            if (!img.data) continue;
+            for (unsigned int iY = 0; iY < img.h; iY++) {
+                memcpy(pixelData + (( size_t )(aImg.y + iY) * pageW + aImg.x) * 4, img.data + ( size_t )img.w * iY * 4, img.w * 4);
+            }
+        }
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, pageW, pageH, 1, GL_RGBA, GL_UNSIGNED_BYTE, static_cast<void*>(pixelData));
+    }
+    free(pixelData);
+    _compileBufferBytes = ( size_t )_atlasW * _atlasH * 4;
+
+    // Everything's on the GPU now, so the CPU copies can go
+    for (RPreImage& img : _preImages) {
+        if (img.ownsData) free(img.data);
+        img.data = NULL;
+        img.ownsData = false;
+    }
+    _FreeBuffers(uploaded);
+
+    _InitPages();
+    return true;
+}
+
+void _FreeBuffers(const std::vector<void*>& buffers) {
+    for (void* buffer : buffers) {
+        free(buffer);
+    }
+}
+
+void _ResizeAtlas(unsigned int w, unsigned int h, unsigned int layers) {
+    GLuint oldArray = _atlasArray;
+    glGenTextures(1, &_atlasArray);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, _atlasArray);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, w, h, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+    if (oldArray) {
+        // Each old layer gets attached to a framebuffer in turn and copied across. Draw commands have their atlas rects in texels,
+        // so the ones already made are still right in the bigger array.
+        GLuint fbo;
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+        for (unsigned int layer = 0; layer < _atlasLayers; layer++) {
+            glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, oldArray, 0, layer);
+            glCopyTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, 0, 0, _atlasW, _atlasH);
+        }
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteTextures(1, &oldArray);
+    }
+
+    _atlasW = w;
+    _atlasH = h;
+    _atlasLayers = layers;
+    glUniform2f(_atlasSizeUniform, ( GLfloat )_atlasW, ( GLfloat )_atlasH);
+}
+
+void _InitPages() {
+    std::vector<RAtlasSlot> used;
+    used.reserve(_atlasImages.size());
+    for (const RAtlasImage& aImg : _atlasImages) {
+        used.push_back(RAtlasSlot{aImg.layer, RAtlasRect{aImg.x, aImg.y, aImg.w, aImg.h}});
+    }
+    RAtlasInit(&_atlasSpace, _atlasW, _atlasH, _atlasLayers, _maxLayers, _maxTextureSize, used);
+    {
+        std::lock_guard<std::mutex> lock(_pendingMutex);
+        _wantedAtlasW = _atlasW;
+        _wantedAtlasH = _atlasH;
+        _wantedAtlasLayers = _atlasLayers;
+    }
+}
+
+void RGetMemoryReport(RMemoryReport* report) {
+    (*report) = RMemoryReport();
+    report->compileBufferBytes = _compileBufferBytes;
+
+    // Pixels still waiting to go into the atlas, or all of them with the software backend
+    for (const RPreImage& img : _preImages) {
+        if (img.data) report->stagingBytes += ( unsigned long long )img.w * img.h * 4;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_pendingMutex);
+        for (const auto& p : _pendingPixels) {
+            const RPreImage& img = _preImages[p.first];
+            report->stagingBytes += ( unsigned long long )img.w * img.h * 4;
+        }
+        report->keptBuffers = static_cast<unsigned int>(_keptBuffers.size());
+    }
+
+    // Every layer of the array is the same size, whatever size the page packed onto it was. Freed images have no size, so they don't count.
+    report->pages.resize(_atlasSpace.pages.size());
+    for (RAtlasPageMemory& page : report->pages) {
+        page.bytes = ( unsigned long long )_atlasSpace.pageW * _atlasSpace.pageH * 4;
+    }
+    for (size_t i = 0; i < _atlasImages.size() && !_atlasSpace.pages.empty(); i++) {
+        const RAtlasImage& aImg = _atlasImages[i];
+        report->pages[aImg.layer].usedBytes += ( unsigned long long )aImg.w * aImg.h * 4;
+    }
+    for (const RAtlasPageMemory& page : report->pages) {
+        report->atlasBytes += page.bytes;
+        report->atlasUsedBytes += page.usedBytes;
+    }
+}
+
+std::vector<rectpack2D::rect_wh> _ImageSizes() {
+    std::vector<rectpack2D::rect_wh> sizes;
+    sizes.reserve(_preImages.size());
+    for (const RPreImage& p : _preImages) {
+        sizes.emplace_back(( int )p.w, ( int )p.h);
+    }
+    return sizes;
+}
+
+bool _PackAtlas(const std::vector<rectpack2D::rect_wh>& sizes, unsigned int maxSide, unsigned int maxPages, RAtlasLayout* layout) {
     using spaces_type = rectpack2D::empty_spaces<false, rectpack2D::default_empty_spaces>;  // don't allow flipping
     using rect_type = rectpack2D::output_rect_t<spaces_type>;
 
-    std::vector<rect_type> rectangles;
-    rectangles.reserve(_preImages.size());
-
-    std::vector<RPreImage> packed;
-    packed.reserve(_preImages.size());
-    auto report_successful = [&packed, &rectangles](rect_type& r) {
-        unsigned int index = static_cast<unsigned int>((&r) - rectangles.data());
-        _preImages[index]._x = r.x;
-        _preImages[index]._y = r.y;
-        packed.push_back(_preImages[index]);
-        return rectpack2D::callback_result::CONTINUE_PACKING;
-    };
-
-    std::vector<RPreImage> unpacked;
-    auto report_unsuccessful = [&unpacked, &rectangles](rect_type& r) {
-        unsigned int index = static_cast<unsigned int>((&r) - rectangles.data());
-        unpacked.push_back(_preImages[index]);
-        return rectpack2D::callback_result::CONTINUE_PACKING;
-    };
-
-    const auto max_side = _maxTextureSize;
     const auto discard_step = 256;
 
-    for (const RPreImage& p : _preImages) {
-        rectangles.emplace_back(rectpack2D::rect_xywh(0, 0, p.w, p.h));
-    }
-
-    // Do packing
-    const auto result_size =
-        rectpack2D::find_best_packing<spaces_type>(rectangles, rectpack2D::make_finder_input(max_side, discard_step, report_successful, report_unsuccessful, rectpack2D::flipping_option::ENABLED));
-
-    // Copy everything into pixeldata
-    unsigned char* pixelData = ( unsigned char* )malloc(result_size.w * result_size.h * 4);
-    if (!pixelData) return false;
-    for (RPreImage& img : packed) {
-        RAtlasImage& aImg = _atlasImages[img.imgIndex];
-        aImg.x = img._x;
-        aImg.y = img._y;
-        aImg.w = img.w;
-        aImg.h = img.h;
-        aImg.atlasId = firstAtlas;
-        for (unsigned int iY = aImg.y; iY < aImg.y + aImg.h; iY++) {
-            memcpy(pixelData + (iY * result_size.w * 4) + (aImg.x * 4), img.data + (aImg.w * (iY - aImg.y) * 4), aImg.w * 4);
+    layout->maxSide = maxSide;
+    layout->pageSizes.clear();
+    layout->placements.assign(sizes.size(), RAtlasPlacement());
+
+    // Fill a page with as much as fits, then start another page with whatever didn't
+    std::vector<unsigned int> remaining(sizes.size());
+    for (unsigned int i = 0; i < remaining.size(); i++) remaining[i] = i;
+    while (!remaining.empty()) {
+        if (layout->pageSizes.size() >= maxPages) return false;
+        unsigned int layer = static_cast<unsigned int>(layout->pageSizes.size());
+
+        std::vector<rect_type> rectangles;
+        rectangles.reserve(remaining.size());
+        for (unsigned int i : remaining) {
+            rectangles.emplace_back(rectpack2D::rect_xywh(0, 0, sizes[i].w, sizes[i].h));
         }
+
+        size_t packed = 0;
+        auto report_successful = [&packed, &rectangles, &remaining, layout, layer](rect_type& r) {
+            RAtlasPlacement& place = layout->placements[remaining[(&r) - rectangles.data()]];
+            place.layer = layer;
+            place.x = r.x;
+            place.y = r.y;
+            packed++;
+            return rectpack2D::callback_result::CONTINUE_PACKING;
+        };
+
+        std::vector<unsigned int> unpacked;
+        auto report_unsuccessful = [&unpacked, &rectangles, &remaining](rect_type& r) {
+            unpacked.push_back(remaining[(&r) - rectangles.data()]);
+            return rectpack2D::callback_result::CONTINUE_PACKING;
+        };
+
+        // Do packing
+        const auto result_size = rectpack2D::find_best_packing<spaces_type>(
+            rectangles, rectpack2D::make_finder_input(( int )maxSide, discard_step, report_successful, report_unsuccessful, rectpack2D::flipping_option::ENABLED));
+        if (packed == 0) return false;  // Nothing fits on a page by itself, so more pages won't help
+
+        layout->pageSizes.push_back(result_size);
+        remaining = std::move(unpacked);
     }
+    return true;
+}
 
-    // Upload atlas to GPU
-    glGenTextures(1, &_atlases[firstAtlas].glTex);
-    _atlases[firstAtlas].w = result_size.w;
-    _atlases[firstAtlas].h = result_size.h;
-    glActiveTexture(GL_TEXTURE0 + firstAtlas);
-    glBindTexture(GL_TEXTURE_2D, _atlases[firstAtlas].glTex);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, result_size.w, result_size.h, 0, GL_RGBA, GL_UNSIGNED_BYTE, static_cast<void*>(pixelData));
-    glBindTexture(GL_TEXTURE_2D, 0);
+void RStartAtlasLayout(const char* cachePath) {
+    if (_backend == RBACKEND_SOFTWARE || _preImages.empty()) return;
+    if (_layoutThread.joinable()) _layoutThread.join();
+
+    // Any GPU this runs on can take pages this big, and anything bigger would be a waste of memory on most games. An image that's bigger than this
+    // gets a page of its own size, and if it turns out the GPU can't do that _Compile packs everything again with the GPU's real limit.
+    std::vector<rectpack2D::rect_wh> sizes = _ImageSizes();
+    unsigned int maxSide = std::max(ATLAS_PACK_SIDE, std::max(_tallest, _widest));
+
+    // The layout only depends on the images' sizes and the page size, so that's what the cache is keyed on
+    Hasher64 hasher;
+    hasher.Update(&maxSide, sizeof(maxSide));
+    for (const rectpack2D::rect_wh& size : sizes) {
+        unsigned int wh[2] = {( unsigned int )size.w, ( unsigned int )size.h};
+        hasher.Update(wh, sizeof(wh));
+    }
+    GameCacheKey key = {ATLAS_CACHE_MAGIC, ATLAS_CACHE_FORMAT_VERSION, static_cast<unsigned int>(sizes.size()), hasher.Final(), 0};
+    std::string path = cachePath ? cachePath : "";
+    if (!path.empty() && _ReadAtlasCache(path.c_str(), key, sizes, maxSide, &_layout)) return;
+
+    _layout = RAtlasLayout();
+    _layoutThread = std::thread([sizes, maxSide, key, path]() {
+        RAtlasLayout layout;
+        if (!_PackAtlas(sizes, maxSide, UINT_MAX, &layout)) return;  // _Compile will try again with the GPU's limits
+        if (!path.empty()) _WriteAtlasCache(path.c_str(), key, layout);
+        _layout = std::move(layout);
+    });
+}
 
-    free(pixelData);
+bool _ReadAtlasCache(const char* path, const GameCacheKey& key, const std::vector<rectpack2D::rect_wh>& sizes, unsigned int maxSide, RAtlasLayout* layout) {
+    FileMapping cache;
+    int unused;
+    if (!GameCacheOpen(path, key, &cache, &unused)) return false;
+
+    // The body's hash has been checked, but a layout that would put images off the edge of their page still doesn't get used
+    const unsigned char* body = cache.data + sizeof(GameCacheHeader);
+    size_t length = cache.length - sizeof(GameCacheHeader);
+    unsigned int pos = 0;
+    bool valid = length >= 4;
+    unsigned int pageCount = valid ? ReadDword(body, &pos) : 0;
+    valid = valid && length == 4 + (( size_t )pageCount * 2 + sizes.size() * 3) * 4;
+    RAtlasLayout read;
+    read.maxSide = maxSide;
+    for (unsigned int i = 0; valid && i < pageCount; i++) {
+        rectpack2D::rect_wh page;
+        page.w = ( int )ReadDword(body, &pos);
+        page.h = ( int )ReadDword(body, &pos);
+        valid = page.w > 0 && page.h > 0 && ( unsigned int )page.w <= maxSide && ( unsigned int )page.h <= maxSide;
+        read.pageSizes.push_back(page);
+    }
+    for (size_t i = 0; valid && i < sizes.size(); i++) {
+        RAtlasPlacement place;
+        place.layer = ReadDword(body, &pos);
+        place.x = ReadDword(body, &pos);
+        place.y = ReadDword(body, &pos);
+        valid = place.layer < pageCount && ( size_t )place.x + sizes[i].w <= ( size_t )read.pageSizes[place.layer].w &&
+                ( size_t )place.y + sizes[i].h <= ( size_t )read.pageSizes[place.layer].h;
+        read.placements.push_back(place);
+    }
+    FileUnmap(&cache);
+    if (valid) (*layout) = std::move(read);
+    return valid;
+}
 
-    if (unpacked.size()) {
-        // We didn't manage to pack every texture so let's move onto the next atlas
-        _preImages = unpacked;
-        return _Compile(firstAtlas + 1);
+void _WriteAtlasCache(const char* path, const GameCacheKey& key, const RAtlasLayout& layout) {
+    // Not being able to write it only makes the next launch pack everything again
+    GameCacheWriter writer;
+    if (!writer.Open(path)) return;
+    writer.WriteDword(static_cast<unsigned int>(layout.pageSizes.size()));
+    for (const rectpack2D::rect_wh& page : layout.pageSizes) {
+        writer.WriteDword(( unsigned int )page.w);
+        writer.WriteDword(( unsigned int )page.h);
     }
-    else {
-        return true;
+    for (const RAtlasPlacement& place : layout.placements) {
+        writer.WriteDword(place.layer);
+        writer.WriteDword(place.x);
+        writer.WriteDword(place.y);
     }
+    writer.Finish(key, 0);
 }
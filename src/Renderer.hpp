@@ -4,10 +4,30 @@
 
 struct GameSettings;
 typedef unsigned int RImageIndex;
+typedef unsigned int RCacheIndex;
+
+// OPENGL draws into a window with OpenGL 3.3. SOFTWARE draws into a framebuffer in memory on the CPU and never opens a window or touches GLFW,
+// so it works on machines with no GPU or display.
+enum RBackend { RBACKEND_OPENGL, RBACKEND_SOFTWARE };
 
 void RInit();
 void RTerminate();
 
+// Forgets every image registered so far, for starting a load over after it failed part way. Does nothing after RMakeGameWindow.
+void RClearImages();
+
+// Chooses which backend to draw with. Has to be called before RMakeGameWindow, the default is RBACKEND_OPENGL.
+void RSetBackend(RBackend backend);
+RBackend RGetBackend();
+
+// Draws and presents frames on a thread of their own, so the game can run the next frame while the last one's being presented.
+// Has to be called before RMakeGameWindow. Does nothing with the software backend.
+void RSetRenderThread(bool enabled);
+
+// Starts working out where every image registered so far goes in the atlas, on another thread, so RMakeGameWindow doesn't have to.
+// Call it once all the images are registered. If cachePath isn't NULL the layout is read from there when the images haven't changed, and written there when they have.
+void RStartAtlasLayout(const char* cachePath);
+
 // Creates the main game window, should be called after all loading is done. Returns true on success, otherwise false.
 bool RMakeGameWindow(GameSettings* settings, unsigned int w, unsigned int h);
 
@@ -28,16 +48,88 @@ bool RShouldClose();
 
 
 // Registers an image in the renderer. Assumes 32-bit pixels in RGBA format (which is how it is in the EXE.) 
+// Images made after RMakeGameWindow get fitted into the atlas as they come and show up from the next frame.
 RImageIndex RMakeImage(unsigned int w, unsigned int h, unsigned int originX, unsigned int originY, unsigned char* bytes);
 
+// Same as RMakeImage, but uses the pixels where they are instead of copying them. They have to stay put until the renderer is shut down,
+// which is easiest done by handing the malloc'd buffer they're in to RKeepBuffer. Several images can point into the same buffer.
+RImageIndex RMakeImageInPlace(unsigned int w, unsigned int h, unsigned int originX, unsigned int originY, unsigned char* bytes);
+
+// Takes ownership of a malloc'd buffer that images made with RMakeImageInPlace or given to RSetImagePixels point into. With OpenGL it's freed once
+// everything in it is in the atlas, otherwise when the renderer shuts down. Pixels have to be given to RSetImagePixels before their buffer is kept.
+// Can be called from any thread.
+void RKeepBuffer(void* buffer);
+
+// Registers an image whose pixels aren't ready yet, so it still gets a place in an atlas. It draws as transparent until RSetImagePixels is called for it.
+RImageIndex RMakeImageDeferred(unsigned int w, unsigned int h, unsigned int originX, unsigned int originY);
+
+// Supplies the pixels for an image made with RMakeImageDeferred, in the same format as RMakeImage. They're used in place, so they have to stay put
+// until the renderer is shut down (see RKeepBuffer). Can be called from any thread, the pixels get uploaded at the start of the next frame.
+void RSetImagePixels(RImageIndex ix, unsigned char* bytes);
+
+// Gives an image's space in the atlas back, for sprites and backgrounds the game deletes. It draws as nothing afterwards, and its index isn't reused.
+// Only for images made after RMakeGameWindow, since those are the only ones a game can delete.
+void RFreeImage(RImageIndex ix);
+
 // Draws a registered image at the given X and Y. Tries to imitate draw_sprite_ext() from GML.
 void RDrawImage(RImageIndex ix, double x, double y, double xscale, double yscale, double rot, unsigned int blend, double alpha);
 
 // Draws a given section of a registered image at the given X and Y.
 void RDrawPartialImage(RImageIndex ix, double x, double y, double xscale, double yscale, double rot, unsigned int blend, double alpha, unsigned int partX, unsigned int partY, unsigned int partW, unsigned int partH);
 
+// Draws a registered image scaled and repeated repeatX times across and repeatY times down, as a single quad with its top-left corner at x, y.
+// The repeats don't have to be whole numbers, the last copy gets cut off. The image's origin is ignored. Used for tiled and stretched room backgrounds.
+void RDrawImageTiled(RImageIndex ix, double x, double y, double xscale, double yscale, double repeatX, double repeatY, unsigned int blend, double alpha);
+
+// Starts recording draws into a new cache instead of the frame, until REndCache. Caches are for things that get drawn the same way every frame:
+// drawing one with RDrawCache is much cheaper than making all the draws it holds again. They can only be made after RMakeGameWindow.
+RCacheIndex RStartCache();
+void REndCache();
+
+// Adds everything recorded in a cache to the frame, in the order it was recorded
+void RDrawCache(RCacheIndex cache);
+
+// Throws a cache away. Its index may be given out again by RStartCache.
+void RFreeCache(RCacheIndex cache);
+
 // Clear the screen and prepare for drawing sprites
 void RStartFrame();
 
 // Render the current frame after drawing all images
 void RRenderFrame();
+
+// What it took to draw the last frame rendered
+struct RFrameStats {
+    unsigned int commands = 0;  // Images drawn
+    unsigned int batches = 0;  // Runs of them that got drawn together
+    unsigned int drawCalls = 0;  // OpenGL draw calls those took, always 0 with the software backend
+    unsigned int culled = 0;  // Images that weren't drawn because they were entirely off screen
+    unsigned int atlasSwitches = 0;  // Times an image came from a different atlas page to the one before it. These don't cost a texture bind,
+                                     // since the pages are all one array texture, but a frame that jumps between pages a lot uses the texture cache badly.
+    unsigned long long uploadedBytes = 0;  // Draw commands and image pixels sent to the GPU. With the render thread, pixels count towards the frame after.
+    double gpuSeconds = -1;  // How long the GPU took to draw a frame, from a timer that's read a few frames later so nothing waits for it.
+                             // -1 until the first one comes back, and always with the software backend or if the driver has no timers.
+};
+const RFrameStats& RGetFrameStats();
+
+// Draws graphs of the last few seconds of frame stats in the top-left corner of the window, on top of everything else: GPU time on top,
+// with the line at 1/60th of a second, and images drawn with culled ones above them in grey underneath. Can be turned on and off at any time.
+void RSetStatsOverlay(bool enabled);
+
+// Where the renderer's memory is going. Byte counts are for pixels, not including any driver overhead.
+struct RAtlasPageMemory {
+    unsigned long long bytes = 0;  // What the page takes up on the GPU
+    unsigned long long usedBytes = 0;  // How much of that has images in it, the rest is wasted by packing
+};
+struct RMemoryReport {
+    unsigned long long stagingBytes = 0;  // Image pixels held in CPU memory, waiting to go into the atlas (or all of them with the software backend)
+    unsigned int keptBuffers = 0;  // Buffers from RKeepBuffer that haven't been freed yet
+    unsigned long long compileBufferBytes = 0;  // The buffer pages were copied through while making the atlas, which is freed straight after
+    unsigned long long atlasBytes = 0;  // All the pages together
+    unsigned long long atlasUsedBytes = 0;
+    std::vector<RAtlasPageMemory> pages;
+};
+void RGetMemoryReport(RMemoryReport* report);
+
+// A hash of the last frame rendered, for checking that a game still draws the same thing it used to. Only the software backend has one, otherwise it's 0.
+unsigned long long RFrameHash();
@@ -0,0 +1,184 @@
+#define PI 3.14159265358979324
+#include "SoftwareRenderer.hpp"
+#include "PixelUtil.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+unsigned char* _softPixels = NULL;
+unsigned char* _softRow = NULL;  // One row of sampled pixels, waiting to be blended into the framebuffer
+unsigned int _softW = 0;
+unsigned int _softH = 0;
+
+void SoftwareRenderer::Resize(unsigned int w, unsigned int h) {
+    Terminate();
+    _softPixels = ( unsigned char* )calloc(( size_t )w * h, 4);
+    _softRow = ( unsigned char* )malloc(( size_t )w * 4);
+    _softW = w;
+    _softH = h;
+}
+
+void SoftwareRenderer::Terminate() {
+    free(_softPixels);
+    free(_softRow);
+    _softPixels = NULL;
+    _softRow = NULL;
+    _softW = 0;
+    _softH = 0;
+}
+
+void SoftwareRenderer::Clear(unsigned int colour) {
+    if (!_softPixels) return;
+    unsigned char pixel[4] = {( unsigned char )(colour & 0xFF), ( unsigned char )((colour >> 8) & 0xFF), ( unsigned char )((colour >> 16) & 0xFF), 0xFF};
+    size_t rowBytes = ( size_t )_softW * 4;
+    for (size_t i = 0; i < rowBytes; i += 4) {
+        memcpy(_softPixels + i, pixel, 4);
+    }
+    for (unsigned int row = 1; row < _softH; row++) {
+        memcpy(_softPixels + row * rowBytes, _softPixels, rowBytes);
+    }
+}
+
+void SoftwareRenderer::Draw(const unsigned char* pixels, unsigned int imageW, unsigned int partX, unsigned int partY, unsigned int partW, unsigned int partH, double originX,
+                            double originY, double x, double y, double xscale, double yscale, double rot, unsigned int blend, double alpha) {
+    if (!pixels || !_softPixels || partW == 0 || partH == 0 || xscale == 0 || yscale == 0 || alpha <= 0) return;
+    unsigned char alphaByte = alpha >= 1 ? 0xFF : ( unsigned char )(alpha * 0xFF + 0.5);
+
+    // A point u, v in the section (in pixels) lands on the screen at
+    //   x + (u - originX) * xscale * cos + (v - originY) * yscale * sin,  y - (u - originX) * xscale * sin + (v - originY) * yscale * cos
+    // so going the other way, from a pixel centre back to the section, is a rotation by -rot and a divide by the scales.
+    double dRot = rot * PI / 180;
+    double sinRot = rot == 0 ? 0 : sin(dRot);
+    double cosRot = rot == 0 ? 1 : cos(dRot);
+
+    // Bounding box of the four corners
+    double minX = x, maxX = x, minY = y, maxY = y;
+    bool first = true;
+    for (unsigned int corner = 0; corner < 4; corner++) {
+        double lx = (((corner & 1) ? partW : 0) - originX) * xscale;
+        double ly = (((corner & 2) ? partH : 0) - originY) * yscale;
+        double sx = x + lx * cosRot + ly * sinRot;
+        double sy = y - lx * sinRot + ly * cosRot;
+        if (first || sx < minX) minX = sx;
+        if (first || sx > maxX) maxX = sx;
+        if (first || sy < minY) minY = sy;
+        if (first || sy > maxY) maxY = sy;
+        first = false;
+    }
+
+    // Pixels whose centres are inside the box, clipped to the framebuffer. It's a pixel bigger all round so that whether a centre right on an edge
+    // gets drawn is down to the test against the section below, and not to which way round the scales made the box.
+    double left = std::max(std::floor(minX - 0.5), 0.0);
+    double right = std::min(std::ceil(maxX + 0.5), ( double )_softW);
+    double top = std::max(std::floor(minY - 0.5), 0.0);
+    double bottom = std::min(std::ceil(maxY + 0.5), ( double )_softH);
+    if (left >= right || top >= bottom) return;
+    unsigned int startX = ( unsigned int )left, endX = ( unsigned int )right;
+    unsigned int startY = ( unsigned int )top, endY = ( unsigned int )bottom;
+    unsigned int count = endX - startX;
+
+    // How far through the section one pixel to the right moves
+    double stepU = cosRot / xscale;
+    double stepV = sinRot / yscale;
+    double w = partW, h = partH;
+
+    for (unsigned int row = startY; row < endY; row++) {
+        double cx = startX + 0.5 - x;
+        double cy = row + 0.5 - y;
+        double u = (cosRot * cx - sinRot * cy) / xscale + originX;
+        double v = (sinRot * cx + cosRot * cy) / yscale + originY;
+        unsigned char* dst = _softPixels + (( size_t )row * _softW + startX) * 4;
+
+        if (rot == 0) {
+            // v is the same all the way along the row
+            if (v < 0 || v >= h) continue;
+            const unsigned char* src = pixels + (( size_t )(partY + std::min(( unsigned int )v, partH - 1)) * imageW + partX) * 4;
+            if (xscale == 1) {
+                // Unscaled, so the row can be blended straight from the image
+                long long tx = ( long long )std::floor(u);
+                long long skip = tx < 0 ? -tx : 0;
+                long long n = std::min(( long long )count - skip, ( long long )partW - (tx + skip));
+                if (n > 0) BlendPixels(dst + skip * 4, src + (tx + skip) * 4, ( size_t )n, blend, alphaByte);
+                continue;
+            }
+            // Multiplying rather than adding up the steps keeps rounding errors from building up along the row
+            for (unsigned int i = 0; i < count; i++) {
+                double pu = u + i * stepU;
+                if (pu >= 0 && pu < w) memcpy(_softRow + i * 4, src + std::min(( unsigned int )pu, partW - 1) * 4, 4);
+                else memset(_softRow + i * 4, 0, 4);
+            }
+        }
+        else {
+            for (unsigned int i = 0; i < count; i++) {
+                double pu = u + i * stepU, pv = v + i * stepV;
+                if (pu >= 0 && pu < w && pv >= 0 && pv < h) {
+                    unsigned int tx = std::min(( unsigned int )pu, partW - 1);
+                    unsigned int ty = std::min(( unsigned int )pv, partH - 1);
+                    memcpy(_softRow + i * 4, pixels + (( size_t )(partY + ty) * imageW + partX + tx) * 4, 4);
+                }
+                else {
+                    memset(_softRow + i * 4, 0, 4);
+                }
+            }
+        }
+        BlendPixels(dst, _softRow, count, blend, alphaByte);
+    }
+}
+
+void SoftwareRenderer::DrawTiled(const unsigned char* pixels, unsigned int imageW, unsigned int imageH, double x, double y, double xscale, double yscale, double repeatX,
+                                 double repeatY, unsigned int blend, double alpha) {
+    if (!pixels || !_softPixels || imageW == 0 || imageH == 0 || xscale == 0 || yscale == 0 || repeatX <= 0 || repeatY <= 0 || alpha <= 0) return;
+    unsigned char alphaByte = alpha >= 1 ? 0xFF : ( unsigned char )(alpha * 0xFF + 0.5);
+
+    // Same edge rules as Draw: a pixel is drawn if its centre lands inside the quad, which is w by h in image pixels before wrapping
+    double w = imageW * repeatX, h = imageH * repeatY;
+    double x2 = x + w * xscale, y2 = y + h * yscale;
+    double left = std::max(std::floor(std::min(x, x2) - 0.5), 0.0);
+    double right = std::min(std::ceil(std::max(x, x2) + 0.5), ( double )_softW);
+    double top = std::max(std::floor(std::min(y, y2) - 0.5), 0.0);
+    double bottom = std::min(std::ceil(std::max(y, y2) + 0.5), ( double )_softH);
+    if (left >= right || top >= bottom) return;
+    unsigned int startX = ( unsigned int )left, endX = ( unsigned int )right;
+    unsigned int startY = ( unsigned int )top, endY = ( unsigned int )bottom;
+
+    // Every row samples the same columns, so where each one wraps to is worked out once. Columns outside the quad are trimmed off the ends.
+    std::vector<unsigned int> columns;
+    unsigned int firstX = endX;
+    for (unsigned int col = startX; col < endX; col++) {
+        double u = (col + 0.5 - x) / xscale;
+        if (u < 0 || u >= w) continue;
+        if (firstX == endX) firstX = col;
+        columns.resize(col - firstX + 1, 0);
+        columns.back() = ( unsigned int )u % imageW;
+    }
+    if (columns.empty()) return;
+
+    for (unsigned int row = startY; row < endY; row++) {
+        double v = (row + 0.5 - y) / yscale;
+        if (v < 0 || v >= h) continue;
+        const unsigned char* src = pixels + (( size_t )(( unsigned int )v % imageH) * imageW) * 4;
+        for (size_t i = 0; i < columns.size(); i++) {
+            memcpy(_softRow + i * 4, src + columns[i] * 4, 4);
+        }
+        BlendPixels(_softPixels + (( size_t )row * _softW + firstX) * 4, _softRow, columns.size(), blend, alphaByte);
+    }
+}
+
+const unsigned char* SoftwareRenderer::Pixels() { return _softPixels; }
+
+unsigned int SoftwareRenderer::Width() { return _softW; }
+
+unsigned int SoftwareRenderer::Height() { return _softH; }
+
+unsigned long long SoftwareRenderer::Hash() {
+    // A dword at a time rather than a byte, which is plenty for telling frames apart and four times quicker
+    unsigned long long hash = 14695981039346656037ULL;
+    const unsigned char* p = _softPixels;
+    for (size_t i = ( size_t )_softW * _softH; i; i--, p += 4) {
+        hash ^= ( unsigned int )p[0] | (( unsigned int )p[1] << 8) | (( unsigned int )p[2] << 16) | (( unsigned int )p[3] << 24);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
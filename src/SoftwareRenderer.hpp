@@ -0,0 +1,37 @@
+#pragma once
+
+#include <ostream>
+
+// Draws into an RGBA framebuffer in memory instead of an OpenGL context, for running games on machines with no GPU or display.
+// Renderer.cpp uses this when RSetBackend(RBACKEND_SOFTWARE) has been called, and nothing else should need to use it directly.
+namespace SoftwareRenderer {
+    // Makes (or remakes) the framebuffer at the given size
+    void Resize(unsigned int w, unsigned int h);
+    void Terminate();
+
+    // Fills the whole framebuffer with a GM colour (0xBBGGRR), fully opaque
+    void Clear(unsigned int colour);
+
+    // Draws the partW x partH section at partX, partY of an image that's imageW pixels wide, the same way the OpenGL renderer draws it:
+    // originX and originY are in section pixels, the section is scaled, then rotated by rot degrees anticlockwise around the origin, which ends up at x, y.
+    // Sampling is nearest-neighbour at pixel centres. pixels can be NULL, in which case nothing is drawn.
+    void Draw(const unsigned char* pixels, unsigned int imageW, unsigned int partX, unsigned int partY, unsigned int partW, unsigned int partH, double originX, double originY,
+              double x, double y, double xscale, double yscale, double rot, unsigned int blend, double alpha);
+
+    // Draws a whole imageW x imageH image scaled and repeated repeatX times across and repeatY times down, top-left corner at x, y, like RDrawImageTiled
+    void DrawTiled(const unsigned char* pixels, unsigned int imageW, unsigned int imageH, double x, double y, double xscale, double yscale, double repeatX, double repeatY,
+                   unsigned int blend, double alpha);
+
+    // The framebuffer, top row first, four bytes per pixel in RGBA order
+    const unsigned char* Pixels();
+    unsigned int Width();
+    unsigned int Height();
+
+    // For checking a frame came out the same as it did before. It's 64-bit FNV-1a, but taking in a pixel at a time as a little-endian dword
+    // rather than a byte at a time, so it won't match an ordinary FNV-1a of the same bytes.
+    unsigned long long Hash();
+
+    // Draws small images and checks the pixels, then checks Hash against a separate version of it and against the hash of a test scene.
+    // Writes what it's checking to out, and returns false if anything was wrong.
+    bool UnitTest(std::ostream& out);
+};
@@ -0,0 +1,159 @@
+#include "SoftwareRenderer.hpp"
+
+#include <cstdlib>
+
+// The scene _SoftTestScene draws hashes to this. It only changes if something draws differently, so if that was on purpose, check the pixel
+// tests still pass and put the new hash in.
+constexpr unsigned long long SOFTWARE_SCENE_HASH = 0xce6b3cffb74dc9d4ULL;
+
+bool _SoftCheck(std::ostream& out, bool ok, const char* what) {
+    if (!ok) out << " -> FAILED! " << what << "\n";
+    return ok;
+}
+
+// Whether the framebuffer pixel at x, y is r, g, b, a, give or take tolerance on each
+bool _SoftPixelIs(unsigned int x, unsigned int y, int r, int g, int b, int a, int tolerance = 0) {
+    const unsigned char* p = SoftwareRenderer::Pixels() + (( size_t )y * SoftwareRenderer::Width() + x) * 4;
+    return std::abs(p[0] - r) <= tolerance && std::abs(p[1] - g) <= tolerance && std::abs(p[2] - b) <= tolerance && std::abs(p[3] - a) <= tolerance;
+}
+
+// The same hash worked out separately: FNV-1a, but taking in each pixel as one little-endian dword instead of a byte at a time
+unsigned long long _SoftHash() {
+    unsigned long long hash = 14695981039346656037ULL;
+    size_t count = ( size_t )SoftwareRenderer::Width() * SoftwareRenderer::Height();
+    for (size_t i = 0; i < count; i++) {
+        const unsigned char* p = SoftwareRenderer::Pixels() + i * 4;
+        unsigned long long dword = p[0] + (p[1] << 8) + (p[2] << 16) + (( unsigned long long )p[3] << 24);
+        hash = (hash ^ dword) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Four opaque pixels, red, green, blue and white, in a 2x2 square
+const unsigned char _softImage[16] = {255, 0, 0, 255, 0, 255, 0, 255, 0, 0, 255, 255, 255, 255, 255, 255};
+
+bool _SoftClearTest(std::ostream& out) {
+    out << "Asserting Clear fills the framebuffer with a GM colour ..\n";
+    SoftwareRenderer::Resize(8, 6);
+    SoftwareRenderer::Clear(0x336699);
+    bool ok = true;
+    for (unsigned int y = 0; y < 6; y++) {
+        for (unsigned int x = 0; x < 8; x++) ok &= _SoftPixelIs(x, y, 0x99, 0x66, 0x33, 255);
+    }
+    return _SoftCheck(out, ok, "cleared pixel isn't the colour, as BBGGRR, fully opaque");
+}
+
+bool _SoftDrawTest(std::ostream& out) {
+    out << "Asserting images get drawn where the OpenGL renderer would put them ..\n";
+    bool ok = true;
+    SoftwareRenderer::Resize(8, 6);
+
+    // Unscaled, with the origin at its top-left
+    SoftwareRenderer::Clear(0);
+    SoftwareRenderer::Draw(_softImage, 2, 0, 0, 2, 2, 0, 0, 3, 2, 1, 1, 0, 0xFFFFFF, 1);
+    ok &= _SoftCheck(out, _SoftPixelIs(3, 2, 255, 0, 0, 255) && _SoftPixelIs(4, 2, 0, 255, 0, 255), "unscaled top row in the wrong place");
+    ok &= _SoftCheck(out, _SoftPixelIs(3, 3, 0, 0, 255, 255) && _SoftPixelIs(4, 3, 255, 255, 255, 255), "unscaled bottom row in the wrong place");
+    ok &= _SoftCheck(out, _SoftPixelIs(2, 2, 0, 0, 0, 255) && _SoftPixelIs(5, 3, 0, 0, 0, 255) && _SoftPixelIs(3, 4, 0, 0, 0, 255), "drew outside the image");
+
+    // Twice as wide, with the origin in the middle
+    SoftwareRenderer::Clear(0);
+    SoftwareRenderer::Draw(_softImage, 2, 0, 0, 2, 2, 1, 1, 4, 3, 2, 1, 0, 0xFFFFFF, 1);
+    ok &= _SoftCheck(out, _SoftPixelIs(2, 2, 255, 0, 0, 255) && _SoftPixelIs(3, 2, 255, 0, 0, 255), "scaled image's first column isn't two wide");
+    ok &= _SoftCheck(out, _SoftPixelIs(4, 2, 0, 255, 0, 255) && _SoftPixelIs(5, 2, 0, 255, 0, 255), "scaled image's second column isn't two wide");
+    ok &= _SoftCheck(out, _SoftPixelIs(1, 2, 0, 0, 0, 255) && _SoftPixelIs(6, 2, 0, 0, 0, 255), "scaled image is too wide");
+
+    // A quarter turn anticlockwise about its top-left, so its top row runs upwards from there
+    SoftwareRenderer::Clear(0);
+    SoftwareRenderer::Draw(_softImage, 2, 0, 0, 2, 2, 0, 0, 2, 4, 1, 1, 90, 0xFFFFFF, 1);
+    ok &= _SoftCheck(out, _SoftPixelIs(2, 3, 255, 0, 0, 255) && _SoftPixelIs(2, 2, 0, 255, 0, 255), "rotated image's top row isn't going up");
+    ok &= _SoftCheck(out, _SoftPixelIs(3, 3, 0, 0, 255, 255) && _SoftPixelIs(3, 2, 255, 255, 255, 255), "rotated image's bottom row isn't to the right");
+
+    // Part of the image, the bottom-right pixel only
+    SoftwareRenderer::Clear(0);
+    SoftwareRenderer::Draw(_softImage, 2, 1, 1, 1, 1, 0, 0, 0, 0, 1, 1, 0, 0xFFFFFF, 1);
+    ok &= _SoftCheck(out, _SoftPixelIs(0, 0, 255, 255, 255, 255) && _SoftPixelIs(1, 0, 0, 0, 0, 255), "drew the wrong part of the image");
+
+    // Hanging off the top-left of the framebuffer
+    SoftwareRenderer::Clear(0);
+    SoftwareRenderer::Draw(_softImage, 2, 0, 0, 2, 2, 0, 0, -1, -1, 1, 1, 0, 0xFFFFFF, 1);
+    ok &= _SoftCheck(out, _SoftPixelIs(0, 0, 255, 255, 255, 255) && _SoftPixelIs(1, 0, 0, 0, 0, 255), "clipped image in the wrong place");
+    return ok;
+}
+
+bool _SoftBlendTest(std::ostream& out) {
+    out << "Asserting blend colour and alpha get applied ..\n";
+    bool ok = true;
+    SoftwareRenderer::Resize(4, 4);
+
+    // White times a red blend colour is red
+    SoftwareRenderer::Clear(0);
+    SoftwareRenderer::Draw(_softImage, 2, 1, 1, 1, 1, 0, 0, 0, 0, 1, 1, 0, 0x0000FF, 1);
+    ok &= _SoftCheck(out, _SoftPixelIs(0, 0, 255, 0, 0, 255), "blend colour wasn't multiplied in");
+
+    // Blue at half alpha over red is about half of each
+    SoftwareRenderer::Clear(0x0000FF);
+    SoftwareRenderer::Draw(_softImage, 2, 0, 1, 1, 1, 0, 0, 0, 0, 1, 1, 0, 0xFFFFFF, 0.5);
+    ok &= _SoftCheck(out, _SoftPixelIs(0, 0, 127, 0, 128, 191, 1), "half alpha didn't blend evenly");
+
+    // Transparent pixels leave what's under them alone
+    const unsigned char clear[4] = {255, 255, 255, 0};
+    SoftwareRenderer::Clear(0x00FF00);
+    SoftwareRenderer::Draw(clear, 1, 0, 0, 1, 1, 0, 0, 0, 0, 1, 1, 0, 0xFFFFFF, 1);
+    ok &= _SoftCheck(out, _SoftPixelIs(0, 0, 0, 255, 0, 255), "transparent pixel changed the framebuffer");
+    return ok;
+}
+
+bool _SoftTiledTest(std::ostream& out) {
+    out << "Asserting tiled images repeat ..\n";
+    SoftwareRenderer::Resize(6, 4);
+    SoftwareRenderer::Clear(0);
+    SoftwareRenderer::DrawTiled(_softImage, 2, 2, 1, 0, 1, 1, 2, 1.5, 0xFFFFFF, 1);
+    bool ok = _SoftCheck(out, _SoftPixelIs(1, 0, 255, 0, 0, 255) && _SoftPixelIs(3, 0, 255, 0, 0, 255) && _SoftPixelIs(4, 0, 0, 255, 0, 255),
+                         "tiles don't repeat across");
+    ok &= _SoftCheck(out, _SoftPixelIs(1, 2, 255, 0, 0, 255) && _SoftPixelIs(4, 2, 0, 255, 0, 255), "tiles don't repeat down");
+    ok &= _SoftCheck(out, _SoftPixelIs(0, 0, 0, 0, 0, 255) && _SoftPixelIs(5, 0, 0, 0, 0, 255) && _SoftPixelIs(1, 3, 0, 0, 0, 255),
+                     "tiles went past the repeat count");
+    return ok;
+}
+
+// A bit of everything, for the hash to cover
+void _SoftTestScene() {
+    SoftwareRenderer::Resize(64, 48);
+    SoftwareRenderer::Clear(0x402010);
+    SoftwareRenderer::DrawTiled(_softImage, 2, 2, 0, 0, 3, 3, 10, 8, 0xFFFFFF, 1);
+    SoftwareRenderer::Draw(_softImage, 2, 0, 0, 2, 2, 1, 1, 32, 24, 7.5, 4.25, 30, 0xFFFFFF, 1);
+    SoftwareRenderer::Draw(_softImage, 2, 0, 0, 2, 2, 0, 0, 40.3, 5.7, 5, 5, 0, 0x80FF80, 0.6);
+    SoftwareRenderer::Draw(_softImage, 2, 0, 0, 2, 2, 2, 2, 10, 40, -3, 3, 200, 0xFFFFFF, 0.3);
+}
+
+bool _SoftHashTest(std::ostream& out) {
+    out << "Asserting Hash is FNV-1a a dword at a time, and the test scene hasn't changed ..\n";
+    bool ok = true;
+    SoftwareRenderer::Resize(0, 0);
+    ok &= _SoftCheck(out, SoftwareRenderer::Hash() == 14695981039346656037ULL, "empty framebuffer doesn't hash to the FNV offset basis");
+
+    _SoftTestScene();
+    unsigned long long hash = SoftwareRenderer::Hash();
+    ok &= _SoftCheck(out, hash == _SoftHash(), "Hash doesn't match FNV-1a over the pixels as dwords");
+    if (!_SoftCheck(out, hash == SOFTWARE_SCENE_HASH, "test scene drew differently")) {
+        out << "    hash was 0x" << std::hex << hash << std::dec << "\n";
+        ok = false;
+    }
+
+    // Changing one pixel changes the hash
+    SoftwareRenderer::Draw(_softImage + 12, 1, 0, 0, 1, 1, 0, 0, 63, 47, 1, 1, 0, 0x000001, 1);
+    ok &= _SoftCheck(out, SoftwareRenderer::Hash() != hash, "changing one pixel didn't change the hash");
+    return ok;
+}
+
+bool SoftwareRenderer::UnitTest(std::ostream& out) {
+    bool ok = true;
+    ok &= _SoftClearTest(out);
+    ok &= _SoftDrawTest(out);
+    ok &= _SoftBlendTest(out);
+    ok &= _SoftTiledTest(out);
+    ok &= _SoftHashTest(out);
+    SoftwareRenderer::Terminate();
+    out << (ok ? "Software renderer OK\n" : "Software renderer FAILED\n");
+    return ok;
+}
@@ -1,6 +1,7 @@
 #include "StreamUtil.hpp"
 #include <stdlib.h>
 #include <string.h>
+#include <zlib.h>
 
 unsigned int ReadDword(const unsigned char* pStream, unsigned int* pPos) {
     unsigned int val = pStream[(*pPos)] + (pStream[(*pPos) + 1] << 8) + (pStream[(*pPos) + 2] << 16) + (pStream[(*pPos) + 3] << 24);
@@ -25,3 +26,84 @@ char* ReadString(const unsigned char* pStream, unsigned int* pPos, unsigned int*
     }
     return str;
 }
+
+// Read and inflate a data block from a byte stream
+// Everything is inflated straight into the output buffer, which grows in place when it runs out of room, so nothing gets copied unless realloc has to move it.
+bool InflateBlock(unsigned char* pStream, unsigned int* pPos, unsigned char** pOutBuffer, unsigned int* pOutBufferSize, unsigned int* pOutSize) {
+    // The first dword is the length in bytes of the compressed data following it.
+    unsigned int len = ReadDword(pStream, pPos);
+
+    // Start inflation
+    z_stream strm;
+    strm.zalloc = Z_NULL;
+    strm.zfree = Z_NULL;
+    strm.opaque = Z_NULL;
+
+    if (inflateInit(&strm) != Z_OK) {
+        // Error starting inflation
+        return false;
+    }
+
+    strm.next_in = pStream + (*pPos);
+    strm.avail_in = len;
+
+    unsigned int outSize = 0;
+    int ret;
+    do {
+        if (outSize == (*pOutBufferSize)) {
+            unsigned int newSize = (*pOutBufferSize) * 2;
+            unsigned char* newBuffer = ( unsigned char* )realloc(*pOutBuffer, newSize);
+            if (!newBuffer) {
+                // Out of memory
+                inflateEnd(&strm);
+                return false;
+            }
+            (*pOutBuffer) = newBuffer;
+            (*pOutBufferSize) = newSize;
+        }
+
+        strm.next_out = (*pOutBuffer) + outSize;
+        strm.avail_out = (*pOutBufferSize) - outSize;
+        ret = inflate(&strm, Z_NO_FLUSH);
+        if ((ret != Z_OK) && (ret != Z_STREAM_END)) {
+            // Error inflating
+            inflateEnd(&strm);
+            return false;
+        }
+        outSize = (*pOutBufferSize) - strm.avail_out;
+    } while (ret != Z_STREAM_END);
+
+    (*pOutSize) = outSize;
+    inflateEnd(&strm);
+    (*pPos) += len;
+    return true;
+}
+
+bool InflateBlockStart(unsigned char* pStream, unsigned int pos, unsigned char* pOut, unsigned int outSize, unsigned int* pOutSize) {
+    unsigned int len = ReadDword(pStream, &pos);
+
+    z_stream strm;
+    strm.zalloc = Z_NULL;
+    strm.zfree = Z_NULL;
+    strm.opaque = Z_NULL;
+
+    if (inflateInit(&strm) != Z_OK) {
+        // Error starting inflation
+        return false;
+    }
+
+    strm.next_in = pStream + pos;
+    strm.avail_in = len;
+    strm.next_out = pOut;
+    strm.avail_out = outSize;
+
+    // Stops as soon as the output's full, so the rest of the block never gets inflated
+    int ret;
+    do {
+        ret = inflate(&strm, Z_NO_FLUSH);
+    } while (ret == Z_OK && strm.avail_out > 0);
+
+    (*pOutSize) = outSize - strm.avail_out;
+    inflateEnd(&strm);
+    return ret == Z_STREAM_END || (ret == Z_OK && strm.avail_out == 0);
+}
@@ -1,5 +1,8 @@
 #pragma once
 
+// Default size for buffers passed to InflateBlock
+constexpr unsigned int ZLIB_BUF_START = 65536;
+
 // Reads a dword from the given position in the byte stream
 unsigned int ReadDword(const unsigned char* pStream, unsigned int* pPos);
 
@@ -11,3 +14,12 @@ char* ReadString(const unsigned char* pStream, unsigned int* pPos, unsigned int*
 // Reads a double from the given position in the byte stream
 double ReadDouble(const unsigned char* pStream, unsigned int* pPos);
 
+// Read and inflate a data block from a byte stream
+// OutBuffer must already be a malloc'd buffer and the size of it must be passed in OutBufferSize. If it's too small it gets realloc'd to a bigger one,
+// so a good guess at the size means less reallocating. On success, OutBuffer and OutBufferSize hold the buffer and its size, and OutSize contains the number of bytes in the output.
+// On failure, OutBuffer still needs freeing.
+bool InflateBlock(unsigned char* pStream, unsigned int* pPos, unsigned char** pOutBuffer, unsigned int* pOutBufferSize, unsigned int* pOutSize);
+
+// Inflates only the start of the data block at pos, for reading a header without paying for the rest of the block.
+// Fills pOut with up to outSize bytes and puts how many it got in pOutSize, which is only less than outSize if the whole block is shorter than that.
+bool InflateBlockStart(unsigned char* pStream, unsigned int pos, unsigned char* pOut, unsigned int outSize, unsigned int* pOutSize);
@@ -1,7 +1,12 @@
+#include "FileMapping.hpp"
+#include "FramePacer.hpp"
 #include "Game.hpp"
+#include "Renderer.hpp"
+#include <algorithm>
 #include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
-#include <thread>
 
 #define CHECK_MEMORY_LEAKS 0
 constexpr bool OUTPUT_FRAME_TIME = true;
@@ -27,11 +32,43 @@ int main(int argc, char** argv) {
         t1 = std::chrono::high_resolution_clock::now();
     }
 
+    // --no-mmap reads the whole exe into memory like older versions did, for comparing the two loader modes
+    // --inflate-threads N sets how many threads inflate asset blocks during the load
+    // --compile-threads N sets how many threads compile the game's code
+    // --eager-compile compiles all the game's code before it starts, so compile errors show up straight away
+    // --no-cache ignores game.exe.gm8cache, game.exe.gmlcache and game.exe.atlascache and doesn't write any of them
+    // --progressive starts the game once the first room's sprites and backgrounds are decoded, and decodes the rest while it runs
+    // --software draws on the CPU into memory instead of opening a window, for running games where there's no GPU or display
+    // --render-thread presents frames on a separate thread while the game runs the next one
+    // --frames N exits after N frames, and --frame-hashes prints a hash of each frame (software only) so runs can be compared
+    // --catch-up runs late frames back to back to get back on schedule, instead of carrying on from wherever it's got to
+    // --stats-overlay draws graphs of GPU time and images drawn per frame in the corner of the window
+    GameLoadOptions loadOptions;
+    GameLoadStats loadStats;
+    loadOptions.stats = &loadStats;
+    unsigned int frameLimit = 0;
+    bool frameHashes = false;
+    FramePacePolicy pacePolicy = PACE_SKIP;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--no-mmap") == 0) loadOptions.mapFile = false;
+        else if (strcmp(argv[i], "--no-cache") == 0) loadOptions.useCache = false;
+        else if (strcmp(argv[i], "--eager-compile") == 0) loadOptions.lazyCompile = false;
+        else if (strcmp(argv[i], "--progressive") == 0) loadOptions.progressive = true;
+        else if (strcmp(argv[i], "--software") == 0) RSetBackend(RBACKEND_SOFTWARE);
+        else if (strcmp(argv[i], "--render-thread") == 0) RSetRenderThread(true);
+        else if (strcmp(argv[i], "--frame-hashes") == 0) frameHashes = true;
+        else if (strcmp(argv[i], "--catch-up") == 0) pacePolicy = PACE_CATCH_UP;
+        else if (strcmp(argv[i], "--stats-overlay") == 0) RSetStatsOverlay(true);
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) frameLimit = ( unsigned int )atoi(argv[++i]);
+        else if (strcmp(argv[i], "--inflate-threads") == 0 && i + 1 < argc) loadOptions.inflateThreads = ( unsigned int )atoi(argv[++i]);
+        else if (strcmp(argv[i], "--compile-threads") == 0 && i + 1 < argc) loadOptions.compileThreads = ( unsigned int )atoi(argv[++i]);
+    }
+
     GameInit();
 
     // This is just temp - you must place a game called "game.exe" in the project directory (or in the same directory as your built exe) to load it.
     // This can easily be changed to load from anywhere when the project is done.
-    if (!GameLoad("game.exe")) {
+    if (!GameLoad("game.exe", loadOptions)) {
         // Load failed
         GameTerminate();
         return 2;
@@ -41,7 +78,8 @@ int main(int argc, char** argv) {
         t2 = std::chrono::high_resolution_clock::now();
         time_span = std::chrono::duration_cast<std::chrono::duration<double>>(t2 - t1);
         se = time_span.count();
-        std::cout << "Successful load in " << se << " seconds" << std::endl;
+        std::cout << "Successful load in " << se << " seconds (" << (loadStats.mapped ? "mapped" : "buffered") << ", peak memory " << (GetPeakMemoryUsage() / 1048576) << " MB)"
+                  << std::endl;
     }
 
     if (!GameStart()) {
@@ -60,12 +98,21 @@ int main(int argc, char** argv) {
         time_span = std::chrono::duration_cast<std::chrono::duration<double>>(t3 - t1);
         se = time_span.count();
         std::cout << "Successful game start in " << se << " seconds" << std::endl;
+
+        RMemoryReport memory;
+        RGetMemoryReport(&memory);
+        std::cout << "Renderer memory: " << (memory.stagingBytes / 1024) << " KB of images on the CPU, " << memory.pages.size() << " atlas pages of "
+                  << (memory.pages.empty() ? 0 : memory.pages[0].bytes / 1024) << " KB";
+        if (memory.atlasBytes) std::cout << " (" << (memory.atlasBytes - memory.atlasUsedBytes) * 100 / memory.atlasBytes << "% unused)";
+        std::cout << ", " << (memory.compileBufferBytes / 1024) << " KB building them" << std::endl;
     }
 
-    unsigned int a = 0;
-    double totMus = 0;
+    unsigned int frame = 0;
+    unsigned long long images = 0, culled = 0, uploaded = 0;
+    unsigned int gpuFrames = 0;
+    double gpuSeconds = 0, maxGpuSeconds = 0;
+    FramePacer pacer(pacePolicy);
     while (true) {
-        t1 = std::chrono::high_resolution_clock::now();
         if (!GameFrame()) {
             const char* err;
             if (GameGetError(&err)) {
@@ -74,21 +121,33 @@ int main(int argc, char** argv) {
             break;
         }
 
-        if constexpr (OUTPUT_FRAME_TIME) {
-            t2 = std::chrono::high_resolution_clock::now();
-            std::chrono::duration<double> time_span = std::chrono::duration_cast<std::chrono::duration<double>>(t2 - t1);
-            double mus = time_span.count() * 1000000.0;
-            std::cout << "Frame took " << ( int )mus << " microseconds" << std::endl;
+        // Printing every frame costs more than some frames take, so frame times get summed up and printed at the end
+        const RFrameStats& renderStats = RGetFrameStats();
+        images += renderStats.commands;
+        culled += renderStats.culled;
+        uploaded += renderStats.uploadedBytes;
+        if (renderStats.gpuSeconds >= 0) {
+            gpuFrames++;
+            gpuSeconds += renderStats.gpuSeconds;
+            maxGpuSeconds = std::max(maxGpuSeconds, renderStats.gpuSeconds);
         }
 
-        while (true) {
-            t2 = std::chrono::high_resolution_clock::now();
-            std::chrono::duration<double> time_span = std::chrono::duration_cast<std::chrono::duration<double>>(t2 - t1);
-            double mus2 = time_span.count() * 1000000.0;
-            long long waitMus = ( long long )(((( double )1000000.0) / GameGetRoomSpeed()) - mus2);
-            if (waitMus <= 0) {
-                break;
-            }
+        frame++;
+        if (frameHashes) std::cout << "Frame " << frame << " hash " << std::hex << RFrameHash() << std::dec << std::endl;
+        if (frameLimit && frame >= frameLimit) break;
+
+        pacer.Wait(1.0 / GameGetRoomSpeed());
+    }
+
+    if constexpr (OUTPUT_FRAME_TIME) {
+        const FramePacerStats& stats = pacer.Stats();
+        if (stats.frames) {
+            std::cout << stats.frames << " frames, " << ( int )(stats.workSeconds / stats.frames * 1000000.0) << " microseconds each on average (min " << ( int )(stats.minWorkSeconds * 1000000.0)
+                      << ", p95 " << ( int )(pacer.WorkPercentile(0.95) * 1000000.0) << ", max " << ( int )(stats.maxWorkSeconds * 1000000.0) << "), " << stats.lateFrames << " late, "
+                      << stats.skippedFrames << " skipped, " << (images / frame) << " images and " << (culled / frame) << " culled per frame" << std::endl;
+            std::cout << "Renderer: " << (uploaded / frame / 1024) << " KB uploaded per frame";
+            if (gpuFrames) std::cout << ", GPU " << ( int )(gpuSeconds / gpuFrames * 1000000.0) << " microseconds per frame on average (max " << ( int )(maxGpuSeconds * 1000000.0) << ")";
+            std::cout << std::endl;
         }
     }
 
@@ -0,0 +1,34 @@
+// Runs the unit tests that don't need a window or a game. CTest runs each one on its own: UnitTests [name]
+// With no name it runs all of them. Returns 1 if any failed.
+
+#include "AtlasAllocator.hpp"
+#include "DrawOrder.hpp"
+#include "SoftwareRenderer.hpp"
+#include <iostream>
+#include <string.h>
+
+struct UnitTest {
+    const char* name;
+    bool (*run)(std::ostream& out);
+};
+
+const UnitTest _tests[] = {
+    {"AtlasAllocator", &AtlasAllocatorUnitTest},
+    {"DrawOrder", &DrawOrderUnitTest},
+    {"SoftwareRenderer", &SoftwareRenderer::UnitTest},
+};
+
+int main(int argc, char** argv) {
+    bool ok = true, found = false;
+    for (const UnitTest& test : _tests) {
+        if (argc > 1 && strcmp(argv[1], test.name) != 0) continue;
+        found = true;
+        std::cout << "== " << test.name << std::endl;
+        ok &= test.run(std::cout);
+    }
+    if (!found) {
+        std::cout << "No test called " << argv[1] << std::endl;
+        return 1;
+    }
+    return ok ? 0 : 1;
+}